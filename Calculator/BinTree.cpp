@@ -0,0 +1,550 @@
+/*------------------------------------------------------------------------------
+    * File:        BinTree.cpp                                                 *
+    * Description: Functions for writing and loading binary images of parsed   *
+    *              expression trees.                                           *
+    * Created:     17 oct 2026                                                 *
+    * Author:      Artem Puzankov                                              *
+    * Email:       puzankov.ao@phystech.edu                                    *
+    * GitHub:      https://github.com/hellopuza                                *
+    * Copyright © 2021 Artem Puzankov. All rights reserved.                    *
+    *///------------------------------------------------------------------------
+
+#include "BinTree.h"
+
+#ifdef BINTREE_MMAP
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+//------------------------------------------------------------------------------
+
+BinTree::BinTree (const char* filename) :
+    state_ (CALC_BIN_OPEN_ERROR)
+{
+    assert(filename != nullptr);
+
+#ifdef BINTREE_MMAP
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return;
+
+    struct stat st = {};
+    if ((fstat(fd, &st) != 0) || (st.st_size == 0))
+    {
+        close(fd);
+        return;
+    }
+
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED) return;
+
+    data_   = (char*)data;
+    size_   = st.st_size;
+    mapped_ = true;
+#else
+    FILE* fp = fopen(filename, "rb");
+    if (fp == nullptr) return;
+
+    size_ = CountSize(fp);
+    data_ = new char [size_ + 1];
+
+    size_t read = fread(data_, 1, size_, fp);
+    fclose(fp);
+
+    if (read != size_) return;
+#endif
+
+    state_ = Validate();
+}
+
+//------------------------------------------------------------------------------
+
+BinTree::~BinTree ()
+{
+#ifdef BINTREE_MMAP
+    if (mapped_) munmap(data_, size_);
+#else
+    delete [] data_;
+#endif
+
+    data_    = nullptr;
+    size_    = 0;
+    header_  = nullptr;
+    nodes_   = nullptr;
+    numbers_ = nullptr;
+    args_    = nullptr;
+    names_   = nullptr;
+    strings_ = nullptr;
+
+    state_ = CALC_DESTRUCTED;
+}
+
+//------------------------------------------------------------------------------
+
+int BinTree::getState () const
+{
+    return state_;
+}
+
+//------------------------------------------------------------------------------
+
+int BinTree::getSymbol (size_t index) const
+{
+    assert(index < header_->nodes_num);
+    assert(nodes_[index].node_type == NODE_VARIABLE);
+
+    return symbols_[nodes_[index].value];
+}
+
+//------------------------------------------------------------------------------
+
+int BinTree::Evaluate (Stack<Variable>& variables, NUM_TYPE& result)
+{
+    if (state_) return state_;
+
+    size_t nodes_num   = header_->nodes_num;
+    size_t strings_num = header_->strings_num;
+
+    values_.resize(nodes_num + strings_num);
+
+    // Values of the names go after the values of the nodes
+    NUM_TYPE* values = values_.data();
+    NUM_TYPE* vars   = values + nodes_num;
+
+    for (size_t name = 0; name < strings_num; ++name)
+    {
+        size_t var = 0;
+        while ((var < variables.getSize()) && (variables[var].symbol != symbols_[name])) ++var;
+
+        if (var == variables.getSize()) return CALC_UNIDENTIFIED_VARIABLE;
+
+        vars[name] = variables[var].value;
+    }
+
+    for (size_t i = 0; i < nodes_num; ++i)
+    {
+        const BinNode& node = nodes_[i];
+
+        switch (node.node_type)
+        {
+        case NODE_NUMBER:
+        {
+            values[i] = { numbers_[node.value], (node.flags & BIN_COMPLEX) ? numbers_[node.value + 1] : 0 };
+            break;
+        }
+        case NODE_VARIABLE:
+        {
+            values[i] = vars[node.value];
+            break;
+        }
+        case NODE_FUNCTION:
+        {
+            values[i] = CalcFunction(node.op_code, values[node.right]);
+            break;
+        }
+        case NODE_OPERATOR:
+        {
+            if (node.flags & BIN_ARGS)
+            {
+                const int32_t* args = args_ + node.left;
+
+                NUM_TYPE value = values[args[0]];
+                for (int32_t arg = 1; arg < node.right; ++arg)
+                    value = CalcOperator(node.op_code, value, values[args[arg]]);
+
+                values[i] = value;
+            }
+            else values[i] = CalcOperator(node.op_code, (node.left != BIN_NO_CHILD) ? values[node.left] : 0, values[node.right]);
+            break;
+        }
+        default: assert(0);
+        }
+    }
+
+    result = values[nodes_num - 1];
+
+    return CALC_OK;
+}
+
+//------------------------------------------------------------------------------
+
+int BinTree::Validate ()
+{
+    if (size_ < sizeof(BinHeader)) return CALC_BIN_WRONG_FORMAT;
+
+    header_ = (const BinHeader*)data_;
+
+    if ((header_->signature  != BIN_SIGNATURE)  ||
+        (header_->version    != BIN_VERSION)    ||
+        (header_->byte_order != BIN_BYTE_ORDER) ||
+        (header_->nodes_num  == 0))
+        return CALC_BIN_WRONG_FORMAT;
+
+    uint64_t nodes_size   = (uint64_t)header_->nodes_num   * sizeof(BinNode);
+    uint64_t numbers_size = (uint64_t)header_->numbers_num * sizeof(double);
+    uint64_t args_size    = (uint64_t)header_->args_num    * sizeof(int32_t);
+    uint64_t names_size   = (uint64_t)header_->strings_num * sizeof(uint32_t);
+    uint64_t names_pad    = (8 - (args_size + names_size) % 8) % 8;
+
+    if (sizeof(BinHeader) + nodes_size + numbers_size + args_size + names_size + names_pad + header_->strings_size != size_)
+        return CALC_BIN_WRONG_FORMAT;
+
+    nodes_   = (const BinNode*) (data_ + sizeof(BinHeader));
+    numbers_ = (const double*)  ((const char*)nodes_   + nodes_size);
+    args_    = (const int32_t*) ((const char*)numbers_ + numbers_size);
+    names_   = (const uint32_t*)((const char*)args_    + args_size);
+    strings_ =                   (const char*)names_   + names_size + names_pad;
+
+    if ((header_->strings_size != 0) && (strings_[header_->strings_size - 1] != '\0'))
+        return CALC_BIN_WRONG_FORMAT;
+
+    symbols_.resize(header_->strings_num);
+    for (size_t name = 0; name < header_->strings_num; ++name)
+    {
+        if (names_[name] >= header_->strings_size) return CALC_BIN_WRONG_FORMAT;
+
+        symbols_[name] = symbols.Intern(strings_ + names_[name]);
+    }
+
+    // Every node but the root must be a child of exactly one later node,
+    // then the image is a tree and it can be evaluated in one forward pass
+    std::vector<char> used(header_->nodes_num);
+
+    for (size_t i = 0; i < header_->nodes_num; ++i)
+    {
+        const BinNode& node = nodes_[i];
+
+        bool has_left  = (node.left  != BIN_NO_CHILD);
+        bool has_right = (node.right != BIN_NO_CHILD);
+
+        // Evaluate and Bin2Tree read a flag on any node, so a node may have
+        // only the flags of its type
+        uint16_t flags = 0;
+
+        if (node.node_type == NODE_NUMBER)
+            flags = BIN_COMPLEX;
+        else
+        if ((node.node_type == NODE_OPERATOR) && ((node.op_code == OP_ADD) || (node.op_code == OP_MUL)))
+            flags = BIN_ARGS;
+
+        if ((node.flags & ~flags) != 0) return CALC_BIN_WRONG_FORMAT;
+
+        switch (node.node_type)
+        {
+        case NODE_NUMBER:
+        {
+            size_t num = (node.flags & BIN_COMPLEX) ? 2 : 1;
+
+            if (has_left || has_right || ((uint64_t)node.value + num > header_->numbers_num))
+                return CALC_BIN_WRONG_FORMAT;
+            break;
+        }
+        case NODE_VARIABLE:
+        {
+            if (has_left || has_right || (node.value >= header_->strings_num))
+                return CALC_BIN_WRONG_FORMAT;
+            break;
+        }
+        case NODE_FUNCTION:
+        {
+            if (has_left || !has_right || (node.op_code < OP_ARCCOS) || (node.op_code > OP_TANH))
+                return CALC_BIN_WRONG_FORMAT;
+            break;
+        }
+        case NODE_OPERATOR:
+        {
+            // Unary minus has no left operand
+            if ((!has_left && (node.op_code != OP_SUB)) || !has_right || (node.op_code < OP_ADD) || (node.op_code > OP_POW))
+                return CALC_BIN_WRONG_FORMAT;
+
+            if (node.flags & BIN_ARGS)
+            {
+                if ((node.left < 0) || (node.right < 1) || ((uint64_t)node.left + node.right > header_->args_num))
+                    return CALC_BIN_WRONG_FORMAT;
+
+                for (int32_t arg = 0; arg < node.right; ++arg)
+                {
+                    int32_t child = args_[node.left + arg];
+
+                    if ((child < 0) || ((size_t)child >= i) || used[child]) return CALC_BIN_WRONG_FORMAT;
+                    used[child] = 1;
+                }
+                continue;
+            }
+            break;
+        }
+        default: return CALC_BIN_WRONG_FORMAT;
+        }
+
+        for (int32_t child : { node.left, node.right })
+        {
+            if (child == BIN_NO_CHILD) continue;
+
+            if ((child < 0) || ((size_t)child >= i) || used[child]) return CALC_BIN_WRONG_FORMAT;
+            used[child] = 1;
+        }
+    }
+
+    for (size_t i = 0; i + 1 < header_->nodes_num; ++i)
+        if (!used[i]) return CALC_BIN_WRONG_FORMAT;
+
+    return CALC_OK;
+}
+
+//------------------------------------------------------------------------------
+
+int Tree2Bin (const Tree<CalcNodeData>& tree, const char* filename)
+{
+    assert(tree.root_ != nullptr);
+    assert(filename   != nullptr);
+
+    std::vector<BinNode>  nodes;
+    std::vector<double>   numbers;
+    std::vector<int32_t>  args;
+    std::vector<uint32_t> names;
+    std::vector<char>     strings;
+
+    std::vector<uint32_t> name_of_symbol;   // index of the name for the symbol id, -1 if none
+    std::vector<int32_t>  children;         // indices of the written subtrees not yet taken by parent
+
+    // Post order walk through prev_ pointers: right subtree, left subtree
+    // (or the operands in order), node
+    std::vector<size_t> positions;
+
+    Node<CalcNodeData>* node_cur = tree.root_;
+    Node<CalcNodeData>* from     = tree.root_->prev_;
+
+    while (true)
+    {
+        Node<CalcNodeData>* next = node_cur->nextChild(from, positions);
+
+        if (next != nullptr)
+        {
+            from     = node_cur;
+            node_cur = next;
+            continue;
+        }
+
+        const CalcNodeData& data = node_cur->getData();
+
+        BinNode node = {};
+        node.node_type = data.node_type;
+        node.op_code   = data.op_code;
+
+        switch (data.node_type)
+        {
+        case NODE_NUMBER:
+        {
+            node.value = numbers.size();
+            numbers.push_back(data.number.real());
+
+            if (data.number.imag() != 0)
+            {
+                node.flags |= BIN_COMPLEX;
+                numbers.push_back(data.number.imag());
+            }
+            break;
+        }
+        case NODE_VARIABLE:
+        {
+            int symbol = (data.symbol != NO_SYMBOL) ? data.symbol : symbols.Intern(data.word);
+
+            if ((size_t)symbol >= name_of_symbol.size()) name_of_symbol.resize(symbol + 1, (uint32_t)-1);
+
+            if (name_of_symbol[symbol] == (uint32_t)-1)
+            {
+                name_of_symbol[symbol] = names.size();
+                names.push_back(strings.size());
+
+                const char* word = symbols.getName(symbol);
+                strings.insert(strings.end(), word, word + strlen(word) + 1);
+            }
+
+            node.value = name_of_symbol[symbol];
+            break;
+        }
+        case NODE_FUNCTION:
+        {
+            node.right = children.back();
+            children.pop_back();
+            break;
+        }
+        case NODE_OPERATOR:
+        {
+            if (node_cur->args_num_ != 0)
+            {
+                node.flags |= BIN_ARGS;
+                node.left   = args.size();
+                node.right  = node_cur->args_num_;
+
+                args.insert(args.end(), children.end() - node_cur->args_num_, children.end());
+                children.resize(children.size() - node_cur->args_num_);
+                break;
+            }
+
+            if (node_cur->left_ != nullptr)
+            {
+                node.left = children.back();
+                children.pop_back();
+            }
+
+            node.right = children.back();
+            children.pop_back();
+            break;
+        }
+        case NODE_LET:
+
+            // Image is a tree, it can not share the values of the bindings
+            return CALC_BIN_BINDINGS;
+
+        default: assert(0);
+        }
+
+        children.push_back(nodes.size());
+        nodes.push_back(node);
+
+        if (node_cur == tree.root_) break;
+
+        from     = node_cur;
+        node_cur = node_cur->prev_;
+    }
+
+    BinHeader header = {};
+    header.nodes_num    = nodes.size();
+    header.numbers_num  = numbers.size();
+    header.strings_num  = names.size();
+    header.strings_size = strings.size();
+    header.args_num     = args.size();
+
+    size_t args_size  = args.size()  * sizeof(int32_t);
+    size_t names_size = names.size() * sizeof(uint32_t);
+    size_t names_pad  = (8 - (args_size + names_size) % 8) % 8;
+
+    BinCode code(sizeof(BinHeader) + nodes.size() * sizeof(BinNode) + numbers.size() * sizeof(double)
+                 + args_size + names_size + names_pad + strings.size());
+
+    #define PUT_SECTION(data, size)                        \
+            {                                              \
+                memcpy(code.data_ + code.ptr_, data, size);\
+                code.ptr_ += size;                         \
+            } //
+
+    PUT_SECTION(&header,        sizeof(BinHeader));
+    PUT_SECTION(nodes.data(),   nodes.size()   * sizeof(BinNode));
+    PUT_SECTION(numbers.data(), numbers.size() * sizeof(double));
+    PUT_SECTION(args.data(),    args_size);
+    PUT_SECTION(names.data(),   names_size);
+    code.ptr_ += names_pad;
+    PUT_SECTION(strings.data(), strings.size());
+
+    #undef PUT_SECTION
+
+    FILE* fp = fopen(filename, "wb");
+    if (fp == nullptr) return CALC_BIN_OPEN_ERROR;
+
+    size_t written = fwrite(code.data_, 1, code.ptr_, fp);
+    fclose(fp);
+
+    return (written == code.ptr_) ? CALC_OK : CALC_BIN_OPEN_ERROR;
+}
+
+//------------------------------------------------------------------------------
+
+int Bin2Tree (const BinTree& bin, Tree<CalcNodeData>& tree)
+{
+    if (bin.getState()) return bin.getState();
+
+    size_t nodes_num = bin.header_->nodes_num;
+
+    std::vector<Node<CalcNodeData>*> built(nodes_num);
+
+    for (size_t i = 0; i < nodes_num; ++i)
+    {
+        const BinNode& node = bin.nodes_[i];
+
+        Node<CalcNodeData>* node_cur = new Node<CalcNodeData>;
+
+        switch (node.node_type)
+        {
+        case NODE_NUMBER:
+        {
+            NUM_TYPE number = { bin.numbers_[node.value], (node.flags & BIN_COMPLEX) ? bin.numbers_[node.value + 1] : 0 };
+
+            node_cur->setData({ number, nullptr, 0, NODE_NUMBER });
+            break;
+        }
+        case NODE_VARIABLE:
+        {
+            int symbol = bin.getSymbol(i);
+
+            node_cur->setData({ POISON<NUM_TYPE>, symbols.getName(symbol), 0, NODE_VARIABLE, symbol });
+            break;
+        }
+        case NODE_FUNCTION:
+        case NODE_OPERATOR:
+        {
+            // Op code is in the range of the names, Validate checked it
+            node_cur->setData({ POISON<NUM_TYPE>, op_names[(unsigned char)node.op_code].word, node.op_code, node.node_type });
+            break;
+        }
+        default: assert(0);
+        }
+
+        if (node.flags & BIN_ARGS)
+        {
+            for (int32_t arg = 0; arg < node.right; ++arg)
+                node_cur->addArg(built[bin.args_[node.left + arg]]);
+
+            built[i] = node_cur;
+            continue;
+        }
+
+        if (node.left != BIN_NO_CHILD)
+        {
+            node_cur->left_        = built[node.left];
+            node_cur->left_->prev_ = node_cur;
+        }
+
+        if (node.right != BIN_NO_CHILD)
+        {
+            node_cur->right_        = built[node.right];
+            node_cur->right_->prev_ = node_cur;
+        }
+
+        built[i] = node_cur;
+    }
+
+    delete tree.root_;
+
+    tree.root_ = built[nodes_num - 1];
+    tree.root_->prev_ = nullptr;
+    tree.root_->recountDepth();
+    CountDepends(tree.root_);
+
+    return CALC_OK;
+}
+
+//------------------------------------------------------------------------------
+
+int Text2Bin (const char* input, const char* image)
+{
+    assert(input != nullptr);
+    assert(image != nullptr);
+
+    FILE* source = fopen(input, "r");
+    if (source == nullptr) return CALC_BIN_OPEN_ERROR;
+
+    Tree<CalcNodeData> tree((char*)"expression");
+    Expression expression = { nullptr, nullptr };
+
+    int err = Stream2Tree(source, expression, tree);
+    fclose(source);
+    if (err) return err;
+
+    return Tree2Bin(tree, image);
+}
+
+//------------------------------------------------------------------------------
@@ -0,0 +1,204 @@
+/*------------------------------------------------------------------------------
+    * File:        BinTree.h                                                   *
+    * Description: Declaration of the binary image of parsed expression trees. *
+    * Created:     17 oct 2026                                                 *
+    * Author:      Artem Puzankov                                              *
+    * Email:       puzankov.ao@phystech.edu                                    *
+    * GitHub:      https://github.com/hellopuza                                *
+    * Copyright © 2021 Artem Puzankov. All rights reserved.                    *
+    *///------------------------------------------------------------------------
+
+#ifndef BINTREE_H_INCLUDED
+#define BINTREE_H_INCLUDED
+
+#define _CRT_SECURE_NO_WARNINGS
+
+
+#if defined (__unix__) || defined (__APPLE__)
+    #define BINTREE_MMAP
+#endif
+
+
+#include "Calculator.h"
+#include <stdint.h>
+
+
+//==============================================================================
+/*------------------------------------------------------------------------------
+                   Binary tree constants and types                             *
+*///----------------------------------------------------------------------------
+//==============================================================================
+
+
+const uint32_t BIN_SIGNATURE  = 0x45455254; // "TREE"
+const uint32_t BIN_VERSION    = 2;
+const uint32_t BIN_BYTE_ORDER = 0x01020304;
+const int32_t  BIN_NO_CHILD   = -1;
+
+enum BIN_NODE_FLAGS
+{
+    BIN_COMPLEX = 1,        // number has the imaginary part, it takes two doubles
+    BIN_ARGS    = 2,        // n-ary sum or product, left is the first index in args, right is the count
+};
+
+// Image layout: header, nodes, numbers, args, names, strings. Every section
+// is 8 byte aligned (args and names together), so the image can be used right
+// from the mapped memory.
+
+struct BinHeader
+{
+    uint32_t signature    = BIN_SIGNATURE;
+    uint32_t version      = BIN_VERSION;
+    uint32_t byte_order   = BIN_BYTE_ORDER;
+    uint32_t nodes_num    = 0;
+    uint32_t numbers_num  = 0;  // number of doubles
+    uint32_t strings_num  = 0;
+    uint32_t strings_size = 0;  // bytes of null terminated names
+    uint32_t args_num     = 0;  // number of operand indices of the n-ary nodes
+};
+
+// Nodes are stored in post order, so children always precede the parent
+// and the root is the last node.
+
+struct BinNode
+{
+    char     node_type = 0;
+    char     op_code   = 0;
+    uint16_t flags     = 0;
+    uint32_t value     = 0;     // index of the number or index of the variable name
+    int32_t  left      = BIN_NO_CHILD;
+    int32_t  right     = BIN_NO_CHILD;
+};
+
+class BinTree
+{
+    int state_;
+
+    char*    data_   = nullptr;
+    size_t   size_   = 0;
+    bool     mapped_ = false;
+
+    std::vector<int>      symbols_;     // symbol ids of the names
+    std::vector<NUM_TYPE> values_;      // scratch for Evaluate
+
+public:
+
+    const BinHeader* header_  = nullptr;
+    const BinNode*   nodes_   = nullptr;
+    const double*    numbers_ = nullptr;
+    const int32_t*   args_    = nullptr; // operand indices of the n-ary nodes
+    const uint32_t*  names_   = nullptr; // offsets of the names in strings_
+    const char*      strings_ = nullptr;
+
+//------------------------------------------------------------------------------
+/*! @brief   BinTree constructor from the image file.
+ *
+ *  @note    The file is mapped to memory where possible, else it is read.
+ *           Check getState() before use, malformed image is not loaded.
+ *
+ *  @param   filename    Name of the image file
+ */
+
+    BinTree (const char* filename);
+
+//------------------------------------------------------------------------------
+/*! @brief   BinTree copy constructor (deleted).
+ *
+ *  @param   obj         Source image
+ */
+
+    BinTree (const BinTree& obj);
+
+    BinTree& operator = (const BinTree& obj); // deleted
+
+//------------------------------------------------------------------------------
+/*! @brief   BinTree destructor.
+ */
+
+   ~BinTree ();
+
+//------------------------------------------------------------------------------
+/*! @brief   Get state of the image.
+ *
+ *  @return  CALC_OK if the image is loaded, else error code
+ */
+
+    int getState () const;
+
+//------------------------------------------------------------------------------
+/*! @brief   Get symbol id of the variable node.
+ *
+ *  @param   index       Index of the node
+ *
+ *  @return  symbol id
+ */
+
+    int getSymbol (size_t index) const;
+
+//------------------------------------------------------------------------------
+/*! @brief   Calculate value of the expression in one pass over the nodes.
+ *
+ *  @note    Nothing is allocated after the first call.
+ *
+ *  @param   variables   Values of the variables
+ *  @param   result      Value of the expression
+ *
+ *  @return  error code
+ */
+
+    int Evaluate (Stack<Variable>& variables, NUM_TYPE& result);
+
+/*------------------------------------------------------------------------------
+                   Private functions                                           *
+*///----------------------------------------------------------------------------
+
+private:
+
+//------------------------------------------------------------------------------
+/*! @brief   Check sections, child indices and codes of the loaded image and
+ *           intern the variable names.
+ *
+ *  @return  error code
+ */
+
+    int Validate ();
+
+//------------------------------------------------------------------------------
+};
+
+//------------------------------------------------------------------------------
+/*! @brief   Write tree to the binary image file.
+ *
+ *  @param   tree        Equation tree
+ *  @param   filename    Name of the image file
+ *
+ *  @return  error code
+ */
+
+int Tree2Bin (const Tree<CalcNodeData>& tree, const char* filename);
+
+//------------------------------------------------------------------------------
+/*! @brief   Build tree from the binary image.
+ *
+ *  @param   bin         Loaded image
+ *  @param   tree        Equation tree
+ *
+ *  @return  error code
+ */
+
+int Bin2Tree (const BinTree& bin, Tree<CalcNodeData>& tree);
+
+//------------------------------------------------------------------------------
+/*! @brief   Parse expression from the text file and write its binary image.
+ *
+ *  @param   input       Name of the text file
+ *  @param   image       Name of the image file
+ *
+ *  @return  error code
+ */
+
+int Text2Bin (const char* input, const char* image);
+
+//------------------------------------------------------------------------------
+
+#endif // BINTREE_H_INCLUDED
@@ -9,6 +9,11 @@
     *///------------------------------------------------------------------------
 
 #include "Calculator.h"
+#include "ParseCache.h"
+
+LogWriter calc_log(CALCULATOR_LOGNAME);
+
+#define CUR_TOKEN(expr) ((expr).lexer->getToken((expr).tok_cur))
 
 //------------------------------------------------------------------------------
 
@@ -66,7 +71,7 @@ int Calculator::Run ()
             char* expr = ScanExpr();
             Expression expression = { expr, expr, CALC_OK };
 
-            int err = Expr2Tree(expression, trees_[0]);
+            int err = parse_cache.Parse(expression, trees_[0]);
             delete [] expr;
             if (!err)
             {
@@ -95,12 +100,13 @@ int Calculator::Run ()
     }
     else
     {
-        Text text(filename_);
-        char* expr = text.text_;
-        Expression expression = { expr, expr, CALC_OK };
+        FILE* source = fopen(filename_, "r");
+        if (source == nullptr) return CALC_NOT_OK;
 
-        int err = Expr2Tree(expression, trees_[0]);
-        delete [] expr;
+        Expression expression = { nullptr, nullptr, CALC_OK };
+
+        int err = Stream2Tree(source, expression, trees_[0]);
+        fclose(source);
         if (err) return err;
 
         //printExprGraph(trees_[0]);
@@ -135,42 +141,34 @@ int Calculator::Calculate (Node<CalcNodeData>* node_cur, bool with_new_var)
 
         number = node_cur->right_->getData().number;
 
-        #define ONE static_cast<NUM_TYPE>(1)
-        #define TWO static_cast<NUM_TYPE>(2)
-
-        switch (node_cur->getData().op_code)
-        {
-        case OP_ARCCOS:     number = acos(number);          break;
-        case OP_ARCCOSH:    number = acosh(number);         break;
-        case OP_ARCCOT:     number = PI/TWO - atan(number); break;
-        case OP_ARCCOTH:    number = atanh(ONE / number);   break;
-        case OP_ARCSIN:     number = asin(number);          break;
-        case OP_ARCSINH:    number = asinh(number);         break;
-        case OP_ARCTAN:     number = atan(number);          break;
-        case OP_ARCTANH:    number = atanh(number);         break;
-        case OP_COS:        number = cos(number);           break;
-        case OP_COSH:       number = cosh(number);          break;
-        case OP_COT:        number = ONE / tan(number);     break;
-        case OP_COTH:       number = ONE / tanh(number);    break;
-        case OP_EXP:        number = exp(number);           break;
-        case OP_LG:         number = log10(number);         break;
-        case OP_LN:         number = log(number);           break;
-        case OP_SIN:        number = sin(number);           break;
-        case OP_SINH:       number = sinh(number);          break;
-        case OP_SQRT:       number = sqrt(number);          break;
-        case OP_TAN:        number = tan(number);           break;
-        case OP_TANH:       number = tanh(number);          break;
-        default: assert(0);
-        }
-
-        #undef ONE
-        #undef TWO
+        number = CalcFunction(node_cur->getData().op_code, number);
 
-        node_cur->setData({ number, node_cur->getData().word, node_cur->getData().op_code, node_cur->getData().node_type });
+        CalcNodeData data = node_cur->getData();
+        data.number = number;
+        node_cur->setData(data);
         break;
     }
     case NODE_OPERATOR:
     {
+        if (node_cur->args_num_ != 0)
+        {
+            char code = node_cur->getData().op_code;
+            number = (code == OP_MUL) ? 1 : 0;
+
+            for (size_t i = 0; i < node_cur->args_num_; ++i)
+            {
+                int err = Calculate(node_cur->args_[i], with_new_var);
+                if (err) return err;
+
+                number = CalcOperator(code, number, node_cur->args_[i]->getData().number);
+            }
+
+            CalcNodeData data = node_cur->getData();
+            data.number = number;
+            node_cur->setData(data);
+            break;
+        }
+
         if (node_cur->left_ != nullptr)
         {
             int err = Calculate(node_cur->left_, with_new_var);
@@ -185,40 +183,46 @@ int Calculator::Calculate (Node<CalcNodeData>* node_cur, bool with_new_var)
 
         right_num = node_cur->right_->getData().number;
 
-        switch (node_cur->getData().op_code)
-        {
-        case OP_ADD:  number = left_num + right_num;     break;
-        case OP_SUB:  number = left_num - right_num;     break;
-        case OP_MUL:  number = left_num * right_num;     break;
-        case OP_DIV:  number = left_num / right_num;     break;
-        case OP_POW:  number = pow(left_num, right_num); break;
-        default: assert(0);
-        }
+        number = CalcOperator(node_cur->getData().op_code, left_num, right_num);
 
-        node_cur->setData({ number, node_cur->getData().word, node_cur->getData().op_code, node_cur->getData().node_type });
+        CalcNodeData data = node_cur->getData();
+        data.number = number;
+        node_cur->setData(data);
         break;
     }
     case NODE_VARIABLE:
     {
         assert((node_cur->right_ == nullptr) && (node_cur->left_ == nullptr));
 
+        // Bindings are pushed while their body is calculated, so the
+        // reference is searched from the end
         int index = -1;
-        for (int i = 0; i < variables_.getSize(); ++i)
-            if (strcmp(variables_[i].name, node_cur->getData().word) == 0)
-            {
-                index = i;
-                break;
-            }
-        
+        if (node_cur->getData().op_code == VAR_BOUND)
+        {
+            for (int i = (int)variables_.getSize() - 1; (i >= 0) && (index == -1); --i)
+                if (variables_[i].symbol == node_cur->getData().symbol) index = i;
+        }
+        else
+        {
+            for (int i = 0; i < variables_.getSize(); ++i)
+                if (variables_[i].symbol == node_cur->getData().symbol)
+                {
+                    index = i;
+                    break;
+                }
+        }
+
         if (index == -1)
         {
             if (not with_new_var) return CALC_WRONG_VARIABLE;
 
-            variables_.Push({ POISON<NUM_TYPE>, node_cur->getData().word });
+            const CalcNodeData& var = node_cur->getData();
+
+            variables_.Push({ POISON<NUM_TYPE>, var.word, var.symbol });
             size_t size = variables_.getSize();
 
-            number = scanVar(*this, node_cur->getData().word);
-            variables_[size - 1] = { number, node_cur->getData().word };
+            number = scanVar(*this, var.word);
+            variables_[size - 1] = { number, var.word, var.symbol };
         }
         else number = variables_[index].value;
         
@@ -227,15 +231,287 @@ int Calculator::Calculate (Node<CalcNodeData>* node_cur, bool with_new_var)
             return CALC_UNIDENTIFIED_VARIABLE;
         }
 
-        node_cur->setData({ number, node_cur->getData().word, node_cur->getData().op_code, node_cur->getData().node_type });
+        CalcNodeData data = node_cur->getData();
+        data.number = number;
+        node_cur->setData(data);
         break;
     }
     case NODE_NUMBER:
         break;
 
+    case NODE_LET:
+    {
+        int err = Calculate(node_cur->right_, with_new_var);
+        if (err) return err;
+
+        const CalcNodeData& let = node_cur->getData();
+
+        variables_.Push({ node_cur->right_->getData().number, let.word, let.symbol });
+        err = Calculate(node_cur->left_, with_new_var);
+        variables_.Pop();
+
+        if (err) return err;
+
+        CalcNodeData data = node_cur->getData();
+        data.number = node_cur->left_->getData().number;
+        node_cur->setData(data);
+        break;
+    }
+    default: assert(0);
+    }
+
+    return CALC_OK;
+}
+
+//------------------------------------------------------------------------------
+
+NUM_TYPE CalcFunction (char op_code, NUM_TYPE number)
+{
+    #define ONE static_cast<NUM_TYPE>(1)
+    #define TWO static_cast<NUM_TYPE>(2)
+
+    switch (op_code)
+    {
+    case OP_ARCCOS:     return acos(number);
+    case OP_ARCCOSH:    return acosh(number);
+    case OP_ARCCOT:     return PI/TWO - atan(number);
+    case OP_ARCCOTH:    return atanh(ONE / number);
+    case OP_ARCSIN:     return asin(number);
+    case OP_ARCSINH:    return asinh(number);
+    case OP_ARCTAN:     return atan(number);
+    case OP_ARCTANH:    return atanh(number);
+    case OP_COS:        return cos(number);
+    case OP_COSH:       return cosh(number);
+    case OP_COT:        return ONE / tan(number);
+    case OP_COTH:       return ONE / tanh(number);
+    case OP_EXP:        return exp(number);
+    case OP_LG:         return log10(number);
+    case OP_LN:         return log(number);
+    case OP_SIN:        return sin(number);
+    case OP_SINH:       return sinh(number);
+    case OP_SQRT:       return sqrt(number);
+    case OP_TAN:        return tan(number);
+    case OP_TANH:       return tanh(number);
+    default: assert(0);
+    }
+
+    #undef ONE
+    #undef TWO
+
+    return POISON<NUM_TYPE>;
+}
+
+//------------------------------------------------------------------------------
+
+NUM_TYPE CalcOperator (char op_code, NUM_TYPE left_num, NUM_TYPE right_num)
+{
+    switch (op_code)
+    {
+    case OP_ADD:  return left_num + right_num;
+    case OP_SUB:  return left_num - right_num;
+    case OP_MUL:  return left_num * right_num;
+    case OP_DIV:  return left_num / right_num;
+    case OP_POW:  return pow(left_num, right_num);
+    default: assert(0);
+    }
+
+    return POISON<NUM_TYPE>;
+}
+
+//------------------------------------------------------------------------------
+
+NUM_TYPE CalcFunctionDerivative (char op_code, NUM_TYPE number, NUM_TYPE value)
+{
+    #define ONE static_cast<NUM_TYPE>(1)
+    #define TWO static_cast<NUM_TYPE>(2)
+
+    switch (op_code)
+    {
+    case OP_ARCCOS:     return -ONE / sqrt(ONE - number * number);
+    case OP_ARCCOSH:    return  ONE / sqrt(number * number - ONE);
+    case OP_ARCCOT:     return -ONE / (ONE + number * number);
+    case OP_ARCCOTH:    return  ONE / (ONE - number * number);
+    case OP_ARCSIN:     return  ONE / sqrt(ONE - number * number);
+    case OP_ARCSINH:    return  ONE / sqrt(ONE + number * number);
+    case OP_ARCTAN:     return  ONE / (ONE + number * number);
+    case OP_ARCTANH:    return  ONE / (ONE - number * number);
+    case OP_COS:        return -sin(number);
+    case OP_COSH:       return  sinh(number);
+    case OP_COT:        return -ONE / (sin(number) * sin(number));
+    case OP_COTH:       return -ONE / (sinh(number) * sinh(number));
+    case OP_EXP:        return  value;
+    case OP_LG:         return  ONE / (number * log(static_cast<NUM_TYPE>(10)));
+    case OP_LN:         return  ONE / number;
+    case OP_SIN:        return  cos(number);
+    case OP_SINH:       return  cosh(number);
+    case OP_SQRT:       return  ONE / (TWO * value);
+    case OP_TAN:        return  ONE / (cos(number) * cos(number));
+    case OP_TANH:       return  ONE / (cosh(number) * cosh(number));
+    default: assert(0);
+    }
+
+    #undef ONE
+    #undef TWO
+
+    return POISON<NUM_TYPE>;
+}
+
+//------------------------------------------------------------------------------
+
+Dual CalcFunctionDual (char op_code, Dual arg)
+{
+    NUM_TYPE value = CalcFunction(op_code, arg.value);
+
+    if (arg.derivative == NUM_TYPE(0)) return { value, 0 };
+
+    return { value, CalcFunctionDerivative(op_code, arg.value, value) * arg.derivative };
+}
+
+//------------------------------------------------------------------------------
+
+Dual CalcOperatorDual (char op_code, Dual left, Dual right)
+{
+    NUM_TYPE value = CalcOperator(op_code, left.value, right.value);
+
+    switch (op_code)
+    {
+    case OP_ADD:  return { value, left.derivative + right.derivative };
+    case OP_SUB:  return { value, left.derivative - right.derivative };
+    case OP_MUL:  return { value, left.derivative * right.value + left.value * right.derivative };
+    case OP_DIV:  return { value, (left.derivative - value * right.derivative) / right.value };
+    case OP_POW:
+    {
+        // Terms with zero derivative are skipped, so x^2 at 0 and 2^x are not
+        // spoiled by log(0) or by 0^(-1)
+        NUM_TYPE derivative = 0;
+
+        if (left.derivative  != NUM_TYPE(0)) derivative += right.value * pow(left.value, right.value - NUM_TYPE(1)) * left.derivative;
+        if (right.derivative != NUM_TYPE(0)) derivative += value * log(left.value) * right.derivative;
+
+        return { value, derivative };
+    }
     default: assert(0);
     }
 
+    return { POISON<NUM_TYPE>, POISON<NUM_TYPE> };
+}
+
+//------------------------------------------------------------------------------
+
+int CalcDual (const Tree<CalcNodeData>& tree, Stack<Variable>& variables, int symbol, Dual& result)
+{
+    assert(tree.root_ != nullptr);
+
+    std::vector<Dual>                 operands;   // values of the visited subtrees not yet taken by parent
+    std::vector<size_t>               positions;
+    std::vector<std::pair<int, Dual>> scope;      // values of the bindings in scope
+
+    // Post order walk, the same as in Tree2Bin
+    Node<CalcNodeData>* node_cur = tree.root_;
+    Node<CalcNodeData>* from     = tree.root_->prev_;
+
+    while (true)
+    {
+        Node<CalcNodeData>* next = node_cur->nextChild(from, positions);
+
+        if (next != nullptr)
+        {
+            from     = node_cur;
+            node_cur = next;
+            continue;
+        }
+
+        const CalcNodeData& data = node_cur->getData();
+
+        Dual dual = {};
+
+        switch (data.node_type)
+        {
+        case NODE_NUMBER:
+
+            dual.value = data.number;
+            break;
+
+        case NODE_VARIABLE:
+        {
+            int var_symbol = (data.symbol != NO_SYMBOL) ? data.symbol : symbols.Intern(data.word);
+
+            size_t bound = scope.size();
+            while ((bound > 0) && (scope[bound - 1].first != var_symbol)) --bound;
+
+            if (bound > 0)
+            {
+                dual = scope[bound - 1].second;
+                break;
+            }
+
+            size_t index = 0;
+            while ((index < variables.getSize()) && (variables[index].symbol != var_symbol)) ++index;
+
+            if (index == variables.getSize()) return CALC_UNIDENTIFIED_VARIABLE;
+
+            dual = { variables[index].value, (var_symbol == symbol) ? NUM_TYPE(1) : NUM_TYPE(0) };
+            break;
+        }
+        case NODE_FUNCTION:
+
+            dual = CalcFunctionDual(data.op_code, operands.back());
+            operands.pop_back();
+            break;
+
+        case NODE_OPERATOR:
+        {
+            if (node_cur->args_num_ != 0)
+            {
+                const Dual* args = operands.data() + operands.size() - node_cur->args_num_;
+
+                dual = args[0];
+                for (size_t arg = 1; arg < node_cur->args_num_; ++arg)
+                    dual = CalcOperatorDual(data.op_code, dual, args[arg]);
+
+                operands.resize(operands.size() - node_cur->args_num_);
+                break;
+            }
+
+            Dual left = {};
+            if (node_cur->left_ != nullptr)
+            {
+                left = operands.back();
+                operands.pop_back();
+            }
+
+            dual = CalcOperatorDual(data.op_code, left, operands.back());
+            operands.pop_back();
+            break;
+        }
+        case NODE_LET:
+
+            // Value of the binding is kept in the scope
+            dual = operands.back();
+            operands.pop_back();
+            scope.pop_back();
+            break;
+
+        default: assert(0);
+        }
+
+        if (node_cur == tree.root_)
+        {
+            operands.push_back(dual);
+            break;
+        }
+
+        if ((node_cur->prev_->getData().node_type == NODE_LET) && (node_cur->prev_->right_ == node_cur))
+            scope.push_back({ node_cur->prev_->getData().symbol, dual });
+        else
+            operands.push_back(dual);
+
+        from     = node_cur;
+        node_cur = node_cur->prev_;
+    }
+
+    result = operands.back();
+
     return CALC_OK;
 }
 
@@ -261,23 +537,15 @@ void Calculator::Write ()
 
 //------------------------------------------------------------------------------
 
-void CalcPrintError (const char* logname, const char* file, int line, const char* function, int err, bool console_err)
+void CalcPrintError (LogWriter& log, const char* file, int line, const char* function, int err, bool console_err)
 {
     assert(function != nullptr);
-    assert(logname  != nullptr);
     assert(file     != nullptr);
 
-    FILE* log = fopen(logname, "a");
-    assert(log != nullptr);
-
-    time_t t = time(NULL);
-    struct tm tm = *localtime(&t);
-
-    fprintf(log, "###############################################################################\n");
-    fprintf(log, "TIME: %d-%02d-%02d %02d:%02d:%02d\n\n",
-            tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
-    fprintf(log, "ERROR: file %s  line %d  function %s\n\n", file, line, function);
-    fprintf(log, "%s\n", calc_errstr[err + 1]);
+    log.Printf("###############################################################################\n"
+               "TIME: %T\n\n"
+               "ERROR: file %s  line %d  function %s\n\n"
+               "%s\n", file, line, function, calc_errstr[err + 1]);
 
     if (console_err)
         printf(  "ERROR: file %s  line %d  function %s\n\n", file, line, function);
@@ -315,6 +583,11 @@ void TypePrint (FILE* fp, const CalcNodeData& node_data)
         delete [] strnum;
         break;
     }
+    case NODE_LET:
+    {
+        fprintf(fp, "let: %s", node_data.word);
+        break;
+    }
     default: fprintf(fp, "err: %s", node_data.word); break;
     }
 }
@@ -338,7 +611,8 @@ bool isPOISON (CalcNodeData value)
              (isPOISON(imag(value.number))) &&
              (value.word      == nullptr)   &&
              (value.op_code   == 0)         &&
-             (value.node_type == 0) );
+             (value.node_type == 0)         &&
+             (value.symbol    == NO_SYMBOL) );
 }
 
 //------------------------------------------------------------------------------
@@ -347,7 +621,8 @@ bool isPOISON (Variable var)
 {
     return ( (isPOISON(real(var.value))) &&
              (isPOISON(imag(var.value))) &&
-             (var.name  == nullptr) );
+             (var.name   == nullptr)   &&
+             (var.symbol == NO_SYMBOL) );
 }
 
 //------------------------------------------------------------------------------
@@ -371,20 +646,20 @@ bool scanAns ()
 
 //------------------------------------------------------------------------------
 
-NUM_TYPE scanVar (Calculator& calc, char* varname)
+NUM_TYPE scanVar (Calculator& calc, const char* varname)
 {
     printf("Enter value of variable %s: ", varname);
 
     char* expr = ScanExpr();
     Expression expression = { expr, expr, CALC_OK };
 
-    Tree<CalcNodeData> vartree(varname);
+    Tree<CalcNodeData> vartree((char*)varname);
     while (Expr2Tree(expression, vartree))
     {
         delete [] expr;
         printf("Try again: ");
         expr = ScanExpr();
-        Expression expression = { expr, expr, CALC_OK };
+        expression = { expr, expr, CALC_OK };
     }
     delete [] expr;
 
@@ -471,405 +746,1047 @@ char* Num2Str (NUM_TYPE number)
 
 char* ScanExpr ()
 {
-    char* expr = new char [MAX_STR_LEN] {};
-    char err   = 0;
+    char* expr = ReadLine(stdin);
 
-    do err = (not fgets(expr, MAX_STR_LEN - 2, stdin)) || (*expr == '\n');
-    while (err && printf("Try again: "));
+    while (((expr == nullptr) || (*expr == '\n')) && printf("Try again: "))
+    {
+        delete [] expr;
+        expr = ReadLine(stdin);
+    }
     
     return expr;
 }
 
 //------------------------------------------------------------------------------
 
-int Tree2Expr (const Tree<CalcNodeData>& tree, Expression& expr)
-{
-    assert(expr.str != nullptr);
-    expr.symb_cur = expr.str;
-    int err = Node2Str(tree.root_, &expr.symb_cur);
-    CALC_ASSERTOK(err, err);
-    expr.symb_cur = expr.str;
-
-    return err;
-}
-
-//------------------------------------------------------------------------------
-
-int Node2Str (Node<CalcNodeData>* node_cur, char** str)
+char* ReadLine (FILE* fp)
 {
-    assert(node_cur != nullptr);
-    assert(*str     != nullptr);
+    assert(fp != nullptr);
 
-    int err = 0;
+    size_t size = MAX_STR_LEN;
+    char*  line = new char [size] {};
 
-    switch (node_cur->getData().node_type)
+    if (not fgets(line, size, fp))
     {
-    case NODE_FUNCTION:
-    {
-        if ((node_cur->right_ == nullptr) || (node_cur->left_ != nullptr))
-            return CALC_TREE_FUNC_WRONG_ARGUMENT;
-
-        sprintf(*str, "%s", node_cur->getData().word);
-        *str += strlen(node_cur->getData().word);
-
-        sprintf(*str, "(");
-        *str += 1;
-
-        err = Node2Str(node_cur->right_, str);
-        if (err) return err;
-
-        sprintf(*str, ")");
-        *str += 1;
-        break;
+        delete [] line;
+        return nullptr;
     }
-    case NODE_OPERATOR:
-    {
-        if ((node_cur->right_ == nullptr) ||
-            (node_cur->left_  == nullptr) && (node_cur->getData().op_code != OP_SUB))
-            return CALC_TREE_OPER_WRONG_ARGUMENTS;
 
-        if (needBrackets(node_cur, node_cur->left_))
-        {
-            sprintf(*str, "(");
-            *str += 1;
+    size_t len = strlen(line);
+    while ((len > 0) && (line[len - 1] != '\n'))
+    {
+        char* temp = new char [2 * size] {};
+        memcpy(temp, line, len);
 
-            if (node_cur->left_ != nullptr)
-            {
-                err = Node2Str(node_cur->left_, str);
-                if (err) return err;
-            }
+        delete [] line;
+        line  = temp;
+        size *= 2;
 
-            sprintf(*str, ")");
-            *str += 1;
-        }
-        else
-        if (node_cur->left_ != nullptr)
-        {
-            err = Node2Str(node_cur->left_, str);
-            if (err) return err;
-        }
+        if (not fgets(line + len, size - len, fp)) break;
+        len += strlen(line + len);
+    }
 
-        sprintf(*str, "%s", node_cur->getData().word);
-        *str += 1;
+    return line;
+}
 
-        if (needBrackets(node_cur, node_cur->right_))
-        {
-            sprintf(*str, "(");
-            *str += 1;
+//------------------------------------------------------------------------------
 
-            err = Node2Str(node_cur->right_, str);
-            if (err) return err;
+int Tree2Expr (const Tree<CalcNodeData>& tree, Expression& expr)
+{
+    assert((expr.str == nullptr) || (expr.size != 0));
 
-            sprintf(*str, ")");
-            *str += 1;
-        }
-        else
-        {
-            err = Node2Str(node_cur->right_, str);
-            if (err) return err;
-        }
-        break;
-    }
-    case NODE_VARIABLE:
+    if (expr.str == nullptr)
     {
-        if ((node_cur->right_ != nullptr) || (node_cur->left_ != nullptr))
-            return CALC_TREE_VAR_WRONG_ARGUMENT;
-
-        sprintf(*str, "%s", node_cur->getData().word);
-        *str += strlen(node_cur->getData().word);
-
-        break;
+        expr.size = MAX_STR_LEN;
+        expr.str  = new char [expr.size];
     }
-    case NODE_NUMBER:
-    {
-        if ((node_cur->right_ != nullptr) || (node_cur->left_ != nullptr))
-            return CALC_TREE_NUM_WRONG_ARGUMENT;
+    expr.symb_cur = expr.str;
 
-        char* number = Num2Str(node_cur->getData().number);
-        sprintf(*str, "%s", number);
-        *str += strlen(number);
-        delete [] number;
+    int err = Node2Str(tree.root_, expr);
+    CALC_ASSERTOK(err, err);
 
-        break;
-    }
-    default: assert(0);
-    }
+    PutStr(expr, "", 1);
+    expr.symb_cur = expr.str;
 
-    return CALC_OK;
+    return err;
 }
 
 //------------------------------------------------------------------------------
 
-int Expr2Tree (Expression& expr, Tree<CalcNodeData>& tree)
+void PutStr (Expression& expr, const char* word, size_t len)
 {
-    assert(expr.str != nullptr);
+    size_t used = expr.symb_cur - expr.str;
 
-    del_spaces(expr.str);
+    if (used + len > expr.size)
+    {
+        size_t size = 2 * expr.size;
+        while (used + len > size) size *= 2;
 
-    tree.root_ = pass_Plus_Minus(expr);
-    if (tree.root_ == nullptr) return CALC_NOT_OK;
+        char* temp = new char [size];
+        memcpy(temp, expr.str, used);
 
-    tree.root_->recountPrev();
-    tree.root_->recountDepth();
+        delete [] expr.str;
+        expr.str      = temp;
+        expr.symb_cur = temp + used;
+        expr.size     = size;
+    }
 
-    return CALC_OK;
+    memcpy(expr.symb_cur, word, len);
+    expr.symb_cur += len;
 }
 
 //------------------------------------------------------------------------------
 
-Node<CalcNodeData>* pass_Plus_Minus (Expression& expr)
+int Node2Str (Node<CalcNodeData>* node_cur, Expression& expr)
 {
-    Node<CalcNodeData>* node_cur = nullptr;
+    assert(node_cur != nullptr);
+    assert(expr.str != nullptr);
 
-    if (*expr.symb_cur == '-')
-    {   
-        ++expr.symb_cur;
+    // Pieces are taken from the top of the stack, so the pieces of a node
+    // are pushed in reverse order. Nothing is recursive, so the depth of
+    // the expression is limited only by memory
+    std::vector<PrintPiece> work = { { node_cur } };
+    std::vector<PrintPiece> pieces;
 
-        Node<CalcNodeData>* right = pass_Mul_Div(expr);
-        if (right == nullptr) return nullptr;
+    bool plus = false;
 
-        node_cur = new Node<CalcNodeData>;
-        node_cur->setData({ POISON<NUM_TYPE>, op_names[OP_SUB].word, op_names[OP_SUB].code, NODE_OPERATOR });
-        node_cur->right_ = right;
-    }
-    else
-    {
-        node_cur = pass_Mul_Div(expr);
-        if (node_cur == nullptr) return nullptr;
-    }
-    
-    while ( (*expr.symb_cur == '+') ||
-            (*expr.symb_cur == '-')   )
+    while (not work.empty())
     {
-        char* symb_cur = expr.symb_cur;
-        ++expr.symb_cur;
+        PrintPiece piece = work.back();
+        work.pop_back();
 
-        Node<CalcNodeData>* left  = node_cur;
-        Node<CalcNodeData>* right = pass_Mul_Div(expr);
-        if (right == nullptr) return nullptr;
+        if (piece.plus)
+        {
+            plus = true;
+            continue;
+        }
 
-        node_cur = new Node<CalcNodeData>;
-        char op = (*symb_cur == '-') ? OP_SUB : OP_ADD;
-        node_cur->setData({ POISON<NUM_TYPE>, op_names[op].word, op_names[op].code, NODE_OPERATOR });
+        if (piece.node == nullptr)
+        {
+            PutPiece(expr, piece.text, piece.len, plus);
+            continue;
+        }
 
-        node_cur->right_ = right;
-        node_cur->left_  = left;
-    }
+        Node<CalcNodeData>* node = piece.node;
+        const char*         word = node->getData().word;
 
-    CHECK_SYNTAX(( (*expr.symb_cur != '+') &&
-                   (*expr.symb_cur != '-') &&
-                   (*expr.symb_cur != '*') &&
-                   (*expr.symb_cur != '/') &&
-                   (*expr.symb_cur != '^') &&
-                   (*expr.symb_cur != '(') &&
-                   (*expr.symb_cur != ')') &&
-                   (*expr.symb_cur != '\0') ), CALC_SYNTAX_ERROR, expr, 1);
+        pieces.clear();
 
-    return node_cur;
+        switch (node->getData().node_type)
+        {
+        case NODE_FUNCTION:
+        {
+            if ((node->right_ == nullptr) || (node->left_ != nullptr))
+                return CALC_TREE_FUNC_WRONG_ARGUMENT;
+
+            pieces.push_back({ nullptr, word, strlen(word) });
+            pieces.push_back({ nullptr, "(", 1 });
+            pieces.push_back({ node->right_ });
+            pieces.push_back({ nullptr, ")", 1 });
+            break;
+        }
+        case NODE_OPERATOR:
+        {
+            if (node->args_num_ != 0)
+            {
+                int err = Args2Str(node, pieces);
+                if (err) return err;
+                break;
+            }
+
+            if ((node->right_ == nullptr) ||
+                (node->left_  == nullptr) && (node->getData().op_code != OP_SUB))
+                return CALC_TREE_OPER_WRONG_ARGUMENTS;
+
+            if (needBrackets(node, node->left_))
+            {
+                pieces.push_back({ nullptr, "(", 1 });
+                if (node->left_ != nullptr) pieces.push_back({ node->left_ });
+                pieces.push_back({ nullptr, ")", 1 });
+            }
+            else
+            if (node->left_ != nullptr) pieces.push_back({ node->left_ });
+
+            pieces.push_back({ nullptr, word, 1 });
+
+            if (needBrackets(node, node->right_, true))
+            {
+                pieces.push_back({ nullptr, "(", 1 });
+                pieces.push_back({ node->right_ });
+                pieces.push_back({ nullptr, ")", 1 });
+            }
+            else pieces.push_back({ node->right_ });
+            break;
+        }
+        case NODE_VARIABLE:
+        {
+            if ((node->right_ != nullptr) || (node->left_ != nullptr))
+                return CALC_TREE_VAR_WRONG_ARGUMENT;
+
+            PutPiece(expr, word, strlen(word), plus);
+            break;
+        }
+        case NODE_NUMBER:
+        {
+            if ((node->right_ != nullptr) || (node->left_ != nullptr))
+                return CALC_TREE_NUM_WRONG_ARGUMENT;
+
+            char* number = Num2Str(node->getData().number);
+            PutPiece(expr, number, strlen(number), plus);
+            delete [] number;
+
+            break;
+        }
+        case NODE_LET:
+        {
+            if ((node->right_ == nullptr) || (node->left_ == nullptr))
+                return CALC_TREE_LET_WRONG_ARGUMENTS;
+
+            pieces.push_back({ nullptr, "let ", 4 });
+            pieces.push_back({ nullptr, word, strlen(word) });
+            pieces.push_back({ nullptr, " = ", 3 });
+            pieces.push_back({ node->right_ });
+            pieces.push_back({ nullptr, "; ", 2 });
+            pieces.push_back({ node->left_ });
+            break;
+        }
+        default: assert(0);
+        }
+
+        for (size_t i = pieces.size(); i > 0; --i) work.push_back(pieces[i - 1]);
+    }
+
+    return CALC_OK;
 }
 
 //------------------------------------------------------------------------------
 
-Node<CalcNodeData>* pass_Mul_Div (Expression& expr)
+int Args2Str (Node<CalcNodeData>* node_cur, std::vector<PrintPiece>& pieces)
 {
-    Node<CalcNodeData>* node_cur = pass_Power(expr);
-    if (node_cur == nullptr) return nullptr;
+    assert(node_cur != nullptr);
+
+    char code = node_cur->getData().op_code;
+    if ((code != OP_ADD) && (code != OP_MUL)) return CALC_TREE_OPER_WRONG_ARGUMENTS;
 
-    while ( (*expr.symb_cur == '*') ||
-            (*expr.symb_cur == '/') )
+    for (size_t i = 0; i < node_cur->args_num_; ++i)
     {
-        char* symb_cur = expr.symb_cur;
-        ++expr.symb_cur;
+        Node<CalcNodeData>* arg = node_cur->args_[i];
+        bool brackets = false;
+
+        // Negated operand of the sum is printed as subtraction
+        if ((code == OP_ADD) && isNegation(arg))
+        {
+            pieces.push_back({ nullptr, "-", 1 });
+            arg = arg->right_;
+
+            brackets = ((arg->getData().node_type == NODE_OPERATOR) &&
+                        ((arg->getData().op_code == OP_ADD) || (arg->getData().op_code == OP_SUB))) ||
+                       startsWithMinus(arg);
+        }
+        else
+        {
+            // Operand starting with minus (like negative number) is printed as subtraction
+            if (i != 0)
+            {
+                if (code == OP_ADD) pieces.push_back({ nullptr, nullptr, 0, true });
+                else                pieces.push_back({ nullptr, node_cur->getData().word, 1 });
+            }
 
-        Node<CalcNodeData>* left  = node_cur;
-        Node<CalcNodeData>* right = pass_Power(expr);
-        if (right == nullptr) return nullptr;
+            brackets = needBrackets(node_cur, arg, i != 0);
+        }
 
-        node_cur = new Node<CalcNodeData>;
-        char op = (*symb_cur == '*') ? OP_MUL : OP_DIV;
-        node_cur->setData({ POISON<NUM_TYPE>, op_names[op].word, op_names[op].code, NODE_OPERATOR });
+        if (brackets) pieces.push_back({ nullptr, "(", 1 });
 
-        node_cur->right_ = right;
-        node_cur->left_  = left;
+        pieces.push_back({ arg });
+
+        if (brackets) pieces.push_back({ nullptr, ")", 1 });
     }
 
-    return node_cur;
+    return CALC_OK;
 }
 
 //------------------------------------------------------------------------------
 
-Node<CalcNodeData>* pass_Power (Expression& expr)
+void PutPiece (Expression& expr, const char* text, size_t len, bool& plus)
 {
-    Node<CalcNodeData>* node_cur = pass_Brackets(expr);
-    if (node_cur == nullptr) return nullptr;
-
-    while (*expr.symb_cur == '^')
+    if (plus)
     {
-        ++expr.symb_cur;
+        if (text[0] != '-') PutStr(expr, "+", 1);
+        plus = false;
+    }
+
+    PutStr(expr, text, len);
+}
+
+//------------------------------------------------------------------------------
+
+int Expr2Tree (Expression& expr, Tree<CalcNodeData>& tree)
+{
+    assert(expr.str != nullptr);
+
+    Lexer lexer(expr.str, strlen(expr.str));
+
+    expr.lexer = &lexer;
+    int err = Tokens2Tree(expr, tree);
+    expr.lexer = nullptr;
+
+    return err;
+}
+
+//------------------------------------------------------------------------------
+
+int Stream2Tree (FILE* source, Expression& expr, Tree<CalcNodeData>& tree)
+{
+    assert(source != nullptr);
+
+    Lexer lexer(source);
+
+    expr.lexer = &lexer;
+    int err = Tokens2Tree(expr, tree);
+    expr.lexer = nullptr;
+
+    return err;
+}
+
+//------------------------------------------------------------------------------
+
+int Tokens2Tree (Expression& expr, Tree<CalcNodeData>& tree)
+{
+    assert(expr.lexer != nullptr);
+
+    expr.tok_cur = 0;
+    tree.root_   = pass_Bindings(expr);
+
+    if (tree.root_ == nullptr) return CALC_NOT_OK;
+
+    tree.root_->recountPrev();
+    tree.root_->recountDepth();
+    CountDepends(tree.root_);
+
+    return CALC_OK;
+}
+
+//------------------------------------------------------------------------------
+
+size_t CheckSyntax (Expression& expr, std::vector<Diagnostic>& diagnostics)
+{
+    assert(expr.str != nullptr);
+
+    diagnostics.clear();
+    expr.diagnostics = &diagnostics;
+
+    Tree<CalcNodeData> tree((char*)"check");
+    if (Expr2Tree(expr, tree) == CALC_OK) tree.Clean();
+
+    expr.diagnostics = nullptr;
+
+    return diagnostics.size();
+}
+
+//------------------------------------------------------------------------------
 
-        Node<CalcNodeData>* left  = node_cur;
-        Node<CalcNodeData>* right = pass_Power(expr);
-        if (right == nullptr) return nullptr;
+void AddDiagnostic (Expression& expr, int err, const Token& token)
+{
+    assert(expr.diagnostics != nullptr);
+
+    std::vector<Diagnostic>& diagnostics = *expr.diagnostics;
 
-        node_cur = new Node<CalcNodeData>;
-        node_cur->setData({ POISON<NUM_TYPE>, op_names[OP_POW].word, op_names[OP_POW].code, NODE_OPERATOR });
+    if (!diagnostics.empty())
+    {
+        Diagnostic& last = diagnostics.back();
 
-        node_cur->right_ = right;
-        node_cur->left_  = left;
+        // Token can be reported twice during recovery
+        if (token.begin < last.begin + last.len) return;
+
+        // Run of bad characters is one error
+        if ((token.kind == TOK_ERROR) && (last.err == err) && (last.begin + last.len == token.begin))
+        {
+            last.len += token.len;
+            return;
+        }
     }
-    
-    return node_cur;
+
+    diagnostics.push_back({ err, token.begin, (size_t)token.len });
 }
 
 //------------------------------------------------------------------------------
 
-Node<CalcNodeData>* pass_Brackets (Expression& expr)
+#define BINDING_ERROR(errcode, expr, token)                      \
+        {                                                        \
+            for (size_t i = 0; i < lets.size(); ++i)             \
+                delete lets[i];                                  \
+                                                                 \
+            if ((expr).diagnostics == nullptr)                   \
+            {                                                    \
+                CHECK_SYNTAX(true, errcode, expr, token);        \
+            }                                                    \
+                                                                 \
+            AddDiagnostic(expr, errcode, token);                 \
+            (expr).err = errcode;                                \
+            return nullptr;                                      \
+        } //
+
+Node<CalcNodeData>* pass_Bindings (Expression& expr)
 {
-    if (*expr.symb_cur == '(')
+    static const int let = symbols.Intern("let");
+
+    std::vector<Node<CalcNodeData>*>       lets;
+    std::vector<char>                      used;   // symbols met before, by symbol id
+    std::vector<const Node<CalcNodeData>*> work;
+
+    while ((CUR_TOKEN(expr).kind == TOK_IDENT) && (CUR_TOKEN(expr).id == let))
     {
-        ++expr.symb_cur;
+        ++expr.tok_cur;
+
+        Token name = CUR_TOKEN(expr);
+        if ((name.kind != TOK_IDENT) || (findFunc(symbols.getName(name.id), name.len) != 0))
+            BINDING_ERROR(CALC_SYNTAX_BAD_BINDING, expr, name);
+
+        ++expr.tok_cur;
+
+        Token token = CUR_TOKEN(expr);
+        if (token.kind != TOK_ASSIGN) BINDING_ERROR(CALC_SYNTAX_BAD_BINDING, expr, token);
+
+        ++expr.tok_cur;
+
+        // Errors of the value are reported by pass_Expression
+        Node<CalcNodeData>* value = pass_Expression(expr);
+        if (value == nullptr)
+        {
+            for (size_t i = 0; i < lets.size(); ++i) delete lets[i];
+            return nullptr;
+        }
+
+        token = CUR_TOKEN(expr);
+        if (token.kind != TOK_SEMICOLON)
+        {
+            delete value;
+            BINDING_ERROR(CALC_SYNTAX_BAD_BINDING, expr, token);
+        }
+
+        ++expr.tok_cur;
+
+        // Names used by the value, the binding must not rename them
+        work.push_back(value);
+        while (not work.empty())
+        {
+            const Node<CalcNodeData>* node = work.back();
+            work.pop_back();
+
+            if (node->getData().node_type == NODE_VARIABLE)
+            {
+                if ((size_t)node->getData().symbol >= used.size()) used.resize(node->getData().symbol + 1, 0);
+                used[node->getData().symbol] = 1;
+            }
+
+            if (node->left_  != nullptr) work.push_back(node->left_);
+            if (node->right_ != nullptr) work.push_back(node->right_);
 
-        Node<CalcNodeData>* node_cur = pass_Plus_Minus(expr);
-        if (node_cur == nullptr) return nullptr;
+            for (size_t i = 0; i < node->args_num_; ++i) work.push_back(node->args_[i]);
+        }
+
+        if ((size_t)name.id >= used.size()) used.resize(name.id + 1, 0);
+        if (used[name.id])
+        {
+            delete value;
+            BINDING_ERROR(CALC_SYNTAX_REBINDING, expr, name);
+        }
+        used[name.id] = 1;
+
+        Node<CalcNodeData>* node_cur = new Node<CalcNodeData>;
+        node_cur->setData({ POISON<NUM_TYPE>, symbols.getName(name.id), 0, NODE_LET, name.id });
+        node_cur->right_ = value;
 
-        CHECK_SYNTAX((*expr.symb_cur != ')'), CALC_SYNTAX_NO_CLOSE_BRACKET, expr, 1);
-        ++expr.symb_cur;
+        lets.push_back(node_cur);
+    }
+
+    Node<CalcNodeData>* body = pass_Expression(expr);
+    if (body == nullptr)
+    {
+        for (size_t i = 0; i < lets.size(); ++i) delete lets[i];
+        return nullptr;
+    }
+
+    Token token = CUR_TOKEN(expr);
+    if (token.kind != TOK_END)
+    {
+        delete body;
+        BINDING_ERROR(CALC_SYNTAX_ERROR, expr, token);
+    }
 
-        return node_cur;
+    for (size_t i = lets.size(); i > 0; --i)
+    {
+        lets[i - 1]->left_ = body;
+        body = lets[i - 1];
     }
 
-    else return pass_Function(expr);
+    return body;
 }
 
+#undef BINDING_ERROR
+
 //------------------------------------------------------------------------------
 
-Node<CalcNodeData>* pass_Function (Expression& expr)
+#define PARSE_ERROR(errcode, expr, token)                        \
+        if ((expr).diagnostics == nullptr)                       \
+        {                                                        \
+            for (size_t i = 0; i < operands.size(); ++i)         \
+                delete operands[i];                              \
+                                                                 \
+            CHECK_SYNTAX(true, errcode, expr, token);            \
+        }                                                        \
+        else AddDiagnostic(expr, errcode, token); //
+
+Node<CalcNodeData>* pass_Expression (Expression& expr)
 {
-    if (isdigit(*expr.symb_cur)) return pass_Number(expr);
+    std::vector<Node<CalcNodeData>*> operands;
+    std::vector<ParseOperator>       operators;
 
-    else
+    size_t errors = (expr.diagnostics != nullptr) ? expr.diagnostics->size() : 0;
+
+    bool expect_operand = true;
+    bool expr_begin     = true;
+
+    // In diagnostics mode the parser goes on after errors: bad characters
+    // are skipped, missing operands are replaced by zero, missing operators
+    // by multiplication and missing close brackets are added at the end
+
+    while (true)
     {
-        CHECK_SYNTAX((not isalpha(*expr.symb_cur)), CALC_SYNTAX_ERROR, expr, 1);
+        Token  token       = CUR_TOKEN(expr);
+        size_t token_index = expr.tok_cur;
+
+        if (expect_operand)
+        {
+            switch (token.kind)
+            {
+            case TOK_NUMBER:
+            case TOK_IMAGINARY:
+            {
+                operands.push_back(pass_Number(expr));
+
+                expect_operand = false;
+                break;
+            }
+            case TOK_IDENT:
+            {
+                ++expr.tok_cur;
+
+                if (CUR_TOKEN(expr).kind == TOK_OPEN)
+                {
+                    int code = findFunc(symbols.getName(token.id), token.len);
+                    if (code == 0) PARSE_ERROR(CALC_SYNTAX_UNIDENTIFIED_FUNCTION, expr, token);
+
+                    ++expr.tok_cur;
+                    operators.push_back({ (char)code, PRIOR_BRACKET, false, token_index });
+
+                    expr_begin = true;
+                    break;
+                }
+
+                Node<CalcNodeData>* node_cur = new Node<CalcNodeData>;
+                node_cur->setData({ POISON<NUM_TYPE>, symbols.getName(token.id), 0, NODE_VARIABLE, token.id });
+                operands.push_back(node_cur);
+
+                expect_operand = false;
+                break;
+            }
+            case TOK_OPEN:
+            {
+                ++expr.tok_cur;
+                operators.push_back({ 0, PRIOR_BRACKET, false, token_index });
+
+                expr_begin = true;
+                break;
+            }
+            case TOK_SUB:
+            {
+                if (expr_begin)
+                {
+                    ++expr.tok_cur;
+                    operators.push_back({ OP_SUB, PRIOR_NEGATION, true, token_index });
+
+                    expr_begin = false;
+                    break;
+                }
+            }
+            // fall through
+            default:
+            {
+                PARSE_ERROR(CALC_SYNTAX_ERROR, expr, token);
 
-        char* word = new char [MAX_STR_LEN] {};
-        size_t index = 0;
+                if (token.kind == TOK_ERROR)
+                    ++expr.tok_cur;
+                else
+                {
+                    Node<CalcNodeData>* node_cur = new Node<CalcNodeData>;
+                    node_cur->setData({ {0, 0}, nullptr, 0, NODE_NUMBER });
+                    operands.push_back(node_cur);
 
-        while (isalpha(*expr.symb_cur) || isdigit(*expr.symb_cur))
+                    expect_operand = false;
+                }
+            }
+            }
+
+            continue;
+        }
+
+        char op       = 0;
+        char priority = 0;
+        bool implicit = false;
+
+        switch (token.kind)
+        {
+        case TOK_ADD: op = OP_ADD; priority = PRIOR_ADD_SUB; break;
+        case TOK_SUB: op = OP_SUB; priority = PRIOR_ADD_SUB; break;
+        case TOK_MUL: op = OP_MUL; priority = PRIOR_MUL_DIV; break;
+        case TOK_DIV: op = OP_DIV; priority = PRIOR_MUL_DIV; break;
+        case TOK_POW: op = OP_POW; priority = PRIOR_POWER;   break;
+
+        case TOK_CLOSE:
+        case TOK_SEMICOLON:
+        case TOK_END:
         {
-            word[index++] = *expr.symb_cur;
+            while (!operators.empty() && (operators.back().priority != PRIOR_BRACKET))
+            {
+                pass_Reduce(operands, operators.back());
+                operators.pop_back();
+            }
+
+            // Semicolon ends the value of the binding
+            if ((token.kind == TOK_END) || (token.kind == TOK_SEMICOLON))
+            {
+                if (!operators.empty())
+                {
+                    PARSE_ERROR(CALC_SYNTAX_NO_CLOSE_BRACKET, expr, token);
+
+                    for (; !operators.empty(); operators.pop_back())
+                        if ((operators.back().priority != PRIOR_BRACKET) || (operators.back().op_code != 0))
+                            pass_Reduce(operands, operators.back());
+                }
+
+                if ((expr.diagnostics != nullptr) && (expr.diagnostics->size() > errors))
+                {
+                    delete operands.back();
+
+                    expr.err = (*expr.diagnostics)[errors].err;
+                    return nullptr;
+                }
 
-            ++expr.symb_cur;
+                FlattenArgs(operands.back());
+
+                return operands.back();
+            }
+
+            if (operators.empty())
+            {
+                PARSE_ERROR(CALC_SYNTAX_ERROR, expr, token);
+
+                ++expr.tok_cur;
+                continue;
+            }
+
+            if (operators.back().op_code != 0)
+                pass_Reduce(operands, operators.back());
+            operators.pop_back();
+
+            ++expr.tok_cur;
+            continue;
         }
 
-        word[index] = '\0';
+        case TOK_ERROR:
+        {
+            PARSE_ERROR(CALC_SYNTAX_ERROR, expr, token);
+
+            ++expr.tok_cur;
+            continue;
+        }
 
-        if (*expr.symb_cur == '(')
+        default:
         {
-            int code = findFunc(word);
-            delete [] word;
+            bool in_brackets = false;
+            for (size_t i = 0; i < operators.size(); ++i)
+                if (operators[i].priority == PRIOR_BRACKET) in_brackets = true;
 
-            expr = { expr.str, expr.symb_cur - index };
-            CHECK_SYNTAX((code == 0), CALC_SYNTAX_UNIDENTIFIED_FUNCTION, expr, index);
-            expr = { expr.str, expr.symb_cur + index };
+            if (in_brackets && (token.kind == TOK_OPEN))
+            {
+                PARSE_ERROR(CALC_SYNTAX_NO_CLOSE_BRACKET, expr, token);
+            }
+            else
+            {
+                PARSE_ERROR(CALC_SYNTAX_ERROR, expr, token);
+            }
 
-            Node<CalcNodeData>* arg = pass_Brackets(expr);
-            if (arg == nullptr) return nullptr;
+            op       = OP_MUL;
+            priority = PRIOR_MUL_DIV;
+            implicit = true;
+        }
+        }
 
-            Node<CalcNodeData>* node_cur = new Node<CalcNodeData>;
-            node_cur->setData({ POISON<NUM_TYPE>, op_names[code].word, op_names[code].code, NODE_FUNCTION });
-            node_cur->right_ = arg;
+        // Power is right associative, other operators are left associative
+        while (!operators.empty() && ((operators.back().priority >  priority) ||
+                                      ((operators.back().priority == priority) && (priority != PRIOR_POWER))))
+        {
+            pass_Reduce(operands, operators.back());
+            operators.pop_back();
+        }
+
+        if (!implicit) ++expr.tok_cur;
+        operators.push_back({ op, priority, false, token_index });
 
-            return node_cur;
+        expect_operand = true;
+        expr_begin     = false;
+    }
+}
+
+#undef PARSE_ERROR
+
+//------------------------------------------------------------------------------
+
+void pass_Reduce (std::vector<Node<CalcNodeData>*>& operands, const ParseOperator& op)
+{
+    assert(!operands.empty());
+
+    // Sums and products are collected into one n-ary node,
+    // subtraction is the sum with the negated operand
+    if (!op.unary && ((op.op_code == OP_ADD) || (op.op_code == OP_SUB) || (op.op_code == OP_MUL)))
+    {
+        assert(operands.size() >= 2);
+
+        char code = (op.op_code == OP_MUL) ? OP_MUL : OP_ADD;
+
+        Node<CalcNodeData>* right = operands.back();
+        operands.pop_back();
+
+        if (op.op_code == OP_SUB)
+        {
+            Node<CalcNodeData>* negation = new Node<CalcNodeData>;
+            negation->setData({ POISON<NUM_TYPE>, op_names[OP_SUB].word, op_names[OP_SUB].code, NODE_OPERATOR });
+            negation->right_ = right;
+
+            right = negation;
         }
-        else
+
+        Node<CalcNodeData>* left = operands.back();
+        if (!isArgs(left, code))
         {
             Node<CalcNodeData>* node_cur = new Node<CalcNodeData>;
-            node_cur->setData({ POISON<NUM_TYPE>, word, 0, NODE_VARIABLE });
+            node_cur->setData({ POISON<NUM_TYPE>, op_names[code].word, op_names[code].code, NODE_OPERATOR });
+            node_cur->addArg(left);
+
+            operands.back() = node_cur;
+            left = node_cur;
+        }
+
+        // Right operand of the same operation is merged by FlattenArgs at
+        // the end, merging it here copies the args at every nesting level
+        left->addArg(right);
+
+        return;
+    }
+
+    Node<CalcNodeData>* node_cur = new Node<CalcNodeData>;
+
+    node_cur->right_ = operands.back();
+    operands.pop_back();
+
+    if (op.priority == PRIOR_BRACKET)
+        node_cur->setData({ POISON<NUM_TYPE>, op_names[op.op_code].word, op_names[op.op_code].code, NODE_FUNCTION });
+
+    else
+    {
+        node_cur->setData({ POISON<NUM_TYPE>, op_names[op.op_code].word, op_names[op.op_code].code, NODE_OPERATOR });
 
-            return node_cur;
-        }   
+        if (!op.unary)
+        {
+            assert(!operands.empty());
+
+            node_cur->left_ = operands.back();
+            operands.pop_back();
+        }
     }
+
+    operands.push_back(node_cur);
 }
 
 //------------------------------------------------------------------------------
 
-Node<CalcNodeData>* pass_Number (Expression& expr)
+void FlattenArgs (Node<CalcNodeData>* root)
 {
-    double value = 0;
-    char* begin = expr.symb_cur;
+    assert(root != nullptr);
+
+    std::vector<Node<CalcNodeData>*> work = { root };
+    std::vector<Node<CalcNodeData>*> nested;
+    std::vector<Node<CalcNodeData>*> args;
+
+    // Nodes are visited from the root, so every operand is moved once: by
+    // the topmost node of the sum or product it belongs to
+    while (!work.empty())
+    {
+        Node<CalcNodeData>* node_cur = work.back();
+        work.pop_back();
+
+        if (node_cur->left_  != nullptr) work.push_back(node_cur->left_);
+        if (node_cur->right_ != nullptr) work.push_back(node_cur->right_);
+
+        if (node_cur->args_num_ == 0) continue;
+
+        char code   = node_cur->getData().op_code;
+        bool merged = false;
+
+        args.clear();
+        for (size_t i = node_cur->args_num_; i-- > 0; ) nested.push_back(node_cur->args_[i]);
+
+        while (!nested.empty())
+        {
+            Node<CalcNodeData>* arg = nested.back();
+            nested.pop_back();
+
+            if (isArgs(arg, code))
+            {
+                for (size_t i = arg->args_num_; i-- > 0; ) nested.push_back(arg->args_[i]);
 
-    value = strtod(expr.symb_cur, &expr.symb_cur);
-    CHECK_SYNTAX((expr.symb_cur == begin), CALC_SYNTAX_NUMBER_ERROR, expr, 1);
+                arg->args_num_ = 0;
+                delete arg;
+
+                merged = true;
+            }
+            else args.push_back(arg);
+        }
+
+        if (merged)
+        {
+            node_cur->args_num_ = 0;
+            for (size_t i = 0; i < args.size(); ++i) node_cur->addArg(args[i]);
+        }
+
+        work.insert(work.end(), args.begin(), args.end());
+    }
+}
+
+//------------------------------------------------------------------------------
+
+Node<CalcNodeData>* pass_Number (Expression& expr)
+{
+    Token number = CUR_TOKEN(expr);
+    ++expr.tok_cur;
 
     Node<CalcNodeData>* node_cur = new Node<CalcNodeData>;
 
-    if (*expr.symb_cur == 'i')
+    if (number.kind == TOK_IMAGINARY)
+        node_cur->setData({ {0, number.value}, nullptr, 0, NODE_NUMBER });
+    else
+        node_cur->setData({ {number.value, 0}, nullptr, 0, NODE_NUMBER });
+
+    return node_cur;
+}
+
+//------------------------------------------------------------------------------
+
+bool needBrackets (Node<CalcNodeData>* node, Node<CalcNodeData>* child, bool right)
+{
+    if (child == nullptr) return false;
+
+    char op = node->getData().op_code;
+
+    // Minus can not follow other operator, a sum prints it as subtraction
+    if (right && (op != OP_ADD) && startsWithMinus(child)) return true;
+
+    // Negative number is bracketed like unary minus
+    if (child->getData().node_type == NODE_NUMBER)
+        return (real(child->getData().number) < 0) && (right || (op == OP_POW));
+
+    if (child->getData().node_type != NODE_OPERATOR) return false;
+
+    char child_op = child->getData().op_code;
+    // Unary minus is allowed only at the beginning of expression
+    if (isNegation(child)) return true;
+
+    if ( ((op       == OP_MUL) || (op       == OP_DIV)) &&
+         ((child_op == OP_ADD) || (child_op == OP_SUB))   )
+        return true;
+
+    if (right && (op == OP_SUB) && ((child_op == OP_ADD) || (child_op == OP_SUB)))
+        return true;
+
+    if (right && (op == OP_DIV) && ((child_op == OP_MUL) || (child_op == OP_DIV)))
+        return true;
+
+    if (op == OP_POW)
+        return (child_op != OP_POW) || !right;
+
+    return false;
+}
+
+//------------------------------------------------------------------------------
+
+bool startsWithMinus (Node<CalcNodeData>* node)
+{
+    assert(node != nullptr);
+
+    // Leftmost operands are printed first unless they are bracketed
+    while (true)
     {
-        ++expr.symb_cur;
-        node_cur->setData({ {0, value}, nullptr, 0, NODE_NUMBER });
+        const CalcNodeData& data = node->getData();
+
+        if (data.node_type == NODE_NUMBER)
+            return (real(data.number) < -NIL) || ((abs(real(data.number)) <= NIL) && (imag(data.number) < -NIL));
+
+        if (data.node_type != NODE_OPERATOR) return false;
+
+        if (isNegation(node)) return true;
+
+        Node<CalcNodeData>* first = (node->args_num_ != 0) ? node->args_[0] : node->left_;
+        if (first == nullptr) return false;
+
+        if ((node->args_num_ != 0) && (data.op_code == OP_ADD) && isNegation(first)) return true;
+
+        if (needBrackets(node, first)) return false;
+
+        node = first;
     }
-    else node_cur->setData({ {value, 0}, nullptr, 0, NODE_NUMBER });
+}
+
+//------------------------------------------------------------------------------
+
+bool isNegation (Node<CalcNodeData>* node)
+{
+    return (node->getData().node_type == NODE_OPERATOR) &&
+           (node->getData().op_code   == OP_SUB)        &&
+           (node->left_ == nullptr) && (node->args_num_ == 0);
+}
+
+//------------------------------------------------------------------------------
+
+bool isArgs (Node<CalcNodeData>* node, char op_code)
+{
+    return (node->args_num_ != 0) && (node->getData().op_code == op_code);
+}
+
+//------------------------------------------------------------------------------
+
+char findFunc (const char* word)
+{
+    assert(word != nullptr);
+
+    return findFunc(word, strlen(word));
+}
+
+//------------------------------------------------------------------------------
+
+char findFunc (const char* word, size_t len)
+{
+    assert(word != nullptr);
+
+    char code = func_hash_table.slot[FuncHash(word, len, func_hash_table.seed)];
+
+    if ((strncmp(op_names[code].word, word, len) == 0) && (op_names[code].word[len] == '\0'))
+        return code;
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+
+void Optimize (Tree<CalcNodeData>& tree)
+{
+    assert(tree.root_ != nullptr);
+
+    // Operands are optimized before the node, so rules are applied to the
+    // node only while they change it and the whole pass is linear. Places
+    // of the nodes are kept, because the rules replace the nodes.
+    std::vector<std::pair<Node<CalcNodeData>**, bool>> work;
+    work.push_back({ &tree.root_, false });
+
+    while (not work.empty())
+    {
+        Node<CalcNodeData>** place = work.back().first;
+        bool                 ready = work.back().second;
+        work.pop_back();
+
+        Node<CalcNodeData>* node_cur = *place;
+
+        if (not ready)
+        {
+            work.push_back({ place, true });
 
-    return node_cur;
-}
+            for (size_t i = node_cur->args_num_; i > 0; --i) work.push_back({ node_cur->args_ + i - 1, false });
 
-//------------------------------------------------------------------------------
+            if (node_cur->right_ != nullptr) work.push_back({ &node_cur->right_, false });
+            if (node_cur->left_  != nullptr) work.push_back({ &node_cur->left_,  false });
+            continue;
+        }
 
-bool needBrackets (Node<CalcNodeData>* node, Node<CalcNodeData>* child)
-{
-    if  ( ((node-> getData().op_code == OP_MUL) || (node-> getData().op_code == OP_DIV)) &&
-          ((child->getData().op_code == OP_ADD) || (child->getData().op_code == OP_SUB))   )
-        return true;
-    else
-        return ( (node-> getData().op_code   == OP_POW)        &&
-                 (child->getData().node_type == NODE_OPERATOR) &&
-                 (child->getData().op_code   != OP_POW)          );
+        while (Optimize(tree, *place)) {}
+    }
+
+    tree.root_->recountDepth();
 }
 
 //------------------------------------------------------------------------------
 
-char findFunc (char* word)
+void OptimizePath (Tree<CalcNodeData>& tree, Node<CalcNodeData>* node_cur, Node<CalcNodeData>* top)
 {
-    assert(word != nullptr);
-
-    operation func_key = { 0, word };
+    assert(node_cur != nullptr);
 
-    operation* p_func_struct = (operation*)bsearch(&func_key, op_names, OP_NUM, sizeof(op_names[0]), CompareOP_Names);
+    while (node_cur != top)
+    {
+        Node<CalcNodeData>*  prev  = node_cur->prev_;
+        Node<CalcNodeData>** place = getPlace(tree, node_cur);
 
-    if (p_func_struct != nullptr) return p_func_struct->code;
+        while (Optimize(tree, *place)) {}
 
-    return 0;
+        node_cur = prev;
+    }
 }
 
 //------------------------------------------------------------------------------
 
-void Optimize (Tree<CalcNodeData>& tree)
+Node<CalcNodeData>** getPlace (Tree<CalcNodeData>& tree, Node<CalcNodeData>* node_cur)
 {
-    bool running = true;
-    while (running)
+    assert(node_cur != nullptr);
+
+    Node<CalcNodeData>* prev = node_cur->prev_;
+
+    if (prev == nullptr) return &tree.root_;
+
+    if (prev->args_num_ != 0)
     {
-        running = Optimize(tree, tree.root_);
+        size_t i = 0;
+        while (prev->args_[i] != node_cur) ++i;
+
+        return prev->args_ + i;
     }
-    tree.root_->recountDepth();
+
+    return (prev->left_ == node_cur) ? &prev->left_ : &prev->right_;
 }
 
 //------------------------------------------------------------------------------
 
-#define OPTIMIZE_ACTION(node_to_place)                   \
-        {                                                \
-            if (node_cur->prev_ == nullptr)              \
-                tree.root_ = node_to_place;              \
-            else                                         \
-            if (node_cur->prev_->left_ == node_cur)      \
-                node_cur->prev_->left_ = node_to_place;  \
-            else                                         \
-                node_cur->prev_->right_ = node_to_place; \
-                                                         \
-            node_to_place->prev_ = node_cur->prev_;      \
-            node_to_place = nullptr;                     \
-                                                         \
-            delete node_cur;                             \
-            return true;                                 \
+#define OPTIMIZE_ACTION(node_to_place)                             \
+        {                                                          \
+            Node<CalcNodeData>* prev = node_cur->prev_;            \
+                                                                   \
+            if (prev == nullptr)                                   \
+                tree.root_ = node_to_place;                        \
+            else                                                   \
+            if (prev->args_num_ != 0)                              \
+            {                                                      \
+                size_t i = 0;                                      \
+                while (prev->args_[i] != node_cur) ++i;            \
+                prev->args_[i] = node_to_place;                    \
+            }                                                      \
+            else                                                   \
+            if (prev->left_ == node_cur)                           \
+                prev->left_ = node_to_place;                       \
+            else                                                   \
+                prev->right_ = node_to_place;                      \
+                                                                   \
+            node_to_place->prev_ = prev;                           \
+            node_to_place = nullptr;                               \
+                                                                   \
+            delete node_cur;                                       \
+            return true;                                           \
         } //
 
 //------------------------------------------------------------------------------
@@ -897,12 +1814,12 @@ bool Optimize (Tree<CalcNodeData>& tree, Node<CalcNodeData>* node_cur)
     switch (node_cur->getData().node_type)
     {
     case NODE_FUNCTION:
-
-        return Optimize(tree, node_cur->right_);
         break;
 
     case NODE_OPERATOR:
 
+        if (node_cur->args_num_ != 0) return OptimizeArgs(tree, node_cur);
+
         switch (node_cur->getData().op_code)
         {
         case OP_ADD:
@@ -914,74 +1831,86 @@ bool Optimize (Tree<CalcNodeData>& tree, Node<CalcNodeData>* node_cur)
                 {
                     OPTIMIZE_ACTION(node_cur->right_);
                 }
-                else return Optimize(tree, node_cur->right_);
-            }
-            else
-            if (abs(node_cur->left_->getData().number) <= NIL)
-            {
-                OPTIMIZE_ACTION(node_cur->right_);
-            }
-            else
-            if (abs(node_cur->right_->getData().number) <= NIL)
-            {
-                OPTIMIZE_ACTION(node_cur->left_);
-            }
-            else
-            if ( (node_cur->left_ ->getData().node_type == NODE_NUMBER) &&
-                 (node_cur->right_->getData().node_type == NODE_NUMBER)   )
-            {
-                if (node_cur->getData().op_code == OP_ADD)
+                else
+                if (node_cur->right_->getData().node_type == NODE_NUMBER)
                 {
-                    CALCULATE_ACTION(node_cur, +);
+                    Node<CalcNodeData>* newnode = new Node<CalcNodeData>;
+                    newnode->setData({ -node_cur->right_->getData().number, nullptr, 0, NODE_NUMBER });
+
+                    OPTIMIZE_ACTION(newnode);
                 }
                 else
+                if (isNegation(node_cur->right_))
                 {
-                    CALCULATE_ACTION(node_cur, -);
+                    // -(-u) = u
+                    Node<CalcNodeData>* inner = node_cur->right_->right_;
+                    node_cur->right_->right_ = nullptr;
+
+                    OPTIMIZE_ACTION(inner);
                 }
-            }
-            else
-            {
-                if (Optimize(tree, node_cur->left_)) return true;
+                else
+                {
+                    // -(c*u) = (-c)*u, -(c/u) = (-c)/u
+                    Node<CalcNodeData>* factor = findFactor(node_cur->right_);
 
-                return Optimize(tree, node_cur->right_);
-            }
-            break;
+                    if (factor != nullptr)
+                    {
+                        CalcNodeData data = factor->getData();
+                        data.number = -data.number;
+                        factor->setData(data);
 
-        case OP_MUL:
+                        // Factor may become 1 deep in the operand
+                        OptimizePath(tree, factor->prev_, node_cur->right_);
 
-            if (abs(node_cur->left_->getData().number) <= NIL)
-            {
-                OPTIMIZE_ACTION(node_cur->left_);
-            }
-            else
-            if (abs(node_cur->right_->getData().number) <= NIL)
-            {
-                OPTIMIZE_ACTION(node_cur->right_);
-            }
-            else
-            if (abs(node_cur->left_->getData().number - static_cast<NUM_TYPE>(1)) <= NIL)
-            {
-                OPTIMIZE_ACTION(node_cur->right_);
+                        OPTIMIZE_ACTION(node_cur->right_);
+                    }
+                }
             }
             else
-            if (abs(node_cur->right_->getData().number - static_cast<NUM_TYPE>(1)) <= NIL)
+            if (node_cur->getData().op_code == OP_ADD)
             {
-                OPTIMIZE_ACTION(node_cur->left_);
+                // Binary sums made by differentiation are packed into n-ary ones
+                PackArgs(node_cur);
+                return OptimizeArgs(tree, node_cur);
             }
             else
-            if ( (node_cur->left_ ->getData().node_type == NODE_NUMBER) &&
-                 (node_cur->right_->getData().node_type == NODE_NUMBER)   )
+            if (abs(node_cur->left_->getData().number) <= NIL)
             {
-                CALCULATE_ACTION(node_cur, *);
+                // 0 - u = -u
+                delete node_cur->left_;
+                node_cur->left_ = nullptr;
+
+                return true;
             }
             else
             {
-                if (Optimize(tree, node_cur->left_)) return true;
+                // u - v = u + (-v) like the parser builds it, then it is optimized as a sum
+                Node<CalcNodeData>* Neg  = new Node<CalcNodeData>;
+                Node<CalcNodeData>* left = node_cur->left_;
+
+                Neg->setData({ POISON<NUM_TYPE>, op_names[OP_SUB].word, op_names[OP_SUB].code, NODE_OPERATOR });
+
+                Neg->right_        = node_cur->right_;
+                Neg->right_->prev_ = Neg;
 
-                return Optimize(tree, node_cur->right_);
+                node_cur->left_  = nullptr;
+                node_cur->right_ = nullptr;
+                node_cur->setData({ POISON<NUM_TYPE>, op_names[OP_ADD].word, op_names[OP_ADD].code, NODE_OPERATOR });
+
+                node_cur->addArg(left);
+                node_cur->addArg(Neg);
+
+                while (Optimize(tree, node_cur->args_[1])) {}
+
+                return true;
             }
             break;
 
+        case OP_MUL:
+
+            PackArgs(node_cur);
+            return OptimizeArgs(tree, node_cur);
+
         case OP_DIV:
 
             if (abs(node_cur->left_->getData().number) <= NIL)
@@ -994,20 +1923,18 @@ bool Optimize (Tree<CalcNodeData>& tree, Node<CalcNodeData>* node_cur)
                 OPTIMIZE_ACTION(node_cur->left_);
             }
             else
-            if ( (abs(node_cur->left_->getData().number - node_cur->right_->getData().number) <= NIL) &&
-                 ((node_cur->left_->getData().node_type == NODE_VARIABLE) || (node_cur->left_->getData().node_type == NODE_NUMBER)) )
+            if ( ( (node_cur->left_ ->getData().node_type == NODE_VARIABLE) &&
+                   (node_cur->right_->getData().node_type == NODE_VARIABLE) &&
+                   (node_cur->left_ ->getData().symbol    == node_cur->right_->getData().symbol) ) ||
+                 ( (node_cur->left_ ->getData().node_type == NODE_NUMBER) &&
+                   (node_cur->right_->getData().node_type == NODE_NUMBER) &&
+                   (abs(node_cur->left_->getData().number - node_cur->right_->getData().number) <= NIL) ) )
             {
                 Node<CalcNodeData>* newnode = new Node<CalcNodeData>;
                 newnode->setData({ {1, 0}, nullptr, 0, NODE_NUMBER });
 
                 OPTIMIZE_ACTION(newnode);
             }
-            else
-            {
-                if (Optimize(tree, node_cur->left_)) return true;
-
-                return Optimize(tree, node_cur->right_);
-            }
             break;
         }
         break;
@@ -1018,6 +1945,15 @@ bool Optimize (Tree<CalcNodeData>& tree, Node<CalcNodeData>* node_cur)
     case NODE_NUMBER:
         break;
 
+    case NODE_LET:
+
+        // Binding not used by the body is dropped
+        if (not isReferenced(node_cur->left_, node_cur->getData().symbol))
+        {
+            OPTIMIZE_ACTION(node_cur->left_);
+        }
+        break;
+
     default: assert(0);
     }
 
@@ -1026,6 +1962,272 @@ bool Optimize (Tree<CalcNodeData>& tree, Node<CalcNodeData>* node_cur)
 
 //------------------------------------------------------------------------------
 
+bool OptimizeArgs (Tree<CalcNodeData>& tree, Node<CalcNodeData>* node_cur)
+{
+    assert(node_cur != nullptr);
+
+    char     code    = node_cur->getData().op_code;
+    NUM_TYPE neutral = (code == OP_MUL) ? 1 : 0;
+
+    // Scan first, the operands are rebuilt only if something changes
+    size_t numbers = 0;
+    bool   changed = false;
+
+    for (size_t i = 0; i < node_cur->args_num_; ++i)
+    {
+        Node<CalcNodeData>* arg = node_cur->args_[i];
+
+        if ((arg->getData().node_type == NODE_OPERATOR) && (arg->getData().op_code == code))
+            changed = true;
+
+        else if (arg->getData().node_type == NODE_NUMBER)
+        {
+            ++numbers;
+
+            if ((abs(arg->getData().number - neutral) <= NIL) ||
+                ((code == OP_MUL) && (abs(arg->getData().number) <= NIL)))
+                changed = true;
+        }
+    }
+
+    if (!changed && (numbers < 2) && (node_cur->args_num_ > 1)) return false;
+
+    // Operands of the same operation are moved up, numbers are folded into one
+    std::vector<Node<CalcNodeData>*> args;
+
+    NUM_TYPE folded       = neutral;
+    size_t   first_number = -1;
+
+    for (size_t i = 0; i < node_cur->args_num_; ++i)
+    {
+        Node<CalcNodeData>* arg = node_cur->args_[i];
+
+        if ((arg->getData().node_type == NODE_OPERATOR) && (arg->getData().op_code == code))
+        {
+            PackArgs(arg);
+
+            args.insert(args.end(), arg->args_, arg->args_ + arg->args_num_);
+            arg->args_num_ = 0;
+
+            delete arg;
+        }
+        else if (arg->getData().node_type == NODE_NUMBER)
+        {
+            if (first_number == (size_t)-1) first_number = args.size();
+
+            folded = CalcOperator(code, folded, arg->getData().number);
+            delete arg;
+        }
+        else args.push_back(arg);
+    }
+
+    delete [] node_cur->args_;
+    node_cur->args_     = nullptr;
+    node_cur->args_num_ = 0;
+
+    if ((code == OP_MUL) && (abs(folded) <= NIL))
+    {
+        for (size_t i = 0; i < args.size(); ++i) delete args[i];
+        args.clear();
+    }
+
+    if (args.empty() || (abs(folded - neutral) > NIL))
+    {
+        Node<CalcNodeData>* number = new Node<CalcNodeData>;
+        number->setData({ folded, nullptr, 0, NODE_NUMBER });
+
+        if (first_number > args.size()) first_number = args.size();
+        args.insert(args.begin() + first_number, number);
+    }
+
+    if (args.size() == 1)
+    {
+        Node<CalcNodeData>* single = args[0];
+        OPTIMIZE_ACTION(single);
+    }
+
+    for (size_t i = 0; i < args.size(); ++i) node_cur->addArg(args[i]);
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+Node<CalcNodeData>* findFactor (Node<CalcNodeData>* node)
+{
+    assert(node != nullptr);
+
+    while (node->getData().node_type == NODE_OPERATOR)
+    {
+        if (isArgs(node, OP_MUL))
+        {
+            for (size_t i = 0; i < node->args_num_; ++i)
+                if (node->args_[i]->getData().node_type == NODE_NUMBER) return node->args_[i];
+
+            node = node->args_[0];
+        }
+        else
+        if (((node->getData().op_code == OP_MUL) || (node->getData().op_code == OP_DIV)) && (node->args_num_ == 0))
+        {
+            if (node->left_->getData().node_type == NODE_NUMBER) return node->left_;
+
+            node = node->left_;
+        }
+        else break;
+    }
+
+    return nullptr;
+}
+
+//------------------------------------------------------------------------------
+
+void PackArgs (Node<CalcNodeData>* node_cur)
+{
+    assert(node_cur != nullptr);
+
+    if (node_cur->args_num_ != 0) return;
+
+    Node<CalcNodeData>* left  = node_cur->left_;
+    Node<CalcNodeData>* right = node_cur->right_;
+
+    node_cur->left_  = nullptr;
+    node_cur->right_ = nullptr;
+
+    node_cur->addArg(left);
+    node_cur->addArg(right);
+}
+
+//------------------------------------------------------------------------------
+
+SymbolSet SymbolBit (int symbol)
+{
+    if (symbol == NO_SYMBOL) return ALL_SYMBOLS;
+
+    return (SymbolSet)1 << (symbol % 64);
+}
+
+//------------------------------------------------------------------------------
+
+SymbolSet CountDepends (Node<CalcNodeData>* node_cur)
+{
+    assert(node_cur != nullptr);
+
+    // Post order walk through prev_ pointers, the operands are counted
+    // before the node. Value of the binding is walked before its body, so
+    // the bindings in scope are kept on the stack.
+    std::vector<size_t>                    positions;
+    std::vector<std::pair<int, SymbolSet>> scope;
+
+    Node<CalcNodeData>* root = node_cur;
+    Node<CalcNodeData>* from = node_cur->prev_;
+
+    while (true)
+    {
+        Node<CalcNodeData>* next = node_cur->nextChild(from, positions);
+
+        if (next != nullptr)
+        {
+            from     = node_cur;
+            node_cur = next;
+            continue;
+        }
+
+        CalcNodeData data = node_cur->getData();
+
+        data.size = 1;
+
+        switch (data.node_type)
+        {
+        case NODE_NUMBER:
+
+            data.depends = 0;
+            break;
+
+        case NODE_VARIABLE:
+        {
+            int symbol = (data.symbol != NO_SYMBOL) ? data.symbol : symbols.Intern(data.word);
+
+            size_t bound = scope.size();
+            while ((bound > 0) && (scope[bound - 1].first != symbol)) --bound;
+
+            data.op_code = (bound > 0) ? VAR_BOUND : 0;
+            data.depends = (bound > 0) ? scope[bound - 1].second : SymbolBit(symbol);
+            break;
+        }
+        case NODE_LET:
+
+            data.depends = node_cur->left_->getData().depends;
+            data.size   += node_cur->left_->getData().size + node_cur->right_->getData().size;
+
+            scope.pop_back();
+            break;
+
+        default:
+
+            data.depends = 0;
+
+            if (node_cur->left_  != nullptr) { data.depends |= node_cur->left_ ->getData().depends; data.size += node_cur->left_ ->getData().size; }
+            if (node_cur->right_ != nullptr) { data.depends |= node_cur->right_->getData().depends; data.size += node_cur->right_->getData().size; }
+
+            for (size_t i = 0; i < node_cur->args_num_; ++i)
+            {
+                data.depends |= node_cur->args_[i]->getData().depends;
+                data.size    += node_cur->args_[i]->getData().size;
+            }
+        }
+
+        node_cur->setData(data);
+
+        if (node_cur == root) break;
+
+        if ((node_cur->prev_->getData().node_type == NODE_LET) && (node_cur->prev_->right_ == node_cur))
+            scope.push_back({ node_cur->prev_->getData().symbol, data.depends });
+
+        from     = node_cur;
+        node_cur = node_cur->prev_;
+    }
+
+    return root->getData().depends;
+}
+
+//------------------------------------------------------------------------------
+
+bool isDependent (const Node<CalcNodeData>* node, int symbol)
+{
+    return (node->getData().depends & SymbolBit(symbol)) != 0;
+}
+
+//------------------------------------------------------------------------------
+
+bool isReferenced (const Node<CalcNodeData>* node, int symbol)
+{
+    assert(node != nullptr);
+
+    std::vector<const Node<CalcNodeData>*> work = { node };
+
+    while (not work.empty())
+    {
+        node = work.back();
+        work.pop_back();
+
+        const CalcNodeData& data = node->getData();
+
+        if ((data.node_type == NODE_VARIABLE) && (data.symbol == symbol)) return true;
+
+        // Body of the binding with the same name references that binding
+        if ((node->left_ != nullptr) && ((data.node_type != NODE_LET) || (data.symbol != symbol)))
+            work.push_back(node->left_);
+
+        if (node->right_ != nullptr) work.push_back(node->right_);
+
+        for (size_t i = 0; i < node->args_num_; ++i) work.push_back(node->args_[i]);
+    }
+
+    return false;
+}
+
+//------------------------------------------------------------------------------
+
 bool isPOISON (NUM_TYPE value)
 {
     if (isnan(real(value)) || isnan(imag(value)))
@@ -1097,34 +2299,50 @@ void printExprGraphNode (FILE* graph, Node<CalcNodeData>* node_cur)
 {
     assert(graph != nullptr);
 
-    char* data      = new char[64] {};
-    char* fillcolor = new char[64] {};
+    // Nodes are printed in pre order from an explicit stack, so the depth
+    // of the tree is not limited by the stack of the thread
+    std::vector<Node<CalcNodeData>*> work = { node_cur };
 
-    getDataAndColor(node_cur, &data, &fillcolor);
+    while (not work.empty())
+    {
+        node_cur = work.back();
+        work.pop_back();
 
-    fprintf(graph, "\t %lu [shape = box, style = filled, color = black, fillcolor = %s, label = \"%s\"]\n", (size_t)node_cur, fillcolor, data);
+        char* data      = new char[64] {};
+        char* fillcolor = new char[64] {};
 
-    if (node_cur->left_ != nullptr)
-    {
-        char* leftdata = new char[64] {};
-        getDataAndColor(node_cur->left_, &leftdata, &fillcolor);
-        fprintf(graph, "\t %lu -> %lu [label=\"left\"]\n", (size_t)node_cur, (size_t)node_cur->left_);
-        delete [] leftdata;
-    }
+        getDataAndColor(node_cur, &data, &fillcolor);
 
-    if (node_cur->right_ != nullptr)
-    {
-        char* rightdata = new char[64] {};
-        getDataAndColor(node_cur->right_, &rightdata, &fillcolor);
-        fprintf(graph, "\t %lu -> %lu [label=\"right\"]\n", (size_t)node_cur, (size_t)node_cur->right_);
-        delete [] rightdata;
-    }
+        fprintf(graph, "\t %lu [shape = box, style = filled, color = black, fillcolor = %s, label = \"%s\"]\n", (size_t)node_cur, fillcolor, data);
+
+        if (node_cur->left_ != nullptr)
+        {
+            char* leftdata = new char[64] {};
+            getDataAndColor(node_cur->left_, &leftdata, &fillcolor);
+            fprintf(graph, "\t %lu -> %lu [label=\"left\"]\n", (size_t)node_cur, (size_t)node_cur->left_);
+            delete [] leftdata;
+        }
+
+        if (node_cur->right_ != nullptr)
+        {
+            char* rightdata = new char[64] {};
+            getDataAndColor(node_cur->right_, &rightdata, &fillcolor);
+            fprintf(graph, "\t %lu -> %lu [label=\"right\"]\n", (size_t)node_cur, (size_t)node_cur->right_);
+            delete [] rightdata;
+        }
 
-    delete [] data;
-    delete [] fillcolor;
+        for (size_t i = 0; i < node_cur->args_num_; ++i)
+            fprintf(graph, "\t %lu -> %lu [label=\"%zu\"]\n", (size_t)node_cur, (size_t)node_cur->args_[i], i);
 
-    if (node_cur->left_  != nullptr) printExprGraphNode(graph, node_cur->left_);
-    if (node_cur->right_ != nullptr) printExprGraphNode(graph, node_cur->right_);
+        delete [] data;
+        delete [] fillcolor;
+
+        // Pushed in reverse order, so the left subtree is printed first
+        for (size_t i = node_cur->args_num_; i > 0; --i) work.push_back(node_cur->args_[i - 1]);
+
+        if (node_cur->right_ != nullptr) work.push_back(node_cur->right_);
+        if (node_cur->left_  != nullptr) work.push_back(node_cur->left_);
+    }
 }
 
 //------------------------------------------------------------------------------
@@ -1159,42 +2377,94 @@ void getDataAndColor (Node<CalcNodeData>* node_cur, char** data, char** fillcolo
         delete [] strnum;
         break;
     }
+    case NODE_LET:
+    {
+        sprintf(*fillcolor, "plum");
+        sprintf(*data, "let %s", node_cur->getData().word);
+        break;
+    }
     default: sprintf(*data, "err: %s", node_cur->getData().word); break;
     }
 }
 
 //------------------------------------------------------------------------------
 
-void PrintBadExpr (const char* logname, const Expression& expr, size_t len)
+void PrintBadExpr (LogWriter& log, const char* file, int line, const char* function, int err,
+                   const Expression& expr, size_t begin, size_t len)
 {
-    assert(logname != nullptr);
+    assert(function != nullptr);
+    assert(file     != nullptr);
+
+    char buf[BAD_EXPR_BUFSIZE] = "";
+    BadExprContext(expr, begin, len, buf);
+
+    log.Printf("###############################################################################\n"
+               "TIME: %T\n\n"
+               "ERROR: file %s  line %d  function %s\n\n"
+               "%s\n%s", file, line, function, calc_errstr[err + 1], buf);
+
+    if (expr.console) printf("ERROR: %s\n\n%s", calc_errstr[err + 1], buf);
+}
 
-    FILE* log = fopen(logname, "a");
-    assert(log != nullptr);
+//------------------------------------------------------------------------------
 
-    fprintf(log, "\t %s\n", expr.str);
-    printf (     "\t %s\n", expr.str);
+char* BadExprContext (const Expression& expr, size_t begin, size_t len, char* buf)
+{
+    assert(buf != nullptr);
 
-    fprintf(log, "\t ");
-    printf (     "\t ");
+    const char* text   = expr.str;
+    size_t      size   = 0;
+    size_t      offset = 0;
 
-    for (int i = 0; i < expr.symb_cur - expr.str; ++i)
+    if (expr.lexer != nullptr)
     {
-        fprintf(log, " ");
-        printf (     " ");
+        text   = expr.lexer->text_;
+        size   = expr.lexer->size_;
+        offset = expr.lexer->offset_;
     }
+    else size = strlen(expr.str);
+
+    // Streamed source keeps only the current chunk, and its lines can be
+    // as long as the whole source, so only the error context is printed
+    const char* bad  = text + ((begin > offset) ? begin - offset : 0);
+    const char* line = bad;
+    while ((line > text) && (line[-1] != '\n') && (bad - line < BAD_EXPR_CONTEXT)) --line;
+
+    const char* line_end = bad;
+    while ((line_end < text + size) && (*line_end != '\n') && (line_end - bad < BAD_EXPR_CONTEXT)) ++line_end;
+
+    int line_len = line_end - line;
+    int tildes   = (len > 1) ? len - 1 : 0;
+    if (tildes > BAD_EXPR_CONTEXT) tildes = BAD_EXPR_CONTEXT;
+
+    char* cur = buf;
+    cur += sprintf(cur, "\t %.*s\n\t %*s^", line_len, line, (int)(bad - line), "");
+
+    memset(cur, '~', tildes);
+    cur += tildes;
+
+    sprintf(cur, "\n");
 
-    fprintf(log, "^");
-    printf (     "^");
+    return buf;
+}
+
+//------------------------------------------------------------------------------
+
+void LogDiagnostics (LogWriter& log, const Expression& expr)
+{
+    assert(expr.diagnostics != nullptr);
 
-    for (int i = 0; i < len - 1; ++i)
+    for (size_t i = 0; i < expr.diagnostics->size(); ++i)
     {
-        fprintf(log, "~");
-        printf (     "~");
-    }
+        const Diagnostic& diag = (*expr.diagnostics)[i];
 
-    fprintf(log, "\n");
-    printf (     "\n");
+        char buf[BAD_EXPR_BUFSIZE] = "";
+        BadExprContext(expr, diag.begin, diag.len, buf);
+
+        log.Printf("###############################################################################\n"
+                   "TIME: %T\n\n"
+                   "%s (bytes %zu-%zu)\n%s", calc_errstr[diag.err + 1], diag.begin, diag.begin + diag.len, buf);
+    }
 }
 
 //------------------------------------------------------------------------------
@@ -30,9 +30,14 @@
 #include "../StringLib/StringLib.h"
 #include "../TreeLib/Tree.h"
 #include "Operations.h"
+#include "SymbolTable.h"
+#include "Lexer.h"
+#include "LogWriter.h"
 #include <complex>
 #include <math.h>
 #include <omp.h>
+#include <stdint.h>
+#include <vector>
 
 
 #define NUM_TYPE std::complex<double>
@@ -47,11 +52,11 @@ template<> constexpr NUM_TYPE POISON<NUM_TYPE> = {NAN, NAN};
 
 constexpr double NIL = 1e-9;
 
-#define ADD_VAR(variables)                \
-        {                                 \
-            variables.Push({ PI, "pi" }); \
-            variables.Push({ E,  "e"  }); \
-            variables.Push({ I,  "i"  }); \
+#define ADD_VAR(variables)                                      \
+        {                                                       \
+            variables.Push({ PI, "pi", symbols.Intern("pi") }); \
+            variables.Push({ E,  "e",  symbols.Intern("e")  }); \
+            variables.Push({ I,  "i",  symbols.Intern("i")  }); \
         } //
 
 
@@ -80,6 +85,12 @@ enum CalculatorErrors
     CALC_TREE_VAR_WRONG_ARGUMENT                                           ,
     CALC_UNIDENTIFIED_VARIABLE                                             ,
     CALC_WRONG_VARIABLE                                                    ,
+    CALC_BIN_OPEN_ERROR                                                    ,
+    CALC_BIN_WRONG_FORMAT                                                  ,
+    CALC_SYNTAX_BAD_BINDING                                                ,
+    CALC_SYNTAX_REBINDING                                                  ,
+    CALC_BIN_BINDINGS                                                      ,
+    CALC_TREE_LET_WRONG_ARGUMENTS                                          ,
 };
 
 char const * const calc_errstr[] =
@@ -100,22 +111,27 @@ char const * const calc_errstr[] =
     "Variable node must not have any children"                             ,
     "I do not solve equations"                                             ,
     "Wrong variable detected"                                              ,
+    "Failed to open binary tree image"                                     ,
+    "Wrong format of binary tree image"                                    ,
+    "Binding must look like \'let name = expression;\'"                     ,
+    "Name of the binding is already used before"                           ,
+    "Binary tree image can not keep bindings"                              ,
+    "Binding node must have the value and the body"                        ,
 };
 
 char const * const CALCULATOR_LOGNAME = "calculator.log";
 
-#define CHECK_SYNTAX(cond, errcode, expr, len) if (cond)                                                                            \
-                                               {                                                                                    \
-                                                 CalcPrintError(CALCULATOR_LOGNAME, __FILE__, __LINE__, __FUNC_NAME__, errcode, 0); \
-                                                 PrintBadExpr(CALCULATOR_LOGNAME, expr, len);                                       \
-                                                 expr.err = errcode;                                                                \
-                                                 return nullptr;                                                                    \
-                                               } //
-
-#define CALC_ASSERTOK(cond, err) if (cond)                                                                        \
-                                 {                                                                                \
-                                   CalcPrintError(CALCULATOR_LOGNAME, __FILE__, __LINE__, __FUNC_NAME__, err, 1); \
-                                   exit(err);                                                                     \
+#define CHECK_SYNTAX(cond, errcode, expr, token) if (cond)                                                                                      \
+                                                 {                                                                                              \
+                                                   PrintBadExpr(calc_log, __FILE__, __LINE__, __FUNC_NAME__, errcode, expr, (token).begin, (token).len); \
+                                                   expr.err = errcode;                                                                          \
+                                                   return nullptr;                                                                              \
+                                                 } //
+
+#define CALC_ASSERTOK(cond, err) if (cond)                                                              \
+                                 {                                                                      \
+                                   CalcPrintError(calc_log, __FILE__, __LINE__, __FUNC_NAME__, err, 1); \
+                                   exit(err);                                                           \
                                  } //
 
 
@@ -126,8 +142,10 @@ char const * const CALCULATOR_LOGNAME = "calculator.log";
 //==============================================================================
 
 
-char const * const GRAPH_FILENAME = "Equation.dot";
-const size_t       MAX_STR_LEN    = 4096;
+char const * const GRAPH_FILENAME   = "Equation.dot";
+const size_t       MAX_STR_LEN      = 4096;
+const int          BAD_EXPR_CONTEXT = 64;
+const size_t       BAD_EXPR_BUFSIZE = 4 * BAD_EXPR_CONTEXT + 16;
 
 enum NODE_TYPE 
 {
@@ -135,21 +153,71 @@ enum NODE_TYPE
     NODE_OPERATOR = 2,
     NODE_VARIABLE = 3,
     NODE_NUMBER   = 4,
+    NODE_LET      = 5,
+};
+
+// Binding 'let name = value; body' is the node with the name, value is its
+// right operand and body is the left one, so the walks visiting the right
+// subtree first meet the value before the references to it. Bindings are
+// parsed only in front of the expression, so they are a chain from the root.
+
+const char VAR_BOUND = 1;   // op_code of the variable referencing the binding, set by CountDepends
+
+struct Diagnostic
+{
+    int    err   = CALC_OK;
+    size_t begin = 0;       // offset of the first bad character
+    size_t len   = 0;       // number of bad characters
 };
 
 struct Expression 
 {
-    char* str      = nullptr;
-    char* symb_cur = nullptr;
-    int   err      = CALC_OK;
+    char*  str      = nullptr;
+    char*  symb_cur = nullptr;
+    int    err      = CALC_OK;
+    size_t size     = 0;        // capacity of str if it is allocated by Tree2Expr
+
+    Lexer* lexer    = nullptr;
+    size_t tok_cur  = 0;
+
+    std::vector<Diagnostic>* diagnostics = nullptr; // if set, all errors are collected here
+    bool                     console     = true;    // syntax errors are printed to the console, not only logged
+};
+
+enum PARSE_PRIORITY
+{
+    PRIOR_BRACKET  = 0,
+    PRIOR_ADD_SUB  = 1,
+    PRIOR_NEGATION = 2,
+    PRIOR_MUL_DIV  = 3,
+    PRIOR_POWER    = 4,
 };
 
+struct ParseOperator
+{
+    char   op_code  = 0;     // 0 for plain brackets
+    char   priority = PRIOR_BRACKET;
+    bool   unary    = false;
+    size_t token    = 0;     // index of the token, for error messages
+};
+
+// Variables of a subtree, one bit for symbol id modulo 64. Variables may
+// share a bit, so only a clear bit is certain: the subtree does not depend
+// on the variable. Nodes made without CountDepends depend on everything
+// and have zero size.
+typedef uint64_t SymbolSet;
+
+const SymbolSet ALL_SYMBOLS = ~(SymbolSet)0;
+
 struct CalcNodeData
 {
-    NUM_TYPE number    = POISON<NUM_TYPE>;
-    char*    word      = nullptr;
-    char     op_code   = 0;
-    char     node_type = 0;
+    NUM_TYPE    number    = POISON<NUM_TYPE>;
+    const char* word      = nullptr;
+    char        op_code   = 0;
+    char        node_type = 0;
+    int         symbol    = NO_SYMBOL;
+    SymbolSet   depends   = ALL_SYMBOLS;
+    size_t      size      = 0;            // number of nodes of the subtree
 };
 
 template<> const char* const      PRINT_TYPE<CalcNodeData> = "CalcNodeData";
@@ -158,11 +226,22 @@ template<> constexpr CalcNodeData POISON    <CalcNodeData> = {};
 bool isPOISON  (CalcNodeData value);
 void TypePrint (FILE* fp, const CalcNodeData& node_data);
 
+// Piece of the printed expression, Node2Str keeps them on its work stack
+struct PrintPiece
+{
+    Node<CalcNodeData>* node = nullptr;     // subtree, nullptr for the text
+    const char*         text = nullptr;
+    size_t              len  = 0;
+    bool                plus = false;       // plus before the operand of the sum, it is
+                                            // dropped if the operand starts with minus
+};
+
 
 struct Variable
 {
-    NUM_TYPE    value = POISON<NUM_TYPE>;
-    const char* name  = nullptr;
+    NUM_TYPE    value  = POISON<NUM_TYPE>;
+    const char* name   = nullptr;
+    int         symbol = NO_SYMBOL;
 };
 
 template<> const char* const  PRINT_TYPE<Variable> = "Variable";
@@ -171,6 +250,13 @@ template<> constexpr Variable POISON    <Variable> = {};
 bool isPOISON  (Variable value);
 void TypePrint (FILE* fp, const Variable& var);
 
+// Value of the expression together with its derivative by one variable
+struct Dual
+{
+    NUM_TYPE value      = 0;
+    NUM_TYPE derivative = 0;
+};
+
 
 class Calculator
 {
@@ -251,7 +337,7 @@ private:
 //------------------------------------------------------------------------------
 /*! @brief   Prints an error wih description to the console and to the log file.
  *
- *  @param   logname      Name of the log file
+ *  @param   log          Log writer
  *  @param   file         Name of the program file
  *  @param   line         Number of line with an error
  *  @param   function     Name of the function with an error
@@ -259,7 +345,79 @@ private:
  *  @param   console_err  Print error to console or not
  */
 
-void CalcPrintError (const char* logname, const char* file, int line, const char* function, int err, bool console_err);
+void CalcPrintError (LogWriter& log, const char* file, int line, const char* function, int err, bool console_err);
+
+//------------------------------------------------------------------------------
+/*! @brief   Calculate value of the function.
+ *
+ *  @param   op_code     Code of the function
+ *  @param   number      Argument
+ *
+ *  @return  value
+ */
+
+NUM_TYPE CalcFunction (char op_code, NUM_TYPE number);
+
+//------------------------------------------------------------------------------
+/*! @brief   Calculate value of the operator.
+ *
+ *  @param   op_code     Code of the operator
+ *  @param   left_num    Left operand (0 for unary minus)
+ *  @param   right_num   Right operand
+ *
+ *  @return  value
+ */
+
+NUM_TYPE CalcOperator (char op_code, NUM_TYPE left_num, NUM_TYPE right_num);
+
+//------------------------------------------------------------------------------
+/*! @brief   Calculate derivative of the function at the point.
+ *
+ *  @param   op_code     Code of the function
+ *  @param   number      Argument
+ *  @param   value       Value of the function at the argument
+ *
+ *  @return  derivative
+ */
+
+NUM_TYPE CalcFunctionDerivative (char op_code, NUM_TYPE number, NUM_TYPE value);
+
+//------------------------------------------------------------------------------
+/*! @brief   Calculate value and derivative of the function.
+ *
+ *  @param   op_code     Code of the function
+ *  @param   arg         Argument with its derivative
+ *
+ *  @return  value with derivative
+ */
+
+Dual CalcFunctionDual (char op_code, Dual arg);
+
+//------------------------------------------------------------------------------
+/*! @brief   Calculate value and derivative of the operator.
+ *
+ *  @param   op_code     Code of the operator
+ *  @param   left        Left operand with its derivative (zeros for unary minus)
+ *  @param   right       Right operand with its derivative
+ *
+ *  @return  value with derivative
+ */
+
+Dual CalcOperatorDual (char op_code, Dual left, Dual right);
+
+//------------------------------------------------------------------------------
+/*! @brief   Calculate value of the expression and its derivative by the
+ *           variable in one pass over the tree, no nodes are created.
+ *
+ *  @param   tree        Equation tree
+ *  @param   variables   Values of the variables
+ *  @param   symbol      Symbol id of the variable
+ *  @param   result      Value with derivative
+ *
+ *  @return  error code
+ */
+
+int CalcDual (const Tree<CalcNodeData>& tree, Stack<Variable>& variables, int symbol, Dual& result);
 
 //------------------------------------------------------------------------------
 /*! @brief   Get an answer from stdin (yes or no).
@@ -278,7 +436,7 @@ bool scanAns ();
  *  @return  number
  */
 
-NUM_TYPE scanVar (Calculator& calc, char* varname);
+NUM_TYPE scanVar (Calculator& calc, const char* varname);
 
 //------------------------------------------------------------------------------
 /*! @brief   Convert complex number to c string.
@@ -292,14 +450,29 @@ char* Num2Str (NUM_TYPE number);
 
 //------------------------------------------------------------------------------
 /*! @brief   Get string equation from stdin.
+ *
+ *  @note    Buffer grows until the whole line is read.
  * 
  *  @return  string expression
  */
 
 char* ScanExpr ();
 
+//------------------------------------------------------------------------------
+/*! @brief   Read line of any length from the stream.
+ * 
+ *  @param   fp          Opened stream
+ *
+ *  @return  line with '\n' (allocated by new[]), nullptr if stream is over
+ */
+
+char* ReadLine (FILE* fp);
+
 //------------------------------------------------------------------------------
 /*! @brief   Convert tree to string expression.
+ *
+ *  @note    expr.str is allocated (or reused if expr.size is enough) and grown
+ *           by new[] as needed, the caller deletes it.
  * 
  *  @param   tree        Equation tree
  *  @param   expr        String expression
@@ -313,15 +486,51 @@ int Tree2Expr (const Tree<CalcNodeData>& tree, Expression& expr);
 /*! @brief   Convert tree node to string expression.
  * 
  *  @param   node_cur    Current node
- *  @param   str         C string
+ *  @param   expr        String expression, written from expr.symb_cur
  *
  *  @return  error code
  */
 
-int Node2Str (Node<CalcNodeData>* node_cur, char** str);
+int Node2Str (Node<CalcNodeData>* node_cur, Expression& expr);
+
+//------------------------------------------------------------------------------
+/*! @brief   Split the n-ary sum or product to the pieces of Node2Str.
+ * 
+ *  @param   node_cur    N-ary node
+ *  @param   pieces      Pieces of the node, appended in order
+ *
+ *  @return  error code
+ */
+
+int Args2Str (Node<CalcNodeData>* node_cur, std::vector<PrintPiece>& pieces);
+
+//------------------------------------------------------------------------------
+/*! @brief   Append text of the piece to the string expression, the plus
+ *           waiting before it is dropped if the text starts with minus.
+ * 
+ *  @param   expr        String expression, written from expr.symb_cur
+ *  @param   text        Text of the piece
+ *  @param   len         Length of the text
+ *  @param   plus        Plus is waiting, reset when it is put
+ */
+
+void PutPiece (Expression& expr, const char* text, size_t len, bool& plus);
+
+//------------------------------------------------------------------------------
+/*! @brief   Append characters to the string expression, growing its buffer.
+ * 
+ *  @param   expr        String expression, written from expr.symb_cur
+ *  @param   word        Characters to append
+ *  @param   len         Number of characters
+ */
+
+void PutStr (Expression& expr, const char* word, size_t len);
 
 //------------------------------------------------------------------------------
 /*! @brief   Convert string expression to tree.
+ *
+ *  @note    Source string is not modified, it is split into tokens once
+ *           and the parsing functions below consume only these tokens.
  * 
  *  @param   expr        String expression
  *  @param   tree        Equation tree
@@ -332,54 +541,101 @@ int Node2Str (Node<CalcNodeData>* node_cur, char** str);
 int Expr2Tree (Expression& expr, Tree<CalcNodeData>& tree);
 
 //------------------------------------------------------------------------------
-/*! @brief   Parsing of expression beginning with plus and minus signs.
+/*! @brief   Convert expression from the stream to tree.
+ *
+ *  @note    Stream is read in chunks while parsing, so the expression length
+ *           is not limited and only the current chunk is kept in memory.
  * 
- *  @param   expr        String expression
+ *  @param   source      Opened stream
+ *  @param   expr        String expression (only error fields are used)
+ *  @param   tree        Equation tree
  *
- *  @return  pointer to tree node
+ *  @return  -1 if error, 0 if ok
  */
 
-Node<CalcNodeData>* pass_Plus_Minus (Expression& expr);
+int Stream2Tree (FILE* source, Expression& expr, Tree<CalcNodeData>& tree);
 
 //------------------------------------------------------------------------------
-/*! @brief   Parsing of expression with mulptiply and division signs.
+/*! @brief   Convert tokens of the expression lexer to tree.
  * 
+ *  @param   expr        String expression with the lexer set
+ *  @param   tree        Equation tree
+ *
+ *  @return  -1 if error, 0 if ok
+ */
+
+int Tokens2Tree (Expression& expr, Tree<CalcNodeData>& tree);
+
+//------------------------------------------------------------------------------
+/*! @brief   Parsing of the bindings 'let name = value;' and the expression
+ *           after them.
+ *
+ *  @note    Name of the binding must not be used before it, neither as
+ *           a variable nor as another binding, so the names never shadow
+ *           each other. Word 'let' at the beginning is reserved.
+ *
  *  @param   expr        String expression
  *
  *  @return  pointer to tree node
  */
 
-Node<CalcNodeData>* pass_Mul_Div (Expression& expr);
+Node<CalcNodeData>* pass_Bindings (Expression& expr);
 
 //------------------------------------------------------------------------------
-/*! @brief   Parsing of expression with power signs.
+/*! @brief   Check syntax of the expression collecting all errors in one pass.
+ *
+ *  @note    Parser recovers after every error, so nothing is printed and
+ *           errors after the first one are found too.
  * 
  *  @param   expr        String expression
+ *  @param   diagnostics List of errors to fill, sorted by position
  *
- *  @return  pointer to tree node
+ *  @return  number of errors
  */
 
-Node<CalcNodeData>* pass_Power (Expression& expr);
+size_t CheckSyntax (Expression& expr, std::vector<Diagnostic>& diagnostics);
 
 //------------------------------------------------------------------------------
-/*! @brief   Parsing of expression with brackets.
+/*! @brief   Add error to the expression diagnostics, merging adjacent bad
+ *           characters into one error.
+ * 
+ *  @param   expr        String expression with diagnostics set
+ *  @param   err         Error code
+ *  @param   token       Bad token
+ */
+
+void AddDiagnostic (Expression& expr, int err, const Token& token);
+
+//------------------------------------------------------------------------------
+/*! @brief   Parsing of expression by precedence climbing with explicit stacks.
+ *
+ *  @note    Nesting depth is limited only by memory, the recursion is replaced
+ *           by the operand and operator stacks.
  * 
  *  @param   expr        String expression
  *
  *  @return  pointer to tree node
  */
 
-Node<CalcNodeData>* pass_Brackets (Expression& expr);
+Node<CalcNodeData>* pass_Expression (Expression& expr);
 
 //------------------------------------------------------------------------------
-/*! @brief   Parsing of expression with function.
+/*! @brief   Apply operator from the top of the operator stack to the operands.
  * 
- *  @param   expr        String expression
+ *  @param   operands    Stack of parsed subtrees
+ *  @param   op          Operator to apply
+ */
+
+void pass_Reduce (std::vector<Node<CalcNodeData>*>& operands, const ParseOperator& op);
+
+//------------------------------------------------------------------------------
+/*! @brief   Merge operands of the n-ary sums and products that are the same
+ *           operation into their parent, like a+(b+c) into a+b+c.
  *
- *  @return  pointer to tree node
+ *  @param   root        Root of the parsed subtree
  */
 
-Node<CalcNodeData>* pass_Function (Expression& expr);
+void FlattenArgs (Node<CalcNodeData>* root);
 
 //------------------------------------------------------------------------------
 /*! @brief   Parsing of expression with number.
@@ -396,11 +652,44 @@ Node<CalcNodeData>* pass_Number (Expression& expr);
  *
  *  @param   node_cur    Current node
  *  @param   child       Current node's child
+ *  @param   right       true if the child is right operand
  *
  *  @return  true if need, else false
  */
 
-bool needBrackets (Node<CalcNodeData>* node, Node<CalcNodeData>* child);
+bool needBrackets (Node<CalcNodeData>* node, Node<CalcNodeData>* child, bool right = false);
+
+//------------------------------------------------------------------------------
+/*! @brief   Check if printed subtree starts with minus, that is its leftmost
+ *           operand is a negative number or unary minus.
+ *
+ *  @param   node        Root of the subtree
+ *
+ *  @return  true if starts, else false
+ */
+
+bool startsWithMinus (Node<CalcNodeData>* node);
+
+//------------------------------------------------------------------------------
+/*! @brief   Check if node is unary minus.
+ *
+ *  @param   node        Node to be checked
+ *
+ *  @return  true if it is, else false
+ */
+
+bool isNegation (Node<CalcNodeData>* node);
+
+//------------------------------------------------------------------------------
+/*! @brief   Check if node is n-ary node of the operator.
+ *
+ *  @param   node        Node to be checked
+ *  @param   op_code     Operator code
+ *
+ *  @return  true if it is, else false
+ */
+
+bool isArgs (Node<CalcNodeData>* node, char op_code);
 
 //------------------------------------------------------------------------------
 /*! @brief   Function identifier.
@@ -410,7 +699,18 @@ bool needBrackets (Node<CalcNodeData>* node, Node<CalcNodeData>* child);
  *  @return  function code if found else NOT_OK
  */
 
-char findFunc (char* word);
+char findFunc (const char* word);
+
+//------------------------------------------------------------------------------
+/*! @brief   Function identifier.
+ *
+ *  @param   word        Characters to be recognized
+ *  @param   len         Number of characters
+ *
+ *  @return  function code if found else NOT_OK
+ */
+
+char findFunc (const char* word, size_t len);
 
 //------------------------------------------------------------------------------
 /*! @brief   Optimize expression process.
@@ -421,16 +721,115 @@ char findFunc (char* word);
 void Optimize (Tree<CalcNodeData>& tree);
 
 //------------------------------------------------------------------------------
-/*! @brief   Optimize expression process.
+/*! @brief   Apply one rule of optimization to the node, its operands are
+ *           not visited.
  *
  *  @param   tree        Tree to optimize
  *  @param   node_cur    Node to optimize
  *
- *  @return  return 0 if optimized, else 1
+ *  @return  true if the node is changed or replaced, else false
  */
 
 bool Optimize (Tree<CalcNodeData>& tree, Node<CalcNodeData>* node_cur);
 
+//------------------------------------------------------------------------------
+/*! @brief   Optimize n-ary sum or product: move up operands of the same
+ *           operation, fold numbers and drop the neutral element.
+ *
+ *  @param   tree        Tree to optimize
+ *  @param   node_cur    N-ary node to optimize
+ *
+ *  @return  true if the node is changed or replaced, else false
+ */
+
+bool OptimizeArgs (Tree<CalcNodeData>& tree, Node<CalcNodeData>* node_cur);
+
+//------------------------------------------------------------------------------
+/*! @brief   Optimize again the nodes from the changed node up to the given
+ *           one, when a rule changes a node deep in its operand.
+ *
+ *  @param   tree        Tree to optimize
+ *  @param   node_cur    Lowest node of the path
+ *  @param   top         Node above the path, it is not optimized
+ */
+
+void OptimizePath (Tree<CalcNodeData>& tree, Node<CalcNodeData>* node_cur, Node<CalcNodeData>* top);
+
+//------------------------------------------------------------------------------
+/*! @brief   Find the pointer to the node in its parent or the tree root.
+ *
+ *  @param   tree        Tree of the node
+ *  @param   node_cur    Node
+ *
+ *  @return  pointer which the node is kept in
+ */
+
+Node<CalcNodeData>** getPlace (Tree<CalcNodeData>& tree, Node<CalcNodeData>* node_cur);
+
+//------------------------------------------------------------------------------
+/*! @brief   Find number factor which sign can be changed to change the sign of
+ *           the product or quotient.
+ *
+ *  @param   node        Product or quotient
+ *
+ *  @return  number node if found, else nullptr
+ */
+
+Node<CalcNodeData>* findFactor (Node<CalcNodeData>* node);
+
+//------------------------------------------------------------------------------
+/*! @brief   Turn binary sum or product into n-ary node with two operands.
+ *
+ *  @param   node_cur    Binary node
+ */
+
+void PackArgs (Node<CalcNodeData>* node_cur);
+
+//------------------------------------------------------------------------------
+/*! @brief   Get the bit of the variable in the sets of variables.
+ *
+ *  @param   symbol      Symbol id of the variable
+ *
+ *  @return  set with the variable
+ */
+
+SymbolSet SymbolBit (int symbol);
+
+//------------------------------------------------------------------------------
+/*! @brief   Count the variables and the size of every node of the subtree.
+ *
+ *  @note    Variables referencing the bindings are marked by VAR_BOUND and
+ *           depend on the variables of the bound value.
+ *
+ *  @param   node_cur    Root of the subtree
+ *
+ *  @return  variables of the subtree
+ */
+
+SymbolSet CountDepends (Node<CalcNodeData>* node_cur);
+
+//------------------------------------------------------------------------------
+/*! @brief   Check if subtree may depend on the variable.
+ *
+ *  @param   node        Root of the subtree
+ *  @param   symbol      Symbol id of the variable
+ *
+ *  @return  false if it surely does not, else true
+ */
+
+bool isDependent (const Node<CalcNodeData>* node, int symbol);
+
+//------------------------------------------------------------------------------
+/*! @brief   Check if the name of the binding is referenced in the subtree.
+ *
+ *  @param   node        Root of the subtree
+ *  @param   symbol      Symbol id of the name
+ *
+ *  @return  true if it is, else false
+ */
+
+bool isReferenced (const Node<CalcNodeData>* node, int symbol);
+
 //------------------------------------------------------------------------------
 /*! @brief   Check if value is POISON.
  *
@@ -450,7 +849,7 @@ bool isPOISON (NUM_TYPE value);
 void printExprGraph (Tree<CalcNodeData> tree);
 
 //------------------------------------------------------------------------------
-/*! @brief   Recursive print the contents of the tree like a graphviz dot file.
+/*! @brief   Print the contents of the subtree like a graphviz dot file.
  *
  *  @param   graph       Dump graphviz dot file
  *  @param   node_cur    Node to visualize
@@ -469,14 +868,50 @@ void printExprGraphNode (FILE* graph, Node<CalcNodeData>* node_cur);
 void getDataAndColor (Node<CalcNodeData>* node_cur, char** data, char** fillcolor);
 
 //------------------------------------------------------------------------------
-/*! @brief   Prints an expression indicating an error.
+/*! @brief   Prints a syntax error with the line of the expression indicating it.
+ *
+ *  @note    Error is written to the log by one call, so the errors of
+ *           different threads are not mixed. It is printed to the console
+ *           too, if expr.console is set.
+ *
+ *  @param   log         Log writer
+ *  @param   file        Name of the program file
+ *  @param   line        Number of line with an error
+ *  @param   function    Name of the function with an error
+ *  @param   err         Error code
+ *  @param   expr        Bad expression
+ *  @param   begin       Offset of string error in the expression
+ *  @param   len         Length of string error
+ */
+
+void PrintBadExpr (LogWriter& log, const char* file, int line, const char* function, int err,
+                   const Expression& expr, size_t begin, size_t len);
+
+//------------------------------------------------------------------------------
+/*! @brief   Write a line of the expression indicating an error to the buffer.
  *
- *  @param   logname     Name of the log file
  *  @param   expr        Bad expression
+ *  @param   begin       Offset of string error in the expression
  *  @param   len         Length of string error
+ *  @param   buf         Buffer of BAD_EXPR_BUFSIZE characters
+ *
+ *  @return  buf
  */
 
-void PrintBadExpr (const char* logname, const Expression& expr, size_t len);
+char* BadExprContext (const Expression& expr, size_t begin, size_t len, char* buf);
+
+//------------------------------------------------------------------------------
+/*! @brief   Write all collected errors of the expression to the log.
+ *
+ *  @param   log         Log writer
+ *  @param   expr        Bad expression
+ */
+
+void LogDiagnostics (LogWriter& log, const Expression& expr);
+
+//------------------------------------------------------------------------------
+
+extern LogWriter calc_log;
 
 //------------------------------------------------------------------------------
 
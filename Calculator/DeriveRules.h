@@ -0,0 +1,478 @@
+/*------------------------------------------------------------------------------
+    * File:        DeriveRules.h                                               *
+    * Description: Table of differentiation rules compiled at build time and  *
+    *              the interpreter applying them.                              *
+    * Created:     17 oct 2026                                                 *
+    * Author:      Artem Puzankov                                              *
+    * Email:       puzankov.ao@phystech.edu                                    *
+    * GitHub:      https://github.com/hellopuza                                *
+    * Copyright © 2021 Artem Puzankov. All rights reserved.                    *
+    *///------------------------------------------------------------------------
+
+#ifndef DERIVERULES_H_INCLUDED
+#define DERIVERULES_H_INCLUDED
+
+#include "Operations.h"
+
+
+/*------------------------------------------------------------------------------
+                   Rule constants and types                                    *
+*///----------------------------------------------------------------------------
+
+
+// Rules are written in the expression syntax with operands u and v and
+// their derivatives u' and v'. Every rule is compiled to a postfix program,
+// so applying it is one loop over a few steps with a small stack.
+
+enum RuleCodes
+{
+    RULE_END      = 0x00,
+    RULE_U        = 0x01,  // copy of the operand u
+    RULE_V        = 0x02,  // copy of the operand v
+    RULE_DU       = 0x03,  // derivative of u
+    RULE_DV       = 0x04,  // derivative of v
+    RULE_NUMBER   = 0x05,  // integer number
+    RULE_FUNCTION = 0x06,  // function of the top of the stack
+    RULE_OPERATOR = 0x07,  // operator of two top values of the stack
+    RULE_NEG      = 0x08,  // unary minus of the top of the stack
+};
+
+const int RULE_MAX_STEPS = 16;
+
+// Derivatives of the operands used by the rule
+const char RULE_USES_DU = 0x01;
+const char RULE_USES_DV = 0x02;
+
+// Indices of the rules in the table after the operation codes: unary minus
+// and the shorter rules for operands not depending on the variable
+enum RuleIndices
+{
+    RULE_UNARY_MINUS = OP_NUM,
+    RULE_MUL_CONST_U,          // u*v,  u is constant
+    RULE_MUL_CONST_V,          // u*v,  v is constant
+    RULE_DIV_CONST_U,          // u/v,  u is constant
+    RULE_DIV_CONST_V,          // u/v,  v is constant
+    RULE_POW_CONST_U,          // u^v,  u is constant
+    RULE_POW_CONST_V,          // u^v,  v is constant
+    RULE_INDEX_NUM,
+};
+
+struct RuleStep
+{
+    char  code    = RULE_END;
+    char  op_code = OP_ERR;
+    short number  = 0;
+};
+
+struct RuleProgram
+{
+    RuleStep steps[RULE_MAX_STEPS] = {};
+    int      size  = 0;
+    int      depth = 0;      // stack size needed
+    char     uses  = 0;      // RULE_USES_DU and RULE_USES_DV
+    bool     error = false;  // rule text is wrong
+};
+
+struct DeriveRule
+{
+    int         code = OP_ERR;
+    const char* text = nullptr;
+};
+
+// Functions have the operand u. For the binary operators u is the left and
+// v the right operand. N-ary sums and products are not in the table, their
+// derivatives have variable length. A rule may use u' and v' only once.
+
+constexpr DeriveRule derive_rules[] =
+{
+    { OP_ADD           , "u' + v'"                   },
+    { OP_SUB           , "u' - v'"                   },
+    { OP_MUL           , "u'*v + u*v'"               },
+    { OP_DIV           , "(u'*v - u*v')/v^2"         },
+    { OP_POW           , "u^v*(v'*ln(u) + v/u*u')"   },
+    { OP_ARCCOS        , "-u'/sqrt(1 - u^2)"         },
+    { OP_ARCCOSH       , "u'/sqrt(u^2 - 1)"          },
+    { OP_ARCCOT        , "-u'/(1 + u^2)"             },
+    { OP_ARCCOTH       , "u'/(1 - u^2)"              },
+    { OP_ARCSIN        , "u'/sqrt(1 - u^2)"          },
+    { OP_ARCSINH       , "u'/sqrt(1 + u^2)"          },
+    { OP_ARCTAN        , "u'/(1 + u^2)"              },
+    { OP_ARCTANH       , "u'/(1 - u^2)"              },
+    { OP_COS           , "-u'*sin(u)"                },
+    { OP_COSH          , "u'*sinh(u)"                },
+    { OP_COT           , "-u'/(sin(u)^2)"            },
+    { OP_COTH          , "-u'/(sinh(u)^2)"           },
+    { OP_EXP           , "u'*exp(u)"                 },
+    { OP_LG            , "u'/(u*ln(10))"             },
+    { OP_LN            , "u'/u"                      },
+    { OP_SIN           , "u'*cos(u)"                 },
+    { OP_SINH          , "u'*cosh(u)"                },
+    { OP_SQRT          , "u'/(2*sqrt(u))"            },
+    { OP_TAN           , "u'/(cos(u)^2)"             },
+    { OP_TANH          , "u'/(cosh(u)^2)"            },
+    { RULE_UNARY_MINUS , "-v'"                       },
+    { RULE_MUL_CONST_U , "u*v'"                      },
+    { RULE_MUL_CONST_V , "u'*v"                      },
+    { RULE_DIV_CONST_U , "-u*v'/v^2"                 },
+    { RULE_DIV_CONST_V , "u'/v"                      },
+    { RULE_POW_CONST_U , "u^v*ln(u)*v'"              },
+    { RULE_POW_CONST_V , "v*u^(v - 1)*u'"            },
+};
+
+const int RULE_NUM = sizeof(derive_rules) / sizeof(derive_rules[0]);
+
+struct RuleTable
+{
+    RuleProgram programs[RULE_INDEX_NUM] = {};
+    int         bad_rule = -1;  // index in derive_rules of the first wrong rule
+};
+
+/*------------------------------------------------------------------------------
+                   Rule compiler                                               *
+*///----------------------------------------------------------------------------
+
+
+struct RuleParser
+{
+    const char* text    = nullptr;
+    size_t      pos     = 0;
+    int         depth   = 0;
+    RuleProgram program = {};
+};
+
+constexpr void ParseRuleSum (RuleParser& parser);
+
+//------------------------------------------------------------------------------
+
+constexpr void SkipRuleSpaces (RuleParser& parser)
+{
+    while (parser.text[parser.pos] == ' ') ++parser.pos;
+}
+
+//------------------------------------------------------------------------------
+
+constexpr void AddRuleStep (RuleParser& parser, char code, char op_code = OP_ERR, int number = 0)
+{
+    if (parser.program.size == RULE_MAX_STEPS)
+    {
+        parser.program.error = true;
+        return;
+    }
+
+    parser.program.steps[parser.program.size++] = { code, op_code, (short)number };
+
+    // Derivative of an operand is built once, so a rule may take it once
+    char uses = (code == RULE_DU) ? RULE_USES_DU : (code == RULE_DV) ? RULE_USES_DV : 0;
+
+    if (parser.program.uses & uses) parser.program.error = true;
+    parser.program.uses |= uses;
+
+    // Operands push one value, functions and unary minus keep the size
+    if (code == RULE_OPERATOR) --parser.depth;
+    else
+    if ((code != RULE_FUNCTION) && (code != RULE_NEG)) ++parser.depth;
+
+    if (parser.depth > parser.program.depth) parser.program.depth = parser.depth;
+}
+
+//------------------------------------------------------------------------------
+
+constexpr char FindRuleFunction (const char* word, size_t len)
+{
+    for (int code = 0; code < OP_NUM; ++code)
+    {
+        if (not isFuncName(op_names[code].word) || (ConstStrLen(op_names[code].word) != len)) continue;
+
+        size_t i = 0;
+        while ((i < len) && (op_names[code].word[i] == word[i])) ++i;
+
+        if (i == len) return (char)code;
+    }
+
+    return OP_ERR;
+}
+
+//------------------------------------------------------------------------------
+
+constexpr void ParseRuleOperand (RuleParser& parser)
+{
+    SkipRuleSpaces(parser);
+
+    const char* cur = parser.text + parser.pos;
+
+    if (cur[0] == '(')
+    {
+        ++parser.pos;
+        ParseRuleSum(parser);
+
+        SkipRuleSpaces(parser);
+        if (parser.text[parser.pos] != ')') parser.program.error = true;
+        else ++parser.pos;
+
+        return;
+    }
+
+    if ((cur[0] >= '0') && (cur[0] <= '9'))
+    {
+        int number = 0;
+        while ((parser.text[parser.pos] >= '0') && (parser.text[parser.pos] <= '9'))
+            number = number * 10 + (parser.text[parser.pos++] - '0');
+
+        AddRuleStep(parser, RULE_NUMBER, OP_ERR, number);
+        return;
+    }
+
+    size_t len = 0;
+    while (isFuncName(cur + len)) ++len;
+
+    if ((len == 1) && ((cur[0] == 'u') || (cur[0] == 'v')))
+    {
+        bool derivative = (cur[1] == '\'');
+
+        if (cur[0] == 'u') AddRuleStep(parser, derivative ? RULE_DU : RULE_U);
+        else               AddRuleStep(parser, derivative ? RULE_DV : RULE_V);
+
+        parser.pos += derivative ? 2 : 1;
+        return;
+    }
+
+    char op_code = (len != 0) ? FindRuleFunction(cur, len) : (char)OP_ERR;
+
+    if ((op_code == OP_ERR) || (cur[len] != '('))
+    {
+        parser.program.error = true;
+        return;
+    }
+
+    parser.pos += len;
+    ParseRuleOperand(parser);
+
+    AddRuleStep(parser, RULE_FUNCTION, op_code);
+}
+
+//------------------------------------------------------------------------------
+
+constexpr void ParseRulePower (RuleParser& parser)
+{
+    ParseRuleOperand(parser);
+
+    SkipRuleSpaces(parser);
+    if (parser.text[parser.pos] != '^') return;
+
+    // Power is right associative
+    ++parser.pos;
+    ParseRulePower(parser);
+
+    AddRuleStep(parser, RULE_OPERATOR, OP_POW);
+}
+
+//------------------------------------------------------------------------------
+
+constexpr void ParseRuleProduct (RuleParser& parser)
+{
+    ParseRulePower(parser);
+
+    while (not parser.program.error)
+    {
+        SkipRuleSpaces(parser);
+
+        char op = parser.text[parser.pos];
+        if ((op != '*') && (op != '/')) return;
+
+        ++parser.pos;
+        ParseRulePower(parser);
+
+        AddRuleStep(parser, RULE_OPERATOR, (op == '*') ? OP_MUL : OP_DIV);
+    }
+}
+
+//------------------------------------------------------------------------------
+
+constexpr void ParseRuleSum (RuleParser& parser)
+{
+    SkipRuleSpaces(parser);
+
+    // Unary minus takes the whole first term: -u'/v is -(u'/v)
+    bool minus = (parser.text[parser.pos] == '-');
+    if (minus) ++parser.pos;
+
+    ParseRuleProduct(parser);
+
+    if (minus) AddRuleStep(parser, RULE_NEG);
+
+    while (not parser.program.error)
+    {
+        SkipRuleSpaces(parser);
+
+        char op = parser.text[parser.pos];
+        if ((op != '+') && (op != '-')) return;
+
+        ++parser.pos;
+        ParseRuleProduct(parser);
+
+        AddRuleStep(parser, RULE_OPERATOR, (op == '+') ? OP_ADD : OP_SUB);
+    }
+}
+
+//------------------------------------------------------------------------------
+
+constexpr RuleProgram CompileRule (const char* text)
+{
+    RuleParser parser = {};
+    parser.text = text;
+
+    ParseRuleSum(parser);
+
+    SkipRuleSpaces(parser);
+    if (parser.text[parser.pos] != '\0') parser.program.error = true;
+
+    return parser.program;
+}
+
+//------------------------------------------------------------------------------
+
+constexpr RuleTable MakeRuleTable ()
+{
+    RuleTable table = {};
+
+    for (int rule = 0; rule < RULE_NUM; ++rule)
+    {
+        RuleProgram& program = table.programs[derive_rules[rule].code];
+
+        if (program.size != 0)
+        {
+            table.bad_rule = rule;
+            return table;
+        }
+
+        program = CompileRule(derive_rules[rule].text);
+
+        if (program.error || (program.size == 0) || (program.depth >= RULE_MAX_STEPS))
+        {
+            table.bad_rule = rule;
+            return table;
+        }
+    }
+
+    for (int code = OP_ERR + 1; code < RULE_INDEX_NUM; ++code)
+        if (table.programs[code].size == 0) table.bad_rule = RULE_NUM;
+
+    return table;
+}
+
+inline constexpr RuleTable rule_table = MakeRuleTable();
+
+static_assert(rule_table.bad_rule != RULE_NUM, "every operation must have its derivative rule");
+static_assert(rule_table.bad_rule == -1, "wrong or repeated rule in derive_rules");
+
+//------------------------------------------------------------------------------
+/*! @brief   Choose the rule of the binary operator by its constant operands.
+ *
+ *  @param   op_code     Operator code
+ *  @param   u_const     Left operand does not depend on the variable
+ *  @param   v_const     Right operand does not depend on the variable
+ *
+ *  @return  index of the rule in the table
+ */
+
+constexpr int SelectRule (int op_code, bool u_const, bool v_const)
+{
+    switch (op_code)
+    {
+    case OP_MUL:
+
+        if (u_const) return RULE_MUL_CONST_U;
+        if (v_const) return RULE_MUL_CONST_V;
+        break;
+
+    case OP_DIV:
+
+        if (v_const) return RULE_DIV_CONST_V;
+        if (u_const) return RULE_DIV_CONST_U;
+        break;
+
+    case OP_POW:
+
+        if (v_const) return RULE_POW_CONST_V;
+        if (u_const) return RULE_POW_CONST_U;
+        break;
+    }
+
+    return op_code;
+}
+
+/*------------------------------------------------------------------------------
+                   Rule interpreter                                            *
+*///----------------------------------------------------------------------------
+
+
+//------------------------------------------------------------------------------
+/*! @brief   Build derivative by the rule of the operation.
+ *
+ *  @note    Builder makes the nodes of one engine: Operand(code) gives u, v,
+ *           u' or v', then Number, Function, Operator and Negate build the
+ *           new nodes from the values of the stack.
+ *
+ *  @param   code        Operation code or index of the rule after them
+ *  @param   builder     Node builder
+ *
+ *  @return  derivative built by the builder
+ */
+
+template <typename BUILDER>
+auto ApplyRule (int code, BUILDER& builder) -> decltype(builder.Number(0))
+{
+    assert((code > OP_ERR) && (code < RULE_INDEX_NUM));
+
+    const RuleProgram& program = rule_table.programs[code];
+
+    decltype(builder.Number(0)) stack[RULE_MAX_STEPS] = {};
+    int top = 0;
+
+    for (int i = 0; i < program.size; ++i)
+    {
+        const RuleStep& step = program.steps[i];
+
+        switch (step.code)
+        {
+        case RULE_U:
+        case RULE_V:
+        case RULE_DU:
+        case RULE_DV:
+
+            stack[top++] = builder.Operand(step.code);
+            break;
+
+        case RULE_NUMBER:
+
+            stack[top++] = builder.Number(step.number);
+            break;
+
+        case RULE_FUNCTION:
+
+            stack[top - 1] = builder.Function(step.op_code, stack[top - 1]);
+            break;
+
+        case RULE_OPERATOR:
+
+            --top;
+            stack[top - 1] = builder.Operator(step.op_code, stack[top - 1], stack[top]);
+            break;
+
+        case RULE_NEG:
+
+            stack[top - 1] = builder.Negate(stack[top - 1]);
+            break;
+
+        default: assert(0);
+        }
+    }
+
+    assert(top == 1);
+
+    return stack[0];
+}
+
+//------------------------------------------------------------------------------
+
+#endif // DERIVERULES_H_INCLUDED
@@ -0,0 +1,1149 @@
+/*------------------------------------------------------------------------------
+    * File:        ExprDag.cpp                                                 *
+    * Description: Functions of the hash-consed expression graph and its      *
+    *              differentiation.                                            *
+    * Created:     17 oct 2026                                                 *
+    * Author:      Artem Puzankov                                              *
+    * Email:       puzankov.ao@phystech.edu                                    *
+    * GitHub:      https://github.com/hellopuza                                *
+    * Copyright © 2021 Artem Puzankov. All rights reserved.                    *
+    *///------------------------------------------------------------------------
+
+#include "ExprDag.h"
+
+//------------------------------------------------------------------------------
+
+ExprDag::ExprDag () :
+    state_ (CALC_OK),
+    table_ (DAG_TABLE_SIZE, DAG_NONE)
+{}
+
+//------------------------------------------------------------------------------
+
+ExprDag::~ExprDag ()
+{
+    state_ = CALC_DESTRUCTED;
+}
+
+//------------------------------------------------------------------------------
+
+size_t ExprDag::getSize () const
+{
+    return nodes_.size();
+}
+
+//------------------------------------------------------------------------------
+
+int ExprDag::Number (NUM_TYPE number)
+{
+    DagNode node = {};
+    node.node_type = NODE_NUMBER;
+    node.number    = number;
+
+    return Insert(node, nullptr);
+}
+
+//------------------------------------------------------------------------------
+
+int ExprDag::Variable (int symbol)
+{
+    assert(symbol != NO_SYMBOL);
+
+    DagNode node = {};
+    node.node_type = NODE_VARIABLE;
+    node.symbol    = symbol;
+
+    return Insert(node, nullptr);
+}
+
+//------------------------------------------------------------------------------
+
+int ExprDag::Function (char op_code, int arg)
+{
+    assert((size_t)arg < nodes_.size());
+
+    DagNode node = {};
+    node.node_type = NODE_FUNCTION;
+    node.op_code   = op_code;
+    node.right     = arg;
+
+    return Insert(node, nullptr);
+}
+
+//------------------------------------------------------------------------------
+
+int ExprDag::Operator (char op_code, int left, int right)
+{
+    assert((size_t)right < nodes_.size());
+
+    const DagNode& r = nodes_[right];
+
+    switch (op_code)
+    {
+    case OP_ADD:
+    case OP_MUL:
+    {
+        int args[] = { left, right };
+        return Args(op_code, args, 2);
+    }
+    case OP_SUB:
+    {
+        if (left != DAG_NONE)
+        {
+            int args[] = { left, Operator(OP_SUB, DAG_NONE, right) };
+            return Args(OP_ADD, args, 2);
+        }
+
+        if (r.node_type == NODE_NUMBER) return Number(-r.number);
+
+        // -(-u) = u
+        if ((r.node_type == NODE_OPERATOR) && (r.op_code == OP_SUB) && (r.left == DAG_NONE))
+            return r.right;
+
+        // -(u + v) = -u - v, so equal terms of the outer sum cancel
+        if ((r.node_type == NODE_OPERATOR) && (r.op_code == OP_ADD) && (r.args_num != 0))
+        {
+            std::vector<int> args(args_.begin() + r.left, args_.begin() + r.left + r.args_num);
+
+            for (size_t i = 0; i < args.size(); ++i) args[i] = Operator(OP_SUB, DAG_NONE, args[i]);
+
+            return Args(OP_ADD, args.data(), args.size());
+        }
+
+        // -(c*u) = (-c)*u, -(c/u) = (-c)/u
+        int negated = NegateFactor(right);
+        if (negated != DAG_NONE) return negated;
+        break;
+    }
+    case OP_DIV:
+    {
+        const DagNode& l = nodes_[left];
+
+        if ((l.node_type == NODE_NUMBER) && (abs(l.number) <= NIL)) return left;
+
+        if ((r.node_type == NODE_NUMBER) && (abs(r.number - static_cast<NUM_TYPE>(1)) <= NIL)) return left;
+
+        if (left == right) return Number(1);
+
+        // Equal factors of numerator and denominator are cancelled
+        std::vector<DagFactor> factors;
+        NUM_TYPE numer = 1;
+        NUM_TYPE denom = 1;
+
+        Factorize(left,  false, factors, numer, denom);
+        Factorize(right, true,  factors, numer, denom);
+
+        if (hasEqualBases(factors)) return Product(factors, numer, denom);
+        break;
+    }
+    case OP_POW:
+    {
+        if (r.node_type != NODE_NUMBER) break;
+
+        if (abs(r.number) <= NIL) return Number(1);
+
+        if (abs(r.number - static_cast<NUM_TYPE>(1)) <= NIL) return left;
+
+        // (u^a)^n = u^(a*n) for integer n
+        const DagNode& l = nodes_[left];
+
+        bool integer = (abs(imag(r.number)) <= NIL) && (abs(real(r.number) - round(real(r.number))) <= NIL);
+
+        if (integer && (l.node_type == NODE_OPERATOR) && (l.op_code == OP_POW) && (nodes_[l.right].node_type == NODE_NUMBER))
+        {
+            // Number may move the nodes, so l and r are not used after it
+            int      base     = l.left;
+            NUM_TYPE exponent = nodes_[l.right].number * r.number;
+
+            return Operator(OP_POW, base, Number(exponent));
+        }
+        break;
+    }
+
+    default: assert(0);
+    }
+
+    DagNode node = {};
+    node.node_type = NODE_OPERATOR;
+    node.op_code   = op_code;
+    node.left      = left;
+    node.right     = right;
+
+    return Insert(node, nullptr);
+}
+
+//------------------------------------------------------------------------------
+
+int ExprDag::Args (char op_code, const int* args, size_t num)
+{
+    assert((op_code == OP_ADD) || (op_code == OP_MUL));
+    assert(args != nullptr);
+
+    NUM_TYPE neutral = (op_code == OP_MUL) ? 1 : 0;
+    NUM_TYPE folded  = neutral;
+
+    std::vector<int> flat;
+    size_t first_number = -1;
+
+    for (size_t i = 0; i < num; ++i)
+    {
+        const DagNode& arg = nodes_[args[i]];
+
+        // Operands of the same operation are already flat and folded
+        const int* inner     = args + i;
+        size_t     inner_num = 1;
+
+        if ((arg.node_type == NODE_OPERATOR) && (arg.op_code == op_code) && (arg.args_num != 0))
+        {
+            inner     = args_.data() + arg.left;
+            inner_num = arg.args_num;
+        }
+
+        for (size_t j = 0; j < inner_num; ++j)
+        {
+            const DagNode& operand = nodes_[inner[j]];
+
+            // (-u)*v = -(u*v), the sign goes to the number factor
+            if ((op_code == OP_MUL) && (operand.node_type == NODE_OPERATOR) && (operand.op_code == OP_SUB) && (operand.left == DAG_NONE))
+            {
+                if (first_number == (size_t)-1) first_number = flat.size();
+
+                folded = -folded;
+                flat.push_back(operand.right);
+            }
+            else
+            if (nodes_[inner[j]].node_type == NODE_NUMBER)
+            {
+                if (first_number == (size_t)-1) first_number = flat.size();
+
+                folded = CalcOperator(op_code, folded, nodes_[inner[j]].number);
+            }
+            else flat.push_back(inner[j]);
+        }
+    }
+
+    if ((op_code == OP_MUL) && (abs(folded) <= NIL)) return Number(0);
+
+    if (flat.empty()) return Number(folded);
+
+    if (op_code == OP_MUL)
+    {
+        // u^a*u^b = u^(a+b), factors of quotients take part too
+        std::vector<DagFactor> factors;
+        NUM_TYPE numer = folded;
+        NUM_TYPE denom = 1;
+
+        for (size_t i = 0; i < flat.size(); ++i) Factorize(flat[i], false, factors, numer, denom);
+
+        if (hasEqualBases(factors)) return Product(factors, numer, denom);
+    }
+    else
+    {
+        // a*u + b*u = (a + b)*u
+        std::vector<DagFactor> terms(flat.size());
+        for (size_t i = 0; i < flat.size(); ++i)
+        {
+            terms[i].exponent = 1;
+            terms[i].base     = SplitCoefficient(flat[i], terms[i].exponent);
+        }
+
+        if (hasEqualBases(terms)) return Sum(terms, folded);
+    }
+
+    if ((op_code == OP_MUL) && (abs(folded + neutral) <= NIL))
+    {
+        int product = (flat.size() == 1) ? flat[0] : Args(OP_MUL, flat.data(), flat.size());
+
+        DagNode node = {};
+        node.node_type = NODE_OPERATOR;
+        node.op_code   = OP_SUB;
+        node.right     = product;
+
+        return Insert(node, nullptr);
+    }
+
+    // Factors are kept in the order of the nodes, so u*v and v*u are one
+    // node and the terms made of them are merged by the sums
+    if (op_code == OP_MUL)
+    {
+        std::sort(flat.begin(), flat.end());
+        first_number = 0;
+    }
+
+    if (abs(folded - neutral) > NIL)
+        flat.insert(flat.begin() + first_number, Number(folded));
+
+    if (flat.size() == 1) return flat[0];
+
+    DagNode node = {};
+    node.node_type = NODE_OPERATOR;
+    node.op_code   = op_code;
+    node.args_num  = flat.size();
+
+    return Insert(node, flat.data());
+}
+
+//------------------------------------------------------------------------------
+
+// Node builder of the rule interpreter, operands and their derivatives are
+// shared nodes of the graph, so nothing is copied
+
+struct DagRuleBuilder
+{
+    ExprDag* dag = nullptr;
+
+    int u  = DAG_NONE;
+    int v  = DAG_NONE;
+    int du = DAG_NONE;
+    int dv = DAG_NONE;
+
+    int Operand (char code)
+    {
+        switch (code)
+        {
+        case RULE_U:  return u;
+        case RULE_V:  return v;
+        case RULE_DU: return du;
+        case RULE_DV: return dv;
+        default: assert(0);
+        }
+
+        return DAG_NONE;
+    }
+
+    int Number   (int number)                     { return dag->Number(number);                }
+    int Function (char op_code, int arg)          { return dag->Function(op_code, arg);        }
+    int Operator (char op_code, int l, int r)     { return dag->Operator(op_code, l, r);       }
+    int Negate   (int arg)                        { return dag->Operator(OP_SUB, DAG_NONE, arg); }
+};
+
+//------------------------------------------------------------------------------
+
+int ExprDag::Derivative (int root, int symbol)
+{
+    assert((size_t)root < nodes_.size());
+
+    // Children precede parents, so one pass in index order differentiates
+    // every node reachable from the root after its operands
+    std::vector<char> used;
+    Reachable(root, used);
+
+    std::vector<int> derivs(root + 1, DAG_NONE);
+
+    int zero = Number(0);
+    int one  = Number(1);
+
+    for (int i = 0; i <= root; ++i)
+    {
+        if (!used[i]) continue;
+
+        // nodes_ may grow below, so the node is copied
+        DagNode node = nodes_[i];
+
+        int u  = node.right;
+        int du = (u != DAG_NONE) ? derivs[u] : DAG_NONE;
+
+        int result = DAG_NONE;
+
+        DagRuleBuilder builder = { this };
+
+        switch (node.node_type)
+        {
+        case NODE_NUMBER:
+
+            result = zero;
+            break;
+
+        case NODE_VARIABLE:
+
+            result = (node.symbol == symbol) ? one : zero;
+            break;
+
+        case NODE_OPERATOR:
+
+            if (node.args_num != 0)
+            {
+                std::vector<int> args(args_.begin() + node.left, args_.begin() + node.left + node.args_num);
+                std::vector<int> terms;
+
+                if (node.op_code == OP_ADD)      // u1' + u2' + ... + un'
+                {
+                    for (size_t j = 0; j < args.size(); ++j) terms.push_back(derivs[args[j]]);
+                }
+                else                             // u1'*u2*...*un + ... + u1*u2*...*un'
+                {
+                    for (size_t j = 0; j < args.size(); ++j)
+                    {
+                        int arg = args[j];
+
+                        args[j] = derivs[arg];
+                        terms.push_back(Args(OP_MUL, args.data(), args.size()));
+                        args[j] = arg;
+                    }
+                }
+
+                result = Args(OP_ADD, terms.data(), terms.size());
+                break;
+            }
+
+            builder.u  = node.left;
+            builder.v  = node.right;
+            builder.du = (node.left != DAG_NONE) ? derivs[node.left] : DAG_NONE;
+            builder.dv = du;
+
+            if (node.left == DAG_NONE)
+            {
+                result = ApplyRule(RULE_UNARY_MINUS, builder);
+                break;
+            }
+
+            // Operands with zero derivative have shorter rules
+            result = ApplyRule(SelectRule(node.op_code, builder.du == zero, builder.dv == zero), builder);
+            break;
+
+        case NODE_FUNCTION:
+
+            builder.u  = u;
+            builder.du = du;
+
+            result = ApplyRule(node.op_code, builder);
+            break;
+
+        default: assert(0);
+        }
+
+        derivs[i] = result;
+    }
+
+    return derivs[root];
+}
+
+//------------------------------------------------------------------------------
+
+size_t ExprDag::CountNodes (int root, size_t& tree_size) const
+{
+    assert((size_t)root < nodes_.size());
+
+    std::vector<char> used;
+    Reachable(root, used);
+
+    // Operands precede the node, so their tree sizes are already known
+    std::vector<size_t> sizes(root + 1);
+    size_t              count = 0;
+
+    for (int i = 0; i <= root; ++i)
+    {
+        if (!used[i]) continue;
+
+        const DagNode& node = nodes_[i];
+
+        sizes[i] = 1;
+        if (node.args_num != 0)
+            for (int j = 0; j < node.args_num; ++j) sizes[i] += sizes[args_[node.left + j]];
+        else
+        {
+            if (node.left  != DAG_NONE) sizes[i] += sizes[node.left];
+            if (node.right != DAG_NONE) sizes[i] += sizes[node.right];
+        }
+
+        ++count;
+    }
+
+    tree_size = sizes[root];
+
+    return count;
+}
+
+//------------------------------------------------------------------------------
+
+void ExprDag::Reachable (int root, std::vector<char>& used) const
+{
+    used.assign(root + 1, 0);
+    used[root] = 1;
+
+    for (int i = root; i >= 0; --i)
+    {
+        if (!used[i]) continue;
+
+        const DagNode& node = nodes_[i];
+
+        if (node.args_num != 0)
+            for (int j = 0; j < node.args_num; ++j) used[args_[node.left + j]] = 1;
+        else
+        {
+            if (node.left  != DAG_NONE) used[node.left]  = 1;
+            if (node.right != DAG_NONE) used[node.right] = 1;
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+
+int ExprDag::NegateFactor (int index)
+{
+    DagNode node = nodes_[index];
+
+    if (node.node_type == NODE_NUMBER) return Number(-node.number);
+
+    if (node.node_type != NODE_OPERATOR) return DAG_NONE;
+
+    if ((node.op_code == OP_MUL) && (node.args_num != 0))
+    {
+        std::vector<int> args(args_.begin() + node.left, args_.begin() + node.left + node.args_num);
+
+        size_t factor = 0;
+        for (size_t i = 0; i < args.size(); ++i)
+            if (nodes_[args[i]].node_type == NODE_NUMBER)
+            {
+                factor = i;
+                break;
+            }
+
+        int negated = NegateFactor(args[factor]);
+        if (negated == DAG_NONE) return DAG_NONE;
+
+        args[factor] = negated;
+        return Args(OP_MUL, args.data(), args.size());
+    }
+
+    if (node.op_code == OP_DIV)
+    {
+        int negated = NegateFactor(node.left);
+        if (negated == DAG_NONE) return DAG_NONE;
+
+        return Operator(OP_DIV, negated, node.right);
+    }
+
+    return DAG_NONE;
+}
+
+//------------------------------------------------------------------------------
+
+void ExprDag::Factorize (int index, bool denominator, std::vector<DagFactor>& factors, NUM_TYPE& numer, NUM_TYPE& denom)
+{
+    const DagNode& node = nodes_[index];
+
+    if (node.node_type == NODE_NUMBER)
+    {
+        // Numbers of numerator and denominator are kept apart, so 1/3 is not
+        // turned into a rounded decimal
+        if (denominator) denom *= node.number;
+        else             numer *= node.number;
+        return;
+    }
+
+    if (node.node_type == NODE_OPERATOR)
+    {
+        if ((node.op_code == OP_MUL) && (node.args_num != 0))
+        {
+            for (int i = 0; i < node.args_num; ++i) Factorize(args_[node.left + i], denominator, factors, numer, denom);
+            return;
+        }
+
+        if (node.op_code == OP_DIV)
+        {
+            int left = node.left, right = node.right;
+
+            Factorize(left,  denominator,     factors, numer, denom);
+            Factorize(right, not denominator, factors, numer, denom);
+            return;
+        }
+
+        if ((node.op_code == OP_SUB) && (node.left == DAG_NONE))
+        {
+            numer = -numer;
+            Factorize(node.right, denominator, factors, numer, denom);
+            return;
+        }
+
+        if ((node.op_code == OP_POW) && (nodes_[node.right].node_type == NODE_NUMBER))
+        {
+            NUM_TYPE exponent = nodes_[node.right].number;
+
+            factors.push_back({ node.left, denominator ? -exponent : exponent });
+            return;
+        }
+    }
+
+    factors.push_back({ index, denominator ? NUM_TYPE(-1) : NUM_TYPE(1) });
+}
+
+//------------------------------------------------------------------------------
+
+int ExprDag::Product (std::vector<DagFactor>& factors, NUM_TYPE numer, NUM_TYPE denom)
+{
+    MergeBases(factors);
+
+    std::vector<int> top;
+    std::vector<int> bottom;
+
+    if (abs(numer - static_cast<NUM_TYPE>(1)) > NIL) top.push_back(Number(numer));
+    if (abs(denom - static_cast<NUM_TYPE>(1)) > NIL) bottom.push_back(Number(denom));
+
+    for (size_t i = 0; i < factors.size(); ++i)
+    {
+        NUM_TYPE exponent = factors[i].exponent;
+
+        if (abs(exponent) <= NIL) continue;
+
+        bool below = (real(exponent) < 0) && (abs(imag(exponent)) <= NIL);
+        if  (below) exponent = -exponent;
+
+        int factor = Operator(OP_POW, factors[i].base, Number(exponent));
+
+        if (below) bottom.push_back(factor);
+        else       top.push_back(factor);
+    }
+
+    int result = top.empty() ? Number(1) : Args(OP_MUL, top.data(), top.size());
+
+    if (bottom.empty()) return result;
+
+    return Operator(OP_DIV, result, Args(OP_MUL, bottom.data(), bottom.size()));
+}
+
+//------------------------------------------------------------------------------
+
+int ExprDag::Sum (std::vector<DagFactor>& terms, NUM_TYPE folded)
+{
+    MergeBases(terms);
+
+    std::vector<int> args;
+
+    if (abs(folded) > NIL) args.push_back(Number(folded));
+
+    for (size_t i = 0; i < terms.size(); ++i)
+    {
+        NUM_TYPE coef = terms[i].exponent;
+
+        if (abs(coef) <= NIL) continue;
+
+        if (abs(coef - static_cast<NUM_TYPE>(1)) <= NIL)
+            args.push_back(terms[i].base);
+
+        else if (abs(coef + static_cast<NUM_TYPE>(1)) <= NIL)
+            args.push_back(Operator(OP_SUB, DAG_NONE, terms[i].base));
+
+        else
+        {
+            int factors[] = { Number(coef), terms[i].base };
+            args.push_back(Args(OP_MUL, factors, 2));
+        }
+    }
+
+    if (args.empty()) return Number(0);
+
+    return Args(OP_ADD, args.data(), args.size());
+}
+
+//------------------------------------------------------------------------------
+
+int ExprDag::SplitCoefficient (int index, NUM_TYPE& coef)
+{
+    DagNode node = nodes_[index];
+
+    if (node.node_type != NODE_OPERATOR) return index;
+
+    if ((node.op_code == OP_SUB) && (node.left == DAG_NONE))
+    {
+        coef = -coef;
+        return SplitCoefficient(node.right, coef);
+    }
+
+    if (node.op_code == OP_DIV)
+    {
+        NUM_TYPE numer = 1;
+        int      left  = SplitCoefficient(node.left, numer);
+
+        if (left == node.left) return index;
+
+        coef *= numer;
+        return Operator(OP_DIV, left, node.right);
+    }
+
+    if ((node.op_code == OP_MUL) && (node.args_num != 0))
+    {
+        std::vector<int> args(args_.begin() + node.left, args_.begin() + node.left + node.args_num);
+
+        for (size_t i = 0; i < args.size(); ++i)
+            if (nodes_[args[i]].node_type == NODE_NUMBER)
+            {
+                coef *= nodes_[args[i]].number;
+                args.erase(args.begin() + i);
+
+                return Args(OP_MUL, args.data(), args.size());
+            }
+    }
+
+    return index;
+}
+
+//------------------------------------------------------------------------------
+
+int ExprDag::Insert (const DagNode& node, const int* args)
+{
+    size_t mask = table_.size() - 1;
+    size_t slot = DagHash(node, args) & mask;
+
+    while (table_[slot] != DAG_NONE)
+    {
+        if (isEqual(table_[slot], node, args)) return table_[slot];
+
+        slot = (slot + 1) & mask;
+    }
+
+    int index = nodes_.size();
+
+    nodes_.push_back(node);
+
+    if (node.args_num != 0)
+    {
+        nodes_.back().left = args_.size();
+        args_.insert(args_.end(), args, args + node.args_num);
+    }
+
+    table_[slot] = index;
+
+    if (2 * ++table_used_ > table_.size()) Rehash();
+
+    return index;
+}
+
+//------------------------------------------------------------------------------
+
+bool ExprDag::isEqual (int index, const DagNode& node, const int* args) const
+{
+    const DagNode& cur = nodes_[index];
+
+    if ((cur.node_type != node.node_type) || (cur.op_code  != node.op_code) ||
+        (cur.symbol    != node.symbol)    || (cur.args_num != node.args_num))
+        return false;
+
+    if (memcmp(&cur.number, &node.number, sizeof(NUM_TYPE)) != 0) return false;
+
+    if (node.args_num != 0)
+        return memcmp(args_.data() + cur.left, args, node.args_num * sizeof(int)) == 0;
+
+    return (cur.left == node.left) && (cur.right == node.right);
+}
+
+//------------------------------------------------------------------------------
+
+void ExprDag::Rehash ()
+{
+    table_.assign(2 * table_.size(), DAG_NONE);
+
+    size_t mask = table_.size() - 1;
+
+    for (size_t index = 0; index < nodes_.size(); ++index)
+    {
+        const DagNode& node = nodes_[index];
+        const int*     args = (node.args_num != 0) ? args_.data() + node.left : nullptr;
+
+        size_t slot = DagHash(node, args) & mask;
+        while (table_[slot] != DAG_NONE) slot = (slot + 1) & mask;
+
+        table_[slot] = index;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+size_t DagHash (const DagNode& node, const int* args)
+{
+    uint64_t hash = 14695981039346656037ull;
+
+    #define HASH_WORD(word)                                 \
+            {                                               \
+                hash = (hash ^ (uint64_t)(word)) * 1099511628211ull; \
+            } //
+
+    HASH_WORD(node.node_type);
+    HASH_WORD(node.op_code);
+    HASH_WORD(node.symbol);
+
+    uint64_t bits[2] = {};
+    memcpy(bits, &node.number, sizeof(bits));
+
+    HASH_WORD(bits[0]);
+    HASH_WORD(bits[1]);
+
+    if (node.args_num != 0)
+    {
+        for (int i = 0; i < node.args_num; ++i) HASH_WORD(args[i]);
+    }
+    else
+    {
+        HASH_WORD(node.left);
+        HASH_WORD(node.right);
+    }
+
+    #undef HASH_WORD
+
+    return hash ^ (hash >> 32);
+}
+
+//------------------------------------------------------------------------------
+
+int Tree2Dag (const Tree<CalcNodeData>& tree, ExprDag& dag)
+{
+    assert(tree.root_ != nullptr);
+
+    // Tree is only read, so prev_ pointers are not used and several threads
+    // may add the same tree. Work stack holds the nodes, marked once their
+    // operands are pushed. Children are walked right, left, then args_ in
+    // order, the same as in Tree2Bin. References to the bindings are the
+    // indices of their values, the graph shares them anyway.
+    std::vector<std::pair<const Node<CalcNodeData>*, bool>> work = { { tree.root_, false } };
+    std::vector<int> children;   // indices of the added subtrees not yet taken by parent
+
+    std::vector<std::pair<const Node<CalcNodeData>*, int>> scope;   // bindings and indices of their values
+
+    while (!work.empty())
+    {
+        const Node<CalcNodeData>* node_cur = work.back().first;
+
+        if (not work.back().second)
+        {
+            work.back().second = true;
+
+            if (node_cur->args_num_ != 0)
+            {
+                for (size_t i = node_cur->args_num_; i-- > 0; ) work.push_back({ node_cur->args_[i], false });
+            }
+            else
+            if (node_cur->getData().node_type == NODE_LET)
+            {
+                // Value, then the binding is put to the scope, then the body
+                work.push_back({ node_cur->left_,  false });
+                work.push_back({ node_cur,         true  });
+                work.push_back({ node_cur->right_, false });
+            }
+            else
+            {
+                if (node_cur->left_  != nullptr) work.push_back({ node_cur->left_,  false });
+                if (node_cur->right_ != nullptr) work.push_back({ node_cur->right_, false });
+            }
+            continue;
+        }
+
+        work.pop_back();
+
+        const CalcNodeData& data = node_cur->getData();
+
+        int index = DAG_NONE;
+
+        switch (data.node_type)
+        {
+        case NODE_NUMBER:
+
+            index = dag.Number(data.number);
+            break;
+
+        case NODE_VARIABLE:
+        {
+            int symbol = (data.symbol != NO_SYMBOL) ? data.symbol : symbols.Intern(data.word);
+
+            size_t bound = scope.size();
+            while ((bound > 0) && (scope[bound - 1].first->getData().symbol != symbol)) --bound;
+
+            index = (bound > 0) ? scope[bound - 1].second : dag.Variable(symbol);
+            break;
+        }
+        case NODE_LET:
+
+            // Binding is met twice after its operands are pushed: after
+            // the value and after the body
+            if (scope.empty() || (scope.back().first != node_cur))
+            {
+                scope.push_back({ node_cur, children.back() });
+                children.pop_back();
+                continue;
+            }
+
+            scope.pop_back();
+
+            index = children.back();
+            children.pop_back();
+            break;
+
+        case NODE_FUNCTION:
+
+            index = dag.Function(data.op_code, children.back());
+            children.pop_back();
+            break;
+
+        case NODE_OPERATOR:
+        {
+            if (node_cur->args_num_ != 0)
+            {
+                index = dag.Args(data.op_code, children.data() + children.size() - node_cur->args_num_, node_cur->args_num_);
+                children.resize(children.size() - node_cur->args_num_);
+                break;
+            }
+
+            int left = DAG_NONE;
+            if (node_cur->left_ != nullptr)
+            {
+                left = children.back();
+                children.pop_back();
+            }
+
+            index = dag.Operator(data.op_code, left, children.back());
+            children.pop_back();
+            break;
+        }
+        default: assert(0);
+        }
+
+        children.push_back(index);
+    }
+
+    return children.back();
+}
+
+//------------------------------------------------------------------------------
+
+int Dag2Tree (const ExprDag& dag, int root, Tree<CalcNodeData>& tree)
+{
+    assert((size_t)root < dag.getSize());
+
+    // Nodes used twice or more are bound to names instead of being copied,
+    // the short ones are cheaper to repeat. Operands precede the node, so
+    // the sizes of the subtrees (capped by DAG_LET_SIZE) are known and the
+    // bindings are in order of their indices.
+    std::vector<size_t> uses (root + 1, 0);
+    std::vector<size_t> sizes(root + 1, 0);
+    std::vector<int>    names(root + 1, NO_SYMBOL);
+
+    std::vector<char> taken;     // symbols of the variables of the expression
+    uses[root] = 1;
+
+    for (int i = root; i >= 0; --i)
+    {
+        if (uses[i] == 0) continue;
+
+        const DagNode& node = dag.nodes_[i];
+
+        if (node.args_num != 0)
+            for (int j = 0; j < node.args_num; ++j) ++uses[dag.args_[node.left + j]];
+        else
+        {
+            if (node.left  != DAG_NONE) ++uses[node.left];
+            if (node.right != DAG_NONE) ++uses[node.right];
+        }
+
+        if (node.node_type == NODE_VARIABLE)
+        {
+            if ((size_t)node.symbol >= taken.size()) taken.resize(node.symbol + 1, 0);
+            taken[node.symbol] = 1;
+        }
+    }
+
+    std::vector<int> bindings;
+    char             name[32] = "";
+    size_t           num      = 0;
+
+    for (int i = 0; i <= root; ++i)
+    {
+        if (uses[i] == 0) continue;
+
+        const DagNode& node = dag.nodes_[i];
+
+        sizes[i] = 1;
+        if (node.args_num != 0)
+            for (int j = 0; j < node.args_num; ++j) sizes[i] += sizes[dag.args_[node.left + j]];
+        else
+        {
+            if (node.left  != DAG_NONE) sizes[i] += sizes[node.left];
+            if (node.right != DAG_NONE) sizes[i] += sizes[node.right];
+        }
+
+        sizes[i] = std::min(sizes[i], DAG_LET_SIZE);
+
+        if ((uses[i] < 2) || (sizes[i] < DAG_LET_SIZE) || (i == root)) continue;
+
+        // Full symbol table leaves the rest of the nodes copied
+        int symbol = NO_SYMBOL;
+        do
+        {
+            sprintf(name, "%s%zu", DAG_LET_PREFIX, ++num);
+            symbol = symbols.Intern(name);
+        }
+        while ((symbol != NO_SYMBOL) && ((size_t)symbol < taken.size()) && taken[symbol]);
+
+        if (symbol == NO_SYMBOL) break;
+
+        names[i] = symbol;
+        bindings.push_back(i);
+    }
+
+    // Values of the bindings, then the body
+    std::vector<Node<CalcNodeData>*> values;
+    bindings.push_back(root);
+
+    for (int top : bindings)
+    {
+        // Work stack holds the node index, negative (-index - 1) once its
+        // operands are built. Built subtrees are on the second stack.
+        std::vector<int>                 work = { top };
+        std::vector<Node<CalcNodeData>*> built;
+
+        while (!work.empty())
+        {
+            int index = work.back();
+            work.pop_back();
+
+            if ((index >= 0) && ((names[index] == NO_SYMBOL) || (index == top)))
+            {
+                const DagNode& node = dag.nodes_[index];
+
+                work.push_back(-index - 1);
+
+                if (node.args_num != 0)
+                {
+                    for (int i = node.args_num - 1; i >= 0; --i) work.push_back(dag.args_[node.left + i]);
+                }
+                else
+                {
+                    if (node.right != DAG_NONE) work.push_back(node.right);
+                    if (node.left  != DAG_NONE) work.push_back(node.left);
+                }
+                continue;
+            }
+
+            Node<CalcNodeData>* node_cur = new Node<CalcNodeData>;
+
+            if (index >= 0)
+            {
+                // Reference to the binding
+                node_cur->setData({ POISON<NUM_TYPE>, symbols.getName(names[index]), 0, NODE_VARIABLE, names[index] });
+                built.push_back(node_cur);
+                continue;
+            }
+
+            const DagNode& node = dag.nodes_[-index - 1];
+
+            switch (node.node_type)
+            {
+            case NODE_NUMBER:
+
+                node_cur->setData({ node.number, nullptr, 0, NODE_NUMBER });
+                break;
+
+            case NODE_VARIABLE:
+
+                node_cur->setData({ POISON<NUM_TYPE>, symbols.getName(node.symbol), 0, NODE_VARIABLE, node.symbol });
+                break;
+
+            case NODE_FUNCTION:
+            case NODE_OPERATOR:
+
+                node_cur->setData({ POISON<NUM_TYPE>, op_names[node.op_code].word, node.op_code, node.node_type });
+                break;
+
+            default: assert(0);
+            }
+
+            if (node.args_num != 0)
+            {
+                for (size_t i = built.size() - node.args_num; i < built.size(); ++i) node_cur->addArg(built[i]);
+
+                built.resize(built.size() - node.args_num);
+            }
+            else
+            if (node.right != DAG_NONE)
+            {
+                node_cur->right_        = built.back();
+                node_cur->right_->prev_ = node_cur;
+                built.pop_back();
+
+                if (node.left != DAG_NONE)
+                {
+                    node_cur->left_        = built.back();
+                    node_cur->left_->prev_ = node_cur;
+                    built.pop_back();
+                }
+            }
+
+            built.push_back(node_cur);
+        }
+
+        values.push_back(built.back());
+    }
+
+    // let s1 = a; let s2 = b; ... body
+    Node<CalcNodeData>* body = values.back();
+
+    for (size_t i = values.size() - 1; i-- > 0; )
+    {
+        int symbol = names[bindings[i]];
+
+        Node<CalcNodeData>* node_cur = new Node<CalcNodeData>;
+        node_cur->setData({ POISON<NUM_TYPE>, symbols.getName(symbol), 0, NODE_LET, symbol });
+
+        node_cur->left_  = body;
+        node_cur->right_ = values[i];
+        body->prev_      = node_cur;
+        values[i]->prev_ = node_cur;
+
+        body = node_cur;
+    }
+
+    delete tree.root_;
+
+    tree.root_ = body;
+    tree.root_->prev_ = nullptr;
+    tree.root_->recountDepth();
+    CountDepends(tree.root_);
+
+    return CALC_OK;
+}
+
+//------------------------------------------------------------------------------
+
+bool hasEqualBases (const std::vector<DagFactor>& factors)
+{
+    // Products and sums are short, sorting is only worth it for long ones
+    if (factors.size() <= DAG_SHORT_ARGS)
+    {
+        for (size_t i = 0; i < factors.size(); ++i)
+            for (size_t j = i + 1; j < factors.size(); ++j)
+                if (factors[i].base == factors[j].base) return true;
+
+        return false;
+    }
+
+    std::vector<int> bases(factors.size());
+    for (size_t i = 0; i < factors.size(); ++i) bases[i] = factors[i].base;
+
+    std::sort(bases.begin(), bases.end());
+
+    return std::adjacent_find(bases.begin(), bases.end()) != bases.end();
+}
+
+//------------------------------------------------------------------------------
+
+void MergeBases (std::vector<DagFactor>& factors)
+{
+    // Exponents (or coefficients) of equal bases are added to the first one,
+    // so the order of the first appearance is kept
+    std::unordered_map<int, size_t> first;
+    size_t                          size = 0;
+
+    for (size_t i = 0; i < factors.size(); ++i)
+    {
+        auto found = first.find(factors[i].base);
+
+        if (found == first.end())
+        {
+            first[factors[i].base] = size;
+            factors[size++]        = factors[i];
+        }
+        else factors[found->second].exponent += factors[i].exponent;
+    }
+
+    factors.resize(size);
+}
+
+//------------------------------------------------------------------------------
@@ -0,0 +1,346 @@
+/*------------------------------------------------------------------------------
+    * File:        ExprDag.h                                                   *
+    * Description: Declaration of the hash-consed expression graph, where      *
+    *              equal subexpressions are one shared node.                   *
+    * Created:     17 oct 2026                                                 *
+    * Author:      Artem Puzankov                                              *
+    * Email:       puzankov.ao@phystech.edu                                    *
+    * GitHub:      https://github.com/hellopuza                                *
+    * Copyright © 2021 Artem Puzankov. All rights reserved.                    *
+    *///------------------------------------------------------------------------
+
+#ifndef EXPRDAG_H_INCLUDED
+#define EXPRDAG_H_INCLUDED
+
+#define _CRT_SECURE_NO_WARNINGS
+
+
+#include "Calculator.h"
+#include "DeriveRules.h"
+#include <algorithm>
+#include <unordered_map>
+
+
+//==============================================================================
+/*------------------------------------------------------------------------------
+                   Expression graph constants and types                        *
+*///----------------------------------------------------------------------------
+//==============================================================================
+
+
+const int    DAG_NONE       = -1;
+const size_t DAG_TABLE_SIZE = 1024;   // initial size of the hash table, power of two
+const size_t DAG_SHORT_ARGS = 8;      // longer lists are sorted to find equal operands
+const size_t DAG_LET_SIZE   = 6;      // shared subexpressions of this size are bound by Dag2Tree
+
+const char* const DAG_LET_PREFIX = "s";   // names of the bindings are s1, s2, ...
+
+// Nodes refer to their children by index, and a node is always added after
+// its children, so the nodes are in topological order.
+
+struct DagNode
+{
+    char     node_type = 0;
+    char     op_code   = 0;
+    int      symbol    = NO_SYMBOL;
+    NUM_TYPE number    = 0;
+    int      left      = DAG_NONE;   // first index in args_ for n-ary node
+    int      right     = DAG_NONE;
+    int      args_num  = 0;          // number of operands of n-ary sum or product
+};
+
+// Factor base^exponent of a product, or term exponent*base of a sum
+
+struct DagFactor
+{
+    int      base     = DAG_NONE;
+    NUM_TYPE exponent = 1;
+};
+
+class ExprDag
+{
+    int state_;
+
+    std::vector<int> table_;         // node indices by hash, DAG_NONE if empty
+    size_t           table_used_ = 0;
+
+public:
+
+    std::vector<DagNode> nodes_;
+    std::vector<int>     args_;      // operands of the n-ary nodes
+
+//------------------------------------------------------------------------------
+/*! @brief   ExprDag constructor.
+ */
+
+    ExprDag ();
+
+//------------------------------------------------------------------------------
+/*! @brief   ExprDag copy constructor (deleted).
+ *
+ *  @param   obj         Source graph
+ */
+
+    ExprDag (const ExprDag& obj);
+
+    ExprDag& operator = (const ExprDag& obj); // deleted
+
+//------------------------------------------------------------------------------
+/*! @brief   ExprDag destructor.
+ */
+
+   ~ExprDag ();
+
+//------------------------------------------------------------------------------
+/*! @brief   Get number of nodes in the graph.
+ *
+ *  @return  number of nodes
+ */
+
+    size_t getSize () const;
+
+//------------------------------------------------------------------------------
+/*! @brief   Get the number node.
+ *
+ *  @param   number      Value
+ *
+ *  @return  index of the node
+ */
+
+    int Number (NUM_TYPE number);
+
+//------------------------------------------------------------------------------
+/*! @brief   Get the variable node.
+ *
+ *  @param   symbol      Symbol id of the variable
+ *
+ *  @return  index of the node
+ */
+
+    int Variable (int symbol);
+
+//------------------------------------------------------------------------------
+/*! @brief   Get the function node.
+ *
+ *  @param   op_code     Function code
+ *  @param   arg         Index of the argument
+ *
+ *  @return  index of the node
+ */
+
+    int Function (char op_code, int arg);
+
+//------------------------------------------------------------------------------
+/*! @brief   Get the operator node, simplified like Optimize does it.
+ *
+ *  @note    Sums, differences and products are made n-ary by Args.
+ *
+ *  @param   op_code     Operator code
+ *  @param   left        Index of the left operand, DAG_NONE for unary minus
+ *  @param   right       Index of the right operand
+ *
+ *  @return  index of the node
+ */
+
+    int Operator (char op_code, int left, int right);
+
+//------------------------------------------------------------------------------
+/*! @brief   Get the n-ary sum or product node. Operands of the same operation
+ *           are moved up, numbers are folded and neutral element is dropped.
+ *
+ *  @param   op_code     OP_ADD or OP_MUL
+ *  @param   args        Indices of the operands
+ *  @param   num         Number of operands
+ *
+ *  @return  index of the node
+ */
+
+    int Args (char op_code, const int* args, size_t num);
+
+//------------------------------------------------------------------------------
+/*! @brief   Differentiate the expression. Every node is differentiated once
+ *           and the derivative refers to the operands instead of copying.
+ *
+ *  @param   root        Index of the expression
+ *  @param   symbol      Symbol id of the variable
+ *
+ *  @return  index of the derivative
+ */
+
+    int Derivative (int root, int symbol);
+
+//------------------------------------------------------------------------------
+/*! @brief   Count nodes of the expression.
+ *
+ *  @param   root        Index of the expression
+ *  @param   tree_size   Number of nodes of the expression tree, where shared
+ *                       nodes are counted every time they are used
+ *
+ *  @return  number of different nodes
+ */
+
+    size_t CountNodes (int root, size_t& tree_size) const;
+
+/*------------------------------------------------------------------------------
+                   Private functions                                           *
+*///----------------------------------------------------------------------------
+
+private:
+
+//------------------------------------------------------------------------------
+/*! @brief   Mark the nodes the expression consists of.
+ *
+ *  @param   root        Index of the expression
+ *  @param   used        Marks of the nodes up to the root
+ */
+
+    void Reachable (int root, std::vector<char>& used) const;
+
+//------------------------------------------------------------------------------
+/*! @brief   Negate the expression by changing sign of its number factor.
+ *
+ *  @param   index       Index of the product, quotient or number
+ *
+ *  @return  index of the negated expression, DAG_NONE if there is no factor
+ */
+
+    int NegateFactor (int index);
+
+//------------------------------------------------------------------------------
+/*! @brief   Split the expression into factors with number exponents.
+ *
+ *  @param   index       Index of the expression
+ *  @param   denominator The expression is in the denominator
+ *  @param   factors     Found factors
+ *  @param   numer       Product of the numbers of numerator
+ *  @param   denom       Product of the numbers of denominator
+ */
+
+    void Factorize (int index, bool denominator, std::vector<DagFactor>& factors, NUM_TYPE& numer, NUM_TYPE& denom);
+
+//------------------------------------------------------------------------------
+/*! @brief   Build the quotient of the factors, powers of equal bases are
+ *           merged and factors with negative exponent go to denominator.
+ *
+ *  @param   factors     Factors
+ *  @param   numer       Number of numerator
+ *  @param   denom       Number of denominator
+ *
+ *  @return  index of the product
+ */
+
+    int Product (std::vector<DagFactor>& factors, NUM_TYPE numer, NUM_TYPE denom);
+
+//------------------------------------------------------------------------------
+/*! @brief   Build the sum of the terms, coefficients of equal terms are added.
+ *
+ *  @param   terms       Terms with coefficients in exponent
+ *  @param   folded      Sum of the numbers
+ *
+ *  @return  index of the sum
+ */
+
+    int Sum (std::vector<DagFactor>& terms, NUM_TYPE folded);
+
+//------------------------------------------------------------------------------
+/*! @brief   Split the number coefficient off the term.
+ *
+ *  @param   index       Index of the term
+ *  @param   coef        Coefficient, multiplied by the found one
+ *
+ *  @return  index of the term without coefficient
+ */
+
+    int SplitCoefficient (int index, NUM_TYPE& coef);
+
+//------------------------------------------------------------------------------
+/*! @brief   Find the equal node or add the new one.
+ *
+ *  @param   node        Node to be found
+ *  @param   args        Operands of n-ary node (node.args_num of them)
+ *
+ *  @return  index of the node
+ */
+
+    int Insert (const DagNode& node, const int* args);
+
+//------------------------------------------------------------------------------
+/*! @brief   Check if the node is equal to the node of the graph.
+ *
+ *  @param   index       Index of the node of the graph
+ *  @param   node        Node to be compared
+ *  @param   args        Operands of n-ary node
+ *
+ *  @return  true if equal, else false
+ */
+
+    bool isEqual (int index, const DagNode& node, const int* args) const;
+
+//------------------------------------------------------------------------------
+/*! @brief   Double the hash table.
+ */
+
+    void Rehash ();
+
+//------------------------------------------------------------------------------
+};
+
+//------------------------------------------------------------------------------
+/*! @brief   Hash of the node.
+ *
+ *  @param   node        Node
+ *  @param   args        Operands of n-ary node
+ *
+ *  @return  hash
+ */
+
+size_t DagHash (const DagNode& node, const int* args);
+
+//------------------------------------------------------------------------------
+/*! @brief   Check if some factors have the same base.
+ *
+ *  @param   factors     Factors
+ *
+ *  @return  true if there are equal bases, else false
+ */
+
+bool hasEqualBases (const std::vector<DagFactor>& factors);
+
+//------------------------------------------------------------------------------
+/*! @brief   Merge factors with the same base adding their exponents.
+ *
+ *  @param   factors     Factors
+ */
+
+void MergeBases (std::vector<DagFactor>& factors);
+
+//------------------------------------------------------------------------------
+/*! @brief   Add the tree to the graph.
+ *
+ *  @param   tree        Equation tree
+ *  @param   dag         Expression graph
+ *
+ *  @return  index of the root
+ */
+
+int Tree2Dag (const Tree<CalcNodeData>& tree, ExprDag& dag);
+
+//------------------------------------------------------------------------------
+/*! @brief   Build tree of the expression. Shared nodes of DAG_LET_SIZE nodes
+ *           and more are bound by 'let' to new names, other ones are copied.
+ *
+ *  @note    Names differ from the variables of the expression. If the symbol
+ *           table is full, the rest of the shared nodes are copied.
+ *
+ *  @param   dag         Expression graph
+ *  @param   root        Index of the expression
+ *  @param   tree        Equation tree
+ *
+ *  @return  error code
+ */
+
+int Dag2Tree (const ExprDag& dag, int root, Tree<CalcNodeData>& tree);
+
+//------------------------------------------------------------------------------
+
+#endif // EXPRDAG_H_INCLUDED
@@ -0,0 +1,394 @@
+/*------------------------------------------------------------------------------
+    * File:        Gradient.cpp                                                *
+    * Description: Functions of the evaluation tape for reverse mode           *
+    *              automatic differentiation.                                  *
+    * Created:     17 oct 2026                                                 *
+    * Author:      Artem Puzankov                                              *
+    * Email:       puzankov.ao@phystech.edu                                    *
+    * GitHub:      https://github.com/hellopuza                                *
+    * Copyright © 2021 Artem Puzankov. All rights reserved.                    *
+    *///------------------------------------------------------------------------
+
+#include "Gradient.h"
+
+//------------------------------------------------------------------------------
+
+Tape::Tape (const Tree<CalcNodeData>& tree) :
+    state_ (CALC_OK)
+{
+    assert(tree.root_ != nullptr);
+
+    std::vector<int>                 children;   // indices of the recorded subtrees not yet taken by parent
+    std::vector<size_t>              positions;
+    std::vector<std::pair<int, int>> scope;      // symbol and index of the bindings in scope
+    size_t                           args_max = 0;
+
+    // Post order walk, the same as in Tree2Bin. Parents are kept by every
+    // function building the tree, so the tree is only read
+    Node<CalcNodeData>* node_cur = tree.root_;
+    Node<CalcNodeData>* from     = tree.root_->prev_;
+
+    while (true)
+    {
+        Node<CalcNodeData>* next = node_cur->nextChild(from, positions);
+
+        if (next != nullptr)
+        {
+            from     = node_cur;
+            node_cur = next;
+            continue;
+        }
+
+        const CalcNodeData& data = node_cur->getData();
+
+        // Value of the binding is recorded once, its references and the
+        // binding node itself are only the indices of the value and the body
+        int      index = (int)nodes_.size();
+        TapeNode node  = {};
+        node.node_type = data.node_type;
+        node.op_code   = data.op_code;
+
+        switch (data.node_type)
+        {
+        case NODE_NUMBER:
+
+            node.number = data.number;
+            break;
+
+        case NODE_VARIABLE:
+        {
+            int symbol = (data.symbol != NO_SYMBOL) ? data.symbol : symbols.Intern(data.word);
+
+            size_t bound = scope.size();
+            while ((bound > 0) && (scope[bound - 1].first != symbol)) --bound;
+
+            if (bound > 0)
+            {
+                index = scope[bound - 1].second;
+                break;
+            }
+
+            size_t var = 0;
+            while ((var < symbols_.size()) && (symbols_[var] != symbol)) ++var;
+
+            if (var == symbols_.size()) symbols_.push_back(symbol);
+
+            node.var    = (int)var;
+            node.active = true;
+            break;
+        }
+        case NODE_FUNCTION:
+
+            node.right  = children.back();
+            node.active = nodes_[node.right].active;
+            children.pop_back();
+            break;
+
+        case NODE_OPERATOR:
+        {
+            if (node_cur->args_num_ != 0)
+            {
+                node.left     = (int)args_.size();
+                node.args_num = (int)node_cur->args_num_;
+
+                for (size_t arg = children.size() - node_cur->args_num_; arg < children.size(); ++arg)
+                {
+                    args_.push_back(children[arg]);
+                    node.active |= nodes_[children[arg]].active;
+                }
+
+                children.resize(children.size() - node_cur->args_num_);
+                args_max = std::max(args_max, node_cur->args_num_);
+                break;
+            }
+
+            if (node_cur->left_ != nullptr)
+            {
+                node.left   = children.back();
+                node.active = nodes_[node.left].active;
+                children.pop_back();
+            }
+
+            node.right   = children.back();
+            node.active |= nodes_[node.right].active;
+            children.pop_back();
+            break;
+        }
+        case NODE_LET:
+
+            index = children.back();
+            children.pop_back();
+            scope.pop_back();
+            break;
+
+        default: assert(0);
+        }
+
+        if (index == (int)nodes_.size()) nodes_.push_back(node);
+
+        if (node_cur == tree.root_)
+        {
+            root_ = index;
+            break;
+        }
+
+        if ((node_cur->prev_->getData().node_type == NODE_LET) && (node_cur->prev_->right_ == node_cur))
+            scope.push_back({ node_cur->prev_->getData().symbol, index });
+        else
+            children.push_back(index);
+
+        from     = node_cur;
+        node_cur = node_cur->prev_;
+    }
+
+    values_.resize(nodes_.size());
+    adjoints_.resize(nodes_.size());
+    gradient_.resize(symbols_.size());
+    products_.resize(args_max);
+}
+
+//------------------------------------------------------------------------------
+
+Tape::~Tape ()
+{
+    state_ = CALC_DESTRUCTED;
+}
+
+//------------------------------------------------------------------------------
+
+size_t Tape::getSize () const
+{
+    return nodes_.size();
+}
+
+//------------------------------------------------------------------------------
+
+size_t Tape::getVariablesNum () const
+{
+    return symbols_.size();
+}
+
+//------------------------------------------------------------------------------
+
+int Tape::getSymbol (size_t var) const
+{
+    assert(var < symbols_.size());
+
+    return symbols_[var];
+}
+
+//------------------------------------------------------------------------------
+
+int Tape::findVariable (int symbol) const
+{
+    for (size_t var = 0; var < symbols_.size(); ++var)
+        if (symbols_[var] == symbol) return (int)var;
+
+    return TAPE_NONE;
+}
+
+//------------------------------------------------------------------------------
+
+NUM_TYPE Tape::getGradient (size_t var) const
+{
+    assert(var < gradient_.size());
+
+    return gradient_[var];
+}
+
+//------------------------------------------------------------------------------
+
+int Tape::Evaluate (Stack<Variable>& variables, NUM_TYPE& result)
+{
+    if (state_) return state_;
+
+    // Values of the variables are kept in gradient_ until the backward pass
+    for (size_t var = 0; var < symbols_.size(); ++var)
+    {
+        size_t index = 0;
+        while ((index < variables.getSize()) && (variables[index].symbol != symbols_[var])) ++index;
+
+        if (index == variables.getSize()) return CALC_UNIDENTIFIED_VARIABLE;
+
+        gradient_[var] = variables[index].value;
+    }
+
+    NUM_TYPE* values = values_.data();
+
+    for (size_t i = 0; i < nodes_.size(); ++i)
+    {
+        const TapeNode& node = nodes_[i];
+
+        switch (node.node_type)
+        {
+        case NODE_NUMBER:
+
+            values[i] = node.number;
+            break;
+
+        case NODE_VARIABLE:
+
+            values[i] = gradient_[node.var];
+            break;
+
+        case NODE_FUNCTION:
+
+            values[i] = CalcFunction(node.op_code, values[node.right]);
+            break;
+
+        case NODE_OPERATOR:
+        {
+            if (node.args_num != 0)
+            {
+                const int* args = args_.data() + node.left;
+
+                NUM_TYPE value = values[args[0]];
+                for (int arg = 1; arg < node.args_num; ++arg)
+                    value = CalcOperator(node.op_code, value, values[args[arg]]);
+
+                values[i] = value;
+            }
+            else values[i] = CalcOperator(node.op_code, (node.left != TAPE_NONE) ? values[node.left] : 0, values[node.right]);
+            break;
+        }
+        default: assert(0);
+        }
+    }
+
+    result = values[root_];
+
+    return CALC_OK;
+}
+
+//------------------------------------------------------------------------------
+
+int Tape::Gradient (Stack<Variable>& variables, NUM_TYPE& result)
+{
+    int err = Evaluate(variables, result);
+    if (err) return err;
+
+    Backward();
+
+    return CALC_OK;
+}
+
+//------------------------------------------------------------------------------
+
+void Tape::Backward ()
+{
+    std::fill(adjoints_.begin(), adjoints_.end(), 0);
+    std::fill(gradient_.begin(), gradient_.end(), 0);
+
+    adjoints_[root_] = 1;
+
+    for (size_t i = nodes_.size(); i-- > 0; )
+    {
+        const TapeNode& node    = nodes_[i];
+        NUM_TYPE        adjoint = adjoints_[i];
+
+        // Subtrees without variables and nodes the root does not depend on
+        // pass nothing
+        if ((not node.active) || (adjoint == NUM_TYPE(0))) continue;
+
+        switch (node.node_type)
+        {
+        case NODE_VARIABLE:
+
+            gradient_[node.var] += adjoint;
+            break;
+
+        case NODE_FUNCTION:
+
+            adjoints_[node.right] += adjoint * CalcFunctionDerivative(node.op_code, values_[node.right], values_[i]);
+            break;
+
+        case NODE_OPERATOR:
+        {
+            if (node.args_num != 0)
+            {
+                BackwardArgs(node, adjoint);
+                break;
+            }
+
+            bool left_active  = (node.left != TAPE_NONE) && nodes_[node.left].active;
+            bool right_active = nodes_[node.right].active;
+
+            NUM_TYPE left  = (node.left != TAPE_NONE) ? values_[node.left] : 0;
+            NUM_TYPE right = values_[node.right];
+
+            switch (node.op_code)
+            {
+            case OP_ADD:
+
+                if (left_active)  adjoints_[node.left]  += adjoint;
+                if (right_active) adjoints_[node.right] += adjoint;
+                break;
+
+            case OP_SUB:
+
+                if (left_active)  adjoints_[node.left]  += adjoint;
+                if (right_active) adjoints_[node.right] -= adjoint;
+                break;
+
+            case OP_MUL:
+
+                if (left_active)  adjoints_[node.left]  += adjoint * right;
+                if (right_active) adjoints_[node.right] += adjoint * left;
+                break;
+
+            case OP_DIV:
+
+                if (left_active)  adjoints_[node.left]  += adjoint / right;
+                if (right_active) adjoints_[node.right] -= adjoint * values_[i] / right;
+                break;
+
+            case OP_POW:
+
+                if (left_active)  adjoints_[node.left]  += adjoint * right * pow(left, right - NUM_TYPE(1));
+                if (right_active) adjoints_[node.right] += adjoint * values_[i] * log(left);
+                break;
+
+            default: assert(0);
+            }
+            break;
+        }
+        default: assert(0);
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void Tape::BackwardArgs (const TapeNode& node, NUM_TYPE adjoint)
+{
+    const int* args = args_.data() + node.left;
+
+    if (node.op_code == OP_ADD)
+    {
+        for (int arg = 0; arg < node.args_num; ++arg)
+            if (nodes_[args[arg]].active) adjoints_[args[arg]] += adjoint;
+
+        return;
+    }
+
+    assert(node.op_code == OP_MUL);
+
+    // Derivative by an operand is the product of the others, it is taken
+    // as product of the operands before and after it, so zero operands
+    // need no special case
+    NUM_TYPE* after = products_.data();
+
+    after[node.args_num - 1] = 1;
+    for (int arg = node.args_num - 1; arg > 0; --arg)
+        after[arg - 1] = after[arg] * values_[args[arg]];
+
+    NUM_TYPE before = adjoint;
+    for (int arg = 0; arg < node.args_num; ++arg)
+    {
+        if (nodes_[args[arg]].active) adjoints_[args[arg]] += before * after[arg];
+
+        before *= values_[args[arg]];
+    }
+}
+
+//------------------------------------------------------------------------------
@@ -0,0 +1,183 @@
+/*------------------------------------------------------------------------------
+    * File:        Gradient.h                                                  *
+    * Description: Declaration of the evaluation tape for reverse mode         *
+    *              automatic differentiation.                                  *
+    * Created:     17 oct 2026                                                 *
+    * Author:      Artem Puzankov                                              *
+    * Email:       puzankov.ao@phystech.edu                                    *
+    * GitHub:      https://github.com/hellopuza                                *
+    * Copyright © 2021 Artem Puzankov. All rights reserved.                    *
+    *///------------------------------------------------------------------------
+
+#ifndef GRADIENT_H_INCLUDED
+#define GRADIENT_H_INCLUDED
+
+#define _CRT_SECURE_NO_WARNINGS
+
+
+#include "Calculator.h"
+
+
+//==============================================================================
+/*------------------------------------------------------------------------------
+                   Gradient constants and types                                *
+*///----------------------------------------------------------------------------
+//==============================================================================
+
+
+const int TAPE_NONE = -1;
+
+// Nodes are recorded in post order, so children always precede the parent.
+// Value of the binding is recorded once and shared by its references, then
+// the root need not be the last node.
+
+struct TapeNode
+{
+    char     node_type = 0;
+    char     op_code   = 0;
+    bool     active    = false;      // depends on some variable
+    int      var       = TAPE_NONE;  // index of the variable
+    NUM_TYPE number    = 0;
+    int      left      = TAPE_NONE;  // first index in args_ for n-ary node
+    int      right     = TAPE_NONE;
+    int      args_num  = 0;          // number of operands of n-ary sum or product
+};
+
+class Tape
+{
+    int state_;
+
+    std::vector<TapeNode> nodes_;
+    int                   root_ = TAPE_NONE;
+    std::vector<int>      args_;      // operands of the n-ary nodes
+    std::vector<int>      symbols_;   // symbol ids of the variables
+
+    std::vector<NUM_TYPE> values_;    // value of every node after Evaluate
+    std::vector<NUM_TYPE> adjoints_;  // derivative of the root by every node
+    std::vector<NUM_TYPE> gradient_;  // derivative of the root by every variable
+    std::vector<NUM_TYPE> products_;  // scratch for the n-ary products
+
+public:
+
+//------------------------------------------------------------------------------
+/*! @brief   Tape constructor, records the tree.
+ *
+ *  @param   tree        Equation tree
+ */
+
+    Tape (const Tree<CalcNodeData>& tree);
+
+//------------------------------------------------------------------------------
+/*! @brief   Tape copy constructor (deleted).
+ *
+ *  @param   obj         Source tape
+ */
+
+    Tape (const Tape& obj);
+
+    Tape& operator = (const Tape& obj); // deleted
+
+//------------------------------------------------------------------------------
+/*! @brief   Tape destructor.
+ */
+
+   ~Tape ();
+
+//------------------------------------------------------------------------------
+/*! @brief   Get number of nodes on the tape.
+ *
+ *  @return  number of nodes
+ */
+
+    size_t getSize () const;
+
+//------------------------------------------------------------------------------
+/*! @brief   Get number of different variables of the expression.
+ *
+ *  @return  number of variables
+ */
+
+    size_t getVariablesNum () const;
+
+//------------------------------------------------------------------------------
+/*! @brief   Get symbol id of the variable.
+ *
+ *  @param   var         Index of the variable
+ *
+ *  @return  symbol id
+ */
+
+    int getSymbol (size_t var) const;
+
+//------------------------------------------------------------------------------
+/*! @brief   Find the variable by symbol id.
+ *
+ *  @param   symbol      Symbol id
+ *
+ *  @return  index of the variable, TAPE_NONE if the expression has no such
+ */
+
+    int findVariable (int symbol) const;
+
+//------------------------------------------------------------------------------
+/*! @brief   Get derivative by the variable found by the last Gradient call.
+ *
+ *  @param   var         Index of the variable
+ *
+ *  @return  derivative
+ */
+
+    NUM_TYPE getGradient (size_t var) const;
+
+//------------------------------------------------------------------------------
+/*! @brief   Calculate value of the expression, values of all nodes are kept.
+ *
+ *  @param   variables   Values of the variables
+ *  @param   result      Value of the expression
+ *
+ *  @return  error code
+ */
+
+    int Evaluate (Stack<Variable>& variables, NUM_TYPE& result);
+
+//------------------------------------------------------------------------------
+/*! @brief   Calculate value of the expression and its derivatives by all
+ *           variables in one forward and one backward pass over the tape.
+ *
+ *  @note    Nothing is allocated after the first call.
+ *
+ *  @param   variables   Values of the variables
+ *  @param   result      Value of the expression
+ *
+ *  @return  error code
+ */
+
+    int Gradient (Stack<Variable>& variables, NUM_TYPE& result);
+
+/*------------------------------------------------------------------------------
+                   Private functions                                           *
+*///----------------------------------------------------------------------------
+
+private:
+
+//------------------------------------------------------------------------------
+/*! @brief   Pass derivatives of the root from the nodes to their operands.
+ */
+
+    void Backward ();
+
+//------------------------------------------------------------------------------
+/*! @brief   Pass derivative of the root from the n-ary node to its operands.
+ *
+ *  @param   node        N-ary node
+ *  @param   adjoint     Derivative of the root by the node
+ */
+
+    void BackwardArgs (const TapeNode& node, NUM_TYPE adjoint);
+
+//------------------------------------------------------------------------------
+};
+
+//------------------------------------------------------------------------------
+
+#endif // GRADIENT_H_INCLUDED
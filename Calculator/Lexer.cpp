@@ -0,0 +1,319 @@
+/*------------------------------------------------------------------------------
+    * File:        Lexer.cpp                                                   *
+    * Description: Functions for splitting math expressions into tokens.       *
+    * Created:     17 oct 2026                                                 *
+    * Author:      Artem Puzankov                                              *
+    * Email:       puzankov.ao@phystech.edu                                    *
+    * GitHub:      https://github.com/hellopuza                                *
+    * Copyright © 2021 Artem Puzankov. All rights reserved.                    *
+    *///------------------------------------------------------------------------
+
+#include "Lexer.h"
+
+//------------------------------------------------------------------------------
+
+enum CHAR_CLASS
+{
+    CH_OTHER = 0,
+    CH_SPACE = 1,
+    CH_DIGIT = 2,
+    CH_ALPHA = 3,
+    CH_PUNCT = 4,
+};
+
+struct CharTable
+{
+    char cls [256] = {};
+    char kind[256] = {};
+};
+
+static constexpr CharTable MakeCharTable ()
+{
+    CharTable table = {};
+
+    for (int c = '0'; c <= '9'; ++c) table.cls[c] = CH_DIGIT;
+    for (int c = 'a'; c <= 'z'; ++c) table.cls[c] = CH_ALPHA;
+    for (int c = 'A'; c <= 'Z'; ++c) table.cls[c] = CH_ALPHA;
+
+    table.cls[(int)' ' ] = CH_SPACE;
+    table.cls[(int)'\t'] = CH_SPACE;
+    table.cls[(int)'\n'] = CH_SPACE;
+    table.cls[(int)'\v'] = CH_SPACE;
+    table.cls[(int)'\f'] = CH_SPACE;
+    table.cls[(int)'\r'] = CH_SPACE;
+
+    const char punct[] = "+-*/^()=;";
+    const char kinds[] = { TOK_ADD, TOK_SUB, TOK_MUL, TOK_DIV, TOK_POW, TOK_OPEN, TOK_CLOSE, TOK_ASSIGN, TOK_SEMICOLON };
+
+    for (size_t i = 0; i < sizeof(kinds); ++i)
+    {
+        table.cls [(unsigned char)punct[i]] = CH_PUNCT;
+        table.kind[(unsigned char)punct[i]] = kinds[i];
+    }
+
+    return table;
+}
+
+static constexpr CharTable char_table = MakeCharTable();
+
+//------------------------------------------------------------------------------
+
+Lexer::Lexer (const char* text, size_t size) :
+    capacity_ (DEFAULT_TOKENS_CAPACITY),
+    text_     (text),
+    size_     (size)
+{
+    assert(text != nullptr);
+
+    tokens_ = new Token[capacity_];
+}
+
+//------------------------------------------------------------------------------
+
+Lexer::Lexer (FILE* source, size_t chunk_size) :
+    capacity_ (DEFAULT_TOKENS_CAPACITY),
+    source_   (source),
+    buf_size_ (chunk_size),
+    eof_      (false)
+{
+    assert(source     != nullptr);
+    assert(chunk_size != 0);
+
+    buffer_ = new char[buf_size_];
+    text_   = buffer_;
+
+    tokens_ = new Token[capacity_];
+}
+
+//------------------------------------------------------------------------------
+
+Lexer::~Lexer ()
+{
+    delete [] tokens_;
+    delete [] buffer_;
+
+    tokens_ = nullptr;
+    buffer_ = nullptr;
+    text_   = nullptr;
+    num_    = 0;
+}
+
+//------------------------------------------------------------------------------
+
+size_t Lexer::Tokenize ()
+{
+    assert(source_ == nullptr);
+
+    pos_    = 0;
+    num_    = 0;
+    first_  = 0;
+    ended_  = false;
+
+    return Scan(-1);
+}
+
+//------------------------------------------------------------------------------
+
+const Token& Lexer::getToken (size_t index)
+{
+    assert(index >= first_);
+
+    while (index >= first_ + num_)
+    {
+        if (ended_) return tokens_[num_ - 1];
+
+        first_ += num_;
+        num_    = 0;
+
+        Scan(LEXER_TOKENS_BLOCK);
+        if ((num_ == 0) && !ended_) Refill();
+    }
+
+    return tokens_[index - first_];
+}
+
+//------------------------------------------------------------------------------
+
+size_t Lexer::Scan (size_t max_tokens)
+{
+    const unsigned char* text = (const unsigned char*)text_;
+
+    size_t errors = 0;
+    size_t pos    = pos_;
+
+    while ((pos < size_) && (num_ < max_tokens))
+    {
+        Token token = {};
+        token.begin = pos;
+
+        bool at_end = false;
+
+        switch (char_table.cls[text[pos]])
+        {
+        case CH_SPACE:
+        {
+            while ((pos < size_) && (char_table.cls[text[pos]] == CH_SPACE)) ++pos;
+
+            pos_ = pos;
+            continue;
+        }
+        case CH_PUNCT:
+        {
+            token.kind = char_table.kind[text[pos++]];
+            break;
+        }
+        case CH_ALPHA:
+        {
+            while ((pos < size_) && ((char_table.cls[text[pos]] == CH_ALPHA) ||
+                                     (char_table.cls[text[pos]] == CH_DIGIT)))
+                ++pos;
+
+            at_end = (pos == size_);
+            if (at_end && !eof_) break;
+
+            token.kind = TOK_IDENT;
+            token.id   = symbols.Intern(text_ + token.begin, pos - token.begin);
+
+            // New name does not fit in the full symbol table
+            if (token.id == NO_SYMBOL)
+            {
+                token.kind = TOK_ERROR;
+                ++errors;
+            }
+            break;
+        }
+        case CH_DIGIT:
+        {
+            while ((pos < size_) && (char_table.cls[text[pos]] == CH_DIGIT)) ++pos;
+
+            if ((pos < size_) && (text[pos] == '.'))
+            {
+                ++pos;
+                while ((pos < size_) && (char_table.cls[text[pos]] == CH_DIGIT)) ++pos;
+            }
+
+            if ((pos < size_) && ((text[pos] == 'e') || (text[pos] == 'E')))
+            {
+                size_t exp = pos + 1;
+                if ((exp < size_) && ((text[exp] == '+') || (text[exp] == '-'))) ++exp;
+
+                if ((exp < size_) && (char_table.cls[text[exp]] == CH_DIGIT))
+                {
+                    pos = exp;
+                    while ((pos < size_) && (char_table.cls[text[pos]] == CH_DIGIT)) ++pos;
+                }
+                else at_end = (exp == size_);
+            }
+
+            at_end = at_end || (pos == size_);
+            if (at_end && !eof_) break;
+
+            token.value = Str2Double(text_ + token.begin, pos - token.begin);
+
+            token.kind = TOK_NUMBER;
+            if ((pos < size_) && (text[pos] == 'i'))
+            {
+                token.kind = TOK_IMAGINARY;
+                ++pos;
+            }
+            break;
+        }
+        default:
+        {
+            ++pos;
+            token.kind = TOK_ERROR;
+            ++errors;
+            break;
+        }
+        }
+
+        // Token can continue in the next chunk, so it is lexed after refill
+        if (at_end && !eof_) return errors;
+
+        token.len    = pos - token.begin;
+        token.begin += offset_;
+        Push(token);
+
+        pos_ = pos;
+    }
+
+    if (eof_ && (pos_ == size_) && (num_ < max_tokens))
+    {
+        Token end = {};
+        end.begin = offset_ + size_;
+        end.kind  = TOK_END;
+        Push(end);
+
+        ended_ = true;
+    }
+
+    return errors;
+}
+
+//------------------------------------------------------------------------------
+
+bool Lexer::Refill ()
+{
+    if ((source_ == nullptr) || eof_) return false;
+
+    size_t rest = size_ - pos_;
+
+    if (rest == buf_size_)
+    {
+        buf_size_ *= 2;
+
+        char* temp = new char[buf_size_];
+        memcpy(temp, buffer_ + pos_, rest);
+
+        delete [] buffer_;
+        buffer_ = temp;
+    }
+    else memmove(buffer_, buffer_ + pos_, rest);
+
+    offset_ += pos_;
+    pos_     = 0;
+
+    size_t read = fread(buffer_ + rest, 1, buf_size_ - rest, source_);
+
+    text_ = buffer_;
+    size_ = rest + read;
+    eof_  = (read < buf_size_ - rest);
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+void Lexer::Push (const Token& token)
+{
+    if (num_ == capacity_)
+    {
+        capacity_ *= 2;
+
+        Token* temp = new Token[capacity_];
+        memcpy(temp, tokens_, num_ * sizeof(Token));
+
+        delete [] tokens_;
+        tokens_ = temp;
+    }
+
+    tokens_[num_++] = token;
+}
+
+//------------------------------------------------------------------------------
+
+bool isIdentifier (const char* word, size_t len)
+{
+    assert(word != nullptr);
+
+    if ((len == 0) || (char_table.cls[(unsigned char)word[0]] != CH_ALPHA)) return false;
+
+    for (size_t i = 1; i < len; ++i)
+        if ((char_table.cls[(unsigned char)word[i]] != CH_ALPHA) &&
+            (char_table.cls[(unsigned char)word[i]] != CH_DIGIT))
+            return false;
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
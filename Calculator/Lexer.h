@@ -0,0 +1,198 @@
+/*------------------------------------------------------------------------------
+    * File:        Lexer.h                                                     *
+    * Description: Declaration of the lexer which splits math expressions      *
+    *              into tokens.                                                *
+    * Created:     17 oct 2026                                                 *
+    * Author:      Artem Puzankov                                              *
+    * Email:       puzankov.ao@phystech.edu                                    *
+    * GitHub:      https://github.com/hellopuza                                *
+    * Copyright © 2021 Artem Puzankov. All rights reserved.                    *
+    *///------------------------------------------------------------------------
+
+#ifndef LEXER_H_INCLUDED
+#define LEXER_H_INCLUDED
+
+#define _CRT_SECURE_NO_WARNINGS
+
+
+#include "SymbolTable.h"
+#include "NumberParser.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+
+//==============================================================================
+/*------------------------------------------------------------------------------
+                   Lexer constants and types                                   *
+*///----------------------------------------------------------------------------
+//==============================================================================
+
+
+const size_t DEFAULT_TOKENS_CAPACITY = 64;
+const size_t LEXER_CHUNK_SIZE        = 1 << 20;
+const size_t LEXER_TOKENS_BLOCK      = 4096;
+
+enum TOKEN_KIND
+{
+    TOK_END       = 0,
+    TOK_NUMBER    = 1,
+    TOK_IMAGINARY = 2,
+    TOK_IDENT     = 3,
+    TOK_ADD       = 4,
+    TOK_SUB       = 5,
+    TOK_MUL       = 6,
+    TOK_DIV       = 7,
+    TOK_POW       = 8,
+    TOK_OPEN      = 9,
+    TOK_CLOSE     = 10,
+    TOK_ERROR     = 11,
+    TOK_ASSIGN    = 12,
+    TOK_SEMICOLON = 13,
+};
+
+struct Token
+{
+    double value = 0;       // value of number, imaginary part for TOK_IMAGINARY
+    size_t begin = 0;       // offset of the first character from the beginning of the source
+    int    len   = 0;       // number of characters in the source text
+    int    id    = -1;      // symbol id for TOK_IDENT
+    char   kind  = TOK_END;
+};
+
+class Lexer
+{
+    size_t capacity_ = 0;
+
+    FILE*  source_   = nullptr;
+    char*  buffer_   = nullptr;
+    size_t buf_size_ = 0;
+    size_t pos_      = 0;
+    bool   eof_      = true;
+    bool   ended_    = false;
+
+public:
+
+    const char* text_   = nullptr;  // characters of the source that are in memory now
+    size_t      size_   = 0;
+    size_t      offset_ = 0;        // offset of text_[0] from the beginning of the source
+
+    Token* tokens_ = nullptr;
+    size_t num_    = 0;
+    size_t first_  = 0;             // index of tokens_[0] among all tokens of the source
+
+//------------------------------------------------------------------------------
+/*! @brief   Lexer constructor.
+ *
+ *  @param   text        Source text (not modified, need not be null terminated)
+ *  @param   size        Length of the source text
+ */
+
+    Lexer (const char* text, size_t size);
+
+//------------------------------------------------------------------------------
+/*! @brief   Lexer constructor for the stream, which is read in chunks on demand.
+ *
+ *  @note    Only the current chunk and the tokens not yet passed to the parser
+ *           are kept in memory, so the source length is not limited.
+ *
+ *  @param   source      Opened stream (not closed by the lexer)
+ *  @param   chunk_size  Number of bytes read at once
+ */
+
+    Lexer (FILE* source, size_t chunk_size = LEXER_CHUNK_SIZE);
+
+//------------------------------------------------------------------------------
+/*! @brief   Lexer copy constructor (deleted).
+ *
+ *  @param   obj         Source lexer
+ */
+
+    Lexer (const Lexer& obj);
+
+    Lexer& operator = (const Lexer& obj); // deleted
+
+//------------------------------------------------------------------------------
+/*! @brief   Lexer destructor.
+ */
+
+   ~Lexer ();
+
+//------------------------------------------------------------------------------
+/*! @brief   Split the whole source text into tokens in one pass.
+ *
+ *  @note    The token array always ends with TOK_END.
+ *
+ *  @return  number of TOK_ERROR tokens found
+ */
+
+    size_t Tokenize ();
+
+//------------------------------------------------------------------------------
+/*! @brief   Get token by its index, reading the source if it is not lexed yet.
+ *
+ *  @note    Getting token forgets all tokens before it, so indices must not
+ *           decrease. Returned reference is valid until the next call.
+ *
+ *  @param   index       Index of the token among all tokens of the source
+ *
+ *  @return  token (TOK_END for all indices after the end of the source)
+ */
+
+    const Token& getToken (size_t index);
+
+/*------------------------------------------------------------------------------
+                   Private functions                                           *
+*///----------------------------------------------------------------------------
+
+private:
+
+//------------------------------------------------------------------------------
+/*! @brief   Append token to the token array.
+ *
+ *  @param   token       Token to append
+ */
+
+    void Push (const Token& token);
+
+//------------------------------------------------------------------------------
+/*! @brief   Lex tokens from the characters in memory.
+ *
+ *  @note    Token touching the end of the chunk is left for the next chunk,
+ *           because it can continue there.
+ *
+ *  @param   max_tokens  Stop when the token array has this number of tokens
+ *
+ *  @return  number of TOK_ERROR tokens found
+ */
+
+    size_t Scan (size_t max_tokens);
+
+//------------------------------------------------------------------------------
+/*! @brief   Move unscanned characters to the beginning of the buffer and read
+ *           the next chunk after them.
+ *
+ *  @return  false if the source is over, else true
+ */
+
+    bool Refill ();
+
+//------------------------------------------------------------------------------
+};
+
+//------------------------------------------------------------------------------
+/*! @brief   Check that the word is read by the lexer as one identifier:
+ *           a letter, then letters and digits.
+ *
+ *  @param   word        Word (need not be null terminated)
+ *  @param   len         Length of the word
+ *
+ *  @return  true if the word is an identifier, else false
+ */
+
+bool isIdentifier (const char* word, size_t len);
+
+//------------------------------------------------------------------------------
+
+#endif // LEXER_H_INCLUDED
@@ -0,0 +1,111 @@
+/*------------------------------------------------------------------------------
+    * File:        LogWriter.cpp                                               *
+    * Description: Functions of the buffered log file writer.                  *
+    * Created:     17 oct 2026                                                 *
+    * Author:      Artem Puzankov                                              *
+    * Email:       puzankov.ao@phystech.edu                                    *
+    * GitHub:      https://github.com/hellopuza                                *
+    * Copyright © 2021 Artem Puzankov. All rights reserved.                    *
+    *///------------------------------------------------------------------------
+
+#include "LogWriter.h"
+
+//------------------------------------------------------------------------------
+
+LogWriter::LogWriter (const char* logname) :
+    logname_ (logname)
+{
+    assert(logname != nullptr);
+}
+
+//------------------------------------------------------------------------------
+
+LogWriter::~LogWriter ()
+{
+    if (file_ != nullptr) fclose(file_);
+
+    file_    = nullptr;
+    logname_ = nullptr;
+}
+
+//------------------------------------------------------------------------------
+
+void LogWriter::Printf (const char* format, ...)
+{
+    assert(format != nullptr);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (file_ == nullptr)
+    {
+        file_ = fopen(logname_, "a");
+        assert(file_ != nullptr);
+
+        setvbuf(file_, nullptr, _IOFBF, LOG_BUFFER_SIZE);
+    }
+
+    size_t stamps = 0;
+    for (const char* ch = strstr(format, "%T"); ch != nullptr; ch = strstr(ch + 2, "%T")) ++stamps;
+
+    size_t size = strlen(format) + stamps * sizeof(stamp_) + 1;
+
+    char  local[256] = "";
+    char* fmt = (size <= sizeof(local)) ? local : new char [size];
+    char* cur = fmt;
+
+    const char* stamp = nullptr;
+
+    for (const char* ch = format; *ch != '\0'; ++ch)
+    {
+        if ((ch[0] == '%') && (ch[1] == '%'))
+        {
+            *cur++ = *ch++;
+            *cur++ = *ch;
+        }
+        else if ((ch[0] == '%') && (ch[1] == 'T'))
+        {
+            if (stamp == nullptr) stamp = TimeStamp();
+
+            cur = strcpy(cur, stamp) + strlen(stamp);
+            ++ch;
+        }
+        else *cur++ = *ch;
+    }
+    *cur = '\0';
+
+    va_list args;
+    va_start(args, format);
+    vfprintf(file_, fmt, args);
+    va_end(args);
+
+    if (fmt != local) delete [] fmt;
+}
+
+//------------------------------------------------------------------------------
+
+void LogWriter::Flush ()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (file_ != nullptr) fflush(file_);
+}
+
+//------------------------------------------------------------------------------
+
+const char* LogWriter::TimeStamp ()
+{
+    time_t t = time(NULL);
+
+    if (t != time_)
+    {
+        time_ = t;
+        struct tm tm = *localtime(&t);
+
+        snprintf(stamp_, sizeof(stamp_), "%d-%02d-%02d %02d:%02d:%02d",
+                 tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
+    }
+
+    return stamp_;
+}
+
+//------------------------------------------------------------------------------
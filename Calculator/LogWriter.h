@@ -0,0 +1,110 @@
+/*------------------------------------------------------------------------------
+    * File:        LogWriter.h                                                 *
+    * Description: Declaration of the buffered log file writer.                *
+    * Created:     17 oct 2026                                                 *
+    * Author:      Artem Puzankov                                              *
+    * Email:       puzankov.ao@phystech.edu                                    *
+    * GitHub:      https://github.com/hellopuza                                *
+    * Copyright © 2021 Artem Puzankov. All rights reserved.                    *
+    *///------------------------------------------------------------------------
+
+#ifndef LOGWRITER_H_INCLUDED
+#define LOGWRITER_H_INCLUDED
+
+#define _CRT_SECURE_NO_WARNINGS
+
+
+#include <assert.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <mutex>
+
+
+//==============================================================================
+/*------------------------------------------------------------------------------
+                   Log writer constants and types                              *
+*///----------------------------------------------------------------------------
+//==============================================================================
+
+
+const size_t LOG_BUFFER_SIZE = 1 << 16;
+const size_t LOG_STAMP_SIZE  = 6 * 12;  // six int fields of the time with separators
+
+class LogWriter
+{
+    const char* logname_ = nullptr;
+    FILE*       file_    = nullptr;
+
+    time_t time_                  = 0;
+    char   stamp_[LOG_STAMP_SIZE] = "";
+
+    std::mutex mutex_;
+
+public:
+
+//------------------------------------------------------------------------------
+/*! @brief   LogWriter constructor.
+ *
+ *  @note    File is opened on the first record and stays open.
+ *
+ *  @param   logname     Name of the log file
+ */
+
+    LogWriter (const char* logname);
+
+//------------------------------------------------------------------------------
+/*! @brief   LogWriter copy constructor (deleted).
+ *
+ *  @param   obj         Source writer
+ */
+
+    LogWriter (const LogWriter& obj);
+
+    LogWriter& operator = (const LogWriter& obj); // deleted
+
+//------------------------------------------------------------------------------
+/*! @brief   LogWriter destructor, flushes and closes the file.
+ */
+
+   ~LogWriter ();
+
+//------------------------------------------------------------------------------
+/*! @brief   Write formatted record to the log buffer.
+ *
+ *  @note    Every "%T" in format is replaced by the current time. Records
+ *           from different threads are not mixed.
+ *
+ *  @param   format      Format string like printf
+ */
+
+    void Printf (const char* format, ...);
+
+//------------------------------------------------------------------------------
+/*! @brief   Write buffered records to the file.
+ */
+
+    void Flush ();
+
+/*------------------------------------------------------------------------------
+                   Private functions                                           *
+*///----------------------------------------------------------------------------
+
+private:
+
+//------------------------------------------------------------------------------
+/*! @brief   Get current time as a string, converting it once a second.
+ *
+ *  @return  time string
+ */
+
+    const char* TimeStamp ();
+
+//------------------------------------------------------------------------------
+};
+
+//------------------------------------------------------------------------------
+
+#endif // LOGWRITER_H_INCLUDED
@@ -0,0 +1,113 @@
+/*------------------------------------------------------------------------------
+    * File:        NumberBench.cpp                                             *
+    * Description: Benchmark of the number parser against strtod.              *
+    * Created:     17 oct 2026                                                 *
+    * Author:      Artem Puzankov                                              *
+    * Email:       puzankov.ao@phystech.edu                                    *
+    * GitHub:      https://github.com/hellopuza                                *
+    * Copyright © 2021 Artem Puzankov. All rights reserved.                    *
+    *///------------------------------------------------------------------------
+
+#include "NumberParser.h"
+#include <chrono>
+#include <random>
+#include <math.h>
+#include <stdio.h>
+
+//------------------------------------------------------------------------------
+
+const size_t BENCH_NUMBERS = 1000000;
+const int    BENCH_ROUNDS  = 5;
+
+struct Literal
+{
+    size_t begin = 0;
+    size_t len   = 0;
+};
+
+//------------------------------------------------------------------------------
+
+static double Seconds ()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//------------------------------------------------------------------------------
+
+static double StrtodPath (const char* str, size_t len)
+{
+    char local[MAX_NUMBER_LEN] = "";
+
+    memcpy(local, str, len);
+    local[len] = '\0';
+
+    return strtod(local, nullptr);
+}
+
+//------------------------------------------------------------------------------
+
+int main (int argc, char* argv[])
+{
+    size_t num = (argc > 1) ? (size_t)atol(argv[1]) : BENCH_NUMBERS;
+
+    // Coefficients like in polynomial fits: up to 17 significant digits,
+    // a quarter of them with exponent
+    std::mt19937_64 rng(2021);
+    std::uniform_real_distribution<double> coef(-1000, 1000);
+
+    char*    text    = new char [num * MAX_NUMBER_LEN];
+    Literal* numbers = new Literal [num];
+    size_t   size    = 0;
+
+    for (size_t i = 0; i < num; ++i)
+    {
+        double value  = fabs(coef(rng));
+        int    digits = 1 + (int)(rng() % 17);
+
+        int len = (rng() % 4 == 0) ? sprintf(text + size, "%.*e", digits - 1, value * 1e-6)
+                                   : sprintf(text + size, "%.*f", digits % 10, value);
+
+        numbers[i] = { size, (size_t)len };
+        size += len;
+    }
+
+    double strtod_time = 0;
+    double fast_time   = 0;
+    double check       = 0;
+
+    for (int round = 0; round < BENCH_ROUNDS; ++round)
+    {
+        double begin = Seconds();
+        for (size_t i = 0; i < num; ++i) check += StrtodPath(text + numbers[i].begin, numbers[i].len);
+
+        double middle = Seconds();
+        for (size_t i = 0; i < num; ++i) check -= Str2Double(text + numbers[i].begin, numbers[i].len);
+
+        fast_time   += Seconds() - middle;
+        strtod_time += middle - begin;
+    }
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < num; ++i)
+    {
+        double expected = StrtodPath(text + numbers[i].begin, numbers[i].len);
+        double value    = Str2Double(text + numbers[i].begin, numbers[i].len);
+
+        if (memcmp(&expected, &value, sizeof(double)) != 0) ++mismatches;
+    }
+
+    double total = (double)num * BENCH_ROUNDS;
+
+    printf("numbers:    %zu (%zu bytes)\n", num, size);
+    printf("strtod:     %.1f ns/number\n", strtod_time / total * 1e9);
+    printf("Str2Double: %.1f ns/number\n", fast_time   / total * 1e9);
+    printf("speedup:    %.2fx\n",          strtod_time / fast_time);
+    printf("mismatches: %zu (checksum %g)\n", mismatches, check);
+
+    delete [] text;
+    delete [] numbers;
+
+    return (mismatches == 0) ? 0 : 1;
+}
+
+//------------------------------------------------------------------------------
@@ -0,0 +1,66 @@
+/*------------------------------------------------------------------------------
+    * File:        NumberParser.h                                              *
+    * Description: Declaration of the fast decimal number parser.              *
+    * Created:     17 oct 2026                                                 *
+    * Author:      Artem Puzankov                                              *
+    * Email:       puzankov.ao@phystech.edu                                    *
+    * GitHub:      https://github.com/hellopuza                                *
+    * Copyright © 2021 Artem Puzankov. All rights reserved.                    *
+    *///------------------------------------------------------------------------
+
+#ifndef NUMBERPARSER_H_INCLUDED
+#define NUMBERPARSER_H_INCLUDED
+
+#define _CRT_SECURE_NO_WARNINGS
+
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+//==============================================================================
+/*------------------------------------------------------------------------------
+                   Number parser constants and types                           *
+*///----------------------------------------------------------------------------
+//==============================================================================
+
+
+const int    MAX_MANTISSA_DIGITS    = 19;     // decimal digits always fitting in uint64_t
+const int    SMALLEST_POWER_OF_TEN  = -342;   // smaller powers give zero
+const int    LARGEST_POWER_OF_TEN   = 308;    // larger powers give infinity
+const int    MAX_EXACT_POWER_OF_TEN = 22;     // 10^22 is the largest power exact in double
+const size_t MAX_NUMBER_LEN         = 64;     // longer numbers are copied to heap for strtod
+
+//------------------------------------------------------------------------------
+/*! @brief   Convert decimal number to the nearest double.
+ *
+ *  @note    Number is digits with optional fraction and exponent ("12.5e-3"),
+ *           parsing stops at the first other character. Result is the same
+ *           as of strtod in "C" locale, which is called only if the fast
+ *           algorithms can not decide the rounding.
+ *
+ *  @param   str         Number characters (need not be null terminated)
+ *  @param   len         Number of characters
+ *
+ *  @return  value
+ */
+
+double Str2Double (const char* str, size_t len);
+
+//------------------------------------------------------------------------------
+/*! @brief   Convert decimal mantissa and exponent to double by Eisel-Lemire
+ *           algorithm.
+ *
+ *  @param   q           Decimal exponent
+ *  @param   w           Decimal mantissa (not zero)
+ *  @param   value       Result
+ *
+ *  @return  false if the rounding can not be decided, else true
+ */
+
+bool EiselLemire (int64_t q, uint64_t w, double& value);
+
+//------------------------------------------------------------------------------
+
+#endif // NUMBERPARSER_H_INCLUDED
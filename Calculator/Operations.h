@@ -51,55 +51,131 @@ enum OperationsCodes
 
 struct operation
 {
-    char code  = 0;
-    char* word = 0;
+    char        code = 0;
+    const char* word = 0;
 };
 
-static operation op_names[] =
+// Entry with code N must be at index N. Words starting with a letter are
+// functions, they are found by findFunc through the hash table below.
+
+constexpr operation op_names[] =
 {
-    { OP_ERR      , (char*) "#ERR#"   },
-    { OP_ADD      , (char*) "+"       },
-    { OP_SUB      , (char*) "-"       },
-    { OP_MUL      , (char*) "*"       },
-    { OP_DIV      , (char*) "/"       },
-    { OP_POW      , (char*) "^"       },
-    { OP_ARCCOS   , (char*) "arccos"  },
-    { OP_ARCCOSH  , (char*) "arccosh" },
-    { OP_ARCCOT   , (char*) "arccot"  },
-    { OP_ARCCOTH  , (char*) "arccoth" },
-    { OP_ARCSIN   , (char*) "arcsin"  },
-    { OP_ARCSINH  , (char*) "arcsinh" },
-    { OP_ARCTAN   , (char*) "arctan"  },
-    { OP_ARCTANH  , (char*) "arctanh" },
-    { OP_COS      , (char*) "cos"     },
-    { OP_COSH     , (char*) "cosh"    },
-    { OP_COT      , (char*) "cot"     },
-    { OP_COTH     , (char*) "coth"    },
-    { OP_EXP      , (char*) "exp"     },
-    { OP_LG       , (char*) "lg"      },
-    { OP_LN       , (char*) "ln"      },
-    { OP_SIN      , (char*) "sin"     },
-    { OP_SINH     , (char*) "sinh"    },
-    { OP_SQRT     , (char*) "sqrt"    },
-    { OP_TAN      , (char*) "tan"     },
-    { OP_TANH     , (char*) "tanh"    },
+    { OP_ERR      , "#ERR#"   },
+    { OP_ADD      , "+"       },
+    { OP_SUB      , "-"       },
+    { OP_MUL      , "*"       },
+    { OP_DIV      , "/"       },
+    { OP_POW      , "^"       },
+    { OP_ARCCOS   , "arccos"  },
+    { OP_ARCCOSH  , "arccosh" },
+    { OP_ARCCOT   , "arccot"  },
+    { OP_ARCCOTH  , "arccoth" },
+    { OP_ARCSIN   , "arcsin"  },
+    { OP_ARCSINH  , "arcsinh" },
+    { OP_ARCTAN   , "arctan"  },
+    { OP_ARCTANH  , "arctanh" },
+    { OP_COS      , "cos"     },
+    { OP_COSH     , "cosh"    },
+    { OP_COT      , "cot"     },
+    { OP_COTH     , "coth"    },
+    { OP_EXP      , "exp"     },
+    { OP_LG       , "lg"      },
+    { OP_LN       , "ln"      },
+    { OP_SIN      , "sin"     },
+    { OP_SINH     , "sinh"    },
+    { OP_SQRT     , "sqrt"    },
+    { OP_TAN      , "tan"     },
+    { OP_TANH     , "tanh"    },
 };
 
 const int OP_NUM = sizeof(op_names) / sizeof(op_names[0]);
 
+/*------------------------------------------------------------------------------
+                   Perfect hash of function names                              *
+*///----------------------------------------------------------------------------
+
+
+constexpr size_t FUNC_HASH_SIZE = 64;
+
+struct FuncHashTable
+{
+    unsigned seed = 0;
+    char     slot[FUNC_HASH_SIZE] = {};
+};
+
+//------------------------------------------------------------------------------
+
+constexpr size_t ConstStrLen (const char* word)
+{
+    size_t len = 0;
+    while (word[len] != '\0') ++len;
+
+    return len;
+}
+
+//------------------------------------------------------------------------------
+
+constexpr size_t FuncHash (const char* word, size_t len, unsigned seed)
+{
+    unsigned hash = seed;
+    for (size_t i = 0; i < len; ++i)
+        hash = (hash ^ (unsigned char)word[i]) * 16777619u;
+
+    return (hash ^ (hash >> 16)) % FUNC_HASH_SIZE;
+}
+
 //------------------------------------------------------------------------------
 
-inline int CompareOP_Names (const void* p1, const void* p2)
+constexpr bool isFuncName (const char* word)
 {
-    assert(p1 != nullptr);
-    assert(p2 != nullptr);
-    assert(p1 != p2);
+    return ((word[0] >= 'a') && (word[0] <= 'z')) ||
+           ((word[0] >= 'A') && (word[0] <= 'Z'));
+}
+
+//------------------------------------------------------------------------------
 
-    // printf("CompareOP_Names: s1(%p): %s, s2(%p): %s\n", p1, ((struct operation*)p1)->word, p2, ((struct operation*)p2)->word);
+constexpr bool CheckOpNames ()
+{
+    for (int i = 0; i < OP_NUM; ++i)
+        if (op_names[i].code != i) return false;
 
-    return strcmp(((struct operation*)p1)->word, ((struct operation*)p2)->word);
+    return true;
 }
 
+static_assert(CheckOpNames(), "op_names entries must be ordered by their codes");
+
+//------------------------------------------------------------------------------
+
+constexpr FuncHashTable MakeFuncHashTable ()
+{
+    for (unsigned seed = 2166136261u; seed != 2166136261u + 100000; ++seed)
+    {
+        FuncHashTable table = {};
+        table.seed = seed;
+
+        bool collision = false;
+        for (int code = 0; (code < OP_NUM) && (not collision); ++code)
+        {
+            if (not isFuncName(op_names[code].word)) continue;
+
+            size_t slot = FuncHash(op_names[code].word, ConstStrLen(op_names[code].word), seed);
+
+            if (table.slot[slot] != OP_ERR)
+                collision = true;
+            else
+                table.slot[slot] = code;
+        }
+
+        if (not collision) return table;
+    }
+
+    return {};
+}
+
+constexpr FuncHashTable func_hash_table = MakeFuncHashTable();
+
+static_assert(func_hash_table.seed != 0, "no perfect hash found for function names, enlarge FUNC_HASH_SIZE");
+
 //------------------------------------------------------------------------------
 
-#endif // OPERATIONS_H_INCLUDED
\ No newline at end of file
+#endif // OPERATIONS_H_INCLUDED
\ No newline at end of file
@@ -0,0 +1,365 @@
+/*------------------------------------------------------------------------------
+    * File:        ParseCache.cpp                                              *
+    * Description: Functions of the LRU cache of parsed expressions.           *
+    * Created:     17 oct 2026                                                 *
+    * Author:      Artem Puzankov                                              *
+    * Email:       puzankov.ao@phystech.edu                                    *
+    * GitHub:      https://github.com/hellopuza                                *
+    * Copyright © 2021 Artem Puzankov. All rights reserved.                    *
+    *///------------------------------------------------------------------------
+
+#include "ParseCache.h"
+
+ParseCache parse_cache;
+
+//------------------------------------------------------------------------------
+
+ParseCache::ParseCache (size_t budget) :
+    budget_      (budget),
+    buckets_num_ (DEFAULT_PARSE_CACHE_BUCKETS)
+{
+    buckets_ = new CacheEntry* [buckets_num_] {};
+}
+
+//------------------------------------------------------------------------------
+
+ParseCache::~ParseCache ()
+{
+    while (oldest_ != nullptr)
+    {
+        CacheEntry* entry = oldest_;
+        oldest_ = entry->newer;
+
+        DeleteEntry(entry);
+    }
+
+    delete [] buckets_;
+
+    buckets_ = nullptr;
+    newest_  = nullptr;
+    size_    = 0;
+    used_    = 0;
+}
+
+//------------------------------------------------------------------------------
+
+int ParseCache::Parse (Expression& expr, Tree<CalcNodeData>& tree)
+{
+    assert(expr.str != nullptr);
+
+    if (budget_ == 0) return Expr2Tree(expr, tree);
+
+    // Key has a space after every token but the last, so it is at most
+    // twice as long as the expression
+    size_t len  = strlen(expr.str);
+    char   local[MAX_STR_LEN] = "";
+    char*  norm = (2 * len < sizeof(local)) ? local : new char [2 * len + 1];
+
+    len = NormalizeExpr(expr.str, norm);
+    size_t hash = SymbolHash(norm, len);
+
+    CacheEntry* entry = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        entry = Find(norm, len, hash);
+        if (entry != nullptr)
+        {
+            ++hits_;
+            ++entry->users;
+
+            Unlink(entry);
+            LinkNewest(entry);
+        }
+        else ++misses_;
+    }
+
+    if (entry != nullptr)
+    {
+        if (norm != local) delete [] norm;
+
+        // Cloning is done without the lock, the entry is pinned by users.
+        // Copy keeps parents and depths of the nodes.
+        tree.root_ = new Node<CalcNodeData>;
+        *tree.root_ = *entry->root;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        --entry->users;
+        if (entry->evicted && (entry->users == 0)) DeleteEntry(entry);
+
+        return CALC_OK;
+    }
+
+    int err = Expr2Tree(expr, tree);
+    if (err)
+    {
+        if (norm != local) delete [] norm;
+        return err;
+    }
+
+    entry = new CacheEntry;
+
+    entry->len  = len;
+    entry->hash = hash;
+    entry->text = new char [len + 1];
+    memcpy(entry->text, norm, len + 1);
+
+    entry->root  = new Node<CalcNodeData>;
+    *entry->root = *tree.root_;
+
+    entry->bytes = sizeof(CacheEntry) + len + 1 + CountNodes(entry->root) * sizeof(Node<CalcNodeData>);
+
+    if (norm != local) delete [] norm;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if ((entry->bytes > budget_) || (Find(entry->text, entry->len, entry->hash) != nullptr))
+        DeleteEntry(entry);
+    else
+        Insert(entry);
+
+    return CALC_OK;
+}
+
+//------------------------------------------------------------------------------
+
+void ParseCache::setBudget (size_t budget)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    budget_ = budget;
+    Evict();
+}
+
+//------------------------------------------------------------------------------
+
+void ParseCache::Clear ()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    while (oldest_ != nullptr) Remove(oldest_);
+}
+
+//------------------------------------------------------------------------------
+
+size_t ParseCache::getHits ()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    return hits_;
+}
+
+//------------------------------------------------------------------------------
+
+size_t ParseCache::getMisses ()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    return misses_;
+}
+
+//------------------------------------------------------------------------------
+
+size_t ParseCache::getUsed ()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    return used_;
+}
+
+//------------------------------------------------------------------------------
+
+CacheEntry* ParseCache::Find (const char* text, size_t len, size_t hash)
+{
+    CacheEntry* entry = buckets_[hash & (buckets_num_ - 1)];
+
+    while (entry != nullptr)
+    {
+        if ((entry->hash == hash) && (entry->len == len) && (memcmp(entry->text, text, len) == 0))
+            return entry;
+
+        entry = entry->chain;
+    }
+
+    return nullptr;
+}
+
+//------------------------------------------------------------------------------
+
+void ParseCache::Insert (CacheEntry* entry)
+{
+    size_t bucket = entry->hash & (buckets_num_ - 1);
+
+    entry->chain     = buckets_[bucket];
+    buckets_[bucket] = entry;
+
+    LinkNewest(entry);
+
+    used_ += entry->bytes;
+    ++size_;
+
+    if (size_ > buckets_num_) Rehash();
+
+    Evict();
+}
+
+//------------------------------------------------------------------------------
+
+void ParseCache::Remove (CacheEntry* entry)
+{
+    CacheEntry** link = &buckets_[entry->hash & (buckets_num_ - 1)];
+    while (*link != entry) link = &(*link)->chain;
+
+    *link = entry->chain;
+    Unlink(entry);
+
+    used_ -= entry->bytes;
+    --size_;
+
+    if (entry->users == 0)
+        DeleteEntry(entry);
+    else
+        entry->evicted = true;
+}
+
+//------------------------------------------------------------------------------
+
+void ParseCache::Evict ()
+{
+    CacheEntry* entry = oldest_;
+
+    while ((used_ > budget_) && (entry != nullptr))
+    {
+        CacheEntry* newer = entry->newer;
+        Remove(entry);
+
+        entry = newer;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void ParseCache::Rehash ()
+{
+    CacheEntry** old     = buckets_;
+    size_t       old_num = buckets_num_;
+
+    buckets_num_ *= 2;
+    buckets_      = new CacheEntry* [buckets_num_] {};
+
+    for (size_t i = 0; i < old_num; ++i)
+    {
+        CacheEntry* entry = old[i];
+
+        while (entry != nullptr)
+        {
+            CacheEntry* next   = entry->chain;
+            size_t      bucket = entry->hash & (buckets_num_ - 1);
+
+            entry->chain     = buckets_[bucket];
+            buckets_[bucket] = entry;
+
+            entry = next;
+        }
+    }
+
+    delete [] old;
+}
+
+//------------------------------------------------------------------------------
+
+void ParseCache::Unlink (CacheEntry* entry)
+{
+    if (entry->newer != nullptr) entry->newer->older = entry->older;
+    else newest_ = entry->older;
+
+    if (entry->older != nullptr) entry->older->newer = entry->newer;
+    else oldest_ = entry->newer;
+
+    entry->newer = nullptr;
+    entry->older = nullptr;
+}
+
+//------------------------------------------------------------------------------
+
+void ParseCache::LinkNewest (CacheEntry* entry)
+{
+    entry->older = newest_;
+    entry->newer = nullptr;
+
+    if (newest_ != nullptr) newest_->newer = entry;
+    else oldest_ = entry;
+
+    newest_ = entry;
+}
+
+//------------------------------------------------------------------------------
+
+size_t NormalizeExpr (const char* str, char* norm)
+{
+    assert(str  != nullptr);
+    assert(norm != nullptr);
+
+    // Texts of the tokens are separated by one space whatever was between
+    // them, so the expressions with the same tokens have the same key and
+    // the key never joins two tokens into one, as '2e -1' and '2e-1'
+    Lexer lexer(str, strlen(str));
+    lexer.Tokenize();
+
+    size_t len = 0;
+
+    for (size_t i = 0; lexer.tokens_[i].kind != TOK_END; ++i)
+    {
+        const Token& token = lexer.tokens_[i];
+
+        if (i != 0) norm[len++] = ' ';
+
+        memcpy(norm + len, str + token.begin, token.len);
+        len += token.len;
+    }
+
+    norm[len] = '\0';
+
+    return len;
+}
+
+//------------------------------------------------------------------------------
+
+size_t CountNodes (Node<CalcNodeData>* node_cur)
+{
+    if (node_cur == nullptr) return 0;
+
+    // Explicit stack, so the depth of the tree is not limited by the stack
+    // of the thread
+    std::vector<Node<CalcNodeData>*> work = { node_cur };
+    size_t count = 0;
+
+    while (not work.empty())
+    {
+        Node<CalcNodeData>* node = work.back();
+        work.pop_back();
+
+        ++count;
+
+        if (node->left_  != nullptr) work.push_back(node->left_);
+        if (node->right_ != nullptr) work.push_back(node->right_);
+
+        for (size_t i = 0; i < node->args_num_; ++i) work.push_back(node->args_[i]);
+    }
+
+    return count;
+}
+
+//------------------------------------------------------------------------------
+
+void DeleteEntry (CacheEntry* entry)
+{
+    assert(entry != nullptr);
+
+    delete entry->root;
+    delete [] entry->text;
+    delete entry;
+}
+
+//------------------------------------------------------------------------------
@@ -0,0 +1,245 @@
+/*------------------------------------------------------------------------------
+    * File:        ParseCache.h                                                *
+    * Description: Declaration of the LRU cache of parsed expressions.         *
+    * Created:     17 oct 2026                                                 *
+    * Author:      Artem Puzankov                                              *
+    * Email:       puzankov.ao@phystech.edu                                    *
+    * GitHub:      https://github.com/hellopuza                                *
+    * Copyright © 2021 Artem Puzankov. All rights reserved.                    *
+    *///------------------------------------------------------------------------
+
+#ifndef PARSECACHE_H_INCLUDED
+#define PARSECACHE_H_INCLUDED
+
+#define _CRT_SECURE_NO_WARNINGS
+
+
+#include "Calculator.h"
+#include <mutex>
+
+
+//==============================================================================
+/*------------------------------------------------------------------------------
+                   Parse cache constants and types                             *
+*///----------------------------------------------------------------------------
+//==============================================================================
+
+
+const size_t DEFAULT_PARSE_CACHE_BUDGET  = 64 << 20;
+const size_t DEFAULT_PARSE_CACHE_BUCKETS = 1024;
+
+struct CacheEntry
+{
+    char*               text  = nullptr;    // normalized expression
+    size_t              len   = 0;
+    size_t              hash  = 0;
+    Node<CalcNodeData>* root  = nullptr;    // parsed tree, never modified
+    size_t              bytes = 0;          // memory taken by the entry
+
+    int  users   = 0;                       // number of trees being cloned from the entry now
+    bool evicted = false;
+
+    CacheEntry* newer = nullptr;            // LRU list
+    CacheEntry* older = nullptr;
+    CacheEntry* chain = nullptr;            // next entry in the same bucket
+};
+
+class ParseCache
+{
+    size_t budget_ = 0;
+    size_t used_   = 0;
+
+    CacheEntry** buckets_     = nullptr;
+    size_t       buckets_num_ = 0;
+    size_t       size_        = 0;
+
+    CacheEntry* newest_ = nullptr;
+    CacheEntry* oldest_ = nullptr;
+
+    size_t hits_   = 0;
+    size_t misses_ = 0;
+
+    std::mutex mutex_;
+
+public:
+
+//------------------------------------------------------------------------------
+/*! @brief   ParseCache constructor.
+ *
+ *  @param   budget      Memory available for the cached trees in bytes
+ */
+
+    ParseCache (size_t budget = DEFAULT_PARSE_CACHE_BUDGET);
+
+//------------------------------------------------------------------------------
+/*! @brief   ParseCache copy constructor (deleted).
+ *
+ *  @param   obj         Source cache
+ */
+
+    ParseCache (const ParseCache& obj);
+
+    ParseCache& operator = (const ParseCache& obj); // deleted
+
+//------------------------------------------------------------------------------
+/*! @brief   ParseCache destructor.
+ */
+
+   ~ParseCache ();
+
+//------------------------------------------------------------------------------
+/*! @brief   Convert string expression to tree, cloning the cached tree if the
+ *           same expression was parsed before.
+ *
+ *  @note    Expressions differing only in whitespace share the entry. Only
+ *           successfully parsed expressions are cached.
+ *
+ *  @param   expr        String expression
+ *  @param   tree        Equation tree
+ *
+ *  @return  -1 if error, 0 if ok
+ */
+
+    int Parse (Expression& expr, Tree<CalcNodeData>& tree);
+
+//------------------------------------------------------------------------------
+/*! @brief   Change memory budget, evicting old entries if needed.
+ *
+ *  @param   budget      Memory available for the cached trees in bytes (0 disables cache)
+ */
+
+    void setBudget (size_t budget);
+
+//------------------------------------------------------------------------------
+/*! @brief   Remove all entries that are not in use.
+ */
+
+    void Clear ();
+
+//------------------------------------------------------------------------------
+/*! @brief   Get number of expressions found in the cache.
+ *
+ *  @return  number of hits
+ */
+
+    size_t getHits ();
+
+//------------------------------------------------------------------------------
+/*! @brief   Get number of expressions parsed from scratch.
+ *
+ *  @return  number of misses
+ */
+
+    size_t getMisses ();
+
+//------------------------------------------------------------------------------
+/*! @brief   Get memory taken by the cached entries.
+ *
+ *  @return  number of bytes
+ */
+
+    size_t getUsed ();
+
+/*------------------------------------------------------------------------------
+                   Private functions                                           *
+*///----------------------------------------------------------------------------
+
+private:
+
+//------------------------------------------------------------------------------
+/*! @brief   Find entry with normalized expression.
+ *
+ *  @param   text        Normalized expression
+ *  @param   len         Its length
+ *  @param   hash        Its hash
+ *
+ *  @return  pointer to entry, nullptr if there is no such entry
+ */
+
+    CacheEntry* Find (const char* text, size_t len, size_t hash);
+
+//------------------------------------------------------------------------------
+/*! @brief   Add entry as the newest one and evict the oldest entries over budget.
+ *
+ *  @param   entry       New entry
+ */
+
+    void Insert (CacheEntry* entry);
+
+//------------------------------------------------------------------------------
+/*! @brief   Remove entry from the hash table and the LRU list.
+ *
+ *  @note    Entry in use is deleted by its last user.
+ *
+ *  @param   entry       Entry to remove
+ */
+
+    void Remove (CacheEntry* entry);
+
+//------------------------------------------------------------------------------
+/*! @brief   Evict the oldest entries not in use until memory fits the budget.
+ */
+
+    void Evict ();
+
+//------------------------------------------------------------------------------
+/*! @brief   Double the number of buckets and rehash all entries.
+ */
+
+    void Rehash ();
+
+//------------------------------------------------------------------------------
+/*! @brief   Unlink entry from the LRU list.
+ *
+ *  @param   entry       Entry to unlink
+ */
+
+    void Unlink (CacheEntry* entry);
+
+//------------------------------------------------------------------------------
+/*! @brief   Link entry to the LRU list as the newest one.
+ *
+ *  @param   entry       Entry to link
+ */
+
+    void LinkNewest (CacheEntry* entry);
+
+//------------------------------------------------------------------------------
+};
+
+//------------------------------------------------------------------------------
+/*! @brief   Write the tokens of the expression separated by single spaces.
+ *
+ *  @param   str         String expression
+ *  @param   norm        Buffer for normalized expression (at least 2 * strlen(str) + 1)
+ *
+ *  @return  length of normalized expression
+ */
+
+size_t NormalizeExpr (const char* str, char* norm);
+
+//------------------------------------------------------------------------------
+/*! @brief   Count nodes of the tree.
+ *
+ *  @param   node_cur    Root of the tree
+ *
+ *  @return  number of nodes
+ */
+
+size_t CountNodes (Node<CalcNodeData>* node_cur);
+
+//------------------------------------------------------------------------------
+/*! @brief   Delete cache entry with its tree and text.
+ *
+ *  @param   entry       Entry to delete
+ */
+
+void DeleteEntry (CacheEntry* entry);
+
+//------------------------------------------------------------------------------
+
+extern ParseCache parse_cache;
+
+//------------------------------------------------------------------------------
+
+#endif // PARSECACHE_H_INCLUDED
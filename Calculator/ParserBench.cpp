@@ -0,0 +1,103 @@
+/*------------------------------------------------------------------------------
+    * File:        ParserBench.cpp                                             *
+    * Description: Benchmark of the expression parser per token.               *
+    * Created:     17 oct 2026                                                 *
+    * Author:      Artem Puzankov                                              *
+    * Email:       puzankov.ao@phystech.edu                                    *
+    * GitHub:      https://github.com/hellopuza                                *
+    * Copyright © 2021 Artem Puzankov. All rights reserved.                    *
+    *///------------------------------------------------------------------------
+
+#include "Calculator.h"
+#include <chrono>
+#include <string>
+
+//------------------------------------------------------------------------------
+
+const size_t BENCH_FLAT_TERMS = 21500;
+const size_t BENCH_BRACKETS   = 1000000;
+const size_t BENCH_FUNCTIONS  = 100000;
+const size_t BENCH_POWERS     = 100000;
+const int    BENCH_ROUNDS     = 5;
+
+//------------------------------------------------------------------------------
+
+static double Seconds ()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//------------------------------------------------------------------------------
+
+static size_t CountTokens (const std::string& text)
+{
+    Lexer lexer(text.c_str(), text.size());
+    lexer.Tokenize();
+
+    return lexer.num_ - 1; // without TOK_END
+}
+
+//------------------------------------------------------------------------------
+
+static int Measure (const char* name, const std::string& text)
+{
+    size_t tokens = CountTokens(text);
+    double best   = 0;
+
+    // Time of lexing, parsing and deleting the tree, the best of the rounds
+    for (int round = 0; round < BENCH_ROUNDS; ++round)
+    {
+        std::string copy = text;
+        Expression  expr = {};
+        expr.str = (char*)copy.c_str();
+
+        double begin = Seconds();
+        {
+            Tree<CalcNodeData> tree((char*)"expression");
+
+            int err = Expr2Tree(expr, tree);
+            if (err)
+            {
+                printf("%-16s syntax error\n", name);
+                return err;
+            }
+        }
+        double time = Seconds() - begin;
+
+        if ((round == 0) || (time < best)) best = time;
+    }
+
+    printf("%-16s %8zu tokens %8.1f ns/token\n", name, tokens, best / tokens * 1e9);
+
+    return CALC_OK;
+}
+
+//------------------------------------------------------------------------------
+
+int main ()
+{
+    // Flat chain of terms 'x+y*1.5-x/2+...', 4 tokens each
+    std::string flat = "x";
+    for (size_t i = 0; i < BENCH_FLAT_TERMS; ++i)
+        flat += (i % 2 == 0) ? "+y*1.5" : "-x/2";
+
+    std::string brackets = std::string(BENCH_BRACKETS, '(') + "x" + std::string(BENCH_BRACKETS, ')');
+
+    std::string functions = "";
+    for (size_t i = 0; i < BENCH_FUNCTIONS; ++i) functions += "sin(";
+    functions += "x" + std::string(BENCH_FUNCTIONS, ')');
+
+    std::string powers = "x";
+    for (size_t i = 0; i < BENCH_POWERS; ++i) powers += "^x";
+
+    int err = CALC_OK;
+
+    if (!err) err = Measure("flat chain",      flat);
+    if (!err) err = Measure("nested brackets", brackets);
+    if (!err) err = Measure("nested sin",      functions);
+    if (!err) err = Measure("x^x^...^x",       powers);
+
+    return err;
+}
+
+//------------------------------------------------------------------------------
@@ -0,0 +1,166 @@
+/*------------------------------------------------------------------------------
+    * File:        SymbolTable.cpp                                             *
+    * Description: Functions of the global table of interned identifiers.      *
+    * Created:     17 oct 2026                                                 *
+    * Author:      Artem Puzankov                                              *
+    * Email:       puzankov.ao@phystech.edu                                    *
+    * GitHub:      https://github.com/hellopuza                                *
+    * Copyright © 2021 Artem Puzankov. All rights reserved.                    *
+    *///------------------------------------------------------------------------
+
+#include "SymbolTable.h"
+
+SymbolTable symbols;
+
+//------------------------------------------------------------------------------
+
+SymbolTable::SymbolTable () :
+    buckets_num_ (DEFAULT_HASH_BUCKETS)
+{
+    buckets_ = new int    [buckets_num_];
+    hashes_  = new size_t [buckets_num_] {};
+
+    for (size_t i = 0; i < buckets_num_; ++i) buckets_[i] = NO_SYMBOL;
+}
+
+//------------------------------------------------------------------------------
+
+SymbolTable::~SymbolTable ()
+{
+    for (size_t i = 0; i < SYMBOLS_MAX_PAGES; ++i)
+        delete [] pages_[i];
+
+    delete [] buckets_;
+    delete [] hashes_;
+
+    buckets_ = nullptr;
+    hashes_  = nullptr;
+    size_    = 0;
+
+    // Names are referenced by nodes of the trees, that can be destroyed
+    // after this table, so the arena blocks are left to the system.
+    arena_ = nullptr;
+}
+
+//------------------------------------------------------------------------------
+
+int SymbolTable::Intern (const char* word, size_t len)
+{
+    assert(word != nullptr);
+
+    size_t hash = SymbolHash(word, len);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    size_t mask   = buckets_num_ - 1;
+    size_t bucket = hash & mask;
+
+    while (buckets_[bucket] != NO_SYMBOL)
+    {
+        if (hashes_[bucket] == hash)
+        {
+            const char* name = getName(buckets_[bucket]);
+
+            if ((strncmp(name, word, len) == 0) && (name[len] == '\0'))
+                return buckets_[bucket];
+        }
+
+        bucket = (bucket + 1) & mask;
+    }
+
+    size_t size = size_;
+    if (size == SYMBOLS_PAGE_SIZE * SYMBOLS_MAX_PAGES) return NO_SYMBOL;
+
+    size_t page = size / SYMBOLS_PAGE_SIZE;
+    if (pages_[page] == nullptr)
+        pages_[page] = new const char* [SYMBOLS_PAGE_SIZE] {};
+
+    int id = size;
+    pages_[page][size % SYMBOLS_PAGE_SIZE] = Store(word, len);
+    size_ = size + 1;
+
+    buckets_[bucket] = id;
+    hashes_ [bucket] = hash;
+
+    if (2 * (size + 1) > buckets_num_) Rehash();
+
+    return id;
+}
+
+//------------------------------------------------------------------------------
+
+int SymbolTable::Intern (const char* word)
+{
+    assert(word != nullptr);
+
+    return Intern(word, strlen(word));
+}
+
+//------------------------------------------------------------------------------
+
+const char* SymbolTable::getName (int id) const
+{
+    assert((id >= 0) && ((size_t)id < size_));
+
+    return pages_[id / SYMBOLS_PAGE_SIZE][id % SYMBOLS_PAGE_SIZE];
+}
+
+//------------------------------------------------------------------------------
+
+size_t SymbolTable::getSize () const
+{
+    return size_;
+}
+
+//------------------------------------------------------------------------------
+
+void SymbolTable::Rehash ()
+{
+    delete [] buckets_;
+    delete [] hashes_;
+
+    buckets_num_ *= 2;
+
+    buckets_ = new int    [buckets_num_];
+    hashes_  = new size_t [buckets_num_] {};
+
+    for (size_t i = 0; i < buckets_num_; ++i) buckets_[i] = NO_SYMBOL;
+
+    size_t mask = buckets_num_ - 1;
+
+    for (size_t id = 0; id < size_; ++id)
+    {
+        const char* name = getName(id);
+        size_t      hash = SymbolHash(name, strlen(name));
+
+        size_t bucket = hash & mask;
+        while (buckets_[bucket] != NO_SYMBOL) bucket = (bucket + 1) & mask;
+
+        buckets_[bucket] = id;
+        hashes_ [bucket] = hash;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+const char* SymbolTable::Store (const char* word, size_t len)
+{
+    if (len + 1 > arena_free_)
+    {
+        size_t block = (len + 1 > SYMBOLS_ARENA_SIZE) ? len + 1 : SYMBOLS_ARENA_SIZE;
+
+        arena_      = new char[block];
+        arena_free_ = block;
+    }
+
+    char* name = arena_;
+    memcpy(name, word, len);
+    name[len] = '\0';
+
+    arena_      += len + 1;
+    arena_free_ -= len + 1;
+
+    return name;
+}
+
+//------------------------------------------------------------------------------
@@ -0,0 +1,167 @@
+/*------------------------------------------------------------------------------
+    * File:        SymbolTable.h                                               *
+    * Description: Declaration of the global table of interned identifiers.    *
+    * Created:     17 oct 2026                                                 *
+    * Author:      Artem Puzankov                                              *
+    * Email:       puzankov.ao@phystech.edu                                    *
+    * GitHub:      https://github.com/hellopuza                                *
+    * Copyright © 2021 Artem Puzankov. All rights reserved.                    *
+    *///------------------------------------------------------------------------
+
+#ifndef SYMBOLTABLE_H_INCLUDED
+#define SYMBOLTABLE_H_INCLUDED
+
+#define _CRT_SECURE_NO_WARNINGS
+
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <atomic>
+#include <mutex>
+
+
+//==============================================================================
+/*------------------------------------------------------------------------------
+                   Symbol table constants and types                            *
+*///----------------------------------------------------------------------------
+//==============================================================================
+
+
+const int    NO_SYMBOL            = -1;
+const size_t SYMBOLS_PAGE_SIZE    = 4096;
+const size_t SYMBOLS_MAX_PAGES    = 4096;
+const size_t SYMBOLS_ARENA_SIZE   = 65536;
+const size_t DEFAULT_HASH_BUCKETS = 1024;
+
+class SymbolTable
+{
+    const char**        pages_[SYMBOLS_MAX_PAGES] = {};
+    std::atomic<size_t> size_ {0}; // read without the lock by getName and getSize
+
+    int*    buckets_     = nullptr;
+    size_t* hashes_      = nullptr;
+    size_t  buckets_num_ = 0;
+
+    char*  arena_      = nullptr;
+    size_t arena_free_ = 0;
+
+    std::mutex mutex_;
+
+public:
+
+//------------------------------------------------------------------------------
+/*! @brief   SymbolTable constructor.
+ */
+
+    SymbolTable ();
+
+//------------------------------------------------------------------------------
+/*! @brief   SymbolTable copy constructor (deleted).
+ *
+ *  @param   obj         Source table
+ */
+
+    SymbolTable (const SymbolTable& obj);
+
+    SymbolTable& operator = (const SymbolTable& obj); // deleted
+
+//------------------------------------------------------------------------------
+/*! @brief   SymbolTable destructor.
+ */
+
+   ~SymbolTable ();
+
+//------------------------------------------------------------------------------
+/*! @brief   Get id of the identifier, adding it to the table if it is new.
+ *
+ *  @param   word        Identifier characters (need not be null terminated)
+ *  @param   len         Identifier length
+ *
+ *  @return  symbol id, NO_SYMBOL if the identifier is new and the table is full
+ */
+
+    int Intern (const char* word, size_t len);
+
+//------------------------------------------------------------------------------
+/*! @brief   Get id of the null terminated identifier, adding it if it is new.
+ *
+ *  @param   word        Identifier
+ *
+ *  @return  symbol id, NO_SYMBOL if the identifier is new and the table is full
+ */
+
+    int Intern (const char* word);
+
+//------------------------------------------------------------------------------
+/*! @brief   Get name of the symbol.
+ *
+ *  @note    Returned string lives as long as the table, so it can be kept in nodes.
+ *
+ *  @param   id          Symbol id
+ *
+ *  @return  null terminated name
+ */
+
+    const char* getName (int id) const;
+
+//------------------------------------------------------------------------------
+/*! @brief   Get number of interned symbols.
+ *
+ *  @return  number of symbols
+ */
+
+    size_t getSize () const;
+
+/*------------------------------------------------------------------------------
+                   Private functions                                           *
+*///----------------------------------------------------------------------------
+
+private:
+
+//------------------------------------------------------------------------------
+/*! @brief   Double the number of hash buckets and rehash all symbols.
+ */
+
+    void Rehash ();
+
+//------------------------------------------------------------------------------
+/*! @brief   Copy identifier to the arena.
+ *
+ *  @param   word        Identifier characters
+ *  @param   len         Identifier length
+ *
+ *  @return  pointer to the null terminated copy
+ */
+
+    const char* Store (const char* word, size_t len);
+
+//------------------------------------------------------------------------------
+};
+
+//------------------------------------------------------------------------------
+/*! @brief   Hash of the identifier.
+ *
+ *  @param   word        Identifier characters
+ *  @param   len         Identifier length
+ *
+ *  @return  hash
+ */
+
+inline size_t SymbolHash (const char* word, size_t len)
+{
+    size_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; ++i)
+        hash = (hash ^ (unsigned char)word[i]) * 1099511628211ULL;
+
+    return hash;
+}
+
+//------------------------------------------------------------------------------
+
+extern SymbolTable symbols;
+
+//------------------------------------------------------------------------------
+
+#endif // SYMBOLTABLE_H_INCLUDED
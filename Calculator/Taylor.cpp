@@ -0,0 +1,507 @@
+/*------------------------------------------------------------------------------
+    * File:        Taylor.cpp                                                  *
+    * Description: Functions of the evaluator of truncated Taylor series       *
+    *              for derivatives of high orders at the point.                *
+    * Created:     17 oct 2026                                                 *
+    * Author:      Artem Puzankov                                              *
+    * Email:       puzankov.ao@phystech.edu                                    *
+    * GitHub:      https://github.com/hellopuza                                *
+    * Copyright © 2021 Artem Puzankov. All rights reserved.                    *
+    *///------------------------------------------------------------------------
+
+#include "Taylor.h"
+
+//------------------------------------------------------------------------------
+
+Taylor::Taylor (size_t order) :
+    state_ (CALC_OK),
+    size_  (order + 1)
+{
+    result_.resize(size_);
+    scratch_.resize(5 * size_);
+}
+
+//------------------------------------------------------------------------------
+
+Taylor::~Taylor ()
+{
+    state_ = CALC_DESTRUCTED;
+}
+
+//------------------------------------------------------------------------------
+
+size_t Taylor::getOrder () const
+{
+    return size_ - 1;
+}
+
+//------------------------------------------------------------------------------
+
+NUM_TYPE Taylor::getCoefficient (size_t k) const
+{
+    assert(k < size_);
+
+    return result_[k];
+}
+
+//------------------------------------------------------------------------------
+
+NUM_TYPE Taylor::getDerivative (size_t k) const
+{
+    assert(k < size_);
+
+    NUM_TYPE derivative = result_[k];
+    for (size_t i = 2; i <= k; ++i)
+        derivative *= (double)i;
+
+    return derivative;
+}
+
+//------------------------------------------------------------------------------
+
+int Taylor::Evaluate (const Tree<CalcNodeData>& tree, Stack<Variable>& variables, int symbol)
+{
+    assert(tree.root_ != nullptr);
+
+    if (state_) return state_;
+
+    operands_.clear();
+    bound_.clear();
+    scope_.clear();
+
+    NUM_TYPE* jet = scratch_.data();
+    NUM_TYPE* acc = jet + size_;
+
+    // Post order walk, the same as in CalcDual
+    Node<CalcNodeData>* node_cur = tree.root_;
+    Node<CalcNodeData>* from     = tree.root_->prev_;
+
+    while (true)
+    {
+        Node<CalcNodeData>* next = node_cur->nextChild(from, positions_);
+
+        if (next != nullptr)
+        {
+            from     = node_cur;
+            node_cur = next;
+            continue;
+        }
+
+        const CalcNodeData& data = node_cur->getData();
+
+        size_t top = operands_.size();
+
+        switch (data.node_type)
+        {
+        case NODE_NUMBER:
+
+            std::fill(jet, jet + size_, NUM_TYPE(0));
+            jet[0] = data.number;
+            break;
+
+        case NODE_VARIABLE:
+        {
+            int var_symbol = (data.symbol != NO_SYMBOL) ? data.symbol : symbols.Intern(data.word);
+
+            size_t bound = scope_.size();
+            while ((bound > 0) && (scope_[bound - 1].first != var_symbol)) --bound;
+
+            if (bound > 0)
+            {
+                std::copy_n(bound_.data() + scope_[bound - 1].second, size_, jet);
+                break;
+            }
+
+            size_t index = 0;
+            while ((index < variables.getSize()) && (variables[index].symbol != var_symbol)) ++index;
+
+            if (index == variables.getSize()) return CALC_UNIDENTIFIED_VARIABLE;
+
+            std::fill(jet, jet + size_, NUM_TYPE(0));
+            jet[0] = variables[index].value;
+            if ((var_symbol == symbol) && (size_ > 1)) jet[1] = 1;
+            break;
+        }
+        case NODE_FUNCTION:
+
+            Function(data.op_code, operands_.data() + top - size_, jet);
+            operands_.resize(top - size_);
+            break;
+
+        case NODE_OPERATOR:
+        {
+            if (node_cur->args_num_ != 0)
+            {
+                const NUM_TYPE* args = operands_.data() + top - node_cur->args_num_ * size_;
+
+                std::copy_n(args, size_, jet);
+                for (size_t arg = 1; arg < node_cur->args_num_; ++arg)
+                {
+                    Operator(data.op_code, jet, args + arg * size_, acc);
+                    std::copy_n(acc, size_, jet);
+                }
+
+                operands_.resize(top - node_cur->args_num_ * size_);
+                break;
+            }
+
+            // Right subtree is visited first, so the left operand is on top
+            const NUM_TYPE* left = acc;
+
+            if (node_cur->left_ != nullptr)
+            {
+                left = operands_.data() + top - size_;
+                top -= size_;
+            }
+            else std::fill(acc, acc + size_, NUM_TYPE(0));
+
+            Operator(data.op_code, left, operands_.data() + top - size_, jet);
+            operands_.resize(top - size_);
+            break;
+        }
+        case NODE_LET:
+
+            // Jet of the binding is kept in the scope
+            std::copy_n(operands_.data() + top - size_, size_, jet);
+            operands_.resize(top - size_);
+            bound_.resize(scope_.back().second);
+            scope_.pop_back();
+            break;
+
+        default: assert(0);
+        }
+
+        if (node_cur == tree.root_)
+        {
+            std::copy_n(jet, size_, result_.data());
+            break;
+        }
+
+        if ((node_cur->prev_->getData().node_type == NODE_LET) && (node_cur->prev_->right_ == node_cur))
+        {
+            scope_.push_back({ node_cur->prev_->getData().symbol, bound_.size() });
+            bound_.insert(bound_.end(), jet, jet + size_);
+        }
+        else operands_.insert(operands_.end(), jet, jet + size_);
+
+        from     = node_cur;
+        node_cur = node_cur->prev_;
+    }
+
+    return CALC_OK;
+}
+
+//------------------------------------------------------------------------------
+
+void Taylor::Function (char op_code, const NUM_TYPE* arg, NUM_TYPE* res)
+{
+    #define ONE static_cast<NUM_TYPE>(1)
+
+    NUM_TYPE* s1 = scratch_.data() + 2 * size_;
+    NUM_TYPE* s2 = s1 + size_;
+    NUM_TYPE* s3 = s2 + size_;
+
+    switch (op_code)
+    {
+    case OP_EXP:
+
+        Integrate(arg, res, exp(arg[0]), ONE, res);
+        break;
+
+    case OP_LG:
+    case OP_LN:
+    {
+        // a = exp(u), so a' = a * u'
+        res[0] = log(arg[0]);
+        for (size_t k = 1; k < size_; ++k)
+        {
+            NUM_TYPE sum = 0;
+            for (size_t j = 1; j < k; ++j)
+                sum += (double)j * res[j] * arg[k - j];
+
+            res[k] = (arg[k] - sum / (double)k) / arg[0];
+        }
+
+        if (op_code == OP_LG)
+        {
+            NUM_TYPE ln10 = log(static_cast<NUM_TYPE>(10));
+            for (size_t k = 0; k < size_; ++k) res[k] /= ln10;
+        }
+        break;
+    }
+    case OP_SQRT:
+    {
+        // a = u * u
+        res[0] = sqrt(arg[0]);
+        for (size_t k = 1; k < size_; ++k)
+        {
+            NUM_TYPE sum = 0;
+            for (size_t j = 1; j < k; ++j)
+                sum += res[j] * res[k - j];
+
+            res[k] = (arg[k] - sum) / (2.0 * res[0]);
+        }
+        break;
+    }
+    case OP_SIN:
+    case OP_COS:
+    case OP_SINH:
+    case OP_COSH:
+    {
+        // Sine and cosine are derivatives of each other, so both are found
+        bool   trig = (op_code == OP_SIN) || (op_code == OP_COS);
+        double sign = (trig) ? -1 : 1;
+
+        NUM_TYPE* s = ((op_code == OP_SIN) || (op_code == OP_SINH)) ? res : s1;
+        NUM_TYPE* c = (s == res) ? s1 : res;
+
+        s[0] = (trig) ? sin(arg[0]) : sinh(arg[0]);
+        c[0] = (trig) ? cos(arg[0]) : cosh(arg[0]);
+
+        for (size_t k = 1; k < size_; ++k)
+        {
+            NUM_TYPE s_sum = 0;
+            NUM_TYPE c_sum = 0;
+            for (size_t j = 1; j <= k; ++j)
+            {
+                s_sum += (double)j * arg[j] * c[k - j];
+                c_sum += (double)j * arg[j] * s[k - j];
+            }
+
+            s[k] = s_sum / (double)k;
+            c[k] = sign * c_sum / (double)k;
+        }
+        break;
+    }
+    case OP_TAN:
+    case OP_TANH:
+    case OP_COT:
+    case OP_COTH:
+    {
+        // u' = factor * (1 + sign * u^2) * a', the square is found together with u
+        double sign   = ((op_code == OP_TAN) || (op_code == OP_COT)) ? 1 : -1;
+        double factor = (op_code == OP_COT) ? -1 : 1;
+
+        res[0] = CalcFunction(op_code, arg[0]);
+        s1[0]  = ONE + sign * res[0] * res[0];
+
+        for (size_t k = 1; k < size_; ++k)
+        {
+            NUM_TYPE sum = 0;
+            for (size_t j = 1; j <= k; ++j)
+                sum += (double)j * arg[j] * s1[k - j];
+
+            res[k] = factor * sum / (double)k;
+
+            NUM_TYPE square = 0;
+            for (size_t j = 0; j <= k; ++j)
+                square += res[j] * res[k - j];
+
+            s1[k] = sign * square;
+        }
+        break;
+    }
+    case OP_ARCCOS:
+    case OP_ARCCOSH:
+    case OP_ARCCOT:
+    case OP_ARCCOTH:
+    case OP_ARCSIN:
+    case OP_ARCSINH:
+    case OP_ARCTAN:
+    case OP_ARCTANH:
+    {
+        // Derivative by argument is 1 / sqrt(1 - a^2) and alike, its jet is
+        // found first
+        Mul(arg, arg, s1);
+
+        switch (op_code)
+        {
+        case OP_ARCCOS:
+        case OP_ARCSIN:
+        case OP_ARCCOTH:
+        case OP_ARCTANH:
+
+            for (size_t k = 0; k < size_; ++k) s1[k] = -s1[k];
+            s1[0] += ONE;
+            break;
+
+        case OP_ARCCOSH:  s1[0] -= ONE; break;
+        default:          s1[0] += ONE; break;
+        }
+
+        const NUM_TYPE* d = s1;
+        if ((op_code == OP_ARCCOS) || (op_code == OP_ARCCOSH) || (op_code == OP_ARCSIN) || (op_code == OP_ARCSINH))
+        {
+            Function(OP_SQRT, s1, s2);
+            d = s2;
+        }
+
+        s3[0] = ONE / d[0];
+        for (size_t k = 1; k < size_; ++k)
+        {
+            NUM_TYPE sum = 0;
+            for (size_t j = 1; j <= k; ++j)
+                sum += d[j] * s3[k - j];
+
+            s3[k] = -sum / d[0];
+        }
+
+        double factor = ((op_code == OP_ARCCOS) || (op_code == OP_ARCCOT)) ? -1 : 1;
+
+        Integrate(arg, s3, CalcFunction(op_code, arg[0]), factor, res);
+        break;
+    }
+    default: assert(0);
+    }
+
+    #undef ONE
+}
+
+//------------------------------------------------------------------------------
+
+void Taylor::Operator (char op_code, const NUM_TYPE* left, const NUM_TYPE* right, NUM_TYPE* res)
+{
+    switch (op_code)
+    {
+    case OP_ADD:
+
+        for (size_t k = 0; k < size_; ++k) res[k] = left[k] + right[k];
+        break;
+
+    case OP_SUB:
+
+        for (size_t k = 0; k < size_; ++k) res[k] = left[k] - right[k];
+        break;
+
+    case OP_MUL:  Mul  (left, right, res); break;
+    case OP_DIV:  Div  (left, right, res); break;
+    case OP_POW:  Power(left, right, res); break;
+    default: assert(0);
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void Taylor::Power (const NUM_TYPE* base, const NUM_TYPE* exponent, NUM_TYPE* res)
+{
+    NUM_TYPE* s1 = scratch_.data() + 2 * size_;
+    NUM_TYPE* s2 = s1 + size_;
+    NUM_TYPE* s3 = s2 + size_;
+
+    bool const_base     = true;
+    bool const_exponent = true;
+    for (size_t k = 1; k < size_; ++k)
+    {
+        const_base     &= (base[k]     == NUM_TYPE(0));
+        const_exponent &= (exponent[k] == NUM_TYPE(0));
+    }
+
+    if (not const_exponent)
+    {
+        // u = exp(b * ln(a)), logarithm of the constant base is not expanded,
+        // so 0^x is not spoiled by the jet of log(0)
+        if (const_base)
+        {
+            NUM_TYPE ln = log(base[0]);
+            for (size_t k = 0; k < size_; ++k) s2[k] = exponent[k] * ln;
+        }
+        else
+        {
+            Function(OP_LN, base, s1);
+            Mul(exponent, s1, s2);
+        }
+
+        Function(OP_EXP, s2, res);
+        return;
+    }
+
+    NUM_TYPE power = exponent[0];
+
+    // The recurrence divides by the base, so x^2 at 0 is taken by squaring.
+    // Series of the base starts from t^1 then, powers above the order are zero.
+    // Negative and fractional powers of zero have no Taylor series, the
+    // recurrence leaves them not finite
+    if ((base[0] == NUM_TYPE(0)) && (power.imag() == 0) && (power.real() >= 0) && (power.real() == floor(power.real())))
+    {
+        std::fill(res, res + size_, NUM_TYPE(0));
+
+        if (power.real() >= (double)size_) return;
+
+        res[0] = 1;
+        std::copy_n(base, size_, s1);
+
+        for (size_t n = (size_t)power.real(); n != 0; n >>= 1)
+        {
+            if (n & 1)
+            {
+                Mul(res, s1, s3);
+                std::copy_n(s3, size_, res);
+            }
+
+            if (n > 1)
+            {
+                Mul(s1, s1, s3);
+                std::copy_n(s3, size_, s1);
+            }
+        }
+        return;
+    }
+
+    // a * u' = p * a' * u
+    res[0] = pow(base[0], power);
+    for (size_t k = 1; k < size_; ++k)
+    {
+        NUM_TYPE sum = 0;
+        for (size_t j = 1; j <= k; ++j)
+            sum += (power * (double)j - (double)(k - j)) * base[j] * res[k - j];
+
+        res[k] = sum / ((double)k * base[0]);
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void Taylor::Mul (const NUM_TYPE* a, const NUM_TYPE* b, NUM_TYPE* res)
+{
+    for (size_t k = 0; k < size_; ++k)
+    {
+        NUM_TYPE sum = 0;
+        for (size_t j = 0; j <= k; ++j)
+            sum += a[j] * b[k - j];
+
+        res[k] = sum;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void Taylor::Div (const NUM_TYPE* a, const NUM_TYPE* b, NUM_TYPE* res)
+{
+    // a = u * b
+    for (size_t k = 0; k < size_; ++k)
+    {
+        NUM_TYPE sum = 0;
+        for (size_t j = 1; j <= k; ++j)
+            sum += b[j] * res[k - j];
+
+        res[k] = (a[k] - sum) / b[0];
+    }
+}
+
+//------------------------------------------------------------------------------
+
+void Taylor::Integrate (const NUM_TYPE* arg, const NUM_TYPE* g, NUM_TYPE value, NUM_TYPE factor, NUM_TYPE* res)
+{
+    // k * u_k = factor * sum of j * a_j * g_(k-j)
+    res[0] = value;
+    for (size_t k = 1; k < size_; ++k)
+    {
+        NUM_TYPE sum = 0;
+        for (size_t j = 1; j <= k; ++j)
+            sum += (double)j * arg[j] * g[k - j];
+
+        res[k] = factor * sum / (double)k;
+    }
+}
+
+//------------------------------------------------------------------------------
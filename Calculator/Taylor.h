@@ -0,0 +1,193 @@
+/*------------------------------------------------------------------------------
+    * File:        Taylor.h                                                    *
+    * Description: Declaration of the evaluator of truncated Taylor series     *
+    *              for derivatives of high orders at the point.                *
+    * Created:     17 oct 2026                                                 *
+    * Author:      Artem Puzankov                                              *
+    * Email:       puzankov.ao@phystech.edu                                    *
+    * GitHub:      https://github.com/hellopuza                                *
+    * Copyright © 2021 Artem Puzankov. All rights reserved.                    *
+    *///------------------------------------------------------------------------
+
+#ifndef TAYLOR_H_INCLUDED
+#define TAYLOR_H_INCLUDED
+
+#define _CRT_SECURE_NO_WARNINGS
+
+
+#include "Calculator.h"
+#include <algorithm>
+
+
+//==============================================================================
+/*------------------------------------------------------------------------------
+                   Taylor constants and types                                  *
+*///----------------------------------------------------------------------------
+//==============================================================================
+
+
+// Jet is a truncated Taylor series of the subtree at the point, coefficients
+// 0 to order are kept one after another. Coefficient k is the derivative of
+// order k divided by k!, so every operation costs O(order^2) and the whole
+// expression O(order^2 * nodes).
+
+class Taylor
+{
+    int    state_;
+    size_t size_;                      // number of coefficients of a jet
+
+    std::vector<NUM_TYPE>               operands_;   // jets of the visited subtrees not yet taken by parent
+    std::vector<NUM_TYPE>               bound_;      // jets of the bindings in scope
+    std::vector<std::pair<int, size_t>> scope_;      // symbol and offset in bound_ of the bindings
+    std::vector<size_t>                 positions_;
+    std::vector<NUM_TYPE>               result_;     // jet of the expression after Evaluate
+    std::vector<NUM_TYPE>               scratch_;    // jets of the node, the n-ary sum or product
+                                                     // and three for the operations
+
+public:
+
+//------------------------------------------------------------------------------
+/*! @brief   Taylor constructor.
+ *
+ *  @param   order       Highest order of the derivatives
+ */
+
+    Taylor (size_t order);
+
+//------------------------------------------------------------------------------
+/*! @brief   Taylor copy constructor (deleted).
+ *
+ *  @param   obj         Source evaluator
+ */
+
+    Taylor (const Taylor& obj);
+
+    Taylor& operator = (const Taylor& obj); // deleted
+
+//------------------------------------------------------------------------------
+/*! @brief   Taylor destructor.
+ */
+
+   ~Taylor ();
+
+//------------------------------------------------------------------------------
+/*! @brief   Get highest order of the derivatives.
+ *
+ *  @return  order
+ */
+
+    size_t getOrder () const;
+
+//------------------------------------------------------------------------------
+/*! @brief   Get Taylor coefficient found by the last Evaluate call.
+ *
+ *  @param   k           Number of the coefficient
+ *
+ *  @return  derivative of order k divided by k!
+ */
+
+    NUM_TYPE getCoefficient (size_t k) const;
+
+//------------------------------------------------------------------------------
+/*! @brief   Get derivative found by the last Evaluate call.
+ *
+ *  @param   k           Order of the derivative
+ *
+ *  @return  derivative
+ */
+
+    NUM_TYPE getDerivative (size_t k) const;
+
+//------------------------------------------------------------------------------
+/*! @brief   Calculate Taylor coefficients of the expression by the variable
+ *           in one pass over the tree, no nodes are created.
+ *
+ *  @note    Nothing is allocated after the first call with the same tree.
+ *
+ *  @param   tree        Equation tree
+ *  @param   variables   Values of the variables
+ *  @param   symbol      Symbol id of the variable
+ *
+ *  @return  error code
+ */
+
+    int Evaluate (const Tree<CalcNodeData>& tree, Stack<Variable>& variables, int symbol);
+
+/*------------------------------------------------------------------------------
+                   Private functions                                           *
+*///----------------------------------------------------------------------------
+
+private:
+
+//------------------------------------------------------------------------------
+/*! @brief   Calculate jet of the function.
+ *
+ *  @param   op_code     Code of the function
+ *  @param   arg         Jet of the argument
+ *  @param   res         Jet of the function (not the argument)
+ */
+
+    void Function (char op_code, const NUM_TYPE* arg, NUM_TYPE* res);
+
+//------------------------------------------------------------------------------
+/*! @brief   Calculate jet of the operator.
+ *
+ *  @param   op_code     Code of the operator
+ *  @param   left        Jet of the left operand
+ *  @param   right       Jet of the right operand
+ *  @param   res         Jet of the operator (not an operand)
+ */
+
+    void Operator (char op_code, const NUM_TYPE* left, const NUM_TYPE* right, NUM_TYPE* res);
+
+//------------------------------------------------------------------------------
+/*! @brief   Calculate jet of the power.
+ *
+ *  @param   base        Jet of the base
+ *  @param   exponent    Jet of the exponent
+ *  @param   res         Jet of the power (not an operand)
+ */
+
+    void Power (const NUM_TYPE* base, const NUM_TYPE* exponent, NUM_TYPE* res);
+
+//------------------------------------------------------------------------------
+/*! @brief   Calculate jet of the product.
+ *
+ *  @param   a           Jet of the first factor
+ *  @param   b           Jet of the second factor
+ *  @param   res         Jet of the product (not a factor)
+ */
+
+    void Mul (const NUM_TYPE* a, const NUM_TYPE* b, NUM_TYPE* res);
+
+//------------------------------------------------------------------------------
+/*! @brief   Calculate jet of the quotient.
+ *
+ *  @param   a           Jet of the dividend
+ *  @param   b           Jet of the divisor
+ *  @param   res         Jet of the quotient (not an operand)
+ */
+
+    void Div (const NUM_TYPE* a, const NUM_TYPE* b, NUM_TYPE* res);
+
+//------------------------------------------------------------------------------
+/*! @brief   Calculate jet of the function by its value and derivative,
+ *           u' = factor * g * a'.
+ *
+ *  @param   arg         Jet of the argument
+ *  @param   g           Jet of the derivative of the function by argument,
+ *                       it may be res itself when g depends on lower
+ *                       coefficients of res only
+ *  @param   value       Value of the function
+ *  @param   factor      Constant factor of the derivative
+ *  @param   res         Jet of the function (not the argument)
+ */
+
+    void Integrate (const NUM_TYPE* arg, const NUM_TYPE* g, NUM_TYPE value, NUM_TYPE factor, NUM_TYPE* res);
+
+//------------------------------------------------------------------------------
+};
+
+//------------------------------------------------------------------------------
+
+#endif // TAYLOR_H_INCLUDED
@@ -0,0 +1,115 @@
+/*------------------------------------------------------------------------------
+    * File:        DeriveBench.cpp                                             *
+    * Description: Benchmark of the derivative with optimization on growing    *
+    *              expressions.                                                *
+    * Created:     17 oct 2026                                                 *
+    * Author:      Artem Puzankov                                              *
+    * Email:       puzankov.ao@phystech.edu                                    *
+    * GitHub:      https://github.com/hellopuza                                *
+    * Copyright © 2021 Artem Puzankov. All rights reserved.                    *
+    *///------------------------------------------------------------------------
+
+#include "Differentiator.h"
+#include <chrono>
+#include <string>
+
+//------------------------------------------------------------------------------
+
+const size_t BENCH_TERMS [] = { 250, 1000, 2000, 8000, 32000 };
+const size_t BENCH_DEPTHS[] = { 2000, 4000, 8000, 16000 };
+const int    BENCH_ROUNDS   = 3;
+
+//------------------------------------------------------------------------------
+
+static double Seconds ()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//------------------------------------------------------------------------------
+
+static std::string GenerateSum (size_t terms)
+{
+    // Sum of terms sin(x*k)*x^m - c/(x+y), 14 nodes each
+    std::string text = "";
+    char        term[128] = "";
+
+    for (size_t k = 1; k <= terms; ++k)
+    {
+        sprintf(term, "%ssin(x*%zu)*x^%zu-%zu/(x+y)", (k == 1) ? "" : "+", k, k % 5 + 1, k);
+        text += term;
+    }
+
+    return text;
+}
+
+//------------------------------------------------------------------------------
+
+static std::string GenerateChain (size_t depth)
+{
+    // Chain x*y-(x*y-(...x)), every level of its derivative y-(y-(...1))
+    // is rewritten by Optimize, deep below the root
+    std::string text = "";
+
+    for (size_t i = 0; i < depth; ++i) text += "x*y-(";
+    text += "x" + std::string(depth, ')');
+
+    return text;
+}
+
+//------------------------------------------------------------------------------
+
+static int Measure (const std::string& text)
+{
+    Tree<CalcNodeData> tree      ((char*)"expression");
+    Tree<CalcNodeData> derivative((char*)"derivative");
+
+    std::string copy = text;
+    Expression  expr = {};
+    expr.str = (char*)copy.c_str();
+
+    int err = Expr2Tree(expr, tree);
+    if (err) return err;
+
+    int    symbol = symbols.Intern("x");
+    double best   = 0;
+
+    // Derivative is built and optimized again in every round, the best time is taken
+    for (int round = 0; round < BENCH_ROUNDS; ++round)
+    {
+        double begin = Seconds();
+
+        err = Derivative(tree, symbol, derivative);
+        if (err) return err;
+
+        double time = Seconds() - begin;
+
+        if ((round == 0) || (time < best)) best = time;
+    }
+
+    printf("%8zu input nodes %8zu result nodes %8.3f s\n",
+           CountNodes(tree.root_), CountNodes(derivative.root_), best);
+
+    return DIFF_OK;
+}
+
+//------------------------------------------------------------------------------
+
+int main ()
+{
+    for (size_t terms : BENCH_TERMS)
+    {
+        int err = Measure(GenerateSum(terms));
+        if (err) return err;
+    }
+
+    for (size_t depth : BENCH_DEPTHS)
+    {
+        int err = Measure(GenerateChain(depth));
+        if (err) return err;
+    }
+
+    return DIFF_OK;
+}
+
+//------------------------------------------------------------------------------
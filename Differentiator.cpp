@@ -19,8 +19,8 @@ Differentiator::Differentiator () :
     path2badnode_ ((char*)"path2badnode_"),
     state_        (DIFF_OK)
 {
-    constants_.Push({ PI, "pi" });
-    constants_.Push({ E,  "e" });
+    constants_.Push({ PI, "pi", symbols.Intern("pi") });
+    constants_.Push({ E,  "e",  symbols.Intern("e")  });
 }
 
 //------------------------------------------------------------------------------
@@ -32,8 +32,25 @@ Differentiator::Differentiator (char* filename) :
     path2badnode_ ((char*)"path2badnode_"),
     state_        (DIFF_OK)
 {
-    constants_.Push({ PI, "pi" });
-    constants_.Push({ E,  "e" });
+    constants_.Push({ PI, "pi", symbols.Intern("pi") });
+    constants_.Push({ E,  "e",  symbols.Intern("e")  });
+}
+
+//------------------------------------------------------------------------------
+
+Differentiator::Differentiator (char* filename, char* output, int threads, bool check, bool shared) :
+    filename_     (filename),
+    output_       (output),
+    threads_      (threads),
+    check_        (check),
+    shared_       (shared),
+    tree_         ((char*)"expression"),
+    constants_    ((char*)"variables"),
+    path2badnode_ ((char*)"path2badnode_"),
+    state_        (DIFF_OK)
+{
+    constants_.Push({ PI, "pi", symbols.Intern("pi") });
+    constants_.Push({ E,  "e",  symbols.Intern("e")  });
 }
 
 //------------------------------------------------------------------------------
@@ -50,10 +67,21 @@ Differentiator::~Differentiator ()
 
 //------------------------------------------------------------------------------
 
+void Differentiator::setVariable (const char* name)
+{
+    assert(name != nullptr);
+
+    diff_var_ = { POISON<NUM_TYPE>, name, symbols.Intern(name) };
+}
+
+//------------------------------------------------------------------------------
+
 int Differentiator::Run ()
 {
     DIFF_ASSERTOK((this == nullptr), DIFF_NULL_INPUT_DIFFERENTIATOR_PTR);
 
+    if (output_ != nullptr) return RunBatch();
+
     if (filename_ == nullptr)
     {
         bool running = true;
@@ -64,12 +92,11 @@ int Differentiator::Run ()
             char* expr = ScanExpr();
             Expression expression = { expr, expr };
 
-            int err = Expr2Tree(expression, tree_);
+            int err = parse_cache.Parse(expression, tree_);
             delete [] expr;
             if (!err)
             {
-                Differentiate(tree_.root_);
-                Optimize(tree_);
+                Derivative(tree_, diff_var_.symbol, tree_);
 
                 printExprGraph(tree_);
                 Write();
@@ -82,16 +109,16 @@ int Differentiator::Run ()
     }
     else
     {
-        Text text(filename_);
-        char* expr = text.text_;
-        Expression expression = { expr, expr };
+        FILE* source = fopen(filename_, "r");
+        if (source == nullptr) return DIFF_NOT_OK;
+
+        Expression expression = { nullptr, nullptr };
 
-        int err = Expr2Tree(expression, tree_);
-        delete [] expr;
+        int err = Stream2Tree(source, expression, tree_);
+        fclose(source);
         if (err) return err;
 
-        Differentiate(tree_.root_);
-        Optimize(tree_);
+        Derivative(tree_, diff_var_.symbol, tree_);
 
         printExprGraph(tree_);
         Write();
@@ -102,814 +129,1459 @@ int Differentiator::Run ()
 
 //------------------------------------------------------------------------------
 
-#define PREV_CONNECT(old_node, new_node)                \
-        {                                               \
-            if (old_node->prev_ != nullptr)             \
-            {                                           \
-                if (old_node->prev_->left_ == old_node) \
-                    old_node->prev_->left_  = new_node; \
-                else                                    \
-                    old_node->prev_->right_ = new_node; \
-            }                                           \
-            else tree_.root_ = new_node;                \
-                                                        \
-            new_node->prev_ = old_node->prev_;          \
-                                                        \
-            new_node->recountPrev();                    \
-            new_node->recountDepth();                   \
-        } //
+int Differentiator::RunImage ()
+{
+    DIFF_ASSERTOK((this == nullptr), DIFF_NULL_INPUT_DIFFERENTIATOR_PTR);
+    assert(filename_ != nullptr);
+    assert(output_   != nullptr);
+
+    BinTree bin(filename_);
+
+    int err = Bin2Tree(bin, tree_);
+    if (err)
+    {
+        CalcPrintError(calc_log, __FILE__, __LINE__, __FUNC_NAME__, err, 1);
+        return err;
+    }
+
+    Derivative(tree_, diff_var_.symbol, tree_);
+
+    FILE* output = fopen(output_, "w");
+    if (output == nullptr)
+    {
+        PrintError(DIFFERENTIATOR_LOGNAME, __FILE__, __LINE__, __FUNC_NAME__, DIFF_FILE_OPEN_ERROR);
+        return DIFF_FILE_OPEN_ERROR;
+    }
+
+    Expression expr = {};
+    Tree2Expr(tree_, expr);
+
+    fprintf(output, "%s\n", expr.str);
+    fclose(output);
+
+    delete [] expr.str;
+
+    return DIFF_OK;
+}
+
+//------------------------------------------------------------------------------
+
+static void PrintNumber (FILE* fp, NUM_TYPE number)
+{
+    if (imag(number) == 0)
+        fprintf(fp, "%.17g", real(number));
+    else
+        fprintf(fp, "%.17g%+.17gi", real(number), imag(number));
+}
 
 //------------------------------------------------------------------------------
 
-int Differentiator::Differentiate (Node<CalcNodeData>* node_cur)
+int Differentiator::RunOrder (int order)
 {
-    int err = DIFF_OK;
+    DIFF_ASSERTOK((this == nullptr), DIFF_NULL_INPUT_DIFFERENTIATOR_PTR);
+    assert(filename_ != nullptr);
+    assert(output_   != nullptr);
+    assert(order > 0);
 
-    switch (node_cur->getData().node_type)
+    FILE* source = fopen(filename_, "r");
+    if (source == nullptr)
     {
-    case NODE_FUNCTION:
-    case NODE_OPERATOR:
+        PrintError(DIFFERENTIATOR_LOGNAME, __FILE__, __LINE__, __FUNC_NAME__, DIFF_FILE_OPEN_ERROR);
+        return DIFF_FILE_OPEN_ERROR;
+    }
 
-        switch (node_cur->getData().op_code)
+    Expression expression = { nullptr, nullptr };
+
+    int err = Stream2Tree(source, expression, tree_);
+    fclose(source);
+    if (err) return err;
+
+    FILE* output = fopen(output_, "w");
+    if (output == nullptr)
+    {
+        PrintError(DIFFERENTIATOR_LOGNAME, __FILE__, __LINE__, __FUNC_NAME__, DIFF_FILE_OPEN_ERROR);
+        return DIFF_FILE_OPEN_ERROR;
+    }
+
+    // All the derivatives are kept until the end. In the graph they are
+    // roots sharing their common subexpressions, every order is built from
+    // the simplified previous one and nothing is expanded to tree until
+    // the output.
+    std::vector<int>   roots;
+    std::vector<char*> results;
+
+    ExprDag dag;
+    if (shared_) roots.push_back(Tree2Dag(tree_, dag));
+
+    for (int k = 1; k <= order; ++k)
+    {
+        size_t tree_size = 0;
+
+        if (shared_)
         {
-        case OP_ADD:       // u' + v'
-        case OP_SUB:       // u' - v'
+            roots.push_back(dag.Derivative(roots.back(), diff_var_.symbol));
+
+            size_t count = dag.CountNodes(roots.back(), tree_size);
+            printf("order %d: %zu nodes, %zu shared (graph %zu)\n", k, tree_size, count, dag.getSize());
+        }
+        else
         {
-            Node<CalcNodeData>* Sum   = new Node<CalcNodeData>;
-            
-            Node<CalcNodeData>* Sum_l = nullptr;
-            if (node_cur->left_ != nullptr)
-                Sum_l = new Node<CalcNodeData>;
+            Derivative(tree_, diff_var_.symbol, tree_);
 
-            Node<CalcNodeData>* Sum_r = new Node<CalcNodeData>;
+            // Tree of every order is simplified in the graph, else it grows
+            // with the repeated subexpressions before the next one is built
+            ExprDag simplified;
+            Dag2Tree(simplified, Tree2Dag(tree_, simplified), tree_);
 
-            Sum->setData({ POISON<NUM_TYPE>, op_names[node_cur->getData().op_code].word, op_names[node_cur->getData().op_code].code, NODE_OPERATOR });
+            Expression result = {};
+            Tree2Expr(tree_, result);
+            results.push_back(result.str);
 
-            Sum->left_  = Sum_l;
-            Sum->right_ = Sum_r;
+            tree_size = CountNodes(tree_.root_);
+            printf("order %d: %zu nodes\n", k, tree_size);
+        }
+    }
 
-            PREV_CONNECT(node_cur, Sum);
-            
-            if (node_cur->left_ != nullptr)
-                *Sum_l = *node_cur->left_;
+    for (int k = 1; k <= order; ++k)
+    {
+        if (shared_)
+        {
+            Dag2Tree(dag, roots[k], tree_);
 
-            *Sum_r = *node_cur->right_;
+            Expression result = {};
+            Tree2Expr(tree_, result);
+            results.push_back(result.str);
+        }
+
+        fprintf(output, "%s\n", results[k - 1]);
+        delete [] results[k - 1];
+    }
 
-            if (node_cur->left_ != nullptr)
+    fclose(output);
+
+    return DIFF_OK;
+}
+
+//------------------------------------------------------------------------------
+
+int Differentiator::RunPartials (int mode, char* vars)
+{
+    DIFF_ASSERTOK((this == nullptr), DIFF_NULL_INPUT_DIFFERENTIATOR_PTR);
+    assert(filename_ != nullptr);
+    assert(output_   != nullptr);
+    assert(vars      != nullptr);
+
+    std::vector<Variable> variables;
+    for (char* name = strtok(vars, ","); name != nullptr; name = strtok(nullptr, ","))
+        variables.push_back({ POISON<NUM_TYPE>, name, symbols.Intern(name) });
+
+    if (variables.empty())
+    {
+        PrintError(DIFFERENTIATOR_LOGNAME, __FILE__, __LINE__, __FUNC_NAME__, DIFF_NO_VARIABLES);
+        return DIFF_NO_VARIABLES;
+    }
+
+    FILE* input = fopen(filename_, "r");
+    if (input == nullptr)
+    {
+        PrintError(DIFFERENTIATOR_LOGNAME, __FILE__, __LINE__, __FUNC_NAME__, DIFF_FILE_OPEN_ERROR);
+        return DIFF_FILE_OPEN_ERROR;
+    }
+
+    // Input trees are shared by the workers, a line with syntax error has
+    // no tree but the error message
+    std::vector<Tree<CalcNodeData>*> inputs;
+    std::vector<const char*>         errors;
+
+    if (mode == PARTIALS_JACOBIAN)
+    {
+        char* line = nullptr;
+        while ((line = ReadLine(input)) != nullptr)
+        {
+            line[strcspn(line, "\r\n")] = '\0';
+
+            if (line[strspn(line, " \t")] != '\0')
             {
-                err = Differentiate(Sum_l);
-                if (err) return err;
+                Tree<CalcNodeData>* tree = new Tree<CalcNodeData>((char*)"expression");
+                Expression expression = { line, line };
+                expression.console = false;  // error is written to the output
+
+                int err = parse_cache.Parse(expression, *tree);
+                if (err)
+                {
+                    delete tree;
+                    tree = nullptr;
+                }
+
+                inputs.push_back(tree);
+                errors.push_back(err ? calc_errstr[expression.err + 1] : nullptr);
             }
 
-            err = Differentiate(Sum_r);
-            if (err) return err;
-
-            break;
+            delete [] line;
         }
-        case OP_MUL:       // u'*v + u*v'
+    }
+    else
+    {
+        Tree<CalcNodeData>* tree = new Tree<CalcNodeData>((char*)"expression");
+        Expression expression = { nullptr, nullptr };
+
+        int err = Stream2Tree(input, expression, *tree);
+        if (err)
         {
-            Node<CalcNodeData>* Sum  = new Node<CalcNodeData>;
-            Node<CalcNodeData>* lMul = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rMul = new Node<CalcNodeData>;
+            fclose(input);
+            delete tree;
+            return err;
+        }
 
-            Node<CalcNodeData>* lMul_l = new Node<CalcNodeData>;
-            Node<CalcNodeData>* lMul_r = new Node<CalcNodeData>;
+        inputs.push_back(tree);
+        errors.push_back(nullptr);
+    }
+    fclose(input);
 
-            Node<CalcNodeData>* rMul_l = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rMul_r = new Node<CalcNodeData>;
+    FILE* output = fopen(output_, "w");
+    if (output == nullptr)
+    {
+        for (size_t i = 0; i < inputs.size(); ++i) delete inputs[i];
 
-            Sum ->setData({ POISON<NUM_TYPE>, op_names[OP_ADD].word, op_names[OP_ADD].code, NODE_OPERATOR });
-            lMul->setData({ POISON<NUM_TYPE>, op_names[OP_MUL].word, op_names[OP_MUL].code, NODE_OPERATOR });
-            rMul->setData({ POISON<NUM_TYPE>, op_names[OP_MUL].word, op_names[OP_MUL].code, NODE_OPERATOR });
+        PrintError(DIFFERENTIATOR_LOGNAME, __FILE__, __LINE__, __FUNC_NAME__, DIFF_FILE_OPEN_ERROR);
+        return DIFF_FILE_OPEN_ERROR;
+    }
 
-            Sum->left_  = lMul;
-            Sum->right_ = rMul;
+    int  threads = (threads_ > 0) ? threads_ : omp_get_max_threads();
+    long num     = (long)variables.size();
 
-            lMul->left_  = lMul_l;
-            lMul->right_ = lMul_r;
-            
-            rMul->left_  = rMul_l;
-            rMul->right_ = rMul_r;
+    // Hessian is built from the first derivatives, which become the shared
+    // inputs of the second pass. Only its upper triangle is differentiated,
+    // the lower one is the same by symmetry.
+    std::vector<Tree<CalcNodeData>*> firsts;
+    std::vector<char*>               results((mode == PARTIALS_HESSIAN) ? num * num : inputs.size() * num, nullptr);
 
-            PREV_CONNECT(node_cur, Sum);
+    // Derivative only reads its input, so the workers differentiate the
+    // same trees without copying them
+    #pragma omp parallel num_threads(threads)
+    {
+        Tree<CalcNodeData> derivative((char*)"derivative");
 
-            *lMul_l = *node_cur->left_;
-            *lMul_r = *node_cur->right_;
+        if (mode == PARTIALS_HESSIAN)
+        {
+            #pragma omp single
+            firsts.resize(num, nullptr);
+
+            #pragma omp for schedule(dynamic, 1)
+            for (long i = 0; i < num; ++i)
+            {
+                firsts[i] = new Tree<CalcNodeData>((char*)"derivative");
+                Derivative(*inputs[0], variables[i].symbol, *firsts[i], shared_);
+            }
 
-            *rMul_l = *node_cur->left_;
-            *rMul_r = *node_cur->right_;
+            #pragma omp for schedule(dynamic, 1)
+            for (long task = 0; task < num * num; ++task)
+            {
+                long i = task / num;
+                long j = task % num;
 
-            err = Differentiate(lMul_l);
-            if (err) return err;
+                if (j < i) continue;
 
-            err = Differentiate(rMul_r);
-            if (err) return err;
+                Derivative(*firsts[i], variables[j].symbol, derivative, shared_);
 
-            break;
+                Expression result = {};
+                Tree2Expr(derivative, result);
+                results[task] = result.str;
+            }
         }
-        case OP_DIV:       // (u'*v - u*v')/v^2
+        else
         {
-            Node<CalcNodeData>* Div  = new Node<CalcNodeData>;
-            Node<CalcNodeData>* lSub = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rPow = new Node<CalcNodeData>;
+            #pragma omp for schedule(dynamic, 1)
+            for (long task = 0; task < (long)results.size(); ++task)
+            {
+                const Tree<CalcNodeData>* tree = inputs[task / num];
+                if (tree == nullptr) continue;
 
-            Node<CalcNodeData>* rPow_l = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rPow_r = new Node<CalcNodeData>;
+                Derivative(*tree, variables[task % num].symbol, derivative, shared_);
 
-            Div ->setData({ POISON<NUM_TYPE>, op_names[OP_DIV].word, op_names[OP_DIV].code, NODE_OPERATOR });
-            rPow->setData({ POISON<NUM_TYPE>, op_names[OP_POW].word, op_names[OP_POW].code, NODE_OPERATOR });
+                Expression result = {};
+                Tree2Expr(derivative, result);
+                results[task] = result.str;
+            }
+        }
+    }
+
+    if (mode == PARTIALS_GRADIENT)
+    {
+        for (long i = 0; i < num; ++i)
+            fprintf(output, "df/d%s = %s\n", variables[i].name, results[i]);
+    }
+    else
+    {
+        long rows = (mode == PARTIALS_HESSIAN) ? num : (long)inputs.size();
 
-            Div->left_  = lSub;
-            Div->right_ = rPow;
+        for (long i = 0; i < rows; ++i)
+        {
+            if ((mode == PARTIALS_JACOBIAN) && (errors[i] != nullptr))
+            {
+                fprintf(output, "ERROR: %s\n", errors[i]);
+                continue;
+            }
 
-            rPow->left_  = rPow_l;
-            rPow->right_ = rPow_r;
+            for (long j = 0; j < num; ++j)
+            {
+                long task = (j < i) && (mode == PARTIALS_HESSIAN) ? j * num + i : i * num + j;
 
-            PREV_CONNECT(node_cur, Div);
+                fprintf(output, (j == 0) ? "%s" : " | %s", results[task]);
+            }
+            fputc('\n', output);
+        }
+    }
+    fclose(output);
 
-            *lSub = *node_cur;
-            lSub->setData({ POISON<NUM_TYPE>, op_names[OP_MUL].word, op_names[OP_MUL].code, NODE_OPERATOR });
+    for (size_t i = 0; i < results.size(); ++i) delete [] results[i];
+    for (size_t i = 0; i < firsts.size();  ++i) delete firsts[i];
+    for (size_t i = 0; i < inputs.size();  ++i) delete inputs[i];
 
-            err = Differentiate(lSub);
-            if (err) return err;
+    calc_log.Flush();
 
-            lSub = Div->left_;
-            lSub->setData({ POISON<NUM_TYPE>, op_names[OP_SUB].word, op_names[OP_SUB].code, NODE_OPERATOR });
+    return DIFF_OK;
+}
 
-            *rPow_l = *node_cur->right_;
-            rPow_r->setData({ NUM_TYPE{2, 0}, nullptr, 0, NODE_NUMBER });
+//------------------------------------------------------------------------------
 
-            break;
+int Differentiator::RunGradient (char* point)
+{
+    DIFF_ASSERTOK((this == nullptr), DIFF_NULL_INPUT_DIFFERENTIATOR_PTR);
+
+    Stack<Variable> variables((char*)"point");
+
+    int err = ReadPoint(point, variables);
+
+    FILE* output = nullptr;
+    if (not err)
+    {
+        Tape     tape(tree_);
+        NUM_TYPE result = 0;
+
+        err = tape.Gradient(variables, result);
+        if (err) CalcPrintError(calc_log, __FILE__, __LINE__, __FUNC_NAME__, err, 1);
+
+        else if ((output = fopen(output_, "w")) == nullptr)
+        {
+            PrintError(DIFFERENTIATOR_LOGNAME, __FILE__, __LINE__, __FUNC_NAME__, DIFF_FILE_OPEN_ERROR);
+            err = DIFF_FILE_OPEN_ERROR;
         }
-        case OP_POW:       // u^v*(v'*ln(u) + v/u*u')
+        else
         {
-            Node<CalcNodeData>* Mul  = new Node<CalcNodeData>;
-            Node<CalcNodeData>* lPow = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rSum = new Node<CalcNodeData>;
+            fprintf(output, "f = ");
+            PrintNumber(output, result);
+            fputc('\n', output);
 
-            Node<CalcNodeData>* lPow_l = new Node<CalcNodeData>;
-            Node<CalcNodeData>* lPow_r = new Node<CalcNodeData>;
+            for (size_t i = 0; i < variables.getSize() - constants_.getSize(); ++i)
+            {
+                int var = tape.findVariable(variables[i].symbol);
 
-            Node<CalcNodeData>* rlMul = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rrMul = new Node<CalcNodeData>;
+                fprintf(output, "df/d%s = ", variables[i].name);
+                PrintNumber(output, (var != TAPE_NONE) ? tape.getGradient(var) : 0);
+                fputc('\n', output);
+            }
 
-            Node<CalcNodeData>* rlMul_l = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rlrLn   = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rlrLn_r = new Node<CalcNodeData>;
+            fclose(output);
+        }
+    }
 
-            Node<CalcNodeData>* rrlDiv   = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rrlDiv_l = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rrlDiv_r = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rrMul_r  = new Node<CalcNodeData>;
+    return err;
+}
 
-            Mul ->setData({ POISON<NUM_TYPE>, op_names[OP_MUL].word, op_names[OP_MUL].code, NODE_OPERATOR });
-            lPow->setData({ POISON<NUM_TYPE>, op_names[OP_POW].word, op_names[OP_POW].code, NODE_OPERATOR });
-            rSum->setData({ POISON<NUM_TYPE>, op_names[OP_ADD].word, op_names[OP_ADD].code, NODE_OPERATOR });
+//------------------------------------------------------------------------------
 
-            rlMul->setData({ POISON<NUM_TYPE>, op_names[OP_MUL].word, op_names[OP_MUL].code, NODE_OPERATOR });
-            rrMul->setData({ POISON<NUM_TYPE>, op_names[OP_MUL].word, op_names[OP_MUL].code, NODE_OPERATOR });
+int Differentiator::RunDual (char* point)
+{
+    DIFF_ASSERTOK((this == nullptr), DIFF_NULL_INPUT_DIFFERENTIATOR_PTR);
 
-            rlrLn ->setData({ POISON<NUM_TYPE>, op_names[OP_LN].word,  op_names[OP_LN].code,  NODE_FUNCTION });
-            rrlDiv->setData({ POISON<NUM_TYPE>, op_names[OP_DIV].word, op_names[OP_DIV].code, NODE_OPERATOR });
+    Stack<Variable> variables((char*)"point");
 
-            Mul->left_  = lPow;
-            Mul->right_ = rSum;
+    int err = ReadPoint(point, variables);
 
-            lPow->left_  = lPow_l;
-            lPow->right_ = lPow_r;
+    Dual result = {};
 
-            rSum->left_  = rlMul;
-            rSum->right_ = rrMul;
+    if (not err)
+    {
+        err = CalcDual(tree_, variables, diff_var_.symbol, result);
+        if (err) CalcPrintError(calc_log, __FILE__, __LINE__, __FUNC_NAME__, err, 1);
+    }
 
-            rlMul->left_  = rlMul_l;
-            rlMul->right_ = rlrLn;
-            rlrLn->right_ = rlrLn_r;
+    FILE* output = (err) ? nullptr : fopen(output_, "w");
+    if ((not err) && (output == nullptr))
+    {
+        PrintError(DIFFERENTIATOR_LOGNAME, __FILE__, __LINE__, __FUNC_NAME__, DIFF_FILE_OPEN_ERROR);
+        err = DIFF_FILE_OPEN_ERROR;
+    }
 
-            rrMul->left_  = rrlDiv;
-            rrMul->right_ = rrMul_r;
+    if (output != nullptr)
+    {
+        fprintf(output, "f = ");
+        PrintNumber(output, result.value);
+        fprintf(output, "\ndf/d%s = ", diff_var_.name);
+        PrintNumber(output, result.derivative);
+        fputc('\n', output);
 
-            rrlDiv->left_  = rrlDiv_l;
-            rrlDiv->right_ = rrlDiv_r;
+        fclose(output);
+    }
 
-            PREV_CONNECT(node_cur, Mul);
+    return err;
+}
 
-            *lPow_l = *node_cur->left_;
-            *lPow_r = *node_cur->right_;
+//------------------------------------------------------------------------------
 
-            *rlMul_l = *node_cur->right_;
-            *rlrLn_r = *node_cur->left_;
+int Differentiator::RunTaylor (char* point, size_t order)
+{
+    DIFF_ASSERTOK((this == nullptr), DIFF_NULL_INPUT_DIFFERENTIATOR_PTR);
 
-            *rrlDiv_l = *node_cur->right_;
-            *rrlDiv_r = *node_cur->left_;
+    Stack<Variable> variables((char*)"point");
 
-            *rrMul_r  = *node_cur->left_;
+    int err = ReadPoint(point, variables);
 
-            err = Differentiate(rlMul_l);
-            if (err) return err;
+    Taylor taylor(order);
 
-            err = Differentiate(rrMul_r);
-            if (err) return err;
+    if (not err)
+    {
+        err = taylor.Evaluate(tree_, variables, diff_var_.symbol);
+        if (err) CalcPrintError(calc_log, __FILE__, __LINE__, __FUNC_NAME__, err, 1);
+    }
 
-            break;
-        }
-        case OP_ARCCOS:    // -u'/sqrt(1 - u^2)
+    FILE* output = (err) ? nullptr : fopen(output_, "w");
+    if ((not err) && (output == nullptr))
+    {
+        PrintError(DIFFERENTIATOR_LOGNAME, __FILE__, __LINE__, __FUNC_NAME__, DIFF_FILE_OPEN_ERROR);
+        err = DIFF_FILE_OPEN_ERROR;
+    }
+
+    if (output != nullptr)
+    {
+        fprintf(output, "f = ");
+        PrintNumber(output, taylor.getDerivative(0));
+        fputc('\n', output);
+
+        for (size_t k = 1; k <= order; ++k)
         {
-            Node<CalcNodeData>* Sub  = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rDiv = new Node<CalcNodeData>;
+            if (k == 1)
+                fprintf(output, "df/d%s = ", diff_var_.name);
+            else
+                fprintf(output, "d%zuf/d%s%zu = ", k, diff_var_.name, k);
 
-            Node<CalcNodeData>* rDiv_l = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rrSqrt = new Node<CalcNodeData>;
+            PrintNumber(output, taylor.getDerivative(k));
+            fputc('\n', output);
+        }
 
-            Node<CalcNodeData>* rrrSub   = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rrrSub_l = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rrrrPow  = new Node<CalcNodeData>;
+        fclose(output);
+    }
 
-            Node<CalcNodeData>* rrrrPow_l = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rrrrPow_r = new Node<CalcNodeData>;
+    return err;
+}
 
-            Sub ->setData({ POISON<NUM_TYPE>, op_names[OP_SUB].word, op_names[OP_SUB].code, NODE_OPERATOR });
-            rDiv->setData({ POISON<NUM_TYPE>, op_names[OP_DIV].word, op_names[OP_DIV].code, NODE_OPERATOR });
+//------------------------------------------------------------------------------
 
-            rrSqrt ->setData({ POISON<NUM_TYPE>, op_names[OP_SQRT].word, op_names[OP_SQRT].code, NODE_FUNCTION });
-            rrrSub ->setData({ POISON<NUM_TYPE>, op_names[OP_SUB].word,  op_names[OP_SUB].code,  NODE_OPERATOR });
-            rrrrPow->setData({ POISON<NUM_TYPE>, op_names[OP_POW].word,  op_names[OP_POW].code,  NODE_OPERATOR });
+int Differentiator::ReadPoint (char* point, Stack<Variable>& variables)
+{
+    assert(filename_ != nullptr);
+    assert(output_   != nullptr);
+    assert(point     != nullptr);
+
+    FILE* source = fopen(filename_, "r");
+    if (source == nullptr)
+    {
+        PrintError(DIFFERENTIATOR_LOGNAME, __FILE__, __LINE__, __FUNC_NAME__, DIFF_FILE_OPEN_ERROR);
+        return DIFF_FILE_OPEN_ERROR;
+    }
 
-            Sub->right_ = rDiv;
+    Expression expression = { nullptr, nullptr };
 
-            rDiv->left_  = rDiv_l;
-            rDiv->right_ = rrSqrt;
+    int err = Stream2Tree(source, expression, tree_);
+    fclose(source);
+    if (err) return err;
 
-            rrSqrt->right_ = rrrSub;
-            rrrSub->left_  = rrrSub_l;
-            rrrSub->right_ = rrrrPow;
+    FILE* values = fopen(point, "r");
+    if (values == nullptr)
+    {
+        PrintError(DIFFERENTIATOR_LOGNAME, __FILE__, __LINE__, __FUNC_NAME__, DIFF_FILE_OPEN_ERROR);
+        return DIFF_FILE_OPEN_ERROR;
+    }
 
-            rrrrPow->left_  = rrrrPow_l;
-            rrrrPow->right_ = rrrrPow_r;
+    char* line = nullptr;
+    while ((line = ReadLine(values)) != nullptr)
+    {
+        // Names and numbers are read by the lexer of the expressions, so
+        // the point has the names and the values the expression can have
+        Lexer lexer(line, strlen(line));
+        lexer.Tokenize();
 
-            PREV_CONNECT(node_cur, Sub);
+        const Token* tokens = lexer.tokens_;
+        size_t       num    = lexer.num_ - 1; // without TOK_END
+        size_t       value  = ((num == 4) && ((tokens[2].kind == TOK_ADD) || (tokens[2].kind == TOK_SUB))) ? 3 : 2;
 
-            *rDiv_l = *node_cur->right_;
-            rrrSub_l->setData({ NUM_TYPE{1, 0}, nullptr, 0, NODE_NUMBER });
-            
-            *rrrrPow_l = *node_cur->right_;
-            rrrrPow_r->setData({ NUM_TYPE{2, 0}, nullptr, 0, NODE_NUMBER });
+        delete [] line;
 
-            err = Differentiate(rDiv_l);
-            if (err) return err;
+        if (num == 0) continue;
 
-            break;
-        }
-        case OP_ARCCOSH:   // u'/sqrt(u^2 - 1)
+        if ((num != value + 1) || (tokens[0].kind != TOK_IDENT) || (tokens[1].kind != TOK_ASSIGN) || (tokens[value].kind != TOK_NUMBER))
         {
-            Node<CalcNodeData>* Div   = new Node<CalcNodeData>;
-            Node<CalcNodeData>* Div_l = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rSqrt = new Node<CalcNodeData>;
+            fclose(values);
+            PrintError(DIFFERENTIATOR_LOGNAME, __FILE__, __LINE__, __FUNC_NAME__, DIFF_WRONG_POINT);
+            return DIFF_WRONG_POINT;
+        }
 
-            Node<CalcNodeData>* rrSub   = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rrlPow  = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rrSub_r = new Node<CalcNodeData>;
+        double number = (tokens[2].kind == TOK_SUB) ? -tokens[value].value : tokens[value].value;
 
-            Node<CalcNodeData>* rrlPow_l = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rrlPow_r = new Node<CalcNodeData>;
+        variables.Push({ number, symbols.getName(tokens[0].id), tokens[0].id });
+    }
+    fclose(values);
 
-            Div  ->setData({ POISON<NUM_TYPE>, op_names[OP_DIV].word,  op_names[OP_DIV].code,  NODE_OPERATOR });
-            rSqrt->setData({ POISON<NUM_TYPE>, op_names[OP_SQRT].word, op_names[OP_SQRT].code, NODE_FUNCTION });
+    // Constants go after the point, so they can be redefined there
+    for (size_t i = 0; i < constants_.getSize(); ++i)
+        variables.Push(constants_[i]);
 
-            rrSub ->setData({ POISON<NUM_TYPE>, op_names[OP_SUB].word, op_names[OP_SUB].code, NODE_OPERATOR });
-            rrlPow->setData({ POISON<NUM_TYPE>, op_names[OP_POW].word, op_names[OP_POW].code, NODE_OPERATOR });
+    return DIFF_OK;
+}
 
-            Div->left_  = Div_l;
-            Div->right_ = rSqrt;
+//------------------------------------------------------------------------------
 
-            rSqrt->right_ = rrSub;
-            rrSub->left_  = rrlPow;
-            rrSub->right_ = rrSub_r;
+int Differentiator::RunBatch ()
+{
+    FILE* input = fopen(filename_, "r");
+    if (input == nullptr)
+    {
+        PrintError(DIFFERENTIATOR_LOGNAME, __FILE__, __LINE__, __FUNC_NAME__, DIFF_FILE_OPEN_ERROR);
+        return DIFF_FILE_OPEN_ERROR;
+    }
 
-            rrlPow->left_  = rrlPow_l;
-            rrlPow->right_ = rrlPow_r;
+    FILE* output = fopen(output_, "w");
+    if (output == nullptr)
+    {
+        fclose(input);
+        PrintError(DIFFERENTIATOR_LOGNAME, __FILE__, __LINE__, __FUNC_NAME__, DIFF_FILE_OPEN_ERROR);
+        return DIFF_FILE_OPEN_ERROR;
+    }
 
-            PREV_CONNECT(node_cur, Div);
+    int threads = (threads_ > 0) ? threads_ : omp_get_max_threads();
 
-            *Div_l = *node_cur->right_;
+    char** lines   = new char* [DIFF_BATCH_SIZE];
+    char** results = new char* [DIFF_BATCH_SIZE];
 
-            *rrlPow_l = *node_cur->right_;
-            rrlPow_r->setData({ NUM_TYPE{2, 0}, nullptr, 0, NODE_NUMBER });
+    while (true)
+    {
+        long num = 0;
+        while ((num < DIFF_BATCH_SIZE) && ((lines[num] = ReadLine(input)) != nullptr)) ++num;
 
-            rrSub_r->setData({ NUM_TYPE{1, 0}, nullptr, 0, NODE_NUMBER });
+        if (num == 0) break;
 
-            err = Differentiate(Div_l);
-            if (err) return err;
+        // Each worker differentiates with its own tree, so jobs share nothing
+        // but the symbol table
+        #pragma omp parallel num_threads(threads)
+        {
+            Differentiator worker;
+            worker.shared_ = shared_;
 
-            break;
+            #pragma omp for schedule(dynamic, DIFF_BATCH_CHUNK)
+            for (long i = 0; i < num; ++i)
+                results[i] = check_ ? worker.Check(lines[i]) : worker.Derive(lines[i]);
         }
-        case OP_ARCCOT:    // -u'/(1 + u^2)
+
+        for (long i = 0; i < num; ++i)
         {
-            Node<CalcNodeData>* Sub  = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rDiv = new Node<CalcNodeData>;
+            fputs(results[i], output);
+            fputc('\n', output);
 
-            Node<CalcNodeData>* rDiv_l = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rrSum  = new Node<CalcNodeData>;
+            delete [] lines[i];
+            delete [] results[i];
+        }
+    }
 
-            Node<CalcNodeData>* rrSum_l = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rrrPow  = new Node<CalcNodeData>;
+    delete [] lines;
+    delete [] results;
 
-            Node<CalcNodeData>* rrrPow_l = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rrrPow_r = new Node<CalcNodeData>;
+    fclose(input);
+    fclose(output);
 
-            Sub ->setData({ POISON<NUM_TYPE>, op_names[OP_SUB].word, op_names[OP_SUB].code, NODE_OPERATOR });
-            rDiv->setData({ POISON<NUM_TYPE>, op_names[OP_DIV].word, op_names[OP_DIV].code, NODE_OPERATOR });
+    calc_log.Flush();
 
-            rrSum ->setData({ POISON<NUM_TYPE>, op_names[OP_ADD].word, op_names[OP_ADD].code, NODE_OPERATOR });
-            rrrPow->setData({ POISON<NUM_TYPE>, op_names[OP_POW].word, op_names[OP_POW].code, NODE_OPERATOR });
+    if (check_) return DIFF_OK;
 
-            Sub->right_ = rDiv;
+    printf("parse cache: %zu hits, %zu misses, %zu bytes used\n",
+           parse_cache.getHits(), parse_cache.getMisses(), parse_cache.getUsed());
 
-            rDiv->left_  = rDiv_l;
-            rDiv->right_ = rrSum;
+    return DIFF_OK;
+}
 
-            rrSum->left_  = rrSum_l;
-            rrSum->right_ = rrrPow;
+//------------------------------------------------------------------------------
 
-            rrrPow->left_  = rrrPow_l;
-            rrrPow->right_ = rrrPow_r;
+char* Differentiator::Derive (char* expr)
+{
+    assert(expr != nullptr);
 
-            PREV_CONNECT(node_cur, Sub);
+    expr[strcspn(expr, "\r\n")] = '\0';
+    if (expr[strspn(expr, " \t")] == '\0') return new char [1] {};
 
-            *rDiv_l = *node_cur->right_;
-            rrSum_l->setData({ NUM_TYPE{1, 0}, nullptr, 0, NODE_NUMBER });
+    // Error is the result of the line and is logged, the workers do not
+    // print it to the console
+    Expression expression = { expr, expr };
+    expression.console = false;
 
-            *rrrPow_l = *node_cur->right_;
-            rrrPow_r->setData({ NUM_TYPE{2, 0}, nullptr, 0, NODE_NUMBER });
+    int err = parse_cache.Parse(expression, tree_);
+    if (err)
+    {
+        const char* errstr = calc_errstr[expression.err + 1];
 
-            err = Differentiate(rDiv_l);
-            if (err) return err;
+        char* result = new char [strlen(errstr) + sizeof("ERROR: ")];
+        sprintf(result, "ERROR: %s", errstr);
 
-            break;
-        }
-        case OP_ARCCOTH:   // u'/(1 - u^2)
-        {
-            Node<CalcNodeData>* Div   = new Node<CalcNodeData>;
-            Node<CalcNodeData>* Div_l = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rSub  = new Node<CalcNodeData>;
+        return result;
+    }
 
-            Node<CalcNodeData>* rSub_l = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rrPow  = new Node<CalcNodeData>;
-            
-            Node<CalcNodeData>* rrPow_l = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rrPow_r = new Node<CalcNodeData>;
+    Derivative(tree_, diff_var_.symbol, tree_, shared_);
 
-            Div  ->setData({ POISON<NUM_TYPE>, op_names[OP_DIV].word, op_names[OP_DIV].code, NODE_OPERATOR });
-            rSub ->setData({ POISON<NUM_TYPE>, op_names[OP_SUB].word, op_names[OP_SUB].code, NODE_OPERATOR });
-            rrPow->setData({ POISON<NUM_TYPE>, op_names[OP_POW].word, op_names[OP_POW].code, NODE_OPERATOR });
+    Expression result = {};
+    Tree2Expr(tree_, result);
 
-            Div->left_  = Div_l;
-            Div->right_ = rSub;
+    tree_.Clean();
 
-            rSub->left_  = rSub_l;
-            rSub->right_ = rrPow;
+    return result.str;
+}
 
-            rrPow->left_  = rrPow_l;
-            rrPow->right_ = rrPow_r;
+//------------------------------------------------------------------------------
 
-            PREV_CONNECT(node_cur, Div);
+char* Differentiator::Check (char* expr)
+{
+    assert(expr != nullptr);
 
-            *Div_l = *node_cur->right_;
-            rSub_l->setData({ NUM_TYPE{1, 0}, nullptr, 0, NODE_NUMBER });
+    expr[strcspn(expr, "\r\n")] = '\0';
+    if (expr[strspn(expr, " \t")] == '\0') return new char [1] {};
 
-            *rrPow_l = *node_cur->right_;
-            rrPow_r->setData({ NUM_TYPE{2, 0}, nullptr, 0, NODE_NUMBER });
+    Expression expression = { expr, expr };
 
-            err = Differentiate(Div_l);
-            if (err) return err;
+    std::vector<Diagnostic> diagnostics;
+    if (CheckSyntax(expression, diagnostics) == 0)
+    {
+        char* result = new char [sizeof("OK")];
+        strcpy(result, "OK");
 
-            break;
-        }
-        case OP_ARCSIN:    // u'/sqrt(1 - u^2)
-        case OP_ARCSINH:   // u'/sqrt(1 + u^2)
-        {
-            Node<CalcNodeData>* Div   = new Node<CalcNodeData>;
-            Node<CalcNodeData>* Div_l = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rSqrt = new Node<CalcNodeData>;
+        return result;
+    }
 
-            Node<CalcNodeData>* rrSum   = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rrSum_l = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rrrPow  = new Node<CalcNodeData>;
-            
-            Node<CalcNodeData>* rrrPow_l = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rrrPow_r = new Node<CalcNodeData>;
+    expression.diagnostics = &diagnostics;
+    LogDiagnostics(calc_log, expression);
 
-            Div  ->setData({ POISON<NUM_TYPE>, op_names[OP_DIV].word,  op_names[OP_DIV].code,  NODE_OPERATOR });
-            rSqrt->setData({ POISON<NUM_TYPE>, op_names[OP_SQRT].word, op_names[OP_SQRT].code, NODE_FUNCTION });
+    size_t size = sizeof("ERROR");
+    for (size_t i = 0; i < diagnostics.size(); ++i)
+        size += strlen(calc_errstr[diagnostics[i].err + 1]) + 64;
 
-            if ((node_cur->getData().op_code) == OP_ARCSIN)
-                rrSum->setData({ POISON<NUM_TYPE>, op_names[OP_SUB].word, op_names[OP_SUB].code, NODE_OPERATOR });
-            else
-                rrSum->setData({ POISON<NUM_TYPE>, op_names[OP_ADD].word, op_names[OP_ADD].code, NODE_OPERATOR });
+    char* result = new char [size];
+    char* cur    = result + sprintf(result, "ERROR");
 
-            rrrPow->setData({ POISON<NUM_TYPE>, op_names[OP_POW].word, op_names[OP_POW].code, NODE_OPERATOR });
+    for (size_t i = 0; i < diagnostics.size(); ++i)
+        cur += sprintf(cur, "%s %zu-%zu: %s", (i == 0) ? "" : ";", diagnostics[i].begin,
+                       diagnostics[i].begin + diagnostics[i].len, calc_errstr[diagnostics[i].err + 1]);
 
-            Div->left_  = Div_l;
-            Div->right_ = rSqrt;
+    return result;
+}
 
-            rSqrt->right_ = rrSum;
-            rrSum->left_  = rrSum_l;
-            rrSum->right_ = rrrPow;
+//------------------------------------------------------------------------------
 
-            rrrPow->left_  = rrrPow_l;
-            rrrPow->right_ = rrrPow_r;
+int Derivative (const Tree<CalcNodeData>& expr, int symbol, Tree<CalcNodeData>& result, bool shared)
+{
+    assert(expr.root_ != nullptr);
 
-            PREV_CONNECT(node_cur, Div);
+    if (shared)
+    {
+        ExprDag dag;
 
-            *Div_l = *node_cur->right_;
-            rrSum_l->setData({ NUM_TYPE{1, 0}, nullptr, 0, NODE_NUMBER });
+        int root = Tree2Dag(expr, dag);
+        root = dag.Derivative(root, symbol);
 
-            *rrrPow_l = *node_cur->right_;
-            rrrPow_r->setData({ NUM_TYPE{2, 0}, nullptr, 0, NODE_NUMBER });
+        return Dag2Tree(dag, root, result);
+    }
 
-            err = Differentiate(Div_l);
-            if (err) return err;
+    Node<CalcNodeData>* root  = nullptr;
+    std::vector<int>    names = DeriveNames(expr.root_, symbol);
 
-            break;
-        }
-        case OP_ARCTAN:    // u'/(1 + u^2)
-        case OP_ARCTANH:   // u'/(1 - u^2)
-        {
-            Node<CalcNodeData>* Div = new Node<CalcNodeData>;
+    // Derivatives of the bindings could not be named in the full symbol
+    // table, the DAG inlines the bindings and needs no names
+    if (names.empty() && (expr.root_->getData().node_type == NODE_LET))
+        return Derivative(expr, symbol, result, true);
 
-            Node<CalcNodeData>* Div_l = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rSum  = new Node<CalcNodeData>;
+    // Tasks need a team of threads, the workers of batch modes are a team
+    // already and take the tasks when they are idle
+    if ((expr.root_->getData().size >= 2 * DIFF_TASK_CUTOFF) && (not omp_in_parallel()))
+    {
+        #pragma omp parallel
+        #pragma omp single
+        root = DeriveNode(expr.root_, symbol, names);
+    }
+    else root = DeriveNode(expr.root_, symbol, names);
 
-            Node<CalcNodeData>* rSum_l = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rrPow  = new Node<CalcNodeData>;
+    // Expression is not needed any more, it may be the result
+    delete result.root_;
 
-            Node<CalcNodeData>* rrPow_l = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rrPow_r = new Node<CalcNodeData>;
+    // Parents are set as the nodes are made, depths are counted by Optimize
+    result.root_ = root;
+    result.root_->prev_ = nullptr;
 
-            Div->setData({ POISON<NUM_TYPE>, op_names[OP_DIV].word, op_names[OP_DIV].code, NODE_OPERATOR });
+    Optimize(result);
+    CountDepends(result.root_);
 
-            if ((node_cur->getData().op_code) == OP_ARCTAN)
-                rSum->setData({ POISON<NUM_TYPE>, op_names[OP_ADD].word, op_names[OP_ADD].code, NODE_OPERATOR });
-            else
-                rSum->setData({ POISON<NUM_TYPE>, op_names[OP_SUB].word, op_names[OP_SUB].code, NODE_OPERATOR });
+    return DIFF_OK;
+}
 
-            rrPow->setData({ POISON<NUM_TYPE>, op_names[OP_POW].word, op_names[OP_POW].code, NODE_OPERATOR });
+//------------------------------------------------------------------------------
 
-            Div->left_  = Div_l;
-            Div->right_ = rSum;
+// Node builder of the rule interpreter, operands are copied and the
+// derivatives of the operands are already built. Operators are made by
+// MakeOperator, so zero terms and unit factors of the rules are dropped as
+// they appear.
 
-            rSum->left_  = rSum_l;
-            rSum->right_ = rrPow;
+struct TreeRuleBuilder
+{
+    const Node<CalcNodeData>* u = nullptr;
+    const Node<CalcNodeData>* v = nullptr;
 
-            rrPow->left_  = rrPow_l;
-            rrPow->right_ = rrPow_r;
+    Node<CalcNodeData>* du = nullptr;
+    Node<CalcNodeData>* dv = nullptr;
 
-            PREV_CONNECT(node_cur, Div);
+    Node<CalcNodeData>* Operand (char code)
+    {
+        switch (code)
+        {
+        case RULE_U:  return CopyNode(u);
+        case RULE_V:  return CopyNode(v);
+        case RULE_DU: return du;
+        case RULE_DV: return dv;
+        default: assert(0);
+        }
 
-            *Div_l = *node_cur->right_;
-            rSum_l->setData({ NUM_TYPE{1, 0}, nullptr, 0, NODE_NUMBER });
+        return nullptr;
+    }
 
-            *rrPow_l = *node_cur->right_;
-            rrPow_r->setData({ NUM_TYPE{2, 0}, nullptr, 0, NODE_NUMBER });
+    Node<CalcNodeData>* Number   (int number)                                                { return NewNumber(NUM_TYPE{(double)number, 0}); }
+    Node<CalcNodeData>* Function (char op_code, Node<CalcNodeData>* arg)                     { return NewFunction(op_code, arg);              }
+    Node<CalcNodeData>* Operator (char op_code, Node<CalcNodeData>* l, Node<CalcNodeData>* r) { return MakeOperator(op_code, l, r);            }
+    Node<CalcNodeData>* Negate   (Node<CalcNodeData>* arg)                                   { return MakeOperator(OP_SUB, nullptr, arg);     }
+};
 
-            err = Differentiate(Div_l);
-            if (err) return err;
+// Continuation record of the differentiation. Node is taken twice: first
+// the operands whose derivatives its rule needs are put to the work stack,
+// then its derivative is built from theirs. Operand given to a task is
+// taken once, when its derivative is needed.
 
-            break;
+struct DeriveTask
+{
+    const Node<CalcNodeData>* node    = nullptr;
+    int                       rule    = OP_ERR;   // rule of the node, OP_ERR for n-ary node
+    bool                      ready   = false;    // derivatives of the operands are built
+    Node<CalcNodeData>**      spawned = nullptr;  // derivative of the node built by OpenMP task
+};
+
+//------------------------------------------------------------------------------
+
+Node<CalcNodeData>* DeriveNode (const Node<CalcNodeData>* node_cur, int symbol, const std::vector<int>& names)
+{
+    assert(node_cur != nullptr);
+
+    // Nothing is recursive, so the depth of the expression is limited only
+    // by memory
+    std::vector<DeriveTask>                work;
+    std::vector<Node<CalcNodeData>*>       derivs;    // built derivatives not yet taken by the parent
+    std::vector<const Node<CalcNodeData>*> operands;
+    std::deque <Node<CalcNodeData>*>       spawned;   // derivatives built by the tasks, never moved
+
+    work.push_back({ node_cur, OP_ERR, false, nullptr });
+
+    while (not work.empty())
+    {
+        DeriveTask task = work.back();
+        work.pop_back();
+
+        const Node<CalcNodeData>* node = task.node;
+        const CalcNodeData&       data = node->getData();
+
+        // Tasks are started only by the last node taken first time, so the
+        // wait is for the operands of this node
+        if (task.spawned != nullptr)
+        {
+            #pragma omp taskwait
+
+            derivs.push_back(*task.spawned);
+            continue;
         }
-        case OP_COS:       // -u'*sin(u)
+
+        if (task.ready)
         {
-            Node<CalcNodeData>* Sub  = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rMul = new Node<CalcNodeData>;
+            // let u = a; f  ->  let u = a; let dudx = a'; f'
+            if (data.node_type == NODE_LET)
+            {
+                Node<CalcNodeData>* dbody = derivs.back();
+                derivs.pop_back();
+
+                if (isDependent(node->right_, symbol) && (not hasBoundDerivative(node, names)))
+                {
+                    dbody = NewLet(names[data.symbol], derivs.back(), dbody);
+                    derivs.pop_back();
+                }
 
-            Node<CalcNodeData>* rMul_l  = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rrSin   = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rrSin_r = new Node<CalcNodeData>;
-            
-            Sub ->setData({ POISON<NUM_TYPE>, op_names[OP_SUB].word, op_names[OP_SUB].code, NODE_OPERATOR });
-            rMul->setData({ POISON<NUM_TYPE>, op_names[OP_MUL].word, op_names[OP_MUL].code, NODE_OPERATOR });
+                derivs.push_back(NewLet(data.symbol, CopyNode(node->right_), dbody));
+                continue;
+            }
 
-            rrSin->setData({ POISON<NUM_TYPE>, op_names[OP_SIN].word, op_names[OP_SIN].code, NODE_FUNCTION });
+            if (node->args_num_ != 0)
+            {
+                size_t num = 0;
+                for (size_t i = 0; i < node->args_num_; ++i)
+                    if (isDependent(node->args_[i], symbol)) ++num;
 
-            Sub->right_ = rMul;
+                Node<CalcNodeData>* darg = DeriveArgs(node, symbol, derivs.data() + derivs.size() - num);
 
-            rMul->left_  = rMul_l;
-            rMul->right_ = rrSin;
+                derivs.resize(derivs.size() - num);
+                derivs.push_back(darg);
+                continue;
+            }
 
-            rrSin->right_ = rrSin_r;
+            TreeRuleBuilder builder = {};
+            builder.u = (data.node_type == NODE_FUNCTION) ? node->right_ : node->left_;
+            builder.v = (data.node_type == NODE_FUNCTION) ? nullptr      : node->right_;
 
-            PREV_CONNECT(node_cur, Sub);
+            // Derivative of v is built last, so it is on the top
+            char uses = rule_table.programs[task.rule].uses;
 
-            *rMul_l  = *node_cur->right_;
-            *rrSin_r = *node_cur->right_;
+            if (uses & RULE_USES_DV) { builder.dv = derivs.back(); derivs.pop_back(); }
+            if (uses & RULE_USES_DU) { builder.du = derivs.back(); derivs.pop_back(); }
 
-            err = Differentiate(rMul_l);
-            if (err) return err;
+            derivs.push_back(ApplyRule(task.rule, builder));
+            continue;
+        }
 
-            break;
+        // Subtree without the variable is a constant
+        if (not isDependent(node, symbol))
+        {
+            derivs.push_back(NewNumber(NUM_TYPE{0, 0}));
+            continue;
         }
-        case OP_COSH:      // u'*sinh(u)
+
+        switch (data.node_type)
+        {
+        case NODE_NUMBER:
+
+            derivs.push_back(NewNumber(NUM_TYPE{0, 0}));
+            continue;
+
+        case NODE_VARIABLE:
         {
-            Node<CalcNodeData>* Mul = new Node<CalcNodeData>;
+            int var = (data.symbol != NO_SYMBOL) ? data.symbol : symbols.Intern(data.word);
 
-            Node<CalcNodeData>* Mul_l   = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rSinh   = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rSinh_r = new Node<CalcNodeData>;
-            
-            Mul  ->setData({ POISON<NUM_TYPE>, op_names[OP_MUL].word,  op_names[OP_MUL].code,  NODE_OPERATOR });
-            rSinh->setData({ POISON<NUM_TYPE>, op_names[OP_SINH].word, op_names[OP_SINH].code, NODE_FUNCTION });
+            // Derivative of the binding is bound to its own name
+            if (data.op_code == VAR_BOUND)
+                derivs.push_back(NewVariable(names[var]));
+            else
+                derivs.push_back(NewNumber((var == symbol) ? NUM_TYPE{1, 0} : NUM_TYPE{0, 0}));
+            continue;
+        }
+        case NODE_LET:
 
-            Mul->left_  = Mul_l;
-            Mul->right_ = rSinh;
+            break;
 
-            rSinh->right_ = rSinh_r;
+        case NODE_FUNCTION:
 
-            PREV_CONNECT(node_cur, Mul);
+            task.rule = data.op_code;
+            break;
 
-            *Mul_l   = *node_cur->right_;
-            *rSinh_r = *node_cur->right_;
+        case NODE_OPERATOR:
 
-            err = Differentiate(Mul_l);
-            if (err) return err;
+            if (node->args_num_ != 0) break;
 
+            if (node->left_ == nullptr) task.rule = RULE_UNARY_MINUS;
+            else
+                task.rule = SelectRule(data.op_code, not isDependent(node->left_, symbol), not isDependent(node->right_, symbol));
             break;
+
+        default: assert(0);
+        }
+
+        task.ready = true;
+        work.push_back(task);
+
+        operands.clear();
+
+        if (node->args_num_ != 0)
+        {
+            for (size_t i = 0; i < node->args_num_; ++i)
+                if (isDependent(node->args_[i], symbol)) operands.push_back(node->args_[i]);
         }
-        case OP_COT:       // -u'/(sin(u)^2)
-        case OP_COTH:      // -u'/(sinh(u)^2)
+        else
+        if (data.node_type == NODE_LET)
         {
-            Node<CalcNodeData>* Sub  = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rDiv = new Node<CalcNodeData>;
+            if (isDependent(node->right_, symbol) && (not hasBoundDerivative(node, names))) operands.push_back(node->right_);
 
-            Node<CalcNodeData>* rDiv_l = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rrPow  = new Node<CalcNodeData>;
+            operands.push_back(node->left_);
+        }
+        else
+        {
+            char uses = rule_table.programs[task.rule].uses;
 
-            Node<CalcNodeData>* rrlSin  = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rrPow_r = new Node<CalcNodeData>;
+            if (uses & RULE_USES_DU) operands.push_back((data.node_type == NODE_FUNCTION) ? node->right_ : node->left_);
+            if (uses & RULE_USES_DV) operands.push_back(node->right_);
+        }
 
-            Node<CalcNodeData>* rrlSin_r = new Node<CalcNodeData>;
-            
-            Sub ->setData({ POISON<NUM_TYPE>, op_names[OP_SUB].word, op_names[OP_SUB].code, NODE_OPERATOR });
-            rDiv->setData({ POISON<NUM_TYPE>, op_names[OP_DIV].word, op_names[OP_DIV].code, NODE_OPERATOR });
+        size_t large = 0;
+        for (size_t i = 0; i < operands.size(); ++i)
+            if (operands[i]->getData().size >= DIFF_TASK_CUTOFF) ++large;
 
-            rrPow->setData({ POISON<NUM_TYPE>, op_names[OP_POW].word, op_names[OP_POW].code, NODE_OPERATOR });
+        // Operands are pushed in reverse order, so their derivatives are
+        // built in order. Single large operand is walked by this thread,
+        // there is nothing to run beside it
+        for (size_t i = operands.size(); i > 0; --i)
+        {
+            const Node<CalcNodeData>* operand = operands[i - 1];
 
-            if ((node_cur->getData().op_code) == OP_COT)
-                rrlSin->setData({ POISON<NUM_TYPE>, op_names[OP_SIN].word, op_names[OP_SIN].code, NODE_FUNCTION });
-            else
-                rrlSin->setData({ POISON<NUM_TYPE>, op_names[OP_SINH].word, op_names[OP_SINH].code, NODE_FUNCTION });
+            if ((large < 2) || (operand->getData().size < DIFF_TASK_CUTOFF))
+            {
+                work.push_back({ operand, OP_ERR, false, nullptr });
+                continue;
+            }
 
-            Sub->right_ = rDiv;
+            Node<CalcNodeData>** slot = &spawned.emplace_back(nullptr);
 
-            rDiv->left_  = rDiv_l;
-            rDiv->right_ = rrPow;
+            #pragma omp task firstprivate(operand, slot, symbol) shared(names)
+            *slot = DeriveNode(operand, symbol, names);
 
-            rrPow->left_  = rrlSin;
-            rrPow->right_ = rrPow_r;
+            work.push_back({ operand, OP_ERR, false, slot });
+        }
+    }
 
-            rrlSin->right_ = rrlSin_r;
+    assert(derivs.size() == 1);
+
+    return derivs[0];
+}
 
-            PREV_CONNECT(node_cur, Sub);
+//------------------------------------------------------------------------------
 
-            *rDiv_l   = *node_cur->right_;
-            *rrlSin_r = *node_cur->right_;
+Node<CalcNodeData>* DeriveArgs (const Node<CalcNodeData>* node_cur, int symbol, Node<CalcNodeData>** dargs)
+{
+    assert(node_cur->args_num_ != 0);
+    assert(dargs != nullptr);
 
-            rrPow_r->setData({ NUM_TYPE{2, 0}, nullptr, 0, NODE_NUMBER });
+    // Zero terms are not added and unit factors are dropped, so the sum
+    // has only the operands depending on the variable
+    Node<CalcNodeData>* Sum = NewOperator(OP_ADD, nullptr, nullptr);
 
-            err = Differentiate(rDiv_l);
-            if (err) return err;
+    switch (node_cur->getData().op_code)
+    {
+    case OP_ADD:       // u1' + u2' + ... + un'
 
-            break;
+        for (size_t i = 0; i < node_cur->args_num_; ++i)
+        {
+            if (not isDependent(node_cur->args_[i], symbol)) continue;
+
+            Node<CalcNodeData>* darg = *dargs++;
+
+            if (isValue(darg, 0)) delete darg;
+            else Sum->addArg(darg);
         }
-        case OP_EXP:       // u'*exp(u)
+        break;
+
+    case OP_MUL:       // u1'*u2*...*un + u1*u2'*...*un + ... + u1*u2*...*un'
+
+        for (size_t i = 0; i < node_cur->args_num_; ++i)
         {
-            Node<CalcNodeData>* Mul   = new Node<CalcNodeData>;
-            Node<CalcNodeData>* Mul_l = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rExp  = new Node<CalcNodeData>;
+            // Constant factors are only copied
+            if (not isDependent(node_cur->args_[i], symbol)) continue;
 
-            Node<CalcNodeData>* rExp_r = new Node<CalcNodeData>;
-            
-            Mul ->setData({ POISON<NUM_TYPE>, op_names[OP_MUL].word, op_names[OP_MUL].code, NODE_OPERATOR });
-            rExp->setData({ POISON<NUM_TYPE>, op_names[OP_EXP].word, op_names[OP_EXP].code, NODE_FUNCTION });
+            Node<CalcNodeData>* darg = *dargs++;
 
-            Mul->left_  = Mul_l;
-            Mul->right_ = rExp;
+            if (isValue(darg, 0))
+            {
+                delete darg;
+                continue;
+            }
 
-            rExp->right_ = rExp_r;
+            Node<CalcNodeData>* Mul = NewOperator(OP_MUL, nullptr, nullptr);
 
-            PREV_CONNECT(node_cur, Mul);
+            for (size_t j = 0; j < node_cur->args_num_; ++j)
+            {
+                if (j != i) Mul->addArg(CopyNode(node_cur->args_[j]));
+                else
+                if (isValue(darg, 1)) delete darg;
+                else Mul->addArg(darg);
+            }
 
-            *Mul_l  = *node_cur->right_;
-            *rExp_r = *node_cur->right_;
+            Sum->addArg(FinishArgs(Mul, 1));
+        }
+        break;
 
-            err = Differentiate(Mul_l);
-            if (err) return err;
+    default: assert(0);
+    }
 
-            break;
+    return FinishArgs(Sum, 0);
+}
+
+//------------------------------------------------------------------------------
+
+Node<CalcNodeData>* FinishArgs (Node<CalcNodeData>* node_cur, NUM_TYPE neutral)
+{
+    assert((node_cur->left_ == nullptr) && (node_cur->right_ == nullptr));
+
+    if (node_cur->args_num_ > 1) return node_cur;
+
+    Node<CalcNodeData>* result = nullptr;
+
+    if (node_cur->args_num_ == 1)
+    {
+        result = node_cur->args_[0];
+        result->prev_ = nullptr;
+
+        node_cur->args_num_ = 0;
+    }
+    else result = NewNumber(neutral);
+
+    delete node_cur;
+
+    return result;
+}
+
+//------------------------------------------------------------------------------
+
+Node<CalcNodeData>* MakeOperator (char op_code, Node<CalcNodeData>* left, Node<CalcNodeData>* right)
+{
+    assert(right != nullptr);
+
+    if (left == nullptr)
+    {
+        assert(op_code == OP_SUB);
+
+        if (right->getData().node_type == NODE_NUMBER)   // -(c)
+        {
+            CalcNodeData data = right->getData();
+            data.number = -data.number;
+            right->setData(data);
+
+            return right;
         }
-        case OP_LG:        // u'/(u*ln(10))
+
+        if (isNegation(right))                           // -(-u) = u
         {
-            Node<CalcNodeData>* Div   = new Node<CalcNodeData>;
-            Node<CalcNodeData>* Div_l = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rMul  = new Node<CalcNodeData>;
+            bool negative = false;
+            return TakeNegation(right, negative);
+        }
 
-            Node<CalcNodeData>* rMul_l = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rrLn   = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rrLn_r = new Node<CalcNodeData>;
-            
-            Div ->setData({ POISON<NUM_TYPE>, op_names[OP_DIV].word, op_names[OP_DIV].code, NODE_OPERATOR });
-            rMul->setData({ POISON<NUM_TYPE>, op_names[OP_MUL].word, op_names[OP_MUL].code, NODE_OPERATOR });
-            rrLn->setData({ POISON<NUM_TYPE>, op_names[OP_LN].word,  op_names[OP_LN].code,  NODE_FUNCTION });
+        if ( (right->getData().node_type == NODE_OPERATOR) && (right->args_num_ == 0) &&
+             ((right->getData().op_code == OP_MUL) || (right->getData().op_code == OP_DIV)) &&
+             (right->left_->getData().node_type == NODE_NUMBER) )
+        {
+            // -(c*u) = (-c)*u, -(c/u) = (-c)/u
+            CalcNodeData data = right->left_->getData();
+            data.number = -data.number;
+            right->left_->setData(data);
 
-            Div->left_  = Div_l;
-            Div->right_ = rMul;
+            return right;
+        }
 
-            rMul->left_  = rMul_l;
-            rMul->right_ = rrLn;
+        return NewOperator(OP_SUB, nullptr, right);
+    }
 
-            rrLn->right_ = rrLn_r;
+    Node<CalcNodeData>* result = nullptr;
+    Node<CalcNodeData>* unused = nullptr;
 
-            PREV_CONNECT(node_cur, Div);
+    // Numbers are folded only where the result is exact enough to be
+    // printed, like Optimize does it
+    if ( (left ->getData().node_type == NODE_NUMBER) &&
+         (right->getData().node_type == NODE_NUMBER) &&
+         ((op_code == OP_ADD) || (op_code == OP_SUB) || (op_code == OP_MUL)) )
+    {
+        left->setData({ CalcOperator(op_code, left->getData().number, right->getData().number), nullptr, 0, NODE_NUMBER });
 
-            *Div_l  = *node_cur->right_;
-            *rMul_l = *node_cur->right_;
+        result = left;
+        unused = right;
+    }
+    else switch (op_code)
+    {
+    case OP_ADD:
 
-            rrLn_r->setData({ NUM_TYPE{10, 0}, nullptr, 0, NODE_NUMBER });
+        if      (isValue(left,  0)) { result = right; unused = left;  }   // 0 + v = v
+        else if (isValue(right, 0)) { result = left;  unused = right; }   // u + 0 = u
+        else
+        {
+            bool negative = false;
 
-            err = Differentiate(Div_l);
-            if (err) return err;
+            if (isNegation(right))                                        // u + (-v) = u - v
+                return MakeOperator(OP_SUB, left, TakeNegation(right, negative));
 
-            break;
+            if (isNegation(left))                                         // (-u) + v = v - u
+                return MakeOperator(OP_SUB, right, TakeNegation(left, negative));
         }
-        case OP_LN:        // u'/u
+        break;
+
+    case OP_SUB:
+
+        if (isValue(right, 0)) { result = left; unused = right; }         // u - 0 = u
+        else
+        if (isValue(left, 0))                                             // 0 - v = -v
         {
-            Node<CalcNodeData>* Div   = new Node<CalcNodeData>;
-            Node<CalcNodeData>* Div_l = new Node<CalcNodeData>;
-            Node<CalcNodeData>* Div_r  = new Node<CalcNodeData>;
-            
-            Div->setData({ POISON<NUM_TYPE>, op_names[OP_DIV].word, op_names[OP_DIV].code, NODE_OPERATOR });
+            delete left;
+            return MakeOperator(OP_SUB, nullptr, right);
+        }
+        else
+        if (isNegation(right))                                            // u - (-v) = u + v
+        {
+            bool negative = false;
+            return MakeOperator(OP_ADD, left, TakeNegation(right, negative));
+        }
+        break;
 
-            Div->left_  = Div_l;
-            Div->right_ = Div_r;
+    case OP_MUL:
 
-            PREV_CONNECT(node_cur, Div);
+        if      (isValue(left,  0)) { result = left;  unused = right; }   // 0*v = 0
+        else if (isValue(right, 0)) { result = right; unused = left;  }   // u*0 = 0
+        else if (isValue(left,  1)) { result = right; unused = left;  }   // 1*v = v
+        else if (isValue(right, 1)) { result = left;  unused = right; }   // u*1 = u
+        else
+        if (isValue(left, -1))                                            // -1*v = -v
+        {
+            delete left;
+            return MakeOperator(OP_SUB, nullptr, right);
+        }
+        else
+        if (isValue(right, -1))                                           // u*(-1) = -u
+        {
+            delete right;
+            return MakeOperator(OP_SUB, nullptr, left);
+        }
+        else return MakeProduct(op_code, left, right);
+        break;
 
-            *Div_l = *node_cur->right_;
-            *Div_r = *node_cur->right_;
+    case OP_DIV:
 
-            err = Differentiate(Div_l);
-            if (err) return err;
+        if      (isValue(left,  0)) { result = left; unused = right; }    // 0/v = 0
+        else if (isValue(right, 1)) { result = left; unused = right; }    // u/1 = u
+        else return MakeProduct(op_code, left, right);
+        break;
 
-            break;
-        }
-        case OP_SIN:       // u'*cos(u)
-        case OP_SINH:      // u'*cosh(u)
+    case OP_POW:
+
+        if      (isValue(right, 1)) { result = left; unused = right; }    // u^1 = u
+        else if (isValue(left,  1)) { result = left; unused = right; }    // 1^v = 1
+        else if (isValue(right, 0))                                       // u^0 = 1
         {
-            Node<CalcNodeData>* Mul = new Node<CalcNodeData>;
+            right->setData({ NUM_TYPE{1, 0}, nullptr, 0, NODE_NUMBER });
 
-            Node<CalcNodeData>* Mul_l  = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rCos   = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rCos_r = new Node<CalcNodeData>;
-            
-            Mul->setData({ POISON<NUM_TYPE>, op_names[OP_MUL].word, op_names[OP_MUL].code, NODE_OPERATOR });
+            result = right;
+            unused = left;
+        }
+        break;
 
-            if ((node_cur->getData().op_code) == OP_SIN)
-                rCos->setData({ POISON<NUM_TYPE>, op_names[OP_COS].word, op_names[OP_COS].code, NODE_FUNCTION });
-            else
-                rCos->setData({ POISON<NUM_TYPE>, op_names[OP_COSH].word, op_names[OP_COSH].code, NODE_FUNCTION });
+    default: assert(0);
+    }
 
-            Mul->left_  = Mul_l;
-            Mul->right_ = rCos;
+    if (result == nullptr) return NewOperator(op_code, left, right);
 
-            rCos->right_ = rCos_r;
+    delete unused;
 
-            PREV_CONNECT(node_cur, Mul);
+    result->prev_ = nullptr;
 
-            *Mul_l  = *node_cur->right_;
-            *rCos_r = *node_cur->right_;
+    return result;
+}
 
-            err = Differentiate(Mul_l);
-            if (err) return err;
+//------------------------------------------------------------------------------
 
-            break;
-        }
-        case OP_SQRT:      // u'/(2*sqrt(u))
-        {
-            Node<CalcNodeData>* Div   = new Node<CalcNodeData>;
-            Node<CalcNodeData>* Div_l = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rMul  = new Node<CalcNodeData>;
+Node<CalcNodeData>* MakeProduct (char op_code, Node<CalcNodeData>* left, Node<CalcNodeData>* right)
+{
+    assert((op_code == OP_MUL) || (op_code == OP_DIV));
 
-            Node<CalcNodeData>* rMul_l = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rrSqrt  = new Node<CalcNodeData>;
-            
-            Node<CalcNodeData>* rrSqrt_r = new Node<CalcNodeData>;
+    // (-u)*v = u*(-v) = -(u*v), the same for division
+    bool negative = false;
 
-            Div ->setData({ POISON<NUM_TYPE>, op_names[OP_DIV].word, op_names[OP_DIV].code, NODE_OPERATOR });
-            rMul->setData({ POISON<NUM_TYPE>, op_names[OP_MUL].word, op_names[OP_MUL].code, NODE_OPERATOR });
+    if (isNegation(left))  left  = TakeNegation(left,  negative);
+    if (isNegation(right)) right = TakeNegation(right, negative);
 
-            rrSqrt->setData({ POISON<NUM_TYPE>, op_names[OP_SQRT].word, op_names[OP_SQRT].code, NODE_FUNCTION });
+    if (not negative) return NewOperator(op_code, left, right);
 
-            Div->left_  = Div_l;
-            Div->right_ = rMul;
+    return MakeOperator(OP_SUB, nullptr, MakeOperator(op_code, left, right));
+}
 
-            rMul->left_  = rMul_l;
-            rMul->right_ = rrSqrt;
+//------------------------------------------------------------------------------
 
-            rrSqrt->right_ = rrSqrt_r;
+Node<CalcNodeData>* TakeNegation (Node<CalcNodeData>* node_cur, bool& negative)
+{
+    assert(isNegation(node_cur));
 
-            PREV_CONNECT(node_cur, Div);
+    Node<CalcNodeData>* inner = node_cur->right_;
 
-            *Div_l = *node_cur->right_;
-            rMul_l->setData({ NUM_TYPE{2, 0}, nullptr, 0, NODE_NUMBER });
+    node_cur->right_ = nullptr;
+    inner->prev_     = nullptr;
 
-            *rrSqrt_r = *node_cur->right_;
+    delete node_cur;
 
-            err = Differentiate(Div_l);
-            if (err) return err;
+    negative = not negative;
 
-            break;
-        }
-        case OP_TAN:       // u'/(cos(u)^2)
-        case OP_TANH:      // u'/(cosh(u)^2)
-        {
-            Node<CalcNodeData>* Div = new Node<CalcNodeData>;
+    return inner;
+}
 
-            Node<CalcNodeData>* Div_l = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rPow  = new Node<CalcNodeData>;
+//------------------------------------------------------------------------------
 
-            Node<CalcNodeData>* rlCos  = new Node<CalcNodeData>;
-            Node<CalcNodeData>* rPow_r = new Node<CalcNodeData>;
+bool isValue (const Node<CalcNodeData>* node, NUM_TYPE number)
+{
+    return (node->getData().node_type == NODE_NUMBER) && (abs(node->getData().number - number) <= NIL);
+}
 
-            Node<CalcNodeData>* rlCos_r = new Node<CalcNodeData>;
-            
-            Div ->setData({ POISON<NUM_TYPE>, op_names[OP_DIV].word, op_names[OP_DIV].code, NODE_OPERATOR });
-            rPow->setData({ POISON<NUM_TYPE>, op_names[OP_POW].word, op_names[OP_POW].code, NODE_OPERATOR });
+//------------------------------------------------------------------------------
 
-            if ((node_cur->getData().op_code) == OP_TAN)
-                rlCos->setData({ POISON<NUM_TYPE>, op_names[OP_COS].word, op_names[OP_COS].code, NODE_FUNCTION });
-            else
-                rlCos->setData({ POISON<NUM_TYPE>, op_names[OP_COSH].word, op_names[OP_COSH].code, NODE_FUNCTION });
+Node<CalcNodeData>* NewNumber (NUM_TYPE number)
+{
+    Node<CalcNodeData>* node = new Node<CalcNodeData>;
 
-            Div->left_  = Div_l;
-            Div->right_ = rPow;
+    node->setData({ number, nullptr, 0, NODE_NUMBER });
 
-            rPow->left_  = rlCos;
-            rPow->right_ = rPow_r;
+    return node;
+}
 
-            rlCos->right_ = rlCos_r;
+//------------------------------------------------------------------------------
 
-            PREV_CONNECT(node_cur, Div);
+Node<CalcNodeData>* NewOperator (char op_code, Node<CalcNodeData>* left, Node<CalcNodeData>* right)
+{
+    Node<CalcNodeData>* node = new Node<CalcNodeData>;
 
-            *Div_l   = *node_cur->right_;
-            *rlCos_r = *node_cur->right_;
+    node->setData({ POISON<NUM_TYPE>, op_names[op_code].word, op_names[op_code].code, NODE_OPERATOR });
 
-            rPow_r->setData({ NUM_TYPE{2, 0}, nullptr, 0, NODE_NUMBER });
+    node->left_  = left;
+    node->right_ = right;
 
-            err = Differentiate(Div_l);
-            if (err) return err;
+    if (left  != nullptr) left ->prev_ = node;
+    if (right != nullptr) right->prev_ = node;
 
-            break;
-        }
-        default: assert(0);
-        }
-        break;
+    return node;
+}
+
+//------------------------------------------------------------------------------
+
+Node<CalcNodeData>* NewFunction (char op_code, Node<CalcNodeData>* arg)
+{
+    Node<CalcNodeData>* node = new Node<CalcNodeData>;
 
-    case NODE_VARIABLE:
+    node->setData({ POISON<NUM_TYPE>, op_names[op_code].word, op_names[op_code].code, NODE_FUNCTION });
+
+    node->right_ = arg;
+    arg->prev_   = node;
+
+    return node;
+}
+
+//------------------------------------------------------------------------------
+
+Node<CalcNodeData>* NewVariable (int symbol)
+{
+    Node<CalcNodeData>* node = new Node<CalcNodeData>;
+
+    node->setData({ POISON<NUM_TYPE>, symbols.getName(symbol), 0, NODE_VARIABLE, symbol });
+
+    return node;
+}
+
+//------------------------------------------------------------------------------
+
+Node<CalcNodeData>* NewLet (int symbol, Node<CalcNodeData>* value, Node<CalcNodeData>* body)
+{
+    Node<CalcNodeData>* node = new Node<CalcNodeData>;
+
+    node->setData({ POISON<NUM_TYPE>, symbols.getName(symbol), 0, NODE_LET, symbol });
+
+    node->right_ = value;
+    node->left_  = body;
+    value->prev_ = node;
+    body->prev_  = node;
+
+    return node;
+}
+
+//------------------------------------------------------------------------------
+
+std::vector<int> DeriveNames (const Node<CalcNodeData>* root, int symbol)
+{
+    assert(root != nullptr);
+
+    std::vector<bool> used(symbols.getSize(), false);
+    std::vector<int>  names;
+
+    std::vector<const Node<CalcNodeData>*> work = { root };
+
+    while (not work.empty())
     {
-        Node<CalcNodeData>* Num = new Node<CalcNodeData>;
+        const Node<CalcNodeData>* node = work.back();
+        work.pop_back();
 
-        if (strcmp(node_cur->getData().word, diff_var_.name) == 0)
-            Num->setData({ NUM_TYPE{1, 0}, nullptr, 0, NODE_NUMBER });
-        else
-            Num->setData({ NUM_TYPE{0, 0}, nullptr, 0, NODE_NUMBER });
+        const CalcNodeData& data = node->getData();
 
-        PREV_CONNECT(node_cur, Num);
+        if ((data.node_type == NODE_VARIABLE) || (data.node_type == NODE_LET))
+        {
+            size_t id = (data.symbol != NO_SYMBOL) ? data.symbol : symbols.Intern(data.word);
 
-        break;
+            if (id >= used.size()) used.resize(id + 1, false);
+            used[id] = true;
+        }
+
+        if (node->left_  != nullptr) work.push_back(node->left_);
+        if (node->right_ != nullptr) work.push_back(node->right_);
+
+        for (size_t i = 0; i < node->args_num_; ++i) work.push_back(node->args_[i]);
     }
-    case NODE_NUMBER:
+
+    // Bindings are a chain from the root
+    for (const Node<CalcNodeData>* node = root; node->getData().node_type == NODE_LET; node = node->left_)
     {
-        Node<CalcNodeData>* Num = new Node<CalcNodeData>;
+        const CalcNodeData& data = node->getData();
 
-        Num->setData({ NUM_TYPE{0, 0}, nullptr, 0, NODE_NUMBER });
+        size_t id = (data.symbol != NO_SYMBOL) ? data.symbol : symbols.Intern(data.word);
 
-        PREV_CONNECT(node_cur, Num);
+        if (id >= names.size()) names.resize(id + 1, NO_SYMBOL);
+        if (names[id] == NO_SYMBOL) names[id] = BoundDerivative(node, symbol, names);
+        if (names[id] == NO_SYMBOL) names[id] = DeriveName(id, symbol, used);
+        if (names[id] == NO_SYMBOL) return {};
+    }
 
-        break;
+    return names;
+}
+
+//------------------------------------------------------------------------------
+
+int BoundDerivative (const Node<CalcNodeData>* node, int symbol, const std::vector<int>& names)
+{
+    assert(node != nullptr);
+
+    // Derivative of 'let u = a; f' is 'let u = a; let dudx = a'; f'', so the
+    // next binding of the derivatives of higher orders is the derivative
+    // already. It is taken only if its value is a' indeed.
+    const Node<CalcNodeData>* next = node->left_;
+
+    if ((next->getData().node_type != NODE_LET) || (not isDependent(node->right_, symbol))) return NO_SYMBOL;
+
+    Tree<CalcNodeData> derivative((char*)"derivative");
+
+    derivative.root_ = DeriveNode(node->right_, symbol, names);
+    derivative.root_->prev_ = nullptr;
+
+    Optimize(derivative);
+
+    if (not isEqualNode(derivative.root_, next->right_)) return NO_SYMBOL;
+
+    const CalcNodeData& data = next->getData();
+
+    return (data.symbol != NO_SYMBOL) ? data.symbol : symbols.Intern(data.word);
+}
+
+//------------------------------------------------------------------------------
+
+bool hasBoundDerivative (const Node<CalcNodeData>* node, const std::vector<int>& names)
+{
+    // New names are not bound in the expression, only a taken one can be
+    const CalcNodeData& next = node->left_->getData();
+
+    return (next.node_type == NODE_LET) && (next.symbol == names[node->getData().symbol]);
+}
+
+//------------------------------------------------------------------------------
+
+bool isEqualNode (const Node<CalcNodeData>* first, const Node<CalcNodeData>* second)
+{
+    std::vector<std::pair<const Node<CalcNodeData>*, const Node<CalcNodeData>*>> work = { { first, second } };
+
+    while (not work.empty())
+    {
+        const Node<CalcNodeData>* a = work.back().first;
+        const Node<CalcNodeData>* b = work.back().second;
+        work.pop_back();
+
+        if ((a == nullptr) || (b == nullptr))
+        {
+            if (a != b) return false;
+            continue;
+        }
+
+        const CalcNodeData& x = a->getData();
+        const CalcNodeData& y = b->getData();
+
+        if ((x.node_type != y.node_type) || (a->args_num_ != b->args_num_)) return false;
+
+        switch (x.node_type)
+        {
+        case NODE_NUMBER:
+
+            if (x.number != y.number) return false;
+            break;
+
+        case NODE_VARIABLE:
+        case NODE_LET:
+
+            // References to the bindings are marked by CountDepends only in
+            // the whole expression, so the names are compared
+            if (((x.symbol != NO_SYMBOL) ? x.symbol : symbols.Intern(x.word)) !=
+                ((y.symbol != NO_SYMBOL) ? y.symbol : symbols.Intern(y.word)))
+                return false;
+            break;
+
+        default:
+
+            if (x.op_code != y.op_code) return false;
+        }
+
+        work.push_back({ a->left_,  b->left_  });
+        work.push_back({ a->right_, b->right_ });
+
+        for (size_t i = 0; i < a->args_num_; ++i) work.push_back({ a->args_[i], b->args_[i] });
     }
 
-    default: assert(0);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+int DeriveName (int name, int symbol, std::vector<bool>& used)
+{
+    // du/dx is named dudx, so the derivatives by different variables and
+    // of different orders never share a name. Number is added to the name
+    // while it is taken by a symbol of the expression
+    const char* word = symbols.getName(name);
+    const char* var  = symbols.getName(symbol);
+
+    size_t len    = strlen(word) + strlen(var) + 2 + 20;
+    char*  result = new char [len + 1];
+    int    id     = NO_SYMBOL;
+
+    for (size_t num = 0; ; ++num)
+    {
+        if (num == 0) sprintf(result, "d%sd%s",    word, var);
+        else          sprintf(result, "d%sd%s%zu", word, var, num);
+
+        id = symbols.Intern(result);
+        if (id == NO_SYMBOL) break;
+
+        if ((size_t)id >= used.size()) used.resize(id + 1, false);
+        if (not used[id]) break;
     }
 
-    delete node_cur;
+    delete [] result;
 
-    return DIFF_OK;
+    if (id != NO_SYMBOL) used[id] = true;
+
+    return id;
+}
+
+//------------------------------------------------------------------------------
+
+Node<CalcNodeData>* CopyNode (const Node<CalcNodeData>* node_cur)
+{
+    Node<CalcNodeData>* node = new Node<CalcNodeData>;
+
+    *node = *node_cur;
+
+    return node;
 }
 
 //------------------------------------------------------------------------------
 
 void Differentiator::Write ()
 {
-    char* str = new char[MAX_STR_LEN] {};
-    Expression expr = {str, str};
+    Expression expr = {};
     Tree2Expr(tree_, expr);
 
     if (filename_ == nullptr)
@@ -925,7 +1597,7 @@ void Differentiator::Write ()
         fclose(output);
     }
 
-    delete [] str;
+    delete [] expr.str;
 }
 
 //------------------------------------------------------------------------------
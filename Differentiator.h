@@ -28,6 +28,13 @@
 
 
 #include "Calculator/Calculator.h"
+#include "Calculator/ParseCache.h"
+#include "Calculator/BinTree.h"
+#include "Calculator/ExprDag.h"
+#include "Calculator/DeriveRules.h"
+#include "Calculator/Gradient.h"
+#include "Calculator/Taylor.h"
+#include <deque>
 
 
 //==============================================================================
@@ -50,6 +57,9 @@ enum DifferentiatorErrors
     DIFF_WRONG_SYNTAX_TREE_LEAF                                            ,
     DIFF_WRONG_SYNTAX_TREE_NODE                                            ,
     DIFF_WRONG_TREE_ONE_CHILD                                              ,
+    DIFF_FILE_OPEN_ERROR                                                   ,
+    DIFF_WRONG_POINT                                                       ,
+    DIFF_NO_VARIABLES                                                      ,
 };
 
 char const * const diff_errstr[] =
@@ -65,6 +75,9 @@ char const * const diff_errstr[] =
     "Wrohg syntax tree leaf"                                               ,
     "Wrohg syntax tree node"                                               ,
     "Every node must have 0 or 2 children"                                 ,
+    "Failed to open file"                                                  ,
+    "Point line must be \"name = value\""                                   ,
+    "List of variables is empty"                                           ,
 };
 
 char const * const DIFFERENTIATOR_LOGNAME = "differentiator.log";
@@ -95,14 +108,29 @@ char const * const DIFFERENTIATOR_LOGNAME = "differentiator.log";
 //==============================================================================
 
 
+const size_t DIFF_BATCH_SIZE  = 65536; // lines read and processed at once in batch mode
+const int    DIFF_BATCH_CHUNK = 64;    // lines given to a worker at once
+const size_t DIFF_TASK_CUTOFF = 4096;  // smaller subtrees are differentiated by one thread
+
+enum PARTIALS_MODE
+{
+    PARTIALS_GRADIENT = 1,  // first partial derivatives of the expression
+    PARTIALS_JACOBIAN = 2,  // first partial derivatives of every line of input
+    PARTIALS_HESSIAN  = 3,  // second partial derivatives of the expression
+};
+
 class Differentiator
 {
 private:
 
     int state_;
     char* filename_;
+    char* output_  = nullptr;
+    int   threads_ = 0;
+    bool  check_   = false;
+    bool  shared_  = false;   // differentiate through the hash-consed graph
 
-    Variable           diff_var_ = {POISON<NUM_TYPE>, "x"};
+    Variable           diff_var_ = {POISON<NUM_TYPE>, "x", symbols.Intern("x")};
     Tree<CalcNodeData> tree_;
     Stack<Variable>    constants_;
 
@@ -125,6 +153,21 @@ public:
 
     Differentiator (char* filename);
 
+//------------------------------------------------------------------------------
+/*! @brief   Differentiator constructor for batch mode.
+ *
+ *  @note    Every line of input file is a separate expression, derivatives
+ *           are written to output file line by line in the same order.
+ *
+ *  @param   filename    Name of input file
+ *  @param   output      Name of output file
+ *  @param   threads     Number of worker threads (0 for all processors)
+ *  @param   check       Only check syntax of lines and write found errors
+ *  @param   shared      Differentiate through the graph of shared subexpressions
+ */
+
+    Differentiator (char* filename, char* output, int threads, bool check = false, bool shared = false);
+
 //------------------------------------------------------------------------------
 /*! @brief   Differentiator copy constructor (deleted).
  *
@@ -141,6 +184,14 @@ public:
 
    ~Differentiator ();
 
+//------------------------------------------------------------------------------
+/*! @brief   Set the variable of differentiation, x by default.
+ *
+ *  @param   name        Name of the variable, it must outlive the differentiator
+ */
+
+    void setVariable (const char* name);
+
 //------------------------------------------------------------------------------
 /*! @brief   Differentiating process.
  *
@@ -149,6 +200,95 @@ public:
 
     int Run ();
 
+//------------------------------------------------------------------------------
+/*! @brief   Differentiating of the expression loaded from its binary image.
+ *
+ *  @note    Image is filename_, derivative is written to output_.
+ *
+ *  @return  error code
+ */
+
+    int RunImage ();
+
+//------------------------------------------------------------------------------
+/*! @brief   Derivatives of all orders up to the given one, each order is
+ *           simplified before it is differentiated again.
+ *
+ *  @note    Expression is filename_, derivatives are written to output_ one
+ *           per line, node counts per order are printed. With shared_ the
+ *           orders are kept in one graph of shared subexpressions.
+ *
+ *  @param   order       Highest order
+ *
+ *  @return  error code
+ */
+
+    int RunOrder (int order);
+
+//------------------------------------------------------------------------------
+/*! @brief   Gradient, Jacobian or Hessian by the list of variables, partial
+ *           derivatives are found in parallel.
+ *
+ *  @note    Input is filename_, every line of it is an expression for the
+ *           Jacobian, else the file is one expression. Workers only read the
+ *           input trees, they are not copied. Result is written
+ *           to output_: the gradient by lines "df/dx = ...", matrices by rows
+ *           with elements separated by " | ", as "; " is in the bindings.
+ *
+ *  @param   mode        PARTIALS_GRADIENT, PARTIALS_JACOBIAN or PARTIALS_HESSIAN
+ *  @param   vars        Names of the variables separated by commas
+ *
+ *  @return  error code
+ */
+
+    int RunPartials (int mode, char* vars);
+
+//------------------------------------------------------------------------------
+/*! @brief   Value and gradient of the expression at the point by reverse mode
+ *           automatic differentiation, the derivative is not built.
+ *
+ *  @note    Expression is filename_, result is written to output_. Every line
+ *           of the point file is "name = value", derivatives are written in
+ *           the same order.
+ *
+ *  @param   point       Name of the point file
+ *
+ *  @return  error code
+ */
+
+    int RunGradient (char* point);
+
+//------------------------------------------------------------------------------
+/*! @brief   Value and derivative of the expression at the point by forward
+ *           mode automatic differentiation, the derivative is not built.
+ *
+ *  @note    Expression is filename_, result is written to output_. Every line
+ *           of the point file is "name = value". Derivative is by diff_var_.
+ *
+ *  @param   point       Name of the point file
+ *
+ *  @return  error code
+ */
+
+    int RunDual (char* point);
+
+//------------------------------------------------------------------------------
+/*! @brief   Derivatives of orders 0 to N of the expression at the point by
+ *           propagation of truncated Taylor series, the derivatives are not
+ *           built.
+ *
+ *  @note    Expression is filename_, result is written to output_ by lines
+ *           "dkf/dxk = ...". Every line of the point file is "name = value".
+ *           Derivatives are by diff_var_.
+ *
+ *  @param   point       Name of the point file
+ *  @param   order       Highest order of the derivatives
+ *
+ *  @return  error code
+ */
+
+    int RunTaylor (char* point, size_t order);
+
 /*------------------------------------------------------------------------------
                    Private functions                                           *
 *///----------------------------------------------------------------------------
@@ -156,14 +296,47 @@ public:
 private:
 
 //------------------------------------------------------------------------------
-/*! @brief   Differentiating process.
+/*! @brief   Differentiating of input file lines in parallel.
  *
- *  @param   node_cur    Current node
+ *  @return  error code
+ */
+
+    int RunBatch ();
+
+//------------------------------------------------------------------------------
+/*! @brief   Load tree_ from filename_ and values of the variables from the
+ *           point file, constants are added after them.
+ *
+ *  @note    Every line of the point file is "name = value", the name is an
+ *           identifier and the value a real number with optional sign.
+ *
+ *  @param   point       Name of the point file
+ *  @param   variables   Values of the variables
  *
  *  @return  error code
  */
 
-    int Differentiate (Node<CalcNodeData>* node_cur);
+    int ReadPoint (char* point, Stack<Variable>& variables);
+
+//------------------------------------------------------------------------------
+/*! @brief   Differentiate one expression using own tree.
+ *
+ *  @param   expr        String expression
+ *
+ *  @return  derivative or error message (allocated by new[])
+ */
+
+    char* Derive (char* expr);
+
+//------------------------------------------------------------------------------
+/*! @brief   Check syntax of one expression collecting all errors.
+ *
+ *  @param   expr        String expression
+ *
+ *  @return  "OK" or list of errors with byte ranges (allocated by new[])
+ */
+
+    char* Check (char* expr);
 
 //------------------------------------------------------------------------------
 /*! @brief   Write derivative to console or to file.
@@ -188,6 +361,245 @@ private:
 //------------------------------------------------------------------------------
 };
 
+//------------------------------------------------------------------------------
+/*! @brief   Derivative of the expression by the variable.
+ *
+ *  @note    Expression is only read and no state is shared, so any number of
+ *           threads may differentiate the same tree at once. Result may be
+ *           the expression tree itself, then it is replaced. Large trees are
+ *           differentiated by the OpenMP tasks, a new team of threads is
+ *           started if the call is not in a parallel region already.
+ *
+ *  @param   expr        Expression
+ *  @param   symbol      Symbol id of the variable
+ *  @param   result      Derivative
+ *  @param   shared      Differentiate through the graph of shared subexpressions
+ *
+ *  @return  error code
+ */
+
+int Derivative (const Tree<CalcNodeData>& expr, int symbol, Tree<CalcNodeData>& result, bool shared = false);
+
+//------------------------------------------------------------------------------
+/*! @brief   Build derivative of the subtree, the subtree is not changed.
+ *
+ *  @note    Subtree is walked with an explicit work stack, so its depth is
+ *           not limited by the stack of the thread. If the rule of a node
+ *           needs derivatives of two or more operands of at least
+ *           DIFF_TASK_CUTOFF nodes, they are built by OpenMP tasks.
+ *
+ *  @param   node_cur    Root of the subtree
+ *  @param   symbol      Symbol id of the variable
+ *  @param   names       Names of the derivatives of the bindings (DeriveNames)
+ *
+ *  @return  root of the derivative (created by operator new)
+ */
+
+Node<CalcNodeData>* DeriveNode (const Node<CalcNodeData>* node_cur, int symbol, const std::vector<int>& names);
+
+//------------------------------------------------------------------------------
+/*! @brief   Build derivative of the n-ary sum or product.
+ *
+ *  @param   node_cur    N-ary node
+ *  @param   symbol      Symbol id of the variable
+ *  @param   dargs       Derivatives of the operands depending on the variable
+ *                       in order, they are taken by the result
+ *
+ *  @return  root of the derivative (created by operator new)
+ */
+
+Node<CalcNodeData>* DeriveArgs (const Node<CalcNodeData>* node_cur, int symbol, Node<CalcNodeData>** dargs);
+
+//------------------------------------------------------------------------------
+/*! @brief   Create number node.
+ *
+ *  @param   number      Value
+ *
+ *  @return  new node
+ */
+
+Node<CalcNodeData>* NewNumber (NUM_TYPE number);
+
+//------------------------------------------------------------------------------
+/*! @brief   Create operator node.
+ *
+ *  @param   op_code     Operator code
+ *  @param   left        Left operand, nullptr for unary minus
+ *  @param   right       Right operand
+ *
+ *  @return  new node
+ */
+
+Node<CalcNodeData>* NewOperator (char op_code, Node<CalcNodeData>* left, Node<CalcNodeData>* right);
+
+//------------------------------------------------------------------------------
+/*! @brief   Create function node.
+ *
+ *  @param   op_code     Function code
+ *  @param   arg         Argument
+ *
+ *  @return  new node
+ */
+
+Node<CalcNodeData>* NewFunction (char op_code, Node<CalcNodeData>* arg);
+
+//------------------------------------------------------------------------------
+/*! @brief   Create variable node.
+ *
+ *  @param   symbol      Symbol id of the variable
+ *
+ *  @return  new node
+ */
+
+Node<CalcNodeData>* NewVariable (int symbol);
+
+//------------------------------------------------------------------------------
+/*! @brief   Create binding node 'let name = value; body'.
+ *
+ *  @param   symbol      Symbol id of the name
+ *  @param   value       Bound value
+ *  @param   body        Expression using the binding
+ *
+ *  @return  new node
+ */
+
+Node<CalcNodeData>* NewLet (int symbol, Node<CalcNodeData>* value, Node<CalcNodeData>* body);
+
+//------------------------------------------------------------------------------
+/*! @brief   Get the names of the bindings keeping derivatives of the
+ *           bindings of the expression.
+ *
+ *  @param   root        Root of the expression
+ *  @param   symbol      Symbol id of the variable
+ *
+ *  @return  symbol ids of the names indexed by symbol ids of the bindings,
+ *           empty if a name does not fit in the symbol table
+ */
+
+std::vector<int> DeriveNames (const Node<CalcNodeData>* root, int symbol);
+
+//------------------------------------------------------------------------------
+/*! @brief   Get the name of the binding keeping derivative of another one.
+ *
+ *  @param   name        Symbol id of the binding
+ *  @param   symbol      Symbol id of the variable
+ *  @param   used        Symbols taken, the new name is added
+ *
+ *  @return  symbol id of the name 'd<name>d<variable>', a number is added
+ *           to it if it is taken; NO_SYMBOL if the symbol table is full
+ */
+
+int DeriveName (int name, int symbol, std::vector<bool>& used);
+
+//------------------------------------------------------------------------------
+/*! @brief   Get the name of the next binding if it keeps derivative of the
+ *           binding, as the bindings of the derivatives do.
+ *
+ *  @param   node        Binding
+ *  @param   symbol      Symbol id of the variable
+ *  @param   names       Names of the derivatives of the outer bindings
+ *
+ *  @return  symbol id of the next binding, NO_SYMBOL if its value is not
+ *           the derivative
+ */
+
+int BoundDerivative (const Node<CalcNodeData>* node, int symbol, const std::vector<int>& names);
+
+//------------------------------------------------------------------------------
+/*! @brief   Check if the derivative of the binding is the next binding.
+ *
+ *  @param   node        Binding
+ *  @param   names       Names of the derivatives of the bindings (DeriveNames)
+ *
+ *  @return  true if the next binding is named by names, else false
+ */
+
+bool hasBoundDerivative (const Node<CalcNodeData>* node, const std::vector<int>& names);
+
+//------------------------------------------------------------------------------
+/*! @brief   Check if the subtrees are the same expression.
+ *
+ *  @param   first       Root of the first subtree
+ *  @param   second      Root of the second subtree
+ *
+ *  @return  true if equal, else false
+ */
+
+bool isEqualNode (const Node<CalcNodeData>* first, const Node<CalcNodeData>* second);
+
+//------------------------------------------------------------------------------
+/*! @brief   Create operator node applying the local identities: numbers are
+ *           folded, zero terms and unit factors and exponents are dropped,
+ *           products with zero are zero.
+ *
+ *  @note    Operands are deleted if they are not used in the result.
+ *
+ *  @param   op_code     Operator code
+ *  @param   left        Left operand, nullptr for unary minus
+ *  @param   right       Right operand
+ *
+ *  @return  new node or one of the operands
+ */
+
+Node<CalcNodeData>* MakeOperator (char op_code, Node<CalcNodeData>* left, Node<CalcNodeData>* right);
+
+//------------------------------------------------------------------------------
+/*! @brief   Create product or quotient node, signs of the operands are moved
+ *           out of it.
+ *
+ *  @param   op_code     OP_MUL or OP_DIV
+ *  @param   left        Left operand
+ *  @param   right       Right operand
+ *
+ *  @return  new node
+ */
+
+Node<CalcNodeData>* MakeProduct (char op_code, Node<CalcNodeData>* left, Node<CalcNodeData>* right);
+
+//------------------------------------------------------------------------------
+/*! @brief   Take the operand of unary minus, the minus node is deleted.
+ *
+ *  @param   node_cur    Unary minus node
+ *  @param   negative    Sign flag, it is inverted
+ *
+ *  @return  operand
+ */
+
+Node<CalcNodeData>* TakeNegation (Node<CalcNodeData>* node_cur, bool& negative);
+
+//------------------------------------------------------------------------------
+/*! @brief   Finish the n-ary node: with one operand it is the operand, without
+ *           operands it is the neutral number.
+ *
+ *  @param   node_cur    N-ary node
+ *  @param   neutral     Neutral element of the operation
+ *
+ *  @return  node or its operand
+ */
+
+Node<CalcNodeData>* FinishArgs (Node<CalcNodeData>* node_cur, NUM_TYPE neutral);
+
+//------------------------------------------------------------------------------
+/*! @brief   Check if node is the number.
+ *
+ *  @param   node        Node to be checked
+ *  @param   number      Number
+ *
+ *  @return  true if it is, else false
+ */
+
+bool isValue (const Node<CalcNodeData>* node, NUM_TYPE number);
+
+//------------------------------------------------------------------------------
+/*! @brief   Copy the subtree.
+ *
+ *  @param   node_cur    Root of the subtree
+ *
+ *  @return  root of the copy
+ */
+
+Node<CalcNodeData>* CopyNode (const Node<CalcNodeData>* node_cur);
+
 //------------------------------------------------------------------------------
 
 #endif // DIFFERENTIATOR_H_INCLUDED
@@ -16,6 +16,7 @@
 
 #include "StackConfig.h"
 #include <assert.h>
+#include <atomic>
 #include <limits.h>
 #include <memory.h>
 #include <stdlib.h>
@@ -48,7 +49,7 @@
                                   } //
 
 const size_t DEFAULT_STACK_CAPACITY = 8;
-static int   stack_id   = 0;
+static std::atomic<int> stack_id(0);
 
 #define newStack_size(NAME, capacity, STK_TYPE) \
         Stack<STK_TYPE> NAME ((char*)#NAME, capacity);
@@ -0,0 +1,1036 @@
+/*------------------------------------------------------------------------------
+    * File:        Tests.cpp                                                   *
+    * Description: Tests of parsing, printing and differentiation.             *
+    * Created:     17 oct 2026                                                 *
+    * Author:      Artem Puzankov                                              *
+    * Email:       puzankov.ao@phystech.edu                                    *
+    * GitHub:      https://github.com/hellopuza                                *
+    * Copyright © 2021 Artem Puzankov. All rights reserved.                    *
+    *///------------------------------------------------------------------------
+
+#include "../Differentiator.h"
+#include <string>
+#include <vector>
+
+//------------------------------------------------------------------------------
+
+static size_t checks_num  = 0;
+static size_t failed_num  = 0;
+
+#define TEST_CHECK(cond, expr)                                                     \
+        {                                                                          \
+            ++checks_num;                                                          \
+            if (not (cond))                                                        \
+            {                                                                      \
+                ++failed_num;                                                      \
+                printf("FAILED %s:%d: %s [%s]\n", __FILE__, __LINE__, #cond, expr); \
+            }                                                                      \
+        }
+
+const double TEST_PRECISION = 1e-9;
+
+//------------------------------------------------------------------------------
+
+static int Parse (const std::string& text, Tree<CalcNodeData>& tree)
+{
+    std::string copy = text;
+    Expression  expr = {};
+    expr.str = (char*)copy.c_str();
+
+    return Expr2Tree(expr, tree);
+}
+
+//------------------------------------------------------------------------------
+
+static std::string Print (const Tree<CalcNodeData>& tree)
+{
+    Expression expr = {};
+
+    if (Tree2Expr(tree, expr)) return "";
+
+    std::string text = expr.str;
+    delete [] expr.str;
+
+    return text;
+}
+
+//------------------------------------------------------------------------------
+
+static std::string Derive (const std::string& text, bool shared)
+{
+    Tree<CalcNodeData> tree((char*)"expression");
+    Tree<CalcNodeData> derivative((char*)"derivative");
+
+    if (Parse(text, tree)) return "";
+    if (Derivative(tree, symbols.Intern("x"), derivative, shared)) return "";
+
+    return Print(derivative);
+}
+
+//------------------------------------------------------------------------------
+
+static NUM_TYPE Value (const Tree<CalcNodeData>& tree)
+{
+    Stack<Variable> variables((char*)"point");
+    variables.Push({ 0.7, "x", symbols.Intern("x") });
+    variables.Push({ 1.3, "y", symbols.Intern("y") });
+    variables.Push({ 0.5, "dudx", symbols.Intern("dudx") });
+
+    Dual result = {};
+    if (CalcDual(tree, variables, symbols.Intern("x"), result)) return POISON<NUM_TYPE>;
+
+    return result.value;
+}
+
+//------------------------------------------------------------------------------
+
+static bool isClose (NUM_TYPE a, NUM_TYPE b)
+{
+    return abs(a - b) <= TEST_PRECISION * std::max(1.0, abs(b));
+}
+
+//------------------------------------------------------------------------------
+
+static void WriteFile (const char* name, const std::string& text)
+{
+    FILE* fp = fopen(name, "w");
+    if (fp == nullptr) return;
+
+    fputs(text.c_str(), fp);
+    fclose(fp);
+}
+
+//------------------------------------------------------------------------------
+
+static std::vector<std::pair<std::string, double>> ReadResults (const char* name)
+{
+    // Lines "name = value" of the output of the modes at a point
+    std::vector<std::pair<std::string, double>> results;
+
+    FILE* fp = fopen(name, "r");
+    if (fp == nullptr) return results;
+
+    char   word[64] = "";
+    double value    = 0;
+
+    while (fscanf(fp, "%63s = %lf", word, &value) == 2) results.push_back({ word, value });
+    fclose(fp);
+
+    return results;
+}
+
+//------------------------------------------------------------------------------
+
+static NUM_TYPE PartialValue (const std::string& text, const char* var)
+{
+    // Value of the symbolic derivative at x = 0.7, y = 1.3
+    Tree<CalcNodeData> tree      ((char*)"expression");
+    Tree<CalcNodeData> derivative((char*)"derivative");
+
+    if (Parse(text, tree)) return POISON<NUM_TYPE>;
+    if (Derivative(tree, symbols.Intern(var), derivative)) return POISON<NUM_TYPE>;
+
+    return Value(derivative);
+}
+
+//------------------------------------------------------------------------------
+
+static std::vector<std::string> ReadLines (const char* name)
+{
+    // Lines of the output of the modes with the expressions
+    std::vector<std::string> lines;
+
+    FILE* fp = fopen(name, "r");
+    if (fp == nullptr) return lines;
+
+    std::string line = "";
+    for (int c = fgetc(fp); c != EOF; c = fgetc(fp))
+    {
+        if (c != '\n') line += (char)c;
+        else
+        {
+            lines.push_back(line);
+            line = "";
+        }
+    }
+    fclose(fp);
+
+    return lines;
+}
+
+//------------------------------------------------------------------------------
+
+static std::vector<std::string> Split (const std::string& row, const std::string& separator)
+{
+    std::vector<std::string> columns;
+
+    size_t begin = 0;
+    for (size_t end = row.find(separator); end != std::string::npos; end = row.find(separator, begin))
+    {
+        columns.push_back(row.substr(begin, end - begin));
+        begin = end + separator.size();
+    }
+    columns.push_back(row.substr(begin));
+
+    return columns;
+}
+
+//------------------------------------------------------------------------------
+
+static NUM_TYPE ExprValue (const std::string& text)
+{
+    Tree<CalcNodeData> tree((char*)"expression");
+    if (Parse(text, tree)) return POISON<NUM_TYPE>;
+
+    return Value(tree);
+}
+
+//------------------------------------------------------------------------------
+
+static NUM_TYPE SecondValue (const std::string& text, const char* var1, const char* var2)
+{
+    // Value of the second symbolic derivative at x = 0.7, y = 1.3
+    Tree<CalcNodeData> tree  ((char*)"expression");
+    Tree<CalcNodeData> first ((char*)"first");
+    Tree<CalcNodeData> second((char*)"second");
+
+    if (Parse(text, tree)) return POISON<NUM_TYPE>;
+    if (Derivative(tree,  symbols.Intern(var1), first))  return POISON<NUM_TYPE>;
+    if (Derivative(first, symbols.Intern(var2), second)) return POISON<NUM_TYPE>;
+
+    return Value(second);
+}
+
+//------------------------------------------------------------------------------
+
+static size_t Depth (const Node<CalcNodeData>* node)
+{
+    // Every node of a chain has one operand that is not a leaf
+    size_t depth = 0;
+
+    while (node != nullptr)
+    {
+        ++depth;
+
+        const Node<CalcNodeData>* left = node->left_;
+
+        if ((left != nullptr) && ((left->left_ != nullptr) || (left->right_ != nullptr)))
+            node = left;
+        else
+            node = node->right_;
+    }
+
+    return depth;
+}
+
+//------------------------------------------------------------------------------
+
+static void TestParseCache ()
+{
+    // Expressions with the same tokens share the cached tree
+    ParseCache cache(1 << 20);
+
+    struct { const char* text; const char* printed; size_t hits; } cases[] =
+    {
+        { "x+sin(y)",       "x+sin(y)",   0 },
+        { " x + sin( y ) ", "x+sin(y)",   1 },
+        { "x+sin(y)*2",     "x+sin(y)*2", 1 },
+        { "x +\tsin(y)",    "x+sin(y)",   2 },
+    };
+
+    for (auto& test : cases)
+    {
+        Tree<CalcNodeData> tree((char*)"expression");
+
+        std::string copy = test.text;
+        Expression  expr = {};
+        expr.str = (char*)copy.c_str();
+
+        TEST_CHECK(cache.Parse(expr, tree) == CALC_OK, test.text);
+        TEST_CHECK(cache.getHits() == test.hits, test.text);
+        TEST_CHECK(tree.Check() == TREE_OK, test.text);
+        TEST_CHECK(Print(tree) == test.printed, test.text);
+    }
+
+    // Cleared cache parses the expression again
+    cache.Clear();
+
+    Tree<CalcNodeData> tree((char*)"expression");
+
+    std::string copy = "x+sin(y)";
+    Expression  expr = {};
+    expr.str = (char*)copy.c_str();
+
+    TEST_CHECK(cache.Parse(expr, tree) == CALC_OK, "x+sin(y)");
+    TEST_CHECK((cache.getHits() == 2) && (cache.getMisses() == 3), "x+sin(y)");
+
+    // Key is made of the tokens, so a space splitting a number is kept
+    ParseCache tokens(1 << 20);
+
+    struct { const char* text; bool parsed; } numbers[] =
+    {
+        { "2e-1*x",    true  },
+        { "2e -1*x",   false },
+        { " 2e-1 * x", true  },
+        { "x*2e+1",    true  },
+        { "x*2e +1",   false },
+    };
+
+    for (auto& test : numbers)
+    {
+        Tree<CalcNodeData> number((char*)"expression");
+
+        std::string text = test.text;
+        Expression  line = {};
+        line.str = (char*)text.c_str();
+
+        TEST_CHECK((tokens.Parse(line, number) == CALC_OK) == test.parsed, test.text);
+    }
+
+    TEST_CHECK(tokens.getHits() == 1, "2e-1*x");
+
+    // Deep tree is measured and cloned without recursion
+    ParseCache deep_cache(1 << 26);
+    const size_t depth = 200000;
+
+    std::string text = "";
+    for (size_t i = 0; i < depth; ++i) text += "-(";
+    text += "x" + std::string(depth, ')');
+
+    for (size_t i = 0; i < 2; ++i)
+    {
+        Tree<CalcNodeData> deep((char*)"deep");
+
+        std::string line = text;
+        Expression  deep_expr = {};
+        deep_expr.str = (char*)line.c_str();
+
+        TEST_CHECK(deep_cache.Parse(deep_expr, deep) == CALC_OK, "-(-(...))");
+    }
+
+    TEST_CHECK(deep_cache.getHits() == 1, "-(-(...))");
+}
+
+//------------------------------------------------------------------------------
+
+static void TestFlatten ()
+{
+    // Nested sums and products are one n-ary node, however they are bracketed
+    Tree<CalcNodeData> tree((char*)"expression");
+
+    TEST_CHECK(Parse("x+(y+(x+(y*(x*(y*x)))))", tree) == CALC_OK, "nested");
+    TEST_CHECK(isArgs(tree.root_, OP_ADD) && (tree.root_->args_num_ == 4), "nested");
+    TEST_CHECK(isArgs(tree.root_->args_[3], OP_MUL) && (tree.root_->args_[3]->args_num_ == 4), "nested");
+    TEST_CHECK(Print(tree) == "x+y+x+y*x*y*x", "nested");
+    TEST_CHECK(tree.Check() == TREE_OK, "nested");
+
+    // Right nested sum of 10^5 levels
+    const size_t depth = 100000;
+
+    std::string text;
+    for (size_t i = 0; i < depth; ++i) text += "x+(";
+    text += "y" + std::string(depth, ')');
+
+    Tree<CalcNodeData> deep((char*)"deep");
+
+    TEST_CHECK(Parse(text, deep) == CALC_OK, "x+(x+(...))");
+    TEST_CHECK(isArgs(deep.root_, OP_ADD) && (deep.root_->args_num_ == depth + 1), "x+(x+(...))");
+}
+
+//------------------------------------------------------------------------------
+
+static void TestRoundTrip ()
+{
+    // Printed derivatives are parsed again to the same values
+    const char* exprs[] =
+    {
+        "x*cot(x)",
+        "x/cot(x)+x^cot(x)",
+        "x*coth(x)-x/tan(x)",
+        "-x*arccos(x/2)",
+        "x^(x^(-2))",
+        "(x-y)^(-x)",
+        "1/(1-x)*(-x)",
+        "-(x-1)/x",
+        "sin(-x)*cos(-2*x)",
+        "y/(x-y)^2-(y-x)/x^3",
+    };
+
+    for (const char* text : exprs)
+        for (bool shared : { false, true })
+        {
+            Tree<CalcNodeData> tree      ((char*)"expression");
+            Tree<CalcNodeData> derivative((char*)"derivative");
+            Tree<CalcNodeData> reparsed  ((char*)"reparsed");
+
+            TEST_CHECK(Parse(text, tree) == CALC_OK, text);
+            TEST_CHECK(Derivative(tree, symbols.Intern("x"), derivative, shared) == CALC_OK, text);
+
+            std::string printed = Print(derivative);
+
+            bool parsed = (Parse(printed, reparsed) == CALC_OK);
+            TEST_CHECK(parsed, printed.c_str());
+
+            if (parsed) TEST_CHECK(isClose(Value(reparsed), Value(derivative)), printed.c_str());
+        }
+
+    TEST_CHECK(Derive("x*cot(x)", false) == "cot(x)+x*(-1/sin(x)^2)", "x*cot(x)");
+}
+
+//------------------------------------------------------------------------------
+
+static void TestDeepChains ()
+{
+    // Chains of 10^6 levels are parsed, differentiated, copied and deleted
+    // without recursion
+    const size_t depth = 1000000;
+
+    std::string quotient = "x";
+    std::string power    = "x";
+    std::string negation = "";
+
+    for (size_t i = 0; i < depth; ++i)
+    {
+        quotient += "/2";
+        power    += "^1";
+        negation += "-(";
+    }
+    negation += "x" + std::string(depth, ')');
+
+    for (const std::string* text : { &quotient, &power, &negation })
+    {
+        Tree<CalcNodeData> tree      ((char*)"expression");
+        Tree<CalcNodeData> derivative((char*)"derivative");
+        Tree<CalcNodeData> copy      ((char*)"copy");
+        Tree<CalcNodeData> reparsed  ((char*)"reparsed");
+
+        std::string prefix = text->substr(0, 8);
+        const char* name   = prefix.c_str();
+
+        TEST_CHECK(Parse(*text, tree) == CALC_OK, name);
+        TEST_CHECK(Depth(tree.root_) == depth + 1, name);
+        TEST_CHECK(Derivative(tree, symbols.Intern("x"), derivative) == CALC_OK, name);
+        TEST_CHECK(derivative.Check() == TREE_OK, name);
+
+        copy.root_  = new Node<CalcNodeData>;
+        *copy.root_ = *tree.root_;
+        TEST_CHECK(Depth(copy.root_) == depth + 1, name);
+        TEST_CHECK(copy.Check() == TREE_OK, name);
+
+        std::string printed = Print(copy);
+        if (text != &negation) TEST_CHECK(printed == *text, name);
+
+        TEST_CHECK(Parse(printed, reparsed) == CALC_OK, name);
+        TEST_CHECK(Print(derivative) != "", name);
+    }
+}
+
+//------------------------------------------------------------------------------
+
+static void TestBindings ()
+{
+    // Derivative keeps the bindings, printed and parsed again it has the same value
+    struct { const char* text; NUM_TYPE value; } cases[] =
+    {
+        { "let u = x^2; u*u",                  4 * 0.7 * 0.7 * 0.7      },
+        { "let u = sin(x); let v = u*y; v+u",  cos(0.7) * 1.3 + cos(0.7) },
+        { "let u = y^2; u*x",                  1.3 * 1.3                },
+
+        // Derivatives of the bindings do not capture the names of the user
+        { "let u = x; let dudx = 3; dudx*u",   3                        },
+        { "let u = x^2; u + dudx*x",           2 * 0.7 + 0.5            },
+        { "let u = x; let dudx1 = u; u*dudx1", 2 * 0.7                  },
+    };
+
+    for (auto& test : cases)
+    {
+        Tree<CalcNodeData> tree      ((char*)"expression");
+        Tree<CalcNodeData> derivative((char*)"derivative");
+        Tree<CalcNodeData> reparsed  ((char*)"reparsed");
+
+        TEST_CHECK(Parse(test.text, tree) == CALC_OK, test.text);
+        TEST_CHECK(Derivative(tree, symbols.Intern("x"), derivative) == CALC_OK, test.text);
+        TEST_CHECK(isClose(Value(derivative), test.value), test.text);
+
+        std::string printed = Print(derivative);
+
+        bool parsed = (Parse(printed, reparsed) == CALC_OK);
+        TEST_CHECK(parsed, printed.c_str());
+
+        if (parsed) TEST_CHECK(isClose(Value(reparsed), test.value), printed.c_str());
+    }
+
+    // Derivatives of higher orders keep the bindings of the lower ones
+    Tree<CalcNodeData> tree  ((char*)"expression");
+    Tree<CalcNodeData> first ((char*)"first");
+    Tree<CalcNodeData> second((char*)"second");
+
+    Parse("let a = x^2; a*y+sin(a)", tree);
+    Derivative(tree,  symbols.Intern("x"), first);
+    Derivative(first, symbols.Intern("x"), second);
+
+    std::string printed = Print(second);
+    TEST_CHECK(printed.find("let a = x^2; let dadx = 2*x; let ddadxdx = 2; ") == 0, printed.c_str());
+    TEST_CHECK(printed.find("dadx1") == std::string::npos, printed.c_str());
+    TEST_CHECK(isClose(Value(second), 2 * 1.3 + 2 * cos(0.49) - 4 * 0.49 * sin(0.49)), printed.c_str());
+
+    TEST_CHECK(Derive("let u = x^2; let dudx = 2*x; dudx*u", false) ==
+               "let u = x^2; let dudx = 2*x; let ddudxdx = 2; ddudxdx*u+dudx*dudx", "let dudx = 2*x");
+
+    // Shared subexpressions of the graph are printed as bindings, named
+    // apart from the variables
+    const char* shared[] = { "sin(x^2+x*y+1)^3", "s1*sin(x^2+x*y+1)^3" };
+
+    for (const char* text : shared)
+    {
+        printed = Derive(text, true);
+
+        TEST_CHECK(printed.find(strstr(text, "s1") ? "let s2 = " : "let s1 = ") == 0, printed.c_str());
+        TEST_CHECK(printed.find("x^2+x*y+1") == printed.rfind("x^2+x*y+1"), printed.c_str());
+    }
+
+    printed = Derive(shared[0], true);
+
+    Tree<CalcNodeData> reparsed((char*)"reparsed");
+    TEST_CHECK(Parse(printed, reparsed) == CALC_OK, printed.c_str());
+    TEST_CHECK(isClose(Value(reparsed), PartialValue(shared[0], "x")), printed.c_str());
+}
+
+//------------------------------------------------------------------------------
+
+static bool isSameDouble (const char* text, size_t len, double value)
+{
+    // strtod reads the number in "C" locale, bits are compared to tell the zeros apart
+    std::string copy(text, len);
+    double      expected = strtod(copy.c_str(), nullptr);
+
+    return memcmp(&expected, &value, sizeof(double)) == 0;
+}
+
+//------------------------------------------------------------------------------
+
+static void TestNumbers ()
+{
+    // Literals give the same doubles as strtod
+    const char* literals[] =
+    {
+        "0", "1", "0.1", "123.456e7", "00012.50000", "1e0", "1E+2",
+
+        // subnormals and the bounds of the normal numbers
+        "4.9406564584124654e-324", "1e-310", "2.2250738585072009e-308",
+        "2.2250738585072011e-308", "2.2250738585072014e-308",
+
+        // 2^53 + 1 and 2^53 + 3 are halfway, they are rounded to even
+        "9007199254740993", "9007199254740995", "9007199254740993.0000000000000000001",
+
+        // 1 + 2^-53 is halfway, a digit far behind the 19th decides
+        "1.00000000000000011102230246251565404236316680908203125",
+        "1.00000000000000011102230246251565404236316680908203126",
+        "1.00000000000000011102230246251565404236316680908203124",
+        "123456789012345678901234567890",
+
+        // overflow and underflow
+        "1.7976931348623157e308", "1.7976931348623158e308", "1.7976931348623159e308", "1e309",
+        "2.4703282292062327e-324", "2.4703282292062328e-324", "1e-400", "0e999",
+    };
+
+    for (const char* text : literals)
+        TEST_CHECK(isSameDouble(text, strlen(text), Str2Double(text, strlen(text))), text);
+
+    // Random literals of 1-25 digits with exponents of the whole range
+    uint64_t seed   = 12345;
+    size_t   failed = 0;
+
+    for (size_t i = 0; i < 100000; ++i)
+    {
+        char   text[64] = "";
+        size_t len      = 0;
+
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        size_t digits = (seed >> 33) % 25 + 1;
+        size_t point  = (seed >> 40) % digits + 1;
+
+        for (size_t d = 0; d < digits; ++d)
+        {
+            seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            text[len++] = '0' + (seed >> 33) % 10;
+
+            if (d + 1 == point) text[len++] = '.';
+        }
+
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        len += sprintf(text + len, "e%d", (int)((seed >> 33) % 660) - 340);
+
+        if (not isSameDouble(text, len, Str2Double(text, len))) ++failed;
+    }
+
+    TEST_CHECK(failed == 0, "random literals");
+
+    // Imaginary literals keep the value of their real part
+    for (const char* text : { "2.5i", "1e-310i", "9007199254740993i", "1e309i" })
+    {
+        Lexer lexer(text, strlen(text));
+        lexer.Tokenize();
+
+        TEST_CHECK(lexer.tokens_[0].kind == TOK_IMAGINARY, text);
+        TEST_CHECK(isSameDouble(text, strlen(text) - 1, lexer.tokens_[0].value), text);
+    }
+}
+
+//------------------------------------------------------------------------------
+
+static void TestGradient ()
+{
+    // Gradient at the point by the tape is the value of the symbolic partial derivatives
+    char input [] = "test_input.txt";
+    char point [] = "test_point.txt";
+    char output[] = "test_output.txt";
+
+    WriteFile(point, "x = 0.7\n\n  y=+1.3e0\n");
+
+    const char* exprs[] = { "x*sin(y)+x^2", "ln(x)*exp(x*y)-y/x", "let u = x*y; u^2+sin(u)", "(x+y)^3-2*x" };
+
+    for (const char* text : exprs)
+    {
+        WriteFile(input, text);
+
+        Differentiator differentiator(input, output, 1);
+        TEST_CHECK(differentiator.RunGradient(point) == DIFF_OK, text);
+
+        Tree<CalcNodeData> tree((char*)"expression");
+        Parse(text, tree);
+
+        auto results = ReadResults(output);
+        TEST_CHECK(results.size() == 3, text);
+        if (results.size() != 3) continue;
+
+        TEST_CHECK((results[0].first == "f") && isClose(results[0].second, Value(tree)), text);
+        TEST_CHECK((results[1].first == "df/dx") && isClose(results[1].second, PartialValue(text, "x")), text);
+        TEST_CHECK((results[2].first == "df/dy") && isClose(results[2].second, PartialValue(text, "y")), text);
+    }
+
+    // Point has the names and the numbers of the expressions
+    WriteFile(input, "x^2");
+
+    struct { const char* text; int err; } points[] =
+    {
+        { "x = -0.5\n",       DIFF_OK          },
+        { "x = 5e-1\r\n",     DIFF_OK          },
+        { "x_1 = 2\n",        DIFF_WRONG_POINT },
+        { "1x = 2\n",         DIFF_WRONG_POINT },
+        { "x = 1 2\n",        DIFF_WRONG_POINT },
+        { "x = y\n",          DIFF_WRONG_POINT },
+        { "x = --1\n",        DIFF_WRONG_POINT },
+        { "= 1\n",            DIFF_WRONG_POINT },
+        { "x 1\n",            DIFF_WRONG_POINT },
+        { "x = 1\nx1 = 2\n", DIFF_OK          },
+    };
+
+    for (auto& test : points)
+    {
+        WriteFile(point, test.text);
+
+        Differentiator differentiator(input, output, 1);
+        TEST_CHECK(differentiator.RunGradient(point) == test.err, test.text);
+    }
+
+    // Output is of the last point
+    auto results = ReadResults(output);
+    TEST_CHECK((results.size() == 3) && (results[2].first == "df/dx1") && (results[2].second == 0), "x1 = 2");
+
+    remove(input);
+    remove(point);
+    remove(output);
+}
+
+//------------------------------------------------------------------------------
+
+static void TestDual ()
+{
+    // Derivative by the dual numbers is the value of the symbolic derivative
+    const char* exprs[] = { "x*sin(y)+x^2", "ln(x)*exp(x*y)-y/x", "let u = x*y; u^2+sin(u)", "x^y", "(x+y)^3-2*x" };
+    const char* vars [] = { "x", "y" };
+
+    Stack<Variable> variables((char*)"point");
+    variables.Push({ 0.7, "x", symbols.Intern("x") });
+    variables.Push({ 1.3, "y", symbols.Intern("y") });
+
+    for (const char* text : exprs)
+    {
+        Tree<CalcNodeData> tree((char*)"expression");
+        Parse(text, tree);
+
+        for (const char* var : vars)
+        {
+            Dual result = {};
+            TEST_CHECK(CalcDual(tree, variables, symbols.Intern(var), result) == CALC_OK, text);
+            TEST_CHECK(isClose(result.value, Value(tree)), text);
+            TEST_CHECK(isClose(result.derivative, PartialValue(text, var)), text);
+        }
+    }
+
+    // Mode of the file takes the variable of differentiation
+    char input [] = "test_input.txt";
+    char point [] = "test_point.txt";
+    char output[] = "test_output.txt";
+
+    WriteFile(input, "x*sin(y)+x^2");
+    WriteFile(point, "x = 0.7\ny = 1.3\n");
+
+    for (const char* var : vars)
+    {
+        Differentiator differentiator(input, output, 1);
+        differentiator.setVariable(var);
+        TEST_CHECK(differentiator.RunDual(point) == DIFF_OK, var);
+
+        auto results = ReadResults(output);
+        TEST_CHECK(results.size() == 2, var);
+        if (results.size() != 2) continue;
+
+        TEST_CHECK(results[1].first == std::string("df/d") + var, var);
+        TEST_CHECK(isClose(results[1].second, PartialValue("x*sin(y)+x^2", var)), var);
+    }
+
+    remove(input);
+    remove(point);
+    remove(output);
+}
+
+//------------------------------------------------------------------------------
+
+static void TestTaylor ()
+{
+    // Taylor coefficients give the values of the derivatives of --order
+    const size_t ORDER = 4;
+
+    char input  [] = "test_input.txt";
+    char point  [] = "test_point.txt";
+    char output [] = "test_output.txt";
+    char symbolic[] = "test_order.txt";
+
+    WriteFile(point, "x = 0.7\ny = 1.3\n");
+
+    const char* exprs[] = { "sin(x)*exp(x*y)", "x^y/(1+x^2)", "let u = x*y; ln(u)*u^3", "tan(x)+cos(y)^2" };
+    const char* vars [] = { "x", "y" };
+
+    for (const char* text : exprs)
+    {
+        WriteFile(input, text);
+
+        for (const char* var : vars)
+        {
+            Differentiator taylor(input, output, 1);
+            taylor.setVariable(var);
+            TEST_CHECK(taylor.RunTaylor(point, ORDER) == DIFF_OK, text);
+
+            Differentiator order(input, symbolic, 1, false, true);
+            order.setVariable(var);
+            TEST_CHECK(order.RunOrder(ORDER) == DIFF_OK, text);
+
+            auto results = ReadResults(output);
+            TEST_CHECK(results.size() == ORDER + 1, text);
+            if (results.size() != ORDER + 1) continue;
+
+            TEST_CHECK(results[1].first == std::string("df/d") + var, text);
+
+            // Every line of --order is the derivative of the next order
+            FILE* fp = fopen(symbolic, "r");
+            if (fp == nullptr) continue;
+
+            char line[4096] = "";
+            for (size_t k = 1; (k <= ORDER) && (fgets(line, sizeof(line), fp) != nullptr); ++k)
+            {
+                line[strcspn(line, "\n")] = '\0';
+
+                Tree<CalcNodeData> tree((char*)"derivative");
+                Parse(line, tree);
+
+                TEST_CHECK(isClose(results[k].second, Value(tree)), text);
+            }
+
+            fclose(fp);
+        }
+    }
+
+    remove(input);
+    remove(point);
+    remove(output);
+    remove(symbolic);
+}
+
+//------------------------------------------------------------------------------
+
+static void TestPartials ()
+{
+    // Every element of the gradient, the Hessian and the Jacobian has the
+    // value of the symbolic partial derivative, in both the tree and the dag
+    char input [] = "test_input.txt";
+    char output[] = "test_output.txt";
+
+    const char* exprs[] = { "x*sin(y)+x^2", "let u = x*y; u^2+sin(u)", "let a = x^2; a*y+sin(a)", "x^y/(1+y^2)" };
+    const char* vars [] = { "x", "y" };
+    const size_t num    = 2;
+
+    for (bool shared : { false, true })
+    {
+        for (const char* text : exprs)
+        {
+            WriteFile(input, text);
+
+            char gradient[] = "x,y";
+            Differentiator partials(input, output, 2, false, shared);
+            TEST_CHECK(partials.RunPartials(PARTIALS_GRADIENT, gradient) == DIFF_OK, text);
+
+            auto lines = ReadLines(output);
+            TEST_CHECK(lines.size() == num, text);
+
+            for (size_t i = 0; (i < num) && (i < lines.size()); ++i)
+            {
+                std::string prefix = std::string("df/d") + vars[i] + " = ";
+
+                TEST_CHECK(lines[i].compare(0, prefix.size(), prefix) == 0, text);
+                TEST_CHECK(isClose(ExprValue(lines[i].substr(prefix.size())), PartialValue(text, vars[i])), text);
+            }
+
+            char hessian[] = "x,y";
+            Differentiator second(input, output, 2, false, shared);
+            TEST_CHECK(second.RunPartials(PARTIALS_HESSIAN, hessian) == DIFF_OK, text);
+
+            lines = ReadLines(output);
+            TEST_CHECK(lines.size() == num, text);
+
+            for (size_t i = 0; (i < num) && (i < lines.size()); ++i)
+            {
+                auto columns = Split(lines[i], " | ");
+                TEST_CHECK(columns.size() == num, text);
+
+                for (size_t j = 0; (j < num) && (j < columns.size()); ++j)
+                    TEST_CHECK(isClose(ExprValue(columns[j]), SecondValue(text, vars[i], vars[j])), text);
+            }
+        }
+
+        // Rows of the Jacobian are the lines of input, a wrong line gives an error row
+        WriteFile(input, "x*sin(y)+x^2\nlet u = x*y; u^2+sin(u)\nx+*y\nx^y/(1+y^2)\n");
+
+        char jacobian[] = "x,y";
+        Differentiator rows(input, output, 2, false, shared);
+        TEST_CHECK(rows.RunPartials(PARTIALS_JACOBIAN, jacobian) == DIFF_OK, "jacobian");
+
+        auto lines = ReadLines(output);
+        TEST_CHECK(lines.size() == 4, "jacobian");
+        if (lines.size() != 4) continue;
+
+        const char* row_exprs[] = { exprs[0], exprs[1], nullptr, exprs[3] };
+
+        for (size_t i = 0; i < 4; ++i)
+        {
+            if (row_exprs[i] == nullptr)
+            {
+                TEST_CHECK(lines[i].compare(0, 6, "ERROR:") == 0, lines[i].c_str());
+                continue;
+            }
+
+            auto columns = Split(lines[i], " | ");
+            TEST_CHECK(columns.size() == num, row_exprs[i]);
+
+            for (size_t j = 0; (j < num) && (j < columns.size()); ++j)
+                TEST_CHECK(isClose(ExprValue(columns[j]), PartialValue(row_exprs[i], vars[j])), row_exprs[i]);
+        }
+    }
+
+    remove(input);
+    remove(output);
+}
+
+//------------------------------------------------------------------------------
+
+static void TestOrders ()
+{
+    // Products are one node whatever order their factors come in, so like
+    // terms of the higher derivatives are merged
+    ExprDag dag;
+
+    int x = dag.Variable(symbols.Intern("x"));
+    int y = dag.Variable(symbols.Intern("y"));
+    int s = dag.Function(OP_SIN, x);
+
+    int xys[] = { x, y, s };
+    int syx[] = { s, y, x };
+
+    TEST_CHECK(dag.Operator(OP_MUL, x, y) == dag.Operator(OP_MUL, y, x), "x*y");
+    TEST_CHECK(dag.Args(OP_MUL, xys, 3) == dag.Args(OP_MUL, syx, 3), "x*y*sin(x)");
+
+    int terms[] = { dag.Args(OP_MUL, xys, 3), dag.Operator(OP_SUB, DAG_NONE, dag.Args(OP_MUL, syx, 3)) };
+    TEST_CHECK(dag.Args(OP_ADD, terms, 2) == dag.Number(0), "x*y*sin(x)-sin(x)*y*x");
+
+    Tree<CalcNodeData> tree  ((char*)"expression");
+    Tree<CalcNodeData> result((char*)"result");
+
+    Parse("sin(x)^2", tree);
+
+    int root = Tree2Dag(tree, dag);
+    for (int k = 0; k < 3; ++k) root = dag.Derivative(root, symbols.Intern("x"));
+
+    TEST_CHECK(Dag2Tree(dag, root, result) == CALC_OK, "sin(x)^2");
+    TEST_CHECK(Print(result) == "-8*sin(x)*cos(x)", Print(result).c_str());
+
+    // Orders of the tree are simplified too and have the values of the graph
+    char input [] = "test_input.txt";
+    char trees [] = "test_tree.txt";
+    char graphs[] = "test_dag.txt";
+
+    WriteFile(input, "sin(x)*exp(x^2)/(1+x^2)");
+
+    Differentiator by_tree (input, trees,  1, false, false);
+    Differentiator by_graph(input, graphs, 1, false, true);
+
+    TEST_CHECK(by_tree.RunOrder(6)  == DIFF_OK, "tree");
+    TEST_CHECK(by_graph.RunOrder(6) == DIFF_OK, "dag");
+
+    auto tree_lines  = ReadLines(trees);
+    auto graph_lines = ReadLines(graphs);
+
+    TEST_CHECK((tree_lines.size() == 6) && (graph_lines.size() == 6), "orders");
+
+    for (size_t k = 0; (k < tree_lines.size()) && (k < graph_lines.size()); ++k)
+    {
+        TEST_CHECK(isClose(ExprValue(tree_lines[k]), ExprValue(graph_lines[k])), "orders");
+        TEST_CHECK(tree_lines[k].size() < 4 * graph_lines[k].size(), "orders");
+    }
+
+    remove(input);
+    remove(trees);
+    remove(graphs);
+}
+
+//------------------------------------------------------------------------------
+
+static void TestBinTree ()
+{
+    // Image gives back the same tree and the same value
+    const char* image = "test_image.bin";
+
+    const char* exprs[] = { "x*sin(x)-ln(y)/2", "x+y*2+(1+2i)*x", "-x^y", "x" };
+
+    for (const char* text : exprs)
+    {
+        Tree<CalcNodeData> tree  ((char*)"expression");
+        Tree<CalcNodeData> loaded((char*)"loaded");
+
+        TEST_CHECK(Parse(text, tree) == CALC_OK, text);
+        TEST_CHECK(Tree2Bin(tree, image) == CALC_OK, text);
+
+        BinTree bin(image);
+        TEST_CHECK(bin.getState() == CALC_OK, text);
+        if (bin.getState()) continue;
+
+        TEST_CHECK(Bin2Tree(bin, loaded) == CALC_OK, text);
+        TEST_CHECK(Print(loaded) == Print(tree), text);
+
+        Stack<Variable> variables((char*)"point");
+        variables.Push({ 0.7, "x", symbols.Intern("x") });
+        variables.Push({ 1.3, "y", symbols.Intern("y") });
+
+        NUM_TYPE value = 0;
+        TEST_CHECK(bin.Evaluate(variables, value) == CALC_OK, text);
+        TEST_CHECK(isClose(value, Value(tree)), text);
+    }
+
+    // Flag that the type of the node does not have makes the image malformed
+    Tree<CalcNodeData> tree((char*)"expression");
+
+    TEST_CHECK(Parse("sin(x)+ln(y)*x^2", tree) == CALC_OK, "sin(x)+ln(y)*x^2");
+    TEST_CHECK(Tree2Bin(tree, image) == CALC_OK, "sin(x)+ln(y)*x^2");
+
+    std::string data;
+
+    FILE* fp = fopen(image, "rb");
+    for (int ch = 0; (fp != nullptr) && ((ch = fgetc(fp)) != EOF); ) data += (char)ch;
+    if (fp != nullptr) fclose(fp);
+
+    struct { const char* name; char node_type; char op_code; uint16_t flags; int state; } cases[] =
+    {
+        { "unchanged",     NODE_NUMBER,   0,      0,           CALC_OK               },
+        { "sin args",      NODE_FUNCTION, OP_SIN, BIN_ARGS,    CALC_BIN_WRONG_FORMAT },
+        { "ln args",       NODE_FUNCTION, OP_LN,  BIN_ARGS,    CALC_BIN_WRONG_FORMAT },
+        { "sin complex",   NODE_FUNCTION, OP_SIN, BIN_COMPLEX, CALC_BIN_WRONG_FORMAT },
+        { "x complex",     NODE_VARIABLE, 0,      BIN_COMPLEX, CALC_BIN_WRONG_FORMAT },
+        { "2 args",        NODE_NUMBER,   0,      BIN_ARGS,    CALC_BIN_WRONG_FORMAT },
+        { "^ args",        NODE_OPERATOR, OP_POW, BIN_ARGS,    CALC_BIN_WRONG_FORMAT },
+        { "+ complex",     NODE_OPERATOR, OP_ADD, BIN_COMPLEX, CALC_BIN_WRONG_FORMAT },
+        { "unknown flag",  NODE_NUMBER,   0,      4,           CALC_BIN_WRONG_FORMAT },
+    };
+
+    for (auto& test : cases)
+    {
+        std::string corrupt = data;
+
+        BinNode* nodes = (BinNode*)(&corrupt[0] + sizeof(BinHeader));
+        size_t   num   = (corrupt.size() >= sizeof(BinHeader)) ? ((BinHeader*)&corrupt[0])->nodes_num : 0;
+
+        for (size_t i = 0; i < num; ++i)
+            if ((nodes[i].node_type == test.node_type) && ((test.op_code == 0) || (nodes[i].op_code == test.op_code)))
+            {
+                nodes[i].flags |= test.flags;
+                break;
+            }
+
+        fp = fopen(image, "wb");
+        if (fp != nullptr)
+        {
+            fwrite(corrupt.data(), 1, corrupt.size(), fp);
+            fclose(fp);
+        }
+
+        BinTree bin(image);
+        TEST_CHECK(bin.getState() == test.state, test.name);
+    }
+
+    remove(image);
+}
+
+//------------------------------------------------------------------------------
+
+static void TestIdentifiers ()
+{
+    // Names of the variables given by -v are read as the lexer reads them
+    struct { const char* word; bool valid; } cases[] =
+    {
+        { "x",    true  },
+        { "x1",   true  },
+        { "Ab2c", true  },
+        { "1x",   false },
+        { "",     false },
+        { "x_y",  false },
+        { "x+y",  false },
+        { "x y",  false },
+    };
+
+    for (auto& test : cases)
+        TEST_CHECK(isIdentifier(test.word, strlen(test.word)) == test.valid, test.word);
+}
+
+//------------------------------------------------------------------------------
+
+int main ()
+{
+    TestParseCache();
+    TestFlatten();
+    TestRoundTrip();
+    TestDeepChains();
+    TestOrders();
+    TestBindings();
+    TestBinTree();
+    TestNumbers();
+    TestGradient();
+    TestDual();
+    TestTaylor();
+    TestPartials();
+    TestIdentifiers();
+
+    printf("%zu checks, %zu failed\n", checks_num, failed_num);
+
+    return (failed_num == 0) ? 0 : 1;
+}
+
+//------------------------------------------------------------------------------
@@ -24,7 +24,9 @@
 #undef NO_DUMP
 
 #include "TreeConfig.h"
+#include <atomic>
 #include <type_traits>
+#include <vector>
 #include <assert.h>
 #include <limits.h>
 #include <stdlib.h>
@@ -56,7 +58,7 @@
           )                                              \
         ) //
 
-static int tree_id = 0;
+static std::atomic<int> tree_id(0);
 
 #define newTree(NAME, TREE_TYPE) \
         Tree<TREE_TYPE> NAME ((char*)#NAME);
@@ -92,6 +94,9 @@ public:
     Node* right_ = nullptr;
     Node* prev_  = nullptr;
 
+    Node** args_     = nullptr;  // children of n-ary node, used instead of left_ and right_
+    size_t args_num_ = 0;
+
     size_t depth_ = 0;
 
 //------------------------------------------------------------------------------
@@ -122,7 +127,7 @@ public:
  *  @return  node data
  */
 
-    const TYPE& getData ();
+    const TYPE& getData () const;
 
 //------------------------------------------------------------------------------
 /*! @brief   Recursive depth recount.
@@ -136,6 +141,29 @@ public:
 
     void recountPrev ();
 
+//------------------------------------------------------------------------------
+/*! @brief   Append child to the n-ary node.
+ *
+ *  @note    Node must not have left_ and right_ children.
+ *
+ *  @param   arg         New child (created by operator new)
+ */
+
+    void addArg (Node* arg);
+
+//------------------------------------------------------------------------------
+/*! @brief   Get the next child to walk into after coming from node "from".
+ *
+ *  @note    Children are walked right, left, then args_ in order.
+ *
+ *  @param   from        Node the walk came from (prev_ or one of the children)
+ *  @param   positions   Positions in args_ of the n-ary nodes on the path
+ *
+ *  @return  child, nullptr if all children are walked
+ */
+
+    Node* nextChild (Node* from, std::vector<size_t>& positions);
+
 //------------------------------------------------------------------------------
 /*! @brief   Node copy constructor.
  *
@@ -159,6 +187,23 @@ private:
 
     int AddFromBase (const Text& base, size_t& line_cur);
 
+//------------------------------------------------------------------------------
+/*! @brief   Copy data of the node, children are not copied.
+ *
+ *  @param   obj         Source node
+ */
+
+    void copyData (const Node& obj);
+
+//------------------------------------------------------------------------------
+/*! @brief   Move children to the list of nodes linked by prev_, the node is
+ *           left without children.
+ *
+ *  @param   list        First node of the list
+ */
+
+    void takeChildren (Node*& list);
+
 //------------------------------------------------------------------------------
 /*! @brief   Recursive tree writing to file.
  *
@@ -179,7 +224,7 @@ private:
     bool findPath (Stack<size_t>& path, TYPE elem);
 
 //------------------------------------------------------------------------------
-/*! @brief   Recursive node checker.
+/*! @brief   Check links and depths of the subtree of the node.
  *
  *  @param   tree        Tree of the node
  *
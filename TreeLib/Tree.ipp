@@ -148,78 +148,148 @@ Node<TYPE>::Node (const Node& obj)
 template <typename TYPE>
 Node<TYPE>& Node<TYPE>::operator = (const Node& obj)
 {
-    if constexpr (std::is_same<TYPE, char*>::value)
-    {
-        if (is_string_)
-            delete [] data_;
+    delete right_;
+    delete left_;
 
-        if (obj.is_string_)
-            data_ = new char[strlen(obj.data_) + 2] {};
+    for (size_t i = 0; i < args_num_; ++i) delete args_[i];
+    delete [] args_;
 
-        strcpy(data_, obj.data_);
-    }
-    else data_ = obj.data_;
+    right_    = nullptr;
+    left_     = nullptr;
+    args_     = nullptr;
+    args_num_ = 0;
 
-    is_string_ = obj.is_string_;
+    copyData(obj);
 
-    if (obj.right_ != nullptr)
-    {
-        if (right_ != nullptr) delete right_;
-        right_ = new Node<TYPE>;
+    if (prev_ == nullptr) depth_ = 0;
+    else depth_ = prev_->depth_ + 1;
 
-        *right_ = *obj.right_;
-        right_->prev_ = this;
-    }
-    else if (right_ != nullptr)
+    // Source is walked with an explicit stack of the copied nodes and their
+    // sources, so deep trees do not need recursion
+    std::vector<std::pair<Node*, const Node*>> work;
+
+    Node*       node = this;
+    const Node* from = &obj;
+
+    while (true)
     {
-        delete right_;
-        right_ = nullptr;
+        if (from->right_ != nullptr)
+        {
+            node->right_ = new Node<TYPE>;
+            node->right_->prev_  = node;
+            node->right_->depth_ = node->depth_ + 1;
+            node->right_->copyData(*from->right_);
+
+            work.push_back({ node->right_, from->right_ });
+        }
+
+        if (from->left_ != nullptr)
+        {
+            node->left_ = new Node<TYPE>;
+            node->left_->prev_  = node;
+            node->left_->depth_ = node->depth_ + 1;
+            node->left_->copyData(*from->left_);
+
+            work.push_back({ node->left_, from->left_ });
+        }
+
+        for (size_t i = 0; i < from->args_num_; ++i)
+        {
+            Node<TYPE>* arg = new Node<TYPE>;
+            node->addArg(arg);
+            arg->copyData(*from->args_[i]);
+
+            work.push_back({ arg, from->args_[i] });
+        }
+
+        if (work.empty()) break;
+
+        node = work.back().first;
+        from = work.back().second;
+        work.pop_back();
     }
-    
-    if (obj.left_ != nullptr)
+
+    return *this;
+}
+
+//------------------------------------------------------------------------------
+
+template <typename TYPE>
+Node<TYPE>::~Node ()
+{
+    // Descendants are deleted one by one from a list linked by prev_, so
+    // deep trees do not need recursion. Each of them has no children when
+    // it is deleted.
+    Node* list = nullptr;
+    takeChildren(list);
+
+    while (list != nullptr)
     {
-        if (left_ != nullptr) delete left_;
-        left_ = new Node<TYPE>;
+        Node* node = list;
+        list = node->prev_;
 
-        *left_ = *obj.left_;
-        left_->prev_ = this;
+        node->takeChildren(list);
+        delete node;
     }
-    else if (left_ != nullptr)
+
+    prev_ = nullptr;
+
+    if constexpr (std::is_same<TYPE, char*>::value) if (is_string_) delete [] data_;
+
+    is_string_ = false;
+
+    data_ = POISON<TYPE>;
+}
+
+//------------------------------------------------------------------------------
+
+template <typename TYPE>
+void Node<TYPE>::copyData (const Node& obj)
+{
+    if constexpr (std::is_same<TYPE, char*>::value)
     {
-        delete left_;
-        left_ = nullptr;
-    }
+        if (is_string_)
+            delete [] data_;
 
-    if (prev_ == nullptr) depth_ = 0;
-    else depth_ = prev_->depth_ + 1;
+        if (obj.is_string_)
+            data_ = new char[strlen(obj.data_) + 2] {};
 
-    return *this;
+        strcpy(data_, obj.data_);
+    }
+    else data_ = obj.data_;
+
+    is_string_ = obj.is_string_;
 }
 
 //------------------------------------------------------------------------------
 
 template <typename TYPE>
-Node<TYPE>::~Node ()
+void Node<TYPE>::takeChildren (Node*& list)
 {
     if (right_ != nullptr)
     {
-        delete right_;
+        right_->prev_ = list;
+        list   = right_;
         right_ = nullptr;
     }
 
     if (left_ != nullptr)
     {
-        delete left_;
-        left_  = nullptr;
+        left_->prev_ = list;
+        list  = left_;
+        left_ = nullptr;
     }
 
-    prev_ = nullptr;
-
-    if constexpr (std::is_same<TYPE, char*>::value) if (is_string_) delete [] data_;
+    for (size_t i = 0; i < args_num_; ++i)
+    {
+        args_[i]->prev_ = list;
+        list = args_[i];
+    }
 
-    is_string_ = false;
+    delete [] args_;
 
-    data_ = POISON<TYPE>;
+    args_     = nullptr;
+    args_num_ = 0;
 }
 
 //------------------------------------------------------------------------------
@@ -376,8 +446,26 @@ void Node<TYPE>::Dump (FILE* dump)
     }
 
 
+    for (size_t i = 0; i < args_num_; ++i)
+    {
+        fprintf(dump, "\t \"prev: " PRINT_PTR "\\n", prev_);
+        fprintf(dump, " this: " PRINT_PTR "\\n depth: %lu\\n data: [", this, depth_);
+        TypePrint(dump, data_);
+        fprintf(dump, "]\\n left: " PRINT_PTR " | right: " PRINT_PTR "\\n", left_, right_);
+
+        fprintf(dump, "\" -> \"");
+
+        fprintf(dump, "prev: " PRINT_PTR "\\n", args_[i]->prev_);
+        fprintf(dump, " this: " PRINT_PTR "\\n depth: %lu\\n data: [", args_[i], args_[i]->depth_);
+        TypePrint(dump, args_[i]->data_);
+        fprintf(dump, "]\\n left: " PRINT_PTR " | right: " PRINT_PTR "\\n", args_[i]->left_, args_[i]->right_);
+        fprintf(dump, "\" [label=\"arg %zu\"]\n", i);
+    }
+
     if (left_  != nullptr) left_->Dump(dump);
     if (right_ != nullptr) right_->Dump(dump);
+
+    for (size_t i = 0; i < args_num_; ++i) args_[i]->Dump(dump);
 }
 
 //------------------------------------------------------------------------------
@@ -429,6 +517,17 @@ void Node<TYPE>::Write (FILE* base)
         for (int i = 0; i <= depth_; ++i) fprintf(base, "    ");
         fprintf(base, "]\n");
     }
+
+    for (size_t arg = 0; arg < args_num_; ++arg)
+    {
+        for (int i = 0; i <= depth_; ++i) fprintf(base, "    ");
+        fprintf(base, "[\n");
+
+        args_[arg]->Write(base);
+
+        for (int i = 0; i <= depth_; ++i) fprintf(base, "    ");
+        fprintf(base, "]\n");
+    }
 }
 
 //------------------------------------------------------------------------------
@@ -445,7 +544,7 @@ void Node<TYPE>::setData (TYPE data)
 //------------------------------------------------------------------------------
 
 template <typename TYPE>
-const TYPE& Node<TYPE>::getData ()
+const TYPE& Node<TYPE>::getData () const
 {
     return data_;
 }
@@ -457,13 +556,34 @@ void Node<TYPE>::recountDepth ()
 {
     assert(this != nullptr);
 
-    if (prev_ == nullptr)
-        depth_ = 0;
-    else
-        depth_ = prev_->depth_ + 1;
+    // Walk the subtree through prev_ pointers, so deep trees do not need
+    // recursion. Only positions in the n-ary nodes on the path are kept.
+
+    std::vector<size_t> positions;
+
+    Node* node_cur = this;
+    Node* from     = prev_;
+
+    while (true)
+    {
+        if (from == node_cur->prev_)
+            node_cur->depth_ = (node_cur->prev_ == nullptr) ? 0 : node_cur->prev_->depth_ + 1;
+
+        Node* next = node_cur->nextChild(from, positions);
+
+        if (next != nullptr)
+        {
+            from     = node_cur;
+            node_cur = next;
+        }
+        else
+        {
+            if (node_cur == this) break;
 
-    if (right_ != nullptr) right_->recountDepth();
-    if (left_  != nullptr) left_->recountDepth();
+            from     = node_cur;
+            node_cur = node_cur->prev_;
+        }
+    }
 }
 
 //------------------------------------------------------------------------------
@@ -473,16 +593,83 @@ void Node<TYPE>::recountPrev ()
 {
     assert(this != nullptr);
 
-    if (right_ != nullptr)
+    std::vector<size_t> positions;
+
+    Node* node_cur = this;
+    Node* from     = prev_;
+
+    while (true)
     {
-        right_->prev_ = this;
-        right_->recountPrev();
+        Node* next = node_cur->nextChild(from, positions);
+
+        if (next != nullptr)
+        {
+            next->prev_ = node_cur;
+
+            from     = node_cur;
+            node_cur = next;
+        }
+        else
+        {
+            if (node_cur == this) break;
+
+            from     = node_cur;
+            node_cur = node_cur->prev_;
+        }
     }
-    if (left_  != nullptr)
+}
+
+//------------------------------------------------------------------------------
+
+template <typename TYPE>
+void Node<TYPE>::addArg (Node* arg)
+{
+    assert(arg != nullptr);
+    assert((left_ == nullptr) && (right_ == nullptr));
+
+    // Capacity is the next power of two, at least 2
+    if ((args_num_ == 0) || ((args_num_ >= 2) && ((args_num_ & (args_num_ - 1)) == 0)))
     {
-        left_->prev_ = this;
-        left_->recountPrev();
+        Node** temp = new Node* [(args_num_ == 0) ? 2 : 2 * args_num_];
+        if (args_num_ != 0) memcpy(temp, args_, args_num_ * sizeof(Node*));
+
+        delete [] args_;
+        args_ = temp;
+    }
+
+    args_[args_num_++] = arg;
+
+    arg->prev_  = this;
+    arg->depth_ = depth_ + 1;
+}
+
+//------------------------------------------------------------------------------
+
+template <typename TYPE>
+Node<TYPE>* Node<TYPE>::nextChild (Node* from, std::vector<size_t>& positions)
+{
+    if (args_num_ != 0)
+    {
+        size_t pos = 0;
+        if (from != prev_)
+        {
+            pos = positions.back() + 1;
+            positions.pop_back();
+        }
+
+        if (pos == args_num_) return nullptr;
+
+        positions.push_back(pos);
+        return args_[pos];
     }
+
+    if (from == prev_)
+        return (right_ != nullptr) ? right_ : left_;
+
+    if ((from == right_) && (left_ != nullptr))
+        return left_;
+
+    return nullptr;
 }
 
 //------------------------------------------------------------------------------
@@ -518,8 +705,13 @@ bool Node<TYPE>::findPath (Stack<size_t>& path, TYPE elem)
         found = left_->findPath(path, elem);
         if (found) return found;
     }
+    for (size_t i = 0; i < args_num_; ++i)
+    {
+        found = args_[i]->findPath(path, elem);
+        if (found) return found;
+    }
 
-    if ((left_ == nullptr) && (right_ == nullptr))
+    if ((left_ == nullptr) && (right_ == nullptr) && (args_num_ == 0))
     {
         if constexpr (std::is_same<TYPE, char*>::value)
             found = (strcmp(elem, data_) == 0);
@@ -571,50 +763,73 @@ int Tree<TYPE>::Check ()
 template <typename TYPE>
 int Node<TYPE>::Check (Tree<TYPE>& tree)
 {
-    if (((prev_ == nullptr) && (depth_ != 0)) ||
-        ((prev_ != nullptr) && (depth_ != prev_->depth_ + 1)))
+    // Path from the node to the checked one is kept with the number of the
+    // next child of every node on it, so the depth of the tree is not
+    // limited by the stack of the thread. Children are right, left, args_
+    std::vector<std::pair<Node*, size_t>> path = { { this, 0 } };
+
+    int err = TREE_OK;
+
+    while (!path.empty())
     {
-        tree.path2badnode_.Push(data_);
-        return TREE_WRONG_DEPTH;
-    }
+        Node*   node  = path.back().first;
+        size_t& child = path.back().second;
 
-    if (prev_ != nullptr)
-        if ((prev_->right_ != this) &&
-            (prev_->left_  != this))
+        if (child == 0)
         {
-            tree.path2badnode_.Push(data_);
-            return TREE_WRONG_PREV_NODE;
+            if (((node->prev_ == nullptr) && (node->depth_ != 0)) ||
+                ((node->prev_ != nullptr) && (node->depth_ != node->prev_->depth_ + 1)))
+            {
+                err = TREE_WRONG_DEPTH;
+                break;
+            }
+
+            // Children of n-ary node are checked by the node itself
+            if ((node->prev_ != nullptr) && (node->prev_->args_num_ == 0))
+                if ((node->prev_->right_ != node) &&
+                    (node->prev_->left_  != node))
+                {
+                    err = TREE_WRONG_PREV_NODE;
+                    break;
+                }
+
+            if (((node->right_ != nullptr) && (node->right_->prev_ != node)) ||
+                ((node->left_  != nullptr) && (node->left_ ->prev_ != node)))
+            {
+                err = TREE_WRONG_PREV_NODE;
+                break;
+            }
         }
 
-    if (right_ != nullptr)
-        if (right_->prev_ != this)
+        Node* next = nullptr;
+
+        if      (child == 0)                 next = node->right_;
+        else if (child == 1)                 next = node->left_;
+        else if (child - 2 < node->args_num_)
         {
-            tree.path2badnode_.Push(data_);
-            return TREE_WRONG_PREV_NODE;
-        }
+            next = node->args_[child - 2];
 
-    if (left_ != nullptr)
-        if (left_->prev_ != this)
+            if (next->prev_ != node)
+            {
+                err = TREE_WRONG_PREV_NODE;
+                break;
+            }
+        }
+        else
         {
-            tree.path2badnode_.Push(data_);
-            return TREE_WRONG_PREV_NODE;
+            path.pop_back();
+            continue;
         }
 
-    int err = TREE_OK;
-
-    if (right_ != nullptr)
-        err = right_->Check(tree);
+        ++child;
 
-    if (err)
-    {
-        tree.path2badnode_.Push(data_);
-        return err;
+        if (next != nullptr) path.push_back({ next, 0 });
     }
 
-    if (left_ != nullptr)
-        err = left_->Check(tree);
-
-    if (err) tree.path2badnode_.Push(data_);
+    // Bad node is pushed first, then the nodes above it
+    if (err)
+        for (size_t i = path.size(); i > 0; --i)
+            tree.path2badnode_.Push(path[i - 1].first->data_);
 
     return err;
 }
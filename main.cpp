@@ -12,6 +12,35 @@
 
 //------------------------------------------------------------------------------
 
+char const * const USAGE = "usage: Differentiator                                 interactive mode\n"
+                           "       Differentiator file                            derivative of expression in file\n"
+                           "       Differentiator --batch input output [-j N] [-c MB] [-e dag]\n"
+                           "                                                      derivative of every line of input\n"
+                           "                                                      in N threads with MB of parse cache,\n"
+                           "                                                      dag shares equal subexpressions\n"
+                           "       Differentiator --check input output [-j N]     syntax errors of every line of input\n"
+                           "       Differentiator --compile input image           binary image of expression in file\n"
+                           "       Differentiator --image image output            derivative of expression in image\n"
+                           "       Differentiator --order N input output [-e tree]\n"
+                           "                                                      derivatives of orders 1 to N of expression\n"
+                           "                                                      in file, one per line\n"
+                           "       Differentiator --gradient input point output   value and gradient of expression in file\n"
+                           "                                                      at point of \"name = value\" lines\n"
+                           "       Differentiator --dual input point output [-v x]\n"
+                           "                                                      value and derivative by x of expression\n"
+                           "                                                      in file at point\n"
+                           "       Differentiator --taylor N input point output [-v x]\n"
+                           "                                                      derivatives of orders 0 to N by x of\n"
+                           "                                                      expression in file at point\n"
+                           "       Differentiator --partials input output -v x,y [-j N] [-e dag]\n"
+                           "       Differentiator --hessian  input output -v x,y [-j N] [-e dag]\n"
+                           "                                                      partial derivatives of expression in file\n"
+                           "       Differentiator --jacobian input output -v x,y [-j N] [-e dag]\n"
+                           "                                                      partial derivatives of every line of input,\n"
+                           "                                                      one row per line, \" | \" between columns\n";
+
+//------------------------------------------------------------------------------
+
 int main (int argc, char* argv[])
 {
     if (argc == 1)
@@ -21,6 +50,181 @@ int main (int argc, char* argv[])
         return diff.Run();
     }
     else
+    if ((strcmp(argv[1], "--batch") == 0) || (strcmp(argv[1], "-b") == 0) ||
+        (strcmp(argv[1], "--check") == 0))
+    {
+        bool check   = (strcmp(argv[1], "--check") == 0);
+        bool shared  = false;
+        int  threads = 0;
+
+        if ((argc < 4) || (argc % 2 != 0))
+        {
+            printf("%s", USAGE);
+            return DIFF_NOT_OK;
+        }
+
+        for (int i = 4; i < argc; i += 2)
+        {
+            if (strcmp(argv[i], "-j") == 0)
+                threads = atoi(argv[i + 1]);
+
+            else if (strcmp(argv[i], "-c") == 0)
+                parse_cache.setBudget((size_t)atoi(argv[i + 1]) << 20);
+
+            else if ((strcmp(argv[i], "-e") == 0) && ((strcmp(argv[i + 1], "dag") == 0) || (strcmp(argv[i + 1], "tree") == 0)))
+                shared = (strcmp(argv[i + 1], "dag") == 0);
+
+            else
+            {
+                printf("%s", USAGE);
+                return DIFF_NOT_OK;
+            }
+        }
+
+        Differentiator diff(argv[2], argv[3], threads, check, shared);
+
+        return diff.Run();
+    }
+    else
+    if ((strcmp(argv[1], "--compile") == 0) || (strcmp(argv[1], "--image") == 0))
+    {
+        if (argc != 4)
+        {
+            printf("%s", USAGE);
+            return DIFF_NOT_OK;
+        }
+
+        if (strcmp(argv[1], "--image") == 0)
+        {
+            Differentiator diff(argv[2], argv[3], 1);
+
+            return diff.RunImage();
+        }
+
+        int err = Text2Bin(argv[2], argv[3]);
+        if (err) CalcPrintError(calc_log, __FILE__, __LINE__, __FUNC_NAME__, err, 1);
+
+        return err;
+    }
+    else
+    if (strcmp(argv[1], "--order") == 0)
+    {
+        bool shared = true;
+        int  order  = (argc > 2) ? atoi(argv[2]) : 0;
+
+        if ((argc == 7) && (strcmp(argv[5], "-e") == 0) && ((strcmp(argv[6], "dag") == 0) || (strcmp(argv[6], "tree") == 0)))
+            shared = (strcmp(argv[6], "dag") == 0);
+
+        else if (argc != 5) order = 0;
+
+        if (order <= 0)
+        {
+            printf("%s", USAGE);
+            return DIFF_NOT_OK;
+        }
+
+        Differentiator diff(argv[3], argv[4], 1, false, shared);
+
+        return diff.RunOrder(order);
+    }
+    else
+    if ((strcmp(argv[1], "--partials") == 0) ||
+        (strcmp(argv[1], "--jacobian") == 0) || (strcmp(argv[1], "--hessian") == 0))
+    {
+        int   mode    = (strcmp(argv[1], "--jacobian") == 0) ? PARTIALS_JACOBIAN :
+                        (strcmp(argv[1], "--hessian")  == 0) ? PARTIALS_HESSIAN  : PARTIALS_GRADIENT;
+        char* vars    = nullptr;
+        bool  shared  = false;
+        int   threads = 0;
+
+        if ((argc < 6) || (argc % 2 != 0))
+        {
+            printf("%s", USAGE);
+            return DIFF_NOT_OK;
+        }
+
+        for (int i = 4; i < argc; i += 2)
+        {
+            if (strcmp(argv[i], "-v") == 0)
+                vars = argv[i + 1];
+
+            else if (strcmp(argv[i], "-j") == 0)
+                threads = atoi(argv[i + 1]);
+
+            else if ((strcmp(argv[i], "-e") == 0) && ((strcmp(argv[i + 1], "dag") == 0) || (strcmp(argv[i + 1], "tree") == 0)))
+                shared = (strcmp(argv[i + 1], "dag") == 0);
+
+            else
+            {
+                printf("%s", USAGE);
+                return DIFF_NOT_OK;
+            }
+        }
+
+        bool valid = (vars != nullptr);
+
+        // Every name is an identifier as the lexer reads it, else no
+        // expression can have the variable
+        for (const char* name = vars; valid; ++name)
+        {
+            size_t len = strcspn(name, ",");
+            valid = isIdentifier(name, len);
+
+            name += len;
+            if (*name == '\0') break;
+        }
+
+        if (not valid)
+        {
+            printf("%s", USAGE);
+            return DIFF_NOT_OK;
+        }
+
+        Differentiator diff(argv[2], argv[3], threads, false, shared);
+
+        return diff.RunPartials(mode, vars);
+    }
+    else
+    if (strcmp(argv[1], "--taylor") == 0)
+    {
+        bool named = (argc == 8) && (strcmp(argv[6], "-v") == 0) && isIdentifier(argv[7], strlen(argv[7]));
+        int  order = ((argc == 6) || named) ? atoi(argv[2]) : 0;
+
+        if (order <= 0)
+        {
+            printf("%s", USAGE);
+            return DIFF_NOT_OK;
+        }
+
+        Differentiator diff(argv[3], argv[5], 1);
+
+        if (named) diff.setVariable(argv[7]);
+
+        return diff.RunTaylor(argv[4], (size_t)order);
+    }
+    else
+    if ((strcmp(argv[1], "--gradient") == 0) || (strcmp(argv[1], "--dual") == 0))
+    {
+        bool dual = (strcmp(argv[1], "--dual") == 0);
+
+        // Derivative of --dual may be by another variable than x
+        bool named = dual && (argc == 7) && (strcmp(argv[5], "-v") == 0) && isIdentifier(argv[6], strlen(argv[6]));
+
+        if ((argc != 5) && (not named))
+        {
+            printf("%s", USAGE);
+            return DIFF_NOT_OK;
+        }
+
+        Differentiator diff(argv[2], argv[4], 1);
+
+        if (not dual) return diff.RunGradient(argv[3]);
+
+        if (named) diff.setVariable(argv[6]);
+
+        return diff.RunDual(argv[3]);
+    }
+    else
     {
         Differentiator diff(argv[1]);
 